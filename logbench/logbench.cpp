@@ -0,0 +1,170 @@
+/*
+    日志队列争用测试: 多个生产者线程同时入队, 一个消费者线程出队(模拟写日志文件)
+
+    ./logbench [-q ring|block] [-o drop|block|overwrite] [-c 生产者数] [-t 秒数] [-n 容量] [-s 慢速消费(us)]
+        -q ring  : RingQueue(有界无锁环形队列), -o 选择队列满时的策略
+        -q block : 原来的 BlockQueue(deque + 互斥锁 + 条件变量), 队列满时阻塞
+        -s       : 消费者每取 1024 条休眠的微秒数, 模拟慢磁盘(0 表示不休眠)
+    统计每秒入队次数、丢弃/覆盖条数, 以及生产者单次入队耗时的分位数(每 64 次采样一次)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "../src/log/ringqueue.hpp"
+#include "../src/log/blockqueue.hpp"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    std::string queue = "ring";
+    std::string policy = "drop";
+    int producers = 32;
+    int seconds = 5;
+    size_t capacity = 1024;
+    int slowUs = 0;
+};
+
+Options opt;
+std::atomic<bool> stop(false);
+std::atomic<uint64_t> pushes(0);
+std::atomic<uint64_t> popped(0);
+
+// 一条日志大小的消息(和 Log::write 格式化后的行长度相近)
+const std::string LINE(120, 'x');
+
+// 每个生产者各自记录入队耗时的样本, 结束后合并
+std::vector<std::vector<uint32_t>> samples;
+
+template<class Queue>
+void Producer(Queue* queue, int id) {
+    std::vector<uint32_t>& mine = samples[id];
+    uint64_t n = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        if ((n & 63) == 0) {
+            Clock::time_point begin = Clock::now();
+            queue->push_back(LINE);
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+            mine.push_back(static_cast<uint32_t>(std::min<uint64_t>(ns, UINT32_MAX)));
+        }
+        else {
+            queue->push_back(LINE);
+        }
+        ++n;
+    }
+    pushes.fetch_add(n, std::memory_order_relaxed);
+}
+
+template<class Queue>
+void Consumer(Queue* queue) {
+    std::string line;
+    uint64_t n = 0;
+    while (queue->pop(line)) {
+        if (opt.slowUs > 0 && (++n & 1023) == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(opt.slowUs));
+        }
+        popped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template<class Queue>
+double Run(Queue* queue) {
+    samples.assign(opt.producers, std::vector<uint32_t>());
+    std::thread consumer(Consumer<Queue>, queue);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < opt.producers; ++i) {
+        threads.emplace_back(Producer<Queue>, queue, i);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    stop = true;
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    double sec = std::chrono::duration<double>(Clock::now() - start).count();
+    queue->Close();
+    consumer.join();
+    return sec;
+}
+
+double Percentile(std::vector<uint32_t>& all, double p) {
+    if (all.empty()) {
+        return 0;
+    }
+    size_t idx = std::min(all.size() - 1, static_cast<size_t>(all.size() * p));
+    std::nth_element(all.begin(), all.begin() + idx, all.end());
+    return all[idx] / 1000.0;
+}
+
+void Usage(const char* name) {
+    fprintf(stderr, "usage: %s [-q ring|block] [-o drop|block|overwrite] [-c producers] [-t seconds] "
+                    "[-n capacity] [-s slowUs]\n", name);
+    exit(1);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int ch;
+    while ((ch = getopt(argc, argv, "q:o:c:t:n:s:")) != -1) {
+        switch (ch) {
+            case 'q': opt.queue = optarg; break;
+            case 'o': opt.policy = optarg; break;
+            case 'c': opt.producers = atoi(optarg); break;
+            case 't': opt.seconds = atoi(optarg); break;
+            case 'n': opt.capacity = atoi(optarg); break;
+            case 's': opt.slowUs = atoi(optarg); break;
+            default: Usage(argv[0]);
+        }
+    }
+    OverflowPolicy policy = OverflowPolicy::DROP;
+    if (opt.policy == "block") {
+        policy = OverflowPolicy::BLOCK;
+    }
+    else if (opt.policy == "overwrite") {
+        policy = OverflowPolicy::OVERWRITE;
+    }
+    else if (opt.policy != "drop") {
+        Usage(argv[0]);
+    }
+    if ((opt.queue != "ring" && opt.queue != "block") || opt.producers <= 0 || opt.seconds <= 0 || opt.capacity == 0) {
+        Usage(argv[0]);
+    }
+
+    double sec = 0;
+    uint64_t dropped = 0;
+    uint64_t overwritten = 0;
+    std::string name;
+    if (opt.queue == "ring") {
+        RingQueue<std::string> queue(opt.capacity, policy);
+        sec = Run(&queue);
+        dropped = queue.DroppedCount();
+        overwritten = queue.OverwrittenCount();
+        name = "RingQueue(" + opt.policy + ")";
+    }
+    else {
+        BlockQueue<std::string> queue(opt.capacity);
+        sec = Run(&queue);
+        name = "BlockQueue";
+    }
+
+    std::vector<uint32_t> all;
+    for (std::vector<uint32_t>& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    printf("%s: %d producers, %.1fs, %.2f M push/s, %.2f M pop/s, dropped %lu, overwritten %lu\n",
+           name.c_str(), opt.producers, sec, pushes.load() / sec / 1e6, popped.load() / sec / 1e6,
+           dropped, overwritten);
+    printf("  push latency(us): p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+           Percentile(all, 0.5), Percentile(all, 0.99), Percentile(all, 0.999), Percentile(all, 1.0));
+    return 0;
+}
@@ -0,0 +1,377 @@
+/*
+    表单解析的随机测试: 和逐字节的参考实现比较结果
+
+    ./parsertest [-n 轮数] [-s 随机种子]
+        FormDecoder::Decode          : 百分号解码(含原地解码), 输入偏移到不同的对齐位置
+        FormDecoder::Find            : 子串查找, 和 std::string_view::find 比较
+        FormDecoder::ParseUrlencoded : 表单字段, 和逐个切分再解码的结果比较
+        MultipartParser              : 随机生成的 multipart 请求体按随机位置切成任意多段喂入,
+                                       和生成时的各个部分比较; 截断的请求体不能报告完成
+    每个输入都放在大小正好的堆内存中, 用 make 编译时带 ASan/UBSan, SIMD 读越界会直接报错.
+    出错时打印种子和出错的输入, 用 -s 复现.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include "../src/http/formdecoder.h"
+#include "../src/http/multipart.h"
+
+namespace {
+
+std::mt19937_64 rng;
+
+size_t Rand(size_t n) {
+    return n ? rng() % n : 0;
+}
+
+// 从字母表中随机取 len 个字符(字母表里 '%' '+' 等特殊字符占比高, 容易触发边界情况)
+std::string RandomString(size_t len, const char* alphabet) {
+    size_t n = strlen(alphabet);
+    std::string s(len, '\0');
+    for (char& ch : s) {
+        ch = alphabet[Rand(n)];
+    }
+    return s;
+}
+
+// 把数据复制到大小正好的堆内存中(越界读会被 ASan 发现)
+std::unique_ptr<char[]> Exact(const std::string& s) {
+    std::unique_ptr<char[]> p(new char[s.size() ? s.size() : 1]);
+    memcpy(p.get(), s.data(), s.size());
+    return p;
+}
+
+void Dump(const char* what, const std::string& s) {
+    fprintf(stderr, "%s (%zu bytes): \"", what, s.size());
+    for (unsigned char ch : s) {
+        if (ch >= 0x20 && ch < 0x7f && ch != '"' && ch != '\\') {
+            fputc(ch, stderr);
+        }
+        else {
+            fprintf(stderr, "\\x%02x", ch);
+        }
+    }
+    fprintf(stderr, "\"\n");
+}
+
+int HexValue(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+// 参考实现: 逐字节解码
+std::string RefDecode(std::string_view s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '+') {
+            out += ' ';
+        }
+        else if (s[i] == '%' && i + 2 < s.size() && HexValue(s[i + 1]) >= 0 && HexValue(s[i + 2]) >= 0) {
+            out += static_cast<char>(HexValue(s[i + 1]) * 16 + HexValue(s[i + 2]));
+            i += 2;
+        }
+        else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+const char* FORM_ALPHABET = "%%%++abcF09zZ=&\xff\x80 ";
+const char* FIND_ALPHABET = "ab-\r\n";
+
+bool TestDecode() {
+    std::string src = RandomString(Rand(80), FORM_ALPHABET);
+    std::string expect = RefDecode(src);
+    // 放在不同的偏移上, 覆盖 16 字节块的各种对齐
+    size_t offset = Rand(16);
+    std::string padded = std::string(offset, 'x') + src;
+    std::unique_ptr<char[]> in = Exact(padded);
+    std::unique_ptr<char[]> out(new char[src.size() ? src.size() : 1]);
+    size_t len = FormDecoder::Decode(in.get() + offset, src.size(), out.get());
+    if (std::string(out.get(), len) != expect) {
+        Dump("Decode input", src);
+        Dump("expected", expect);
+        Dump("got", std::string(out.get(), len));
+        return false;
+    }
+    // 原地解码
+    len = FormDecoder::Decode(in.get() + offset, src.size(), in.get() + offset);
+    if (std::string(in.get() + offset, len) != expect) {
+        Dump("Decode in place input", src);
+        return false;
+    }
+    return true;
+}
+
+bool TestFind() {
+    std::string hay = RandomString(Rand(120), FIND_ALPHABET);
+    std::string needle;
+    if (!hay.empty() && Rand(2)) {
+        // 一半的情况下子串取自 haystack, 保证能找到
+        size_t pos = Rand(hay.size());
+        needle = hay.substr(pos, 1 + Rand(std::min<size_t>(40, hay.size() - pos)));
+    }
+    else {
+        needle = RandomString(Rand(40), FIND_ALPHABET);
+    }
+    size_t expect = std::string_view(hay).find(needle);
+    std::unique_ptr<char[]> h = Exact(hay);
+    std::unique_ptr<char[]> n = Exact(needle);
+    const char* found = FormDecoder::Find(h.get(), hay.size(), n.get(), needle.size());
+    size_t got = found ? static_cast<size_t>(found - h.get()) : std::string_view::npos;
+    if (got != expect) {
+        Dump("Find haystack", hay);
+        Dump("needle", needle);
+        fprintf(stderr, "expected %zd, got %zd\n", static_cast<ssize_t>(expect), static_cast<ssize_t>(got));
+        return false;
+    }
+    return true;
+}
+
+bool TestUrlencoded() {
+    std::string body = RandomString(Rand(100), FORM_ALPHABET);
+    // 参考实现: 按 '&' 切分, 第一个 '=' 分开键值, 跳过空键
+    std::vector<std::pair<std::string, std::string>> expect;
+    size_t start = 0;
+    while (start <= body.size() && !body.empty()) {
+        size_t amp = body.find('&', start);
+        if (amp == std::string::npos) {
+            amp = body.size();
+        }
+        std::string item = body.substr(start, amp - start);
+        size_t eq = item.find('=');
+        std::string key = item.substr(0, eq);
+        if (!key.empty()) {
+            expect.emplace_back(RefDecode(key), eq == std::string::npos ? "" : RefDecode(item.substr(eq + 1)));
+        }
+        start = amp + 1;
+    }
+    std::unique_ptr<char[]> in = Exact(body);
+    std::string buf;
+    std::vector<FormDecoder::Field> fields;
+    FormDecoder::ParseUrlencoded(std::string_view(in.get(), body.size()), &buf, &fields);
+    bool ok = fields.size() == expect.size();
+    for (size_t i = 0; ok && i < fields.size(); ++i) {
+        ok = fields[i].first == expect[i].first && fields[i].second == expect[i].second;
+    }
+    if (!ok) {
+        Dump("ParseUrlencoded body", body);
+        fprintf(stderr, "expected %zu fields, got %zu\n", expect.size(), fields.size());
+        return false;
+    }
+    return true;
+}
+
+struct PartRecord {
+    std::string name;
+    std::string filename;
+    std::string contentType;
+    bool isFile = false;
+    std::string data;
+    bool ended = false;
+
+    bool operator==(const PartRecord& other) const {
+        return name == other.name && filename == other.filename && contentType == other.contentType &&
+               isFile == other.isFile && data == other.data && ended == other.ended;
+    }
+};
+
+// 把解析结果原样记录下来
+class Recorder : public MultipartParser::Handler {
+public:
+    std::vector<PartRecord> parts;
+
+private:
+    bool OnPartBegin(const MultipartParser::Part& part) override {
+        PartRecord rec;
+        rec.name.assign(part.name.data(), part.name.size());
+        rec.filename.assign(part.filename.data(), part.filename.size());
+        rec.contentType.assign(part.contentType.data(), part.contentType.size());
+        rec.isFile = part.isFile;
+        parts.push_back(rec);
+        return true;
+    }
+
+    bool OnPartData(const char* data, size_t len) override {
+        if (parts.empty() || parts.back().ended || len == 0) {
+            return false;
+        }
+        parts.back().data.append(data, len);
+        return true;
+    }
+
+    bool OnPartEnd() override {
+        if (parts.empty() || parts.back().ended) {
+            return false;
+        }
+        parts.back().ended = true;
+        return true;
+    }
+};
+
+// 在 text + delim 中, 第一次出现 delim 的位置必须正好是 text 的结尾
+bool EndsCleanly(const std::string& text, const std::string& delim) {
+    return (text + delim).find(delim) == text.size();
+}
+
+// 生成随机的 multipart 请求体和期望的解析结果
+// @param closeAt 结束分隔符末尾 "--" 的位置(截断到这里的请求体不完整)
+void MakeMultipart(std::string* contentType, std::string* body, std::vector<PartRecord>* expect, size_t* closeAt) {
+    std::string boundary = RandomString(1 + Rand(30), "ab-'()+_,./:=?");
+    std::string delim = "\r\n--" + boundary;
+    *contentType = "multipart/form-data; boundary=" + (Rand(2) ? boundary : "\"" + boundary + "\"");
+    body->clear();
+    expect->clear();
+
+    // 内容的字母表包含分隔符的组成字符, 容易出现分隔符的前缀
+    std::string alphabet = "\r\n-x" + boundary.substr(0, 3);
+    std::string preamble;
+    if (Rand(3) == 0) {
+        do {
+            preamble = RandomString(Rand(40), alphabet.c_str());
+        } while (!EndsCleanly("\r\n" + preamble, delim));
+        *body += preamble + "\r\n";
+    }
+    *body += "--" + boundary;
+
+    size_t partNum = Rand(5);
+    for (size_t i = 0; i < partNum; ++i) {
+        *body += Rand(4) ? "\r\n" : " \t\r\n";   // 分隔符后允许空白
+        PartRecord rec;
+        rec.ended = true;
+        if (Rand(8) != 0) {
+            rec.name = RandomString(1 + Rand(8), "abcxyz_0");
+            *body += Rand(2) ? "Content-Disposition: form-data; name=\"" + rec.name + "\""
+                             : "content-disposition:form-data;name=" + rec.name;
+            if (Rand(2)) {
+                rec.isFile = true;
+                rec.filename = RandomString(Rand(12), "abc.-_1");
+                *body += "; filename=\"" + rec.filename + "\"";
+            }
+            *body += "\r\n";
+            if (Rand(2)) {
+                rec.contentType = "application/octet-stream";
+                *body += "Content-Type: " + rec.contentType + "\r\n";
+            }
+        }
+        *body += "\r\n";
+        do {
+            rec.data = RandomString(Rand(3) ? Rand(64) : Rand(4096), alphabet.c_str());
+        } while (!EndsCleanly(rec.data, delim));
+        *body += rec.data + delim;
+        expect->push_back(rec);
+    }
+    *closeAt = body->size();
+    *body += "--";
+    if (Rand(3) == 0) {
+        // 结束分隔符之后的内容忽略
+        *body += "\r\nepilogue" + delim + "--";
+    }
+}
+
+bool TestMultipart() {
+    std::string contentType;
+    std::string body;
+    std::vector<PartRecord> expect;
+    size_t closeAt = 0;
+    MakeMultipart(&contentType, &body, &expect, &closeAt);
+
+    // 随机切成若干段, 每段放在大小正好的堆内存中
+    std::vector<size_t> cuts;
+    size_t pieces = Rand(4) == 0 ? body.size() : Rand(8);   // 有时每个字节一段
+    for (size_t i = 0; i < pieces; ++i) {
+        cuts.push_back(Rand(body.size() + 1));
+    }
+    cuts.push_back(0);
+    cuts.push_back(body.size());
+    std::sort(cuts.begin(), cuts.end());
+
+    // 截断: 去掉结束分隔符末尾的 "--" 之后不能报告完成
+    bool truncate = Rand(8) == 0;
+    size_t total = truncate ? closeAt : body.size();
+
+    Recorder recorder;
+    MultipartParser parser(&recorder);
+    if (!parser.Reset(contentType)) {
+        Dump("Reset content type", contentType);
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i + 1 < cuts.size(); ++i) {
+        size_t from = std::min(cuts[i], total);
+        size_t to = std::min(cuts[i + 1], total);
+        std::unique_ptr<char[]> piece = Exact(body.substr(from, to - from));
+        ok = parser.Feed(piece.get(), to - from);
+    }
+    bool pass = ok && parser.Done() == !truncate;
+    if (pass && !truncate) {
+        pass = recorder.parts.size() == expect.size();
+        for (size_t i = 0; pass && i < expect.size(); ++i) {
+            pass = recorder.parts[i] == expect[i];
+        }
+    }
+    if (!pass) {
+        Dump("Content-Type", contentType);
+        Dump("body", body);
+        fprintf(stderr, "feed %s, done %d, truncated %d, expected %zu parts, got %zu\n",
+                ok ? "ok" : "failed", parser.Done(), truncate, expect.size(), recorder.parts.size());
+        return false;
+    }
+    return true;
+}
+
+void Usage(const char* name) {
+    fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", name);
+    exit(1);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = 20000;
+    unsigned long long seed = std::random_device()();
+    int ch;
+    while ((ch = getopt(argc, argv, "n:s:")) != -1) {
+        switch (ch) {
+            case 'n': iterations = atol(optarg); break;
+            case 's': seed = strtoull(optarg, nullptr, 10); break;
+            default: Usage(argv[0]);
+        }
+    }
+    if (iterations <= 0) {
+        Usage(argv[0]);
+    }
+    rng.seed(seed);
+
+    struct {
+        const char* name;
+        bool (*fn)();
+    } tests[] = {
+        { "Decode", TestDecode },
+        { "Find", TestFind },
+        { "ParseUrlencoded", TestUrlencoded },
+        { "Multipart", TestMultipart },
+    };
+    for (auto& test : tests) {
+        for (long i = 0; i < iterations; ++i) {
+            if (!test.fn()) {
+                fprintf(stderr, "%s failed at iteration %ld, seed %llu\n", test.name, i, seed);
+                return 1;
+            }
+        }
+        printf("%-16s %ld cases ok\n", test.name, iterations);
+    }
+    printf("seed %llu\n", seed);
+    return 0;
+}
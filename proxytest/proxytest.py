@@ -0,0 +1,226 @@
+"""
+    反向代理测试: 启动两个上游(upstream.py), 通过服务器的 /api/proxy/ 发请求, 检查转发结果
+
+    服务器先以这两个上游启动(本机压测时所有连接来自 127.0.0.1, 不要开启限流):
+        ./server --store=memory --upstream=127.0.0.1:9001 --upstream=127.0.0.1:9002
+    python3 proxytest.py [-H 服务器地址] [-P 服务器端口] [-p 第一个上游端口]
+
+    检查: Content-Length / chunked / 读到关闭为止的响应体, HEAD, 流水线, 100-continue,
+    部分发出后上游断开的 POST 不重发(只到达一个上游一次), 上游连接的复用和按最少在途请求的分配
+    本机的 socket 缓冲区很大时 1MB 的请求体会一次发完, 要让"部分发出"真正出现, 先调小发送缓冲区的上限:
+        sysctl -w net.ipv4.tcp_wmem="4096 16384 65536"
+"""
+
+import os, sys, json, time, socket, getopt, threading, subprocess, collections
+
+SERVER = ('127.0.0.1', 8888)
+FIRST_UPSTREAM = 9001
+
+
+def Conn():
+    s = socket.create_connection(SERVER)
+    s.settimeout(10)
+    return s
+
+
+class Reader:
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = b''
+
+    def Fill(self):
+        data = self.sock.recv(1 << 20)
+        if not data:
+            raise EOFError
+        self.buf += data
+
+    def Head(self):
+        while b'\r\n\r\n' not in self.buf:
+            self.Fill()
+        head, self.buf = self.buf.split(b'\r\n\r\n', 1)
+        lines = head.decode().split('\r\n')
+        headers = {}
+        for line in lines[1:]:
+            k, v = line.split(':', 1)
+            headers[k.strip().lower()] = v.strip()
+        return int(lines[0].split()[1]), headers
+
+    def Take(self, n):
+        while len(self.buf) < n:
+            self.Fill()
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def Line(self):
+        while b'\r\n' not in self.buf:
+            self.Fill()
+        line, self.buf = self.buf.split(b'\r\n', 1)
+        return line
+
+    def Response(self, head=False):
+        status, headers = self.Head()
+        if head:
+            return status, headers, b''
+        if headers.get('transfer-encoding') == 'chunked':
+            body = b''
+            while True:
+                size = int(self.Line().split(b';')[0], 16)
+                if size == 0:
+                    while self.Line() != b'':
+                        pass
+                    return status, headers, body
+                body += self.Take(size)
+                self.Take(2)
+        if 'content-length' in headers:
+            return status, headers, self.Take(int(headers['content-length']))
+        try:
+            while True:
+                self.Fill()
+        except EOFError:
+            pass
+        body, self.buf = self.buf, b''
+        return status, headers, body
+
+
+def Request(method, path, body=b'', extra=''):
+    if body or method in ('POST', 'PUT'):
+        return ('%s %s HTTP/1.1\r\nHost: t\r\nConnection: keep-alive\r\n%sContent-Length: %d\r\n\r\n'
+                % (method, path, extra, len(body))).encode() + body
+    return ('%s %s HTTP/1.1\r\nHost: t\r\nConnection: keep-alive\r\n%s\r\n' % (method, path, extra)).encode()
+
+
+def Expect(size):
+    if size < 1000000:
+        return bytes((i * 7) & 0xff for i in range(size))
+    return (b'abcdefghij' * (size // 10 + 1))[:size]
+
+
+def UpstreamHits(path):
+    # 直接问上游, 不经过代理
+    total = 0
+    for port in (FIRST_UPSTREAM, FIRST_UPSTREAM + 1):
+        s = socket.create_connection(('127.0.0.1', port))
+        s.sendall(('GET /hits?path=%s HTTP/1.1\r\nHost: t\r\n\r\n' % path).encode())
+        total += json.loads(Reader(s).Response()[2])['hits']
+        s.close()
+    return total
+
+
+def TestFunctional():
+    s = Conn()
+    r = Reader(s)
+    for size in (0, 1, 1000, 65536, 300000, 5000000):
+        s.sendall(Request('GET', '/api/proxy/len?size=%d' % size))
+        status, headers, body = r.Response()
+        assert status == 200 and body == Expect(size), (size, status, len(body))
+    s.sendall(Request('HEAD', '/api/proxy/len?size=5000'))
+    status, headers, body = r.Response(head=True)
+    assert status == 200 and headers['content-length'] == '5000', headers
+    for k in (1, 5, 40):
+        s.sendall(Request('GET', '/api/proxy/chunked?n=%d' % k))
+        status, headers, body = r.Response()
+        assert body == b''.join(('chunk-%d;' % i).encode() * (i + 1) for i in range(k)), k
+    # 流水线
+    s.sendall(Request('GET', '/api/proxy/len?size=100') + Request('POST', '/api/proxy/echo', b'x' * 5000) +
+              Request('GET', '/api/proxy/chunked?n=3'))
+    a, b, c = r.Response(), r.Response(), r.Response()
+    assert a[2] == Expect(100) and json.loads(b[2])['body'] == 'x' * 5000 and c[0] == 200
+    # 100-continue: 服务器确认后才发送请求体, Expect 不转发给上游
+    s.sendall(Request('PUT', '/api/proxy/echo', b'', 'Expect: 100-continue\r\n').replace(b'Content-Length: 0', b'Content-Length: 4'))
+    status, headers = r.Head()
+    assert status == 100, status
+    s.sendall(b'abcd')
+    status, headers, body = r.Response()
+    echo = json.loads(body)
+    assert echo['body'] == 'abcd' and 'Expect' not in echo['headers'], echo
+    # 读到关闭为止的响应体
+    s.sendall(Request('GET', '/api/proxy/close'))
+    status, headers, body = r.Response()
+    assert body == b'until-close-body' * 1000 and headers['connection'] == 'close', headers
+    print('functional ok')
+
+
+def TestNoResend():
+    # 上游读完首部就断开: 请求体只发出了一部分, POST 不能换一个上游重发
+    before = UpstreamHits('/drop')
+    s = Conn()
+    r = Reader(s)
+    s.sendall(Request('POST', '/api/proxy/drop', b'p' * 1000000))
+    status, headers, body = r.Response()
+    hits = UpstreamHits('/drop') - before
+    assert status == 502 and hits == 1, (status, hits)
+    print('partial POST not resent ok')
+
+
+def TestReuse():
+    peers = collections.Counter()
+    s = Conn()
+    r = Reader(s)
+    for i in range(400):
+        s.sendall(Request('GET', '/api/proxy/echo'))
+        status, headers, body = r.Response()
+        echo = json.loads(body)
+        peers[(echo['up'], echo['peer'])] += 1
+    # 空闲池按工作线程划分, 取出和放回可能在不同的线程: 开始时会多建一些连接, 之后应当大多复用
+    assert len(peers) < 200, len(peers)
+    print('400 requests over', len(peers), 'upstream connections',
+          dict(collections.Counter(up for up, peer in peers.elements())))
+
+
+def TestBalance():
+    result = collections.Counter()
+    lock = threading.Lock()
+
+    def Worker():
+        c = Conn()
+        rr = Reader(c)
+        for i in range(10):
+            c.sendall(Request('GET', '/api/proxy/slow?ms=50'))
+            status, headers, body = rr.Response()
+            with lock:
+                result[body.decode()] += 1
+
+    threads = [threading.Thread(target=Worker) for _ in range(8)]
+    begin = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert sum(result.values()) == 80 and len(result) == 2, result
+    print('slow balance', dict(result), '%.2fs' % (time.time() - begin))
+
+
+def Usage():
+    sys.stderr.write('usage: %s [-H host] [-P port] [-p firstUpstreamPort]\n' % sys.argv[0])
+    sys.exit(1)
+
+
+if __name__ == '__main__':
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], 'H:P:p:')
+    except getopt.GetoptError:
+        Usage()
+    for k, v in opts:
+        if k == '-H':
+            SERVER = (v, SERVER[1])
+        elif k == '-P':
+            SERVER = (SERVER[0], int(v))
+        elif k == '-p':
+            FIRST_UPSTREAM = int(v)
+    here = os.path.dirname(os.path.abspath(__file__))
+    upstreams = [subprocess.Popen([sys.executable, os.path.join(here, 'upstream.py'), str(FIRST_UPSTREAM + i), 'u%d' % (i + 1)])
+                 for i in range(2)]
+    try:
+        for i in range(50):
+            try:
+                UpstreamHits('/')
+                break
+            except OSError:
+                time.sleep(0.1)
+        TestFunctional()
+        TestNoResend()
+        TestReuse()
+        TestBalance()
+    finally:
+        for p in upstreams:
+            p.kill()
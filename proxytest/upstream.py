@@ -0,0 +1,102 @@
+"""
+    反向代理测试用的上游服务器(HTTP/1.1 keep-alive, 每个连接一个线程)
+
+    python3 upstream.py <端口> [名字]
+        GET  /len?size=N      N 字节的响应体(Content-Length)
+        GET  /chunked?n=K     K 块的 chunked 响应体, 带尾部首部
+        GET  /close           没有长度, 以关闭连接结束的响应体
+        GET  /slow?ms=T       等 T 毫秒后响应(响应体是上游的名字)
+        *    /drop            读完首部后不读请求体, 稍等后以 RST 断开连接
+        GET  /hits?path=P     这个上游收到 P 的次数(JSON)
+        其他                  以 JSON 回显方法、路径、对端端口、首部和请求体
+"""
+
+import sys, time, json, socket, threading, collections
+from http.server import ThreadingHTTPServer, BaseHTTPRequestHandler
+from urllib.parse import urlparse, parse_qs
+
+NAME = sys.argv[2] if len(sys.argv) > 2 else 'u'
+hits = collections.Counter()
+hitsLock = threading.Lock()
+
+
+def Body(size):
+    if size < 1000000:
+        return bytes((i * 7) & 0xff for i in range(size))
+    return (b'abcdefghij' * (size // 10 + 1))[:size]
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, *args):
+        pass
+
+    def Reply(self, code, body, headers=()):
+        self.send_response(code)
+        for k, v in headers:
+            self.send_header(k, v)
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        if self.command != 'HEAD':
+            self.wfile.write(body)
+
+    def HandleAny(self):
+        url = urlparse(self.path)
+        query = parse_qs(url.query)
+        with hitsLock:
+            hits[url.path] += 1
+        if url.path == '/drop':
+            # 等代理把发送缓冲区写满, 再用 RST 断开
+            time.sleep(0.2)
+            self.close_connection = True
+            self.connection.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, b'\x01\x00\x00\x00\x00\x00\x00\x00')
+            return
+        n = int(self.headers.get('Content-Length') or 0)
+        body = self.rfile.read(n) if n else b''
+        if url.path == '/len':
+            size = int(query.get('size', ['10'])[0])
+            self.Reply(200, Body(size), [('X-Upstream', NAME)])
+        elif url.path == '/chunked':
+            k = int(query.get('n', ['5'])[0])
+            self.send_response(200)
+            self.send_header('Transfer-Encoding', 'chunked')
+            self.send_header('X-Upstream', NAME)
+            self.end_headers()
+            for i in range(k):
+                part = ('chunk-%d;' % i).encode() * (i + 1)
+                self.wfile.write(b'%x\r\n' % len(part) + part + b'\r\n')
+                self.wfile.flush()
+            self.wfile.write(b'0\r\nX-Trailer: yes\r\n\r\n')
+        elif url.path == '/close':
+            self.send_response(200)
+            self.send_header('Connection', 'close')
+            self.end_headers()
+            self.wfile.write(b'until-close-body' * 1000)
+            self.close_connection = True
+        elif url.path == '/slow':
+            time.sleep(int(query.get('ms', ['100'])[0]) / 1000)
+            self.Reply(200, NAME.encode())
+        elif url.path == '/hits':
+            with hitsLock:
+                count = hits[query.get('path', [''])[0]]
+            self.Reply(200, json.dumps({'up': NAME, 'hits': count}).encode(), [('Content-Type', 'application/json')])
+        else:
+            out = json.dumps({'up': NAME, 'method': self.command, 'path': self.path, 'peer': self.client_address[1],
+                              'headers': dict(self.headers), 'body': body.decode('latin1')}).encode()
+            self.Reply(201, out, [('Content-Type', 'application/json')])
+
+    do_GET = do_POST = do_PUT = do_DELETE = do_HEAD = do_PATCH = do_OPTIONS = HandleAny
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def server_bind(self):
+        # 接收缓冲区小一些: 大的请求体不会一次全部进入上游的内核缓冲区
+        self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 16384)
+        ThreadingHTTPServer.server_bind(self)
+
+
+if __name__ == '__main__':
+    Server(('127.0.0.1', int(sys.argv[1])), Handler).serve_forever()
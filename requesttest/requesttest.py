@@ -0,0 +1,132 @@
+"""
+    HTTP/1 请求首部的解析测试: 请求体长度的各种写法, 检查服务器不会把请求体当成下一个请求(请求走私)
+
+    服务器先启动:
+        ./server --store=memory
+    python3 requesttest.py [-H 服务器地址] [-P 服务器端口]
+
+    检查: 首部名不区分大小写(content-length / transfer-encoding / CoNtEnT-LeNgTh),
+    冒号前有空白、多个不同的 Content-Length、同时有 Transfer-Encoding 和 Content-Length、重复的 Host 都返回 400 并关闭连接,
+    多个相同的 Content-Length 照常接受
+"""
+
+import sys, socket, getopt
+
+SERVER = ('127.0.0.1', 8888)
+
+# 请求体里藏着的"下一个请求": 服务器把它当成请求处理时会返回 404
+SMUGGLED = b'GET /smuggled HTTP/1.1\r\nHost: x\r\n\r\n'
+FOLLOW = b'GET /index.html HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n'
+
+
+class Reader:
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = b''
+
+    def Fill(self):
+        data = self.sock.recv(1 << 20)
+        if not data:
+            raise EOFError
+        self.buf += data
+
+    def Response(self):
+        while b'\r\n\r\n' not in self.buf:
+            self.Fill()
+        head, self.buf = self.buf.split(b'\r\n\r\n', 1)
+        lines = head.decode().split('\r\n')
+        headers = {}
+        for line in lines[1:]:
+            k, v = line.split(':', 1)
+            headers[k.strip().lower()] = v.strip()
+        n = int(headers.get('content-length', '0'))
+        while len(self.buf) < n:
+            self.Fill()
+        self.buf = self.buf[n:]
+        return int(lines[0].split()[1])
+
+    def Closed(self):
+        try:
+            self.Fill()
+        except (EOFError, ConnectionResetError):
+            return True
+        except socket.timeout:
+            return False
+        return False
+
+
+def Post(headers, body):
+    return (b'POST /login HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n'
+            b'Content-Type: application/x-www-form-urlencoded\r\n' + headers + b'\r\n' + body)
+
+
+def Accepted(name, request):
+    # 请求被接受: 请求体读完后, 同一连接上的下一个请求是 /index.html 而不是藏在请求体里的 /smuggled
+    s = socket.create_connection(SERVER)
+    s.settimeout(5)
+    reader = Reader(s)
+    s.sendall(request + FOLLOW)
+    first = reader.Response()
+    second = reader.Response()
+    s.close()
+    if first == 400 or second != 200:
+        Fail(name, 'responses %d %d, expected the body to be consumed' % (first, second))
+    print('%-32s ok (%d, %d)' % (name, first, second))
+
+
+def Rejected(name, request):
+    # 请求被拒绝: 400 之后连接关闭, 请求体里的内容不会被当成请求
+    s = socket.create_connection(SERVER)
+    s.settimeout(5)
+    reader = Reader(s)
+    s.sendall(request + FOLLOW)
+    status = reader.Response()
+    if status != 400:
+        Fail(name, 'status %d, expected 400' % status)
+    if not reader.Closed() or reader.buf:
+        Fail(name, 'connection still open after 400')
+    s.close()
+    print('%-32s ok (400, closed)' % name)
+
+
+def Fail(name, what):
+    sys.stderr.write('%s: %s\n' % (name, what))
+    sys.exit(1)
+
+
+def Run():
+    n = b'%d' % len(SMUGGLED)
+    chunked = b'%x\r\n' % len(SMUGGLED) + SMUGGLED + b'\r\n0\r\n\r\n'
+    Accepted('Content-Length', Post(b'Content-Length: ' + n + b'\r\n', SMUGGLED))
+    Accepted('content-length', Post(b'content-length: ' + n + b'\r\n', SMUGGLED))
+    Accepted('CoNtEnT-LeNgTh', Post(b'CoNtEnT-LeNgTh:' + n + b'  \r\n', SMUGGLED))
+    Accepted('transfer-encoding: chunked', Post(b'transfer-encoding: chunked\r\n', chunked))
+    Accepted('same Content-Length twice', Post(b'Content-Length: ' + n + b'\r\ncontent-length: ' + n + b'\r\n', SMUGGLED))
+    Rejected('Content-Length with space', Post(b'Content-Length : ' + n + b'\r\n', SMUGGLED))
+    Rejected('Transfer-Encoding with space', Post(b'Transfer-Encoding : chunked\r\n', chunked))
+    Rejected('different Content-Length', Post(b'Content-Length: ' + n + b'\r\nContent-Length: 0\r\n', SMUGGLED))
+    Rejected('Content-Length, Transfer-Encoding', Post(b'Content-Length: ' + n + b'\r\nTransfer-Encoding: chunked\r\n', chunked))
+    Rejected('transfer-encoding, Content-Length', Post(b'transfer-encoding: chunked\r\nContent-Length: 0\r\n', chunked))
+    Rejected('Transfer-Encoding: gzip', Post(b'Transfer-Encoding: gzip\r\n', SMUGGLED))
+    Rejected('Host twice', b'GET /index.html HTTP/1.1\r\nHost: x\r\nhost: y\r\nConnection: keep-alive\r\n\r\n')
+    Rejected('header without colon', b'GET /index.html HTTP/1.1\r\nHost: x\r\nbad header\r\n\r\n')
+    Rejected('folded header', b'GET /index.html HTTP/1.1\r\nHost: x\r\nX-A: 1\r\n Content-Length: 5\r\n\r\n')
+    print('all ok')
+
+
+def Usage():
+    sys.stderr.write('usage: %s [-H host] [-P port]\n' % sys.argv[0])
+    sys.exit(1)
+
+
+if __name__ == '__main__':
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], 'H:P:')
+    except getopt.GetoptError:
+        Usage()
+    for k, v in opts:
+        if k == '-H':
+            SERVER = (v, SERVER[1])
+        elif k == '-P':
+            SERVER = (SERVER[0], int(v))
+    Run()
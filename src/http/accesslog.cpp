@@ -0,0 +1,290 @@
+#include "accesslog.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <charconv>
+#include <chrono>
+#include "../log/logsite.h"
+
+
+AccessLog::AccessLog() : isOpen_(false), fd_(-1), sampleRate_(1), fields_(FIELD_COMBINED),
+                         batchBytes_(64 * 1024), flushIntervalMS_(1000), reportedDropped_(0)
+{ }
+
+AccessLog::~AccessLog() {
+    Close();
+}
+
+bool AccessLog::Init(const char* path, int sampleRate, int fields,
+                     size_t batchBytes, int flushIntervalMS, OverflowPolicy policy) {
+    assert(path);
+    Close();
+
+    fd_ = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        CLOG(ERROR) << "Open access log " << path << " error!";
+        return false;
+    }
+    sampleRate_ = sampleRate > 0 ? sampleRate : 1;
+    fields_ = fields;
+    batchBytes_ = batchBytes;
+    flushIntervalMS_ = flushIntervalMS > 0 ? flushIntervalMS : 1000;
+    queue_.reset(new RingQueue<std::string>(QUEUE_BATCHES, policy));
+    reportedDropped_ = 0;
+    isOpen_ = true;
+
+    writeThread_.reset(new std::thread(&AccessLog::WriteLoop_, this));
+    return true;
+}
+
+void AccessLog::Close() {
+    if (!isOpen_.exchange(false)) {
+        return;
+    }
+    // 写线程取完队列并写出残余记录后退出, 之后没有线程再使用 fd
+    queue_->Close();
+    if (writeThread_ && writeThread_->joinable()) {
+        writeThread_->join();
+    }
+    writeThread_.reset();
+    close(fd_);
+    fd_ = -1;
+}
+
+bool AccessLog::ShouldSample() {
+    if (!IsOpen()) {
+        return false;
+    }
+    if (sampleRate_ == 1) {
+        return true;
+    }
+    thread_local unsigned int counter = 0;
+    return (counter++ % sampleRate_) == 0;
+}
+
+void AccessLog::Record(const AccessRecord& rec) {
+    if (!IsOpen()) {
+        return;
+    }
+    ThreadBuf* buf = LocalBuf_();
+    std::lock_guard<std::mutex> lk(buf->mtx);
+    Format_(buf, rec);
+    if (buf->data.size() >= batchBytes_) {
+        Submit_(buf);
+    }
+}
+
+void AccessLog::Flush() {
+    std::vector<std::shared_ptr<ThreadBuf>> bufs;
+    {
+        std::lock_guard<std::mutex> lk(bufsMtx_);
+        bufs = bufs_;
+    }
+    for (auto& b : bufs) {
+        std::lock_guard<std::mutex> lk(b->mtx);
+        Submit_(b.get());
+    }
+}
+
+AccessLog::ThreadBuf* AccessLog::LocalBuf_() {
+    thread_local ThreadBufHolder holder;
+    if (!holder.buf) {
+        holder.buf = std::make_shared<ThreadBuf>();
+        holder.buf->data.reserve(batchBytes_ + 1024);
+        std::lock_guard<std::mutex> lk(bufsMtx_);
+        bufs_.push_back(holder.buf);
+    }
+    return holder.buf.get();
+}
+
+AccessLog::ThreadBufHolder::~ThreadBufHolder() {
+    if (buf) {
+        std::lock_guard<std::mutex> lk(buf->mtx);
+        AccessLog::GetInstance()->Submit_(buf.get());
+        buf->alive = false;
+    }
+}
+
+void AccessLog::Submit_(ThreadBuf* buf) {
+    if (buf->data.empty()) {
+        return;
+    }
+    // 整块移交给写线程; 队列满时按策略丢弃/阻塞/覆盖最旧的一批, 已关闭时丢弃
+    queue_->push_back(std::move(buf->data));
+    buf->data.clear();
+    buf->data.reserve(batchBytes_ + 1024);
+}
+
+void AccessLog::WriteOut_(const std::string& batch) {
+    const char* p = batch.data();
+    size_t left = batch.size();
+    // O_APPEND 保证每次 write 整块追加到文件末尾
+    while (left > 0) {
+        ssize_t n = write(fd_, p, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+void AccessLog::WriteResidue_(bool final) {
+    std::vector<std::shared_ptr<ThreadBuf>> bufs;
+    {
+        std::lock_guard<std::mutex> lk(bufsMtx_);
+        bufs = bufs_;
+    }
+    std::string batch;
+    std::vector<std::shared_ptr<ThreadBuf>> alive;
+    for (auto& b : bufs) {
+        // BLOCK 策略下持有缓冲区锁的线程可能正等着写线程腾出队列: 平时只 try_lock, 拿不到就跳过
+        // (这个线程正忙, 会自己提交); 队列关闭后入队不再阻塞, 最后一次才等锁
+        std::unique_lock<std::mutex> lk(b->mtx, std::defer_lock);
+        if (final) {
+            lk.lock();
+        }
+        else if (!lk.try_lock()) {
+            alive.push_back(b);
+            continue;
+        }
+        // 持有缓冲区的锁时这个线程不能再入队: 先写出队列中更早的批次, 再写残余记录, 同一线程的记录保持顺序
+        while (queue_->try_pop(batch)) {
+            WriteOut_(batch);
+        }
+        WriteOut_(b->data);
+        b->data.clear();
+        if (b->alive) {
+            alive.push_back(b);
+        }
+    }
+    {
+        // 清理已退出线程的缓冲区(期间新注册的缓冲区保留)
+        std::lock_guard<std::mutex> lk(bufsMtx_);
+        for (size_t i = bufs.size(); i < bufs_.size(); ++i) {
+            alive.push_back(bufs_[i]);
+        }
+        bufs_.swap(alive);
+    }
+
+    size_t dropped = queue_->DroppedCount() + queue_->OverwrittenCount();
+    if (dropped != reportedDropped_) {
+        LOG_EVERY_SEC(WARNING, 10) << "Access log queue overflow, " << dropped - reportedDropped_ << " batches lost";
+        reportedDropped_ = dropped;
+    }
+}
+
+void AccessLog::WriteLoop_() {
+    typedef std::chrono::steady_clock Clock;
+    std::chrono::milliseconds interval(flushIntervalMS_);
+    Clock::time_point next = Clock::now() + interval;
+    std::string batch;
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (now >= next) {
+            WriteResidue_(false);
+            next = now + interval;
+            continue;
+        }
+        if (queue_->pop(batch, std::chrono::duration_cast<std::chrono::milliseconds>(next - now))) {
+            WriteOut_(batch);
+        }
+        else if (queue_->closed()) {
+            // 队列已经取空
+            break;
+        }
+    }
+    WriteResidue_(true);
+}
+
+void AccessLog::AppendQuoted_(std::string& out, const std::string& str) {
+    out += '"';
+    if (str.empty()) {
+        out += '-';
+    }
+    AppendEscaped_(out, str);
+    out += '"';
+}
+
+void AccessLog::AppendEscaped_(std::string& out, const std::string& str) {
+    static const char HEX[] = "0123456789abcdef";
+    for (unsigned char ch : str) {
+        if (ch == '"' || ch == '\\' || ch < 0x20 || ch >= 0x7f) {
+            // 转义引号和不可见字符, 防止伪造日志行
+            out += "\\x";
+            out += HEX[ch >> 4];
+            out += HEX[ch & 0xf];
+        }
+        else {
+            out += static_cast<char>(ch);
+        }
+    }
+}
+
+void AccessLog::Format_(ThreadBuf* buf, const AccessRecord& rec) {
+    // 例子: 127.0.0.1 - - [18/Oct/2026:19:24:55 +0800] "GET /index.html HTTP/1.1" 200 3164 "-" "curl/7.88.1" 153
+    std::string& out = buf->data;
+    char num[24];
+    bool first = true;
+    auto sep = [&]() {
+        if (!first) {
+            out += ' ';
+        }
+        first = false;
+    };
+
+    if (fields_ & FIELD_IP) {
+        sep();
+        out += rec.ip;
+        if (fields_ == FIELD_COMBINED) {
+            out += " - -";
+        }
+    }
+    if (fields_ & FIELD_TIME) {
+        // 同一秒内复用格式化好的时间字符串
+        if (buf->cachedSec != rec.when) {
+            struct tm tmBuf;
+            localtime_r(&rec.when, &tmBuf);
+            strftime(buf->cachedTime, sizeof(buf->cachedTime), "[%d/%b/%Y:%H:%M:%S %z]", &tmBuf);
+            buf->cachedSec = rec.when;
+        }
+        sep();
+        out += buf->cachedTime;
+    }
+    if (fields_ & FIELD_REQUEST) {
+        sep();
+        out += '"';
+        AppendEscaped_(out, rec.method);
+        out += ' ';
+        AppendEscaped_(out, rec.path);
+        out += " HTTP/";
+        AppendEscaped_(out, rec.version);
+        out += '"';
+    }
+    if (fields_ & FIELD_STATUS) {
+        sep();
+        out.append(num, std::to_chars(num, num + sizeof(num), rec.status).ptr);
+    }
+    if (fields_ & FIELD_BYTES) {
+        sep();
+        out.append(num, std::to_chars(num, num + sizeof(num), rec.bytes).ptr);
+    }
+    if (fields_ & FIELD_REFERER) {
+        sep();
+        AppendQuoted_(out, rec.referer);
+    }
+    if (fields_ & FIELD_UA) {
+        sep();
+        AppendQuoted_(out, rec.userAgent);
+    }
+    if (fields_ & FIELD_LATENCY) {
+        sep();
+        out.append(num, std::to_chars(num, num + sizeof(num), rec.latencyUs).ptr);
+    }
+    out += '\n';
+}
@@ -0,0 +1,151 @@
+/*
+    访问日志(Combined Log Format)
+
+    每个线程把记录格式化到自己的缓冲区, 攒够一批后放入有界无锁环形队列(RingQueue), 不在请求线程里写文件;
+    只有后台写线程从队列中取出批次, 用一次 write(O_APPEND) 落盘, 并定期把空闲线程里的残余记录刷出去.
+    磁盘慢到队列写满时按 OverflowPolicy 处理(默认丢弃并计数, 不阻塞请求线程).
+    支持按 1/N 采样以及只输出部分字段.
+*/
+
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include "../log/ringqueue.hpp"
+
+// 一条访问记录
+struct AccessRecord {
+    std::string ip;
+    std::string method;
+    std::string path;
+    std::string version;
+    std::string referer;
+    std::string userAgent;
+    int status = 0;
+    size_t bytes = 0;          // 发送给客户端的总字节数
+    int64_t latencyUs = 0;     // 从开始处理请求到响应写完的耗时(微秒)
+    time_t when = 0;           // 请求开始处理的时间
+};
+
+class AccessLog {
+public:
+    // 输出字段(可按位组合)
+    enum FIELD {
+        FIELD_IP      = 1 << 0,
+        FIELD_TIME    = 1 << 1,
+        FIELD_REQUEST = 1 << 2,
+        FIELD_STATUS  = 1 << 3,
+        FIELD_BYTES   = 1 << 4,
+        FIELD_REFERER = 1 << 5,
+        FIELD_UA      = 1 << 6,
+        FIELD_LATENCY = 1 << 7,
+        // Combined Log Format + 耗时
+        FIELD_COMBINED = 0xff,
+        // 计费用的最小字段集
+        FIELD_BILLING = FIELD_IP | FIELD_TIME | FIELD_REQUEST | FIELD_STATUS | FIELD_BYTES | FIELD_LATENCY
+    };
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return AccessLog指针
+    static AccessLog* GetInstance() {
+        static AccessLog inst;
+        return &inst;
+    }
+
+    /// @brief 初始化函数
+    /// @param path 日志文件路径
+    /// @param sampleRate 采样率, 每 sampleRate 个请求记录 1 个 (1 表示全部记录)
+    /// @param fields 输出的字段(FIELD 按位组合)
+    /// @param batchBytes 每个线程缓冲区攒够多少字节后交给写线程
+    /// @param flushIntervalMS 后台线程刷盘间隔(单位:ms)
+    /// @param policy 队列满(写线程跟不上)时的处理策略
+    /// @return true-成功, false-打开文件失败
+    bool Init(const char* path, int sampleRate = 1, int fields = FIELD_COMBINED,
+              size_t batchBytes = 64 * 1024, int flushIntervalMS = 1000,
+              OverflowPolicy policy = OverflowPolicy::DROP);
+
+    /// @brief 是否开启
+    bool IsOpen() const {
+        return isOpen_.load(std::memory_order_relaxed);
+    }
+
+    /// @brief 当前请求是否被采样(每个线程独立计数, 无锁)
+    /// @return true-需要记录, false-跳过
+    bool ShouldSample();
+
+    /// @brief 记录一条访问日志(写入当前线程的缓冲区)
+    /// @param rec 访问记录
+    void Record(const AccessRecord& rec);
+
+    /// @brief 把所有线程缓冲区中的记录交给写线程
+    void Flush();
+
+    /// @brief 关闭访问日志
+    void Close();
+
+private:
+    // 每个线程一个缓冲区
+    struct ThreadBuf {
+        std::mutex mtx;        // 只和后台刷盘线程竞争
+        std::string data;
+        time_t cachedSec = -1; // 缓存的时间字符串对应的秒
+        char cachedTime[32];
+        bool alive = true;
+    };
+
+    // 线程退出时把残余记录交给写线程
+    struct ThreadBufHolder {
+        std::shared_ptr<ThreadBuf> buf;
+        ~ThreadBufHolder();
+    };
+
+    AccessLog();
+    ~AccessLog();
+
+    /// @brief 获取当前线程的缓冲区(第一次调用时注册)
+    ThreadBuf* LocalBuf_();
+    /// @brief 格式化一条记录追加到 buf
+    void Format_(ThreadBuf* buf, const AccessRecord& rec);
+    /// @brief 把缓冲区中的记录作为一批放入队列(调用者持有 buf->mtx)
+    void Submit_(ThreadBuf* buf);
+    /// @brief 写一批记录到文件(只在写线程中调用)
+    void WriteOut_(const std::string& batch);
+    /// @brief 写出队列中的批次和各线程缓冲区的残余记录(只在写线程中调用)
+    /// @param final 队列已经关闭, 等待每个缓冲区的锁(平时拿不到锁的缓冲区跳过)
+    void WriteResidue_(bool final);
+    /// @brief 后台写线程
+    void WriteLoop_();
+
+    /// @brief 追加带引号的字段, 空字段输出 "-"
+    static void AppendQuoted_(std::string& out, const std::string& str);
+    /// @brief 追加字段并转义引号和不可见字符
+    static void AppendEscaped_(std::string& out, const std::string& str);
+
+private:
+    static const size_t QUEUE_BATCHES = 64;    // 队列中最多等待写出的批次
+
+    std::atomic<bool> isOpen_;
+    int fd_;                    // 只有写线程使用, Close 在写线程结束后才关闭
+    int sampleRate_;
+    int fields_;
+    size_t batchBytes_;
+    int flushIntervalMS_;
+
+    std::mutex bufsMtx_;
+    std::vector<std::shared_ptr<ThreadBuf>> bufs_;
+
+    std::unique_ptr<RingQueue<std::string>> queue_;
+    size_t reportedDropped_;    // 已经报告过的丢弃批次数
+    std::unique_ptr<std::thread> writeThread_;
+};
+
+
+#endif
@@ -0,0 +1,78 @@
+#include "eventstream.h"
+
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+namespace {
+
+// 追加一个字段, 值中的换行(不允许出现在 event / id 中)去掉
+void AppendField(std::string* out, const char* name, const std::string& value) {
+    out->append(name);
+    out->append(": ");
+    for (char ch : value) {
+        if (ch != '\r' && ch != '\n' && ch != '\0') {
+            out->push_back(ch);
+        }
+    }
+    out->push_back('\n');
+}
+
+}
+
+
+HttpHandler::Result EventStreamHandler::Handle(HttpRequest& /*request*/, const RouteParams& /*params*/, HttpResponse& response) {
+    // 事件流在 HttpConn 中直接建立, 走到这里的是不能保持推送的请求(如 HTTP/2 的流)
+    response.SetCode(400);
+    return DONE;
+}
+
+
+bool EventStream::Accepts(const HttpRequest& request) {
+    return request.methodId() == Router::GET && request.BodyComplete();
+}
+
+PushStream::Frame EventStream::Encode(const std::string& data, const std::string& event, const std::string& id) {
+    std::string* frame = new std::string();
+    frame->reserve(data.size() + event.size() + id.size() + 32);
+    if (!id.empty()) {
+        AppendField(frame, "id", id);
+    }
+    if (!event.empty()) {
+        AppendField(frame, "event", event);
+    }
+    // 每一行一个 data 字段, \r\n、\r、\n 都算换行
+    size_t start = 0;
+    while (true) {
+        size_t end = data.find_first_of("\r\n", start);
+        frame->append("data: ");
+        frame->append(data, start, end == std::string::npos ? std::string::npos : end - start);
+        frame->push_back('\n');
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + ((data[end] == '\r' && end + 1 < data.size() && data[end + 1] == '\n') ? 2 : 1);
+    }
+    frame->push_back('\n');
+    return Frame(frame);
+}
+
+EventStream::EventStream(int fd, EventStreamHandler* handler)
+    : PushStream(fd, MAX_QUEUE_BYTES), handler_(handler) {}
+
+void EventStream::Open(const HttpRequest& request) {
+    // 没有 Content-Length, 连接断开即事件流结束; 禁止代理缓冲
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                           "Connection: keep-alive\r\nX-Accel-Buffering: no\r\n\r\n"
+                           "retry: " + std::to_string(RETRY_MS) + "\n\n";
+    Push(std::make_shared<const std::string>(std::move(response)));
+    handler_->OnOpen(shared_from_this(), request);
+}
+
+void EventStream::Process(Buffer& in) {
+    in.RetrieveAll();
+}
+
+void EventStream::OnShutdown_() {
+    handler_->OnClose(shared_from_this());
+}
@@ -0,0 +1,91 @@
+/*
+    Server-Sent Events(text/event-stream)
+
+    路由到 EventStreamHandler 的 GET 请求不按一问一答处理: 发出响应首部后连接保持在推送状态,
+    之后由 Send / EventChannel::Publish 追加事件, 直到客户端断开或服务端 End.
+    事件编码一次后作为共享的 Frame 放入各个订阅者的发送队列(见 PushStream),
+    慢的订阅者超过发送队列上限或长时间写不出去时断开, 浏览器的 EventSource 会按 retry 自动重连.
+*/
+
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <string>
+#include <memory>
+#include "../buffer/buffer.h"
+#include "router.h"
+#include "pushstream.h"
+
+class EventStream;
+class HttpRequest;
+
+// 事件流的处理者, 注册到路由上的 GET 路径
+// 连接建立后 OnOpen 决定订阅哪些事件(如加入 EventChannel), 断开时 OnClose 退订
+class EventStreamHandler : public HttpHandler {
+public:
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+
+    /// @brief 事件流建立(在工作线程中调用, 不能阻塞)
+    /// @param stream 事件流
+    /// @param request 请求(可以从 Last-Event-ID 首部补发错过的事件)
+    virtual void OnOpen(const std::shared_ptr<EventStream>& /*stream*/, const HttpRequest& /*request*/) {}
+
+    /// @brief 事件流断开(只调用一次, 可能在定时器线程中调用)
+    virtual void OnClose(const std::shared_ptr<EventStream>& /*stream*/) {}
+};
+
+class EventStream : public PushStream, public std::enable_shared_from_this<EventStream> {
+public:
+    static const size_t MAX_QUEUE_BYTES = 1 << 20;  // 发送队列的上限, 超过时断开(订阅者太慢)
+    static const int RETRY_MS = 3000;               // 告诉客户端断开后多久重连
+
+    /// @brief 请求是否可以作为事件流(GET, 没有请求体)
+    static bool Accepts(const HttpRequest& request);
+
+    /// @brief 编码一个事件
+    /// @param data 数据(可以有多行)
+    /// @param event 事件类型(为空时是默认的 message)
+    /// @param id 事件 ID(为空时不发送)
+    /// @return 可以发送给任意多个连接的帧
+    static Frame Encode(const std::string& data, const std::string& event = std::string(),
+                        const std::string& id = std::string());
+
+    /// @param fd 连接的 socket
+    /// @param handler 事件流的处理者
+    EventStream(int fd, EventStreamHandler* handler);
+
+    /// @brief 响应首部放入发送队列, 并调用 OnOpen
+    /// @param request 请求(已经检查过 Accepts)
+    void Open(const HttpRequest& request);
+
+    /// @brief 客户端发来的数据(事件流是单向的)直接丢弃
+    void Process(Buffer& in) override;
+
+    /// @brief 发送一个事件(线程安全)
+    /// @return false-连接已经关闭(或正在关闭)
+    bool Send(const std::string& data, const std::string& event = std::string(),
+              const std::string& id = std::string()) {
+        return Push(Encode(data, event, id));
+    }
+
+protected:
+    /// @brief 连接断开: 调用 handler 的 OnClose
+    void OnShutdown_() override;
+
+private:
+    EventStreamHandler* handler_;
+};
+
+// 一组事件流(如同一个频道的订阅者), 发布的事件只编码一次
+class EventChannel : public PushGroup {
+public:
+    /// @brief 发布一个事件
+    /// @return 放入了发送队列的订阅者数
+    size_t Publish(const std::string& data, const std::string& event = std::string(),
+                   const std::string& id = std::string()) {
+        return Broadcast(EventStream::Encode(data, event, id));
+    }
+};
+
+
+#endif
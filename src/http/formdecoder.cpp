@@ -0,0 +1,127 @@
+#include "formdecoder.h"
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+inline int HexValue(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+}
+
+
+size_t FormDecoder::Decode(const char* src, size_t len, char* dst) {
+    size_t i = 0, out = 0;
+    while (i < len) {
+#if defined(__SSE2__)
+        // 整块跳过没有 '%' / '+' 的 16 字节, 停在下一个需要转换的字符上
+        // 原地解码时 out <= i, 先读后写不会覆盖还没读的数据
+        const __m128i percent = _mm_set1_epi8('%');
+        const __m128i plus = _mm_set1_epi8('+');
+        while (i + 16 <= len) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, percent),
+                                                      _mm_cmpeq_epi8(block, plus)));
+            if (mask == 0) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + out), block);
+                i += 16;
+                out += 16;
+                continue;
+            }
+            int skip = __builtin_ctz(mask);
+            memmove(dst + out, src + i, skip);
+            i += skip;
+            out += skip;
+            break;
+        }
+        if (i >= len) {
+            break;
+        }
+#endif
+        char ch = src[i];
+        int hi, lo;
+        if (ch == '+') {
+            dst[out++] = ' ';
+            ++i;
+        }
+        else if (ch == '%' && i + 2 < len && (hi = HexValue(src[i + 1])) >= 0 && (lo = HexValue(src[i + 2])) >= 0) {
+            dst[out++] = static_cast<char>(hi * 16 + lo);
+            i += 3;
+        }
+        else {
+            dst[out++] = ch;
+            ++i;
+        }
+    }
+    return out;
+}
+
+void FormDecoder::ParseUrlencoded(std::string_view body, std::string* buf, std::vector<Field>* fields) {
+    fields->clear();
+    // 解码后不会变长: 一次分配好, 之后不再扩容, 字段的 string_view 一直有效
+    buf->resize(body.size());
+    if (body.empty()) {
+        return;
+    }
+    char* out = &(*buf)[0];
+    const char* p = body.data();
+    const char* end = p + body.size();
+    while (p < end) {
+        const char* amp = static_cast<const char*>(memchr(p, '&', end - p));
+        if (!amp) {
+            amp = end;
+        }
+        const char* eq = static_cast<const char*>(memchr(p, '=', amp - p));
+        const char* keyEnd = eq ? eq : amp;
+        if (keyEnd != p) {
+            size_t keyLen = Decode(p, keyEnd - p, out);
+            std::string_view key(out, keyLen);
+            out += keyLen;
+            size_t valueLen = eq ? Decode(eq + 1, amp - eq - 1, out) : 0;
+            std::string_view value(out, valueLen);
+            out += valueLen;
+            fields->emplace_back(key, value);
+        }
+        p = amp + 1;
+    }
+}
+
+const char* FormDecoder::Find(const char* haystack, size_t n, const char* needle, size_t m) {
+    if (m == 0) {
+        return haystack;
+    }
+    if (n < m) {
+        return nullptr;
+    }
+    if (m == 1) {
+        return static_cast<const char*>(memchr(haystack, needle[0], n));
+    }
+    size_t i = 0;
+#if defined(__SSE2__)
+    // 候选位置: 首字节和尾字节同时相等, 一次比较 16 个位置
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                        _mm_cmpeq_epi8(blockLast, last)));
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, m - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    return static_cast<const char*>(memmem(haystack + i, n - i, needle, m));
+}
@@ -0,0 +1,588 @@
+#include "handlers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <mutex>
+#include "../pool/logincache.h"
+#include "../pool/userbloom.h"
+#include "../pool/sessionstore.h"
+#include "multipart.h"
+#include "../log/logsite.h"
+
+
+SingleFlight<std::string, AuthHandler::FindResult> AuthHandler::findFlight_;
+
+
+// 上传目录的配额: 启动时扫描目录得到已有的用量, 之后按本进程的上传增减(外部删除的文件重启后才会计入)
+class UploadQuota {
+public:
+    UploadQuota(const std::string& dir, size_t maxBytes, size_t maxFiles)
+        : maxBytes_(maxBytes), maxFiles_(maxFiles), bytes_(0), files_(0) {
+        DIR* dp = opendir(dir.c_str());
+        if (!dp) {
+            return;
+        }
+        struct dirent* entry;
+        struct stat st;
+        while ((entry = readdir(dp)) != nullptr) {
+            // 以 '.' 开头的是临时文件(或 . 和 ..)
+            if (entry->d_name[0] != '.' && fstatat(dirfd(dp), entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+                bytes_ += st.st_size;
+                ++files_;
+            }
+        }
+        closedir(dp);
+    }
+
+    /// @brief 占用配额
+    /// @return false-超过配额(没有占用)
+    bool Acquire(size_t bytes, size_t files) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (bytes_ + bytes > maxBytes_ || files_ + files > maxFiles_) {
+            return false;
+        }
+        bytes_ += bytes;
+        files_ += files;
+        return true;
+    }
+
+    /// @brief 归还 Acquire 占用的配额
+    void Release(size_t bytes, size_t files) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        bytes_ -= bytes;
+        files_ -= files;
+    }
+
+private:
+    std::mutex mtx_;
+    size_t maxBytes_;
+    size_t maxFiles_;
+    size_t bytes_;
+    size_t files_;
+};
+
+
+namespace {
+
+bool WriteAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 把临时文件链接为目标文件名(目标已存在时失败, 不会覆盖), 成功后删除临时文件名
+// @return 0-成功, 否则为响应的状态码
+int LinkUpload(const std::string& tmpPath, const std::string& path) {
+    if (link(tmpPath.c_str(), path.c_str()) < 0) {
+        if (errno == EEXIST) {
+            return 409;
+        }
+        CLOG(WARNING) << "Upload link " << tmpPath << " -> " << path << " failed: " << strerror(errno);
+        return 500;
+    }
+    unlink(tmpPath.c_str());
+    return 0;
+}
+
+// 上传的文件: 先写临时文件, 接收完整后链接为目标文件名, 中断时删除临时文件
+// 配额: 创建时占用一个文件和已知的 Content-Length(splice 写入的部分不经过 Write), 之后写入超出的部分再占用
+class FileSink : public BodySink {
+public:
+    FileSink(int fd, const std::string& tmpPath, const std::string& path, size_t limit,
+             const std::shared_ptr<UploadQuota>& quota, size_t reserved)
+        : fd_(fd), tmpPath_(tmpPath), path_(path), limit_(limit), finished_(false), code_(500),
+          quota_(quota), written_(0), charged_(reserved) {}
+
+    ~FileSink() override {
+        close(fd_);
+        if (!finished_) {
+            unlink(tmpPath_.c_str());
+            quota_->Release(charged_, 1);
+        }
+    }
+
+    int Fd() const override {
+        return fd_;
+    }
+
+    size_t Limit() const override {
+        return limit_;
+    }
+
+    bool Write(const char* data, size_t len) override {
+        written_ += len;
+        if (written_ > charged_) {
+            if (!quota_->Acquire(written_ - charged_, 0)) {
+                code_ = 507;
+                return false;
+            }
+            charged_ = written_;
+        }
+        if (!WriteAll(fd_, data, len)) {
+            CLOG(WARNING) << "Upload write " << tmpPath_ << " failed: " << strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool Finish() override {
+        // 按实际大小结算配额(包括 splice 写入的部分)
+        struct stat st;
+        if (fstat(fd_, &st) < 0) {
+            return false;
+        }
+        size_t size = st.st_size;
+        if (size > charged_) {
+            if (!quota_->Acquire(size - charged_, 0)) {
+                code_ = 507;
+                return false;
+            }
+        }
+        else {
+            quota_->Release(charged_ - size, 0);
+        }
+        charged_ = size;
+        code_ = LinkUpload(tmpPath_, path_);
+        if (code_ != 0) {
+            return false;
+        }
+        finished_ = true;
+        return true;
+    }
+
+    int ErrorCode() const override {
+        return code_;
+    }
+
+private:
+    int fd_;
+    std::string tmpPath_;
+    std::string path_;
+    size_t limit_;
+    bool finished_;
+    int code_;
+    std::shared_ptr<UploadQuota> quota_;
+    size_t written_;        // 经过 Write 写入的字节数
+    size_t charged_;        // 占用的配额字节数
+};
+
+// multipart 上传: 边解析边把每个文件部分写入临时文件, 部分结束时链接为目标文件名, 其他字段忽略
+class MultipartUploadSink : public BodySink, private MultipartParser::Handler {
+public:
+    MultipartUploadSink(const std::string& dir, size_t limit, const std::shared_ptr<UploadQuota>& quota)
+        : parser_(this), dir_(dir), limit_(limit), quota_(quota), code_(500), fd_(-1), bytes_(0) {}
+
+    ~MultipartUploadSink() override {
+        DropPart_();
+    }
+
+    bool Reset(const std::string& contentType) {
+        return parser_.Reset(contentType);
+    }
+
+    size_t Limit() const override {
+        return limit_;
+    }
+
+    bool Write(const char* data, size_t len) override {
+        return parser_.Feed(data, len);
+    }
+
+    bool Finish() override {
+        return parser_.Done();
+    }
+
+    int ErrorCode() const override {
+        return code_;
+    }
+
+    // 保存下来的文件: 文件名 -> 字节数
+    const std::vector<std::pair<std::string, size_t>>& Files() const {
+        return files_;
+    }
+
+private:
+    bool OnPartBegin(const MultipartParser::Part& part) override {
+        if (!part.isFile) {
+            return true;
+        }
+        // 只取文件名的最后一段(有的浏览器会带上路径)
+        std::string_view filename = part.filename;
+        size_t slash = filename.find_last_of("/\\");
+        if (slash != std::string_view::npos) {
+            filename.remove_prefix(slash + 1);
+        }
+        name_.assign(filename.data(), filename.size());
+        if (!UploadHandler::ValidName(name_)) {
+            CLOG(WARNING) << "Upload rejected filename: " << name_;
+            code_ = 400;
+            return false;
+        }
+        if (access((dir_ + name_).c_str(), F_OK) == 0) {
+            code_ = 409;
+            return false;
+        }
+        if (!quota_->Acquire(0, 1)) {
+            code_ = 507;
+            return false;
+        }
+        tmpPath_ = dir_ + ".upload-XXXXXX";
+        fd_ = mkostemp(&tmpPath_[0], O_CLOEXEC);
+        if (fd_ < 0) {
+            CLOG(WARNING) << "Create upload file in " << dir_ << " failed: " << strerror(errno);
+            quota_->Release(0, 1);
+            return false;
+        }
+        fchmod(fd_, 0644);
+        bytes_ = 0;
+        return true;
+    }
+
+    bool OnPartData(const char* data, size_t len) override {
+        if (fd_ < 0) {
+            return true;
+        }
+        if (!quota_->Acquire(len, 0)) {
+            code_ = 507;
+            return false;
+        }
+        bytes_ += len;
+        if (!WriteAll(fd_, data, len)) {
+            CLOG(WARNING) << "Upload write " << tmpPath_ << " failed: " << strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool OnPartEnd() override {
+        if (fd_ < 0) {
+            return true;
+        }
+        int code = LinkUpload(tmpPath_, dir_ + name_);
+        if (code != 0) {
+            code_ = code;
+            return false;
+        }
+        close(fd_);
+        fd_ = -1;
+        files_.emplace_back(name_, bytes_);
+        return true;
+    }
+
+    void DropPart_() {
+        if (fd_ >= 0) {
+            close(fd_);
+            unlink(tmpPath_.c_str());
+            quota_->Release(bytes_, 1);
+            fd_ = -1;
+        }
+    }
+
+private:
+    MultipartParser parser_;
+    std::string dir_;
+    size_t limit_;
+    std::shared_ptr<UploadQuota> quota_;
+    int code_;              // 失败时响应的状态码
+    int fd_;                // 当前文件部分的临时文件
+    std::string tmpPath_;
+    std::string name_;
+    size_t bytes_;          // 当前文件部分的字节数(已占用配额)
+    std::vector<std::pair<std::string, size_t>> files_;
+};
+
+}
+
+
+HttpHandler::Result StaticFileHandler::Handle(HttpRequest& /*request*/, const RouteParams& /*params*/, HttpResponse& response) {
+    if (!file_.empty()) {
+        response.SetPath(file_);
+    }
+    return DONE;
+}
+
+
+HttpHandler::Result LoginPageHandler::Handle(HttpRequest& request, const RouteParams& /*params*/, HttpResponse& response) {
+    // 已登陆: 直接进入欢迎页, 只查内存中的会话
+    response.SetPath(request.SessionUser().empty() ? "/login.html" : "/welcome.html");
+    return DONE;
+}
+
+
+HttpHandler::Result SessionInfoHandler::Handle(HttpRequest& request, const RouteParams& /*params*/, HttpResponse& response) {
+    const std::string& user = request.SessionUser();
+    std::string body = "{\"user\": ";
+    if (user.empty()) {
+        body += "null";
+    }
+    else {
+        body += '"';
+        for (char ch : user) {
+            if (ch == '"' || ch == '\\') {
+                body += '\\';
+                body += ch;
+            }
+            else if (static_cast<unsigned char>(ch) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", ch);
+                body += buf;
+            }
+            else {
+                body += ch;
+            }
+        }
+        body += '"';
+    }
+    body += "}";
+    response.SetContent(body, "application/json");
+    return DONE;
+}
+
+
+HttpHandler::Result AuthHandler::Handle(HttpRequest& request, const RouteParams& /*params*/, HttpResponse& response) {
+    if (!request.IsForm()) {
+        // 不是表单提交: 返回登陆/注册页面
+        response.SetPath(isLogin_ ? "/login.html" : "/register.html");
+        return DONE;
+    }
+    if (isLogin_ && LoginCache::GetInstance()->Verify(request.GetPost("username"), request.GetPost("password"))) {
+        // 近期登陆过: 直接用缓存结果, 不访问用户存储
+        Welcome_(request.GetPost("username"), response);
+        return DONE;
+    }
+    // 用户存储的验证交给 SQL 线程执行(HandlePending), 工作线程不在这里阻塞
+    return PENDING;
+}
+
+void AuthHandler::HandlePending(HttpRequest& request, HttpResponse& response) {
+    if (UserVerify_(request.GetPost("username"), request.GetPost("password"), isLogin_)) {
+        Welcome_(request.GetPost("username"), response);
+    }
+    else {
+        response.SetPath("/error.html");
+    }
+}
+
+void AuthHandler::Welcome_(const std::string& name, HttpResponse& response) {
+    response.SetPath("/welcome.html");
+    std::string token = SessionStore::GetInstance()->Create(name);
+    if (!token.empty()) {
+        response.SetHeader("Set-Cookie", SessionStore::GetInstance()->SetCookieValue(token));
+    }
+}
+
+bool AuthHandler::UserVerify_(const std::string& name, const std::string& pwd, bool isLogin) {
+    if (name == "" || pwd == "") {
+        return false;
+    }
+    UserStore* store = UserStore::GetInstance();
+    if (!store) {
+        return false;
+    }
+
+    bool flag = false;
+    if (isLogin || UserBloom::GetInstance()->MayExist(name)) {
+        // 布隆过滤器判定用户名一定不存在时, 注册可以跳过查询
+        // 同一用户名的并发查询只访问一次存储, 其他请求共享结果
+        FindResult found = findFlight_.Do(name, [store, &name]() {
+            FindResult result;
+            result.first = store->Find(name, &result.second);
+            return result;
+        });
+        UserStore::Status status = found.first;
+        const std::string& storedPwd = found.second;
+        if (status == UserStore::STORE_ERROR) {
+            return false;
+        }
+        if (isLogin) {
+            flag = (status == UserStore::OK && pwd == storedPwd);
+        }
+        else if (status == UserStore::OK) {
+            return false;
+        }
+        else {
+            // 注册行为: 布隆过滤器误判
+            UserBloom::GetInstance()->RecordFalsePositive();
+        }
+    }
+    if (!isLogin) {
+        flag = (store->Insert(name, pwd) == UserStore::OK);
+    }
+
+    if (flag) {
+        // 登陆或注册成功: 写入登陆缓存
+        LoginCache::GetInstance()->Put(name, pwd);
+        if (!isLogin) {
+            UserBloom::GetInstance()->Add(name);
+        }
+    }
+    return flag;
+}
+
+
+UploadHandler::UploadHandler(const std::string& dir, size_t maxBytes, size_t maxDirBytes, size_t maxFiles)
+    : dir_(dir), maxBytes_(maxBytes) {
+    if (mkdir(dir_.c_str(), 0755) < 0 && errno != EEXIST) {
+        CLOG(WARNING) << "Create upload dir " << dir_ << " failed: " << strerror(errno);
+    }
+    quota_ = std::make_shared<UploadQuota>(dir_, maxDirBytes, maxFiles);
+}
+
+bool UploadHandler::ValidName(const std::string& name) {
+    if (name.empty() || name.size() > 255 || name[0] == '.') {
+        return false;
+    }
+    for (char ch : name) {
+        if (!isalnum(static_cast<unsigned char>(ch)) && ch != '.' && ch != '_' && ch != '-') {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<BodySink> UploadHandler::OpenBody(HttpRequest& request, const RouteParams& params, HttpResponse& response) {
+    if (request.SessionUser().empty()) {
+        response.SetCode(401);
+        return nullptr;
+    }
+    std::string name = params.Get("name");
+    if (params.Size() == 0) {
+        // 没有文件名: 表单上传
+        std::unique_ptr<MultipartUploadSink> sink(new MultipartUploadSink(dir_, maxBytes_, quota_));
+        if (!sink->Reset(request.GetHeader("Content-Type"))) {
+            response.SetCode(400);
+            return nullptr;
+        }
+        return sink;
+    }
+    if (!ValidName(name)) {
+        response.SetCode(400);
+        return nullptr;
+    }
+    // 已存在的文件不覆盖(接收完整后链接时还会再检查一次)
+    if (access((dir_ + name).c_str(), F_OK) == 0) {
+        response.SetCode(409);
+        return nullptr;
+    }
+    // 已知长度的请求体先占用全部配额, chunked 请求体边写边占用
+    size_t reserved = request.BodyRemaining();
+    if (!quota_->Acquire(reserved, 1)) {
+        response.SetCode(507);
+        return nullptr;
+    }
+    // 临时文件以 '.' 开头, 不会与合法的文件名冲突
+    std::string tmpPath = dir_ + ".upload-XXXXXX";
+    int fd = mkostemp(&tmpPath[0], O_CLOEXEC);
+    if (fd < 0) {
+        CLOG(WARNING) << "Create upload file in " << dir_ << " failed: " << strerror(errno);
+        quota_->Release(reserved, 1);
+        response.SetCode(500);
+        return nullptr;
+    }
+    fchmod(fd, 0644);
+    return std::unique_ptr<BodySink>(new FileSink(fd, tmpPath, dir_ + name, maxBytes_, quota_, reserved));
+}
+
+HttpHandler::Result UploadHandler::Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) {
+    if (request.SessionUser().empty()) {
+        response.SetCode(401);
+        return DONE;
+    }
+    if (params.Size() == 0) {
+        MultipartUploadSink* sink = dynamic_cast<MultipartUploadSink*>(request.Sink());
+        if (!sink) {
+            response.SetCode(400);
+            return DONE;
+        }
+        std::string body = "{\"files\": [";
+        char item[320];
+        for (size_t i = 0; i < sink->Files().size(); ++i) {
+            snprintf(item, sizeof(item), "%s{\"name\": \"%s\", \"bytes\": %zu}", i ? ", " : "",
+                     sink->Files()[i].first.c_str(), sink->Files()[i].second);
+            body += item;
+        }
+        body += "]}";
+        response.SetCode(201);
+        response.SetContent(body, "application/json");
+        return DONE;
+    }
+    std::string name = params.Get("name");
+    if (request.BodyBytes() == 0) {
+        // 空的请求体不会经过 OpenBody: 直接建立空文件(已存在时不覆盖)
+        if (!ValidName(name)) {
+            response.SetCode(400);
+            return DONE;
+        }
+        if (!quota_->Acquire(0, 1)) {
+            response.SetCode(507);
+            return DONE;
+        }
+        int fd = open((dir_ + name).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            response.SetCode(errno == EEXIST ? 409 : 500);
+            quota_->Release(0, 1);
+            return DONE;
+        }
+        close(fd);
+    }
+    char body[320];
+    snprintf(body, sizeof(body), "{\"name\": \"%s\", \"bytes\": %zu}",
+             name.c_str(), request.BodyBytes());
+    response.SetCode(201);
+    response.SetContent(body, "application/json");
+    return DONE;
+}
+
+
+int ChatHandler::Accept(const HttpRequest& request) {
+    // 广播会发给所有连接, 匿名客户端不能加入
+    return request.SessionUser().empty() ? 401 : 0;
+}
+
+void ChatHandler::OnOpen(const std::shared_ptr<WebSocket>& ws) {
+    group_.Join(ws);
+}
+
+void ChatHandler::OnMessage(const std::shared_ptr<WebSocket>& /*ws*/, bool binary, std::string& message) {
+    group_.Broadcast(message, binary);
+}
+
+void ChatHandler::OnClose(const std::shared_ptr<WebSocket>& ws) {
+    group_.Leave(ws);
+}
+
+
+void EventsHandler::OnOpen(const std::shared_ptr<EventStream>& stream, const HttpRequest& /*request*/) {
+    channel_->Join(stream);
+}
+
+void EventsHandler::OnClose(const std::shared_ptr<EventStream>& stream) {
+    channel_->Leave(stream);
+}
+
+
+HttpHandler::Result PublishHandler::Handle(HttpRequest& request, const RouteParams& /*params*/, HttpResponse& response) {
+    if (request.SessionUser().empty()) {
+        // 事件会发给所有订阅者, 匿名客户端不能发布
+        response.SetCode(401);
+        return DONE;
+    }
+    size_t subscribers = channel_->Publish(request.body());
+    response.SetContent("{\"subscribers\": " + std::to_string(subscribers) + "}", "application/json");
+    return DONE;
+}
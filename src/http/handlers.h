@@ -0,0 +1,143 @@
+/*
+    内置的请求处理者: 静态文件、登陆页、会话信息、登陆/注册、文件上传、WebSocket 聊天室、事件推送
+*/
+
+#ifndef HANDLERS_H
+#define HANDLERS_H
+
+#include <string>
+#include <utility>
+#include "router.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "websocket.h"
+#include "eventstream.h"
+#include "../pool/userstore.h"
+#include "../pool/singleflight.hpp"
+
+// 静态文件: 发送资源目录中与请求路径(或固定路径)对应的文件
+class StaticFileHandler : public HttpHandler {
+public:
+    /// @param file 固定发送的文件(为空时发送请求路径对应的文件)
+    explicit StaticFileHandler(const std::string& file = std::string()) : file_(file) {}
+
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+
+private:
+    std::string file_;
+};
+
+// 登陆页: 已经登陆(会话有效)时直接进入欢迎页
+class LoginPageHandler : public HttpHandler {
+public:
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+};
+
+// 当前会话: 返回 JSON {"user": "<用户名>"}, 没有登陆时为 null
+class SessionInfoHandler : public HttpHandler {
+public:
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+};
+
+// 登陆/注册: 需要访问用户存储时交给 SQL 线程
+class AuthHandler : public HttpHandler {
+public:
+    /// @param isLogin true-登陆 false-注册
+    explicit AuthHandler(bool isLogin) : isLogin_(isLogin) {}
+
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+    void HandlePending(HttpRequest& request, HttpResponse& response) override;
+
+private:
+    /// @brief 身份密码验证(会阻塞在用户存储上)
+    /// @param name 用户名
+    /// @param pwd 密码
+    /// @param isLogin 登陆选项(注册/登陆)
+    /// @return 是否成功
+    static bool UserVerify_(const std::string& name, const std::string& pwd, bool isLogin);
+    /// @brief 登陆/注册成功: 建立会话并进入欢迎页
+    static void Welcome_(const std::string& name, HttpResponse& response);
+
+private:
+    bool isLogin_;
+
+    // 用户查询结果: 状态 + 密码
+    typedef std::pair<UserStore::Status, std::string> FindResult;
+    static SingleFlight<std::string, FindResult> findFlight_;
+};
+
+// 上传目录的配额(定义见 handlers.cpp)
+class UploadQuota;
+
+// 文件上传(需要登陆):
+//   PUT/POST /upload/:name  请求体写入上传目录中的临时文件, 接收完整后链接为 name(已存在时 409, 不覆盖);
+//                           Content-Length 请求体由连接直接 splice 到文件, chunked 请求体解码后写入
+//   POST /upload            multipart/form-data 表单, 边接收边解析, 每个文件部分分别保存
+// 上传目录的总字节数和文件数超过配额时响应 507
+class UploadHandler : public HttpHandler {
+public:
+    /// @param dir 上传目录(以 '/' 结尾, 不存在时创建)
+    /// @param maxBytes 单个文件的大小上限
+    /// @param maxDirBytes 上传目录中所有文件的总大小上限
+    /// @param maxFiles 上传目录中的文件数上限
+    UploadHandler(const std::string& dir, size_t maxBytes, size_t maxDirBytes, size_t maxFiles);
+
+    std::unique_ptr<BodySink> OpenBody(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+
+    /// @brief 文件名是否合法(只允许字母数字和 . _ -, 不以 '.' 开头)
+    static bool ValidName(const std::string& name);
+
+private:
+    std::string dir_;
+    size_t maxBytes_;
+    std::shared_ptr<UploadQuota> quota_;
+};
+
+// WebSocket 聊天室: 收到的每条消息原样广播给所有连接(包括发送者)
+// 只接受已登录(带有效会话)的连接, 没有会话的升级请求响应 401
+class ChatHandler : public WebSocketHandler {
+public:
+    /// @param maxMessage 一条消息的大小上限
+    explicit ChatHandler(size_t maxMessage) : maxMessage_(maxMessage) {}
+
+    int Accept(const HttpRequest& request) override;
+    size_t MaxMessage() const override {
+        return maxMessage_;
+    }
+    void OnOpen(const std::shared_ptr<WebSocket>& ws) override;
+    void OnMessage(const std::shared_ptr<WebSocket>& ws, bool binary, std::string& message) override;
+    void OnClose(const std::shared_ptr<WebSocket>& ws) override;
+
+private:
+    size_t maxMessage_;
+    WebSocketGroup group_;
+};
+
+// 事件推送:
+//   GET  /events  订阅(text/event-stream), 之后收到发布的每个事件
+//   POST /events  把请求体作为一个事件发布给所有订阅者, 返回 JSON {"subscribers": <收到的订阅者数>}
+//                 (需要登录, 没有有效会话时响应 401)
+class EventsHandler : public EventStreamHandler {
+public:
+    explicit EventsHandler(const std::shared_ptr<EventChannel>& channel) : channel_(channel) {}
+
+    void OnOpen(const std::shared_ptr<EventStream>& stream, const HttpRequest& request) override;
+    void OnClose(const std::shared_ptr<EventStream>& stream) override;
+
+private:
+    std::shared_ptr<EventChannel> channel_;
+};
+
+class PublishHandler : public HttpHandler {
+public:
+    explicit PublishHandler(const std::shared_ptr<EventChannel>& channel) : channel_(channel) {}
+
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+
+private:
+    std::shared_ptr<EventChannel> channel_;
+};
+
+
+#endif
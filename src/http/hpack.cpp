@@ -0,0 +1,512 @@
+#include "hpack.h"
+
+#include <string.h>
+#include <algorithm>
+
+
+namespace {
+
+typedef std::pair<std::string, std::string> Entry;
+
+// RFC 7541 附录 A
+const Entry STATIC_TABLE[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+const size_t STATIC_NUM = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+const size_t ENTRY_OVERHEAD = 32;
+const size_t MAX_HEADER_LIST = 64 * 1024;   // 解码后首部列表的上限
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t len;
+};
+
+// RFC 7541 附录 B: 符号 -> (码, 码长), 下标 256 是 EOS
+const HuffmanCode HUFFMAN_CODES[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+/*
+    Huffman 解码状态机: 状态是码树的内部节点(256 个), 每次输入 4 个比特.
+    最短的码有 5 比特, 所以 4 个比特最多产生一个符号.
+*/
+class HuffmanDecoder {
+public:
+    enum {
+        EMIT = 1,       // 产生了一个符号
+        FAIL = 2,       // 遇到 EOS
+    };
+
+    struct Transition {
+        uint8_t next;
+        uint8_t flags;
+        uint8_t sym;
+    };
+
+    static const HuffmanDecoder& Instance() {
+        static HuffmanDecoder inst;
+        return inst;
+    }
+
+    const Transition& Step(uint8_t state, uint8_t nibble) const {
+        return table_[state][nibble];
+    }
+
+    // 在该状态结束是否合法: 剩下的比特是不超过 7 位的全 1 (EOS 的前缀)
+    bool Accept(uint8_t state) const {
+        return accept_[state];
+    }
+
+private:
+    HuffmanDecoder() {
+        // 建树: 内部节点编号 0..255, 叶子记录符号
+        struct Node {
+            int child[2];
+            int sym;
+        };
+        std::vector<Node> nodes(1, Node{{-1, -1}, -1});
+        for (int sym = 0; sym < 257; ++sym) {
+            int node = 0;
+            for (int bit = HUFFMAN_CODES[sym].len - 1; bit >= 0; --bit) {
+                int b = (HUFFMAN_CODES[sym].code >> bit) & 1;
+                if (nodes[node].child[b] < 0) {
+                    nodes[node].child[b] = static_cast<int>(nodes.size());
+                    nodes.push_back(Node{{-1, -1}, -1});
+                }
+                node = nodes[node].child[b];
+            }
+            nodes[node].sym = sym;
+        }
+        // 内部节点 -> 状态号
+        std::vector<int> stateOf(nodes.size(), -1);
+        std::vector<int> nodeOf;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].sym < 0) {
+                stateOf[i] = static_cast<int>(nodeOf.size());
+                nodeOf.push_back(static_cast<int>(i));
+            }
+        }
+        memset(accept_, 0, sizeof(accept_));
+        for (int node = 0, depth = 0; depth <= 7 && node >= 0 && nodes[node].sym < 0; ++depth) {
+            accept_[stateOf[node]] = true;
+            node = nodes[node].child[1];
+        }
+        for (size_t s = 0; s < nodeOf.size(); ++s) {
+            for (int nibble = 0; nibble < 16; ++nibble) {
+                Transition& t = table_[s][nibble];
+                t.flags = 0;
+                t.sym = 0;
+                int node = nodeOf[s];
+                for (int bit = 3; bit >= 0; --bit) {
+                    node = nodes[node].child[(nibble >> bit) & 1];
+                    if (nodes[node].sym >= 0) {
+                        if (nodes[node].sym == 256) {
+                            t.flags |= FAIL;
+                        }
+                        t.flags |= EMIT;
+                        t.sym = static_cast<uint8_t>(nodes[node].sym);
+                        node = 0;
+                    }
+                }
+                t.next = static_cast<uint8_t>(stateOf[node]);
+            }
+        }
+    }
+
+    Transition table_[256][16];
+    bool accept_[256];
+};
+
+inline size_t EntrySize(const std::string& name, const std::string& value) {
+    return ENTRY_OVERHEAD + name.size() + value.size();
+}
+
+// 编码时不加入动态表的首部: 每个响应都不同, 加进去只会挤掉有用的条目
+bool ShouldIndex(const std::string& name) {
+    return name != "content-length" && name != "set-cookie" && name != "etag" &&
+           name != "last-modified" && name != "date";
+}
+
+}
+
+
+const Entry* Hpack::Table::Get(size_t index) const {
+    if (index == 0) {
+        return nullptr;
+    }
+    if (index <= STATIC_NUM) {
+        return &STATIC_TABLE[index - 1];
+    }
+    index -= STATIC_NUM + 1;
+    return index < entries_.size() ? &entries_[index] : nullptr;
+}
+
+void Hpack::Table::Add(const std::string& name, const std::string& value) {
+    size_t size = EntrySize(name, value);
+    if (size > maxSize_) {
+        // 比整个表还大: 清空表, 不加入(RFC 7541 4.4)
+        entries_.clear();
+        size_ = 0;
+        return;
+    }
+    entries_.emplace_front(name, value);
+    size_ += size;
+    Evict_();
+}
+
+void Hpack::Table::SetMaxSize(size_t maxSize) {
+    maxSize_ = maxSize;
+    Evict_();
+}
+
+void Hpack::Table::Evict_() {
+    while (size_ > maxSize_ && !entries_.empty()) {
+        size_ -= EntrySize(entries_.back().first, entries_.back().second);
+        entries_.pop_back();
+    }
+}
+
+size_t Hpack::Table::Find(const std::string& name, const std::string& value, size_t* nameOnly) const {
+    *nameOnly = 0;
+    for (size_t i = 0; i < STATIC_NUM; ++i) {
+        if (STATIC_TABLE[i].first == name) {
+            if (STATIC_TABLE[i].second == value) {
+                return i + 1;
+            }
+            if (*nameOnly == 0) {
+                *nameOnly = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].first == name) {
+            if (entries_[i].second == value) {
+                return STATIC_NUM + 1 + i;
+            }
+            if (*nameOnly == 0) {
+                *nameOnly = STATIC_NUM + 1 + i;
+            }
+        }
+    }
+    return 0;
+}
+
+
+bool Hpack::Decoder::Decode(const uint8_t* data, size_t len, HeaderList* headers) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    size_t listSize = 0;
+    while (p < end) {
+        uint8_t b = *p;
+        uint64_t index = 0;
+        if (b & 0x80) {
+            // 索引
+            if (!DecodeInt(&p, end, 7, &index)) {
+                return false;
+            }
+            const Entry* entry = table_.Get(index);
+            if (!entry) {
+                return false;
+            }
+            headers->push_back(*entry);
+        }
+        else if ((b & 0xe0) == 0x20) {
+            // 动态表大小更新
+            if (!DecodeInt(&p, end, 5, &index) || index > maxTableSize_) {
+                return false;
+            }
+            table_.SetMaxSize(index);
+            continue;
+        }
+        else {
+            // 字面值: 01 加入动态表, 0000 不加入, 0001 永不加入
+            bool indexing = (b & 0x40) != 0;
+            if (!DecodeInt(&p, end, indexing ? 6 : 4, &index)) {
+                return false;
+            }
+            std::pair<std::string, std::string> field;
+            if (index) {
+                const Entry* entry = table_.Get(index);
+                if (!entry) {
+                    return false;
+                }
+                field.first = entry->first;
+            }
+            else if (!DecodeString(&p, end, &field.first)) {
+                return false;
+            }
+            if (!DecodeString(&p, end, &field.second)) {
+                return false;
+            }
+            if (indexing) {
+                table_.Add(field.first, field.second);
+            }
+            headers->push_back(std::move(field));
+        }
+        listSize += EntrySize(headers->back().first, headers->back().second);
+        if (listSize > MAX_HEADER_LIST) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void Hpack::Encoder::SetMaxTableSize(size_t maxSize) {
+    // 本端最多用默认大小, 对端更小时跟着缩小
+    size_t size = std::min(maxSize, DEFAULT_TABLE_SIZE);
+    if (size != table_.MaxSize()) {
+        table_.SetMaxSize(size);
+        pendingResize_ = true;
+    }
+}
+
+void Hpack::Encoder::Encode(const HeaderList& headers, std::string* out) {
+    if (pendingResize_) {
+        EncodeInt(table_.MaxSize(), 5, 0x20, out);
+        pendingResize_ = false;
+    }
+    for (const auto& field : headers) {
+        size_t nameIndex = 0;
+        size_t index = table_.Find(field.first, field.second, &nameIndex);
+        if (index) {
+            EncodeInt(index, 7, 0x80, out);
+            continue;
+        }
+        bool indexing = ShouldIndex(field.first);
+        if (indexing) {
+            EncodeInt(nameIndex, 6, 0x40, out);
+        }
+        else {
+            EncodeInt(nameIndex, 4, 0x00, out);
+        }
+        if (!nameIndex) {
+            EncodeString(field.first, out);
+        }
+        EncodeString(field.second, out);
+        if (indexing) {
+            table_.Add(field.first, field.second);
+        }
+    }
+}
+
+
+void Hpack::EncodeInt(uint64_t value, int prefixBits, uint8_t flags, std::string* out) {
+    uint64_t max = (1u << prefixBits) - 1;
+    if (value < max) {
+        out->push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out->push_back(static_cast<char>(flags | max));
+    value -= max;
+    while (value >= 128) {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+bool Hpack::DecodeInt(const uint8_t** p, const uint8_t* end, int prefixBits, uint64_t* value) {
+    if (*p >= end) {
+        return false;
+    }
+    uint64_t max = (1u << prefixBits) - 1;
+    uint64_t v = **p & max;
+    ++*p;
+    if (v < max) {
+        *value = v;
+        return true;
+    }
+    for (int shift = 0; *p < end; shift += 7) {
+        if (shift > 28) {
+            // 超过 2^35: 任何合法的长度/索引都不会这么大
+            return false;
+        }
+        uint8_t b = **p;
+        ++*p;
+        v += static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Hpack::EncodeString(const std::string& s, std::string* out) {
+    size_t huffLen = HuffmanLength(s);
+    if (huffLen < s.size()) {
+        EncodeInt(huffLen, 7, 0x80, out);
+        HuffmanEncode(s, out);
+    }
+    else {
+        EncodeInt(s.size(), 7, 0x00, out);
+        out->append(s);
+    }
+}
+
+bool Hpack::DecodeString(const uint8_t** p, const uint8_t* end, std::string* s) {
+    if (*p >= end) {
+        return false;
+    }
+    bool huffman = (**p & 0x80) != 0;
+    uint64_t len = 0;
+    if (!DecodeInt(p, end, 7, &len) || len > static_cast<uint64_t>(end - *p)) {
+        return false;
+    }
+    const uint8_t* data = *p;
+    *p += len;
+    if (huffman) {
+        s->clear();
+        return HuffmanDecode(data, len, s);
+    }
+    s->assign(reinterpret_cast<const char*>(data), len);
+    return true;
+}
+
+bool Hpack::HuffmanDecode(const uint8_t* data, size_t len, std::string* out) {
+    const HuffmanDecoder& decoder = HuffmanDecoder::Instance();
+    out->reserve(out->size() + len * 8 / 5);
+    uint8_t state = 0;
+    for (size_t i = 0; i < len; ++i) {
+        for (int shift = 4; shift >= 0; shift -= 4) {
+            const HuffmanDecoder::Transition& t = decoder.Step(state, (data[i] >> shift) & 0x0f);
+            if (t.flags & HuffmanDecoder::FAIL) {
+                return false;
+            }
+            if (t.flags & HuffmanDecoder::EMIT) {
+                out->push_back(static_cast<char>(t.sym));
+            }
+            state = t.next;
+        }
+    }
+    return decoder.Accept(state);
+}
+
+size_t Hpack::HuffmanLength(const std::string& s) {
+    size_t bits = 0;
+    for (unsigned char ch : s) {
+        bits += HUFFMAN_CODES[ch].len;
+    }
+    return (bits + 7) / 8;
+}
+
+void Hpack::HuffmanEncode(const std::string& s, std::string* out) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (unsigned char ch : s) {
+        acc = (acc << HUFFMAN_CODES[ch].len) | HUFFMAN_CODES[ch].code;
+        bits += HUFFMAN_CODES[ch].len;
+        while (bits >= 8) {
+            bits -= 8;
+            out->push_back(static_cast<char>(acc >> bits));
+        }
+    }
+    if (bits > 0) {
+        // 用 EOS 的前缀(全 1)填充到整字节
+        out->push_back(static_cast<char>((acc << (8 - bits)) | ((1u << (8 - bits)) - 1)));
+    }
+}
@@ -0,0 +1,119 @@
+/*
+    HPACK(RFC 7541): HTTP/2 的首部压缩
+
+    静态表 + 动态表(按 32 + 名字长度 + 值长度计算大小, 超过上限时从最旧的开始淘汰).
+    Huffman 解码用启动时由码表生成的状态机, 每次处理 4 个比特, 不逐比特走树.
+    编码时完全匹配的首部只发索引; 名字匹配时发字面值, 常用的首部同时加入动态表.
+    解码器和编码器各自维护自己方向的动态表, 每个 HTTP/2 连接一对, 只在持有连接的线程中使用.
+*/
+
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+class Hpack {
+public:
+    // 首部列表: 名字(小写) -> 值, 保持顺序
+    typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+    static const size_t DEFAULT_TABLE_SIZE = 4096;
+
+    // 动态表
+    class Table {
+    public:
+        Table() : size_(0), maxSize_(DEFAULT_TABLE_SIZE) {}
+
+        /// @brief 按 HPACK 索引取条目(1 开始, 先静态表后动态表)
+        /// @return 不存在时返回 nullptr
+        const std::pair<std::string, std::string>* Get(size_t index) const;
+        /// @brief 加入新条目(最新的条目索引最小)
+        void Add(const std::string& name, const std::string& value);
+        /// @brief 调整上限, 淘汰超出的条目
+        void SetMaxSize(size_t maxSize);
+        /// @brief 查找条目
+        /// @param nameOnly 只匹配名字时的索引(0 表示没有)
+        /// @return 名字和值都匹配的索引(0 表示没有)
+        size_t Find(const std::string& name, const std::string& value, size_t* nameOnly) const;
+
+        size_t MaxSize() const {
+            return maxSize_;
+        }
+
+    private:
+        void Evict_();
+
+        std::deque<std::pair<std::string, std::string>> entries_;
+        size_t size_;
+        size_t maxSize_;
+    };
+
+    // 解码器
+    class Decoder {
+    public:
+        /// @param maxTableSize 本端 SETTINGS_HEADER_TABLE_SIZE(对端调整动态表不能超过它)
+        explicit Decoder(size_t maxTableSize = DEFAULT_TABLE_SIZE) : maxTableSize_(maxTableSize) {}
+
+        /// @brief 解码一个完整的首部块
+        /// @param data 首部块
+        /// @param len 长度
+        /// @param headers 解码结果(追加)
+        /// @return false-压缩错误(COMPRESSION_ERROR, 连接必须关闭)
+        bool Decode(const uint8_t* data, size_t len, HeaderList* headers);
+
+    private:
+        Table table_;
+        size_t maxTableSize_;
+    };
+
+    // 编码器
+    class Encoder {
+    public:
+        Encoder() : pendingResize_(false) {}
+
+        /// @brief 对端 SETTINGS_HEADER_TABLE_SIZE 变化(下一个首部块开头通知对端)
+        void SetMaxTableSize(size_t maxSize);
+
+        /// @brief 编码一个首部块
+        /// @param headers 首部(名字必须是小写)
+        /// @param out 编码结果(追加)
+        void Encode(const HeaderList& headers, std::string* out);
+
+    private:
+        Table table_;
+        bool pendingResize_;
+    };
+
+    /// @brief 整数编码(RFC 7541 5.1)
+    /// @param value 整数
+    /// @param prefixBits 前缀的比特数
+    /// @param flags 首字节中前缀以外的高位
+    static void EncodeInt(uint64_t value, int prefixBits, uint8_t flags, std::string* out);
+    /// @brief 整数解码
+    /// @param p 当前位置, 成功时向后移动
+    /// @return false-数据不完整或溢出
+    static bool DecodeInt(const uint8_t** p, const uint8_t* end, int prefixBits, uint64_t* value);
+
+    /// @brief 字符串编码, Huffman 编码更短时使用 Huffman
+    static void EncodeString(const std::string& s, std::string* out);
+    /// @brief 字符串解码
+    static bool DecodeString(const uint8_t** p, const uint8_t* end, std::string* s);
+
+    /// @brief Huffman 解码
+    /// @return false-编码错误(含 EOS 或填充非法)
+    static bool HuffmanDecode(const uint8_t* data, size_t len, std::string* out);
+    /// @brief Huffman 编码
+    static void HuffmanEncode(const std::string& s, std::string* out);
+    /// @brief Huffman 编码后的长度
+    static size_t HuffmanLength(const std::string& s);
+
+    Hpack() = delete;
+};
+
+
+#endif
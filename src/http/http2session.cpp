@@ -0,0 +1,725 @@
+#include "http2session.h"
+
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include "../log/logsite.h"
+#include "accesslog.h"
+
+
+namespace {
+
+const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t FRAME_HEADER_LEN = 9;
+const int64_t DEFAULT_WINDOW = 65535;
+const int64_t MAX_WINDOW = 0x7fffffff;
+const size_t MAX_PEER_FRAME = (1 << 24) - 1;
+
+inline uint32_t ReadUint32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline void AppendUint32(std::string* s, uint32_t v) {
+    s->push_back(static_cast<char>(v >> 24));
+    s->push_back(static_cast<char>(v >> 16));
+    s->push_back(static_cast<char>(v >> 8));
+    s->push_back(static_cast<char>(v));
+}
+
+// HTTP2-Settings 首部: base64url(不带填充)
+bool Base64UrlDecode(const std::string& in, std::string* out) {
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char ch : in) {
+        int v;
+        if (ch >= 'A' && ch <= 'Z') v = ch - 'A';
+        else if (ch >= 'a' && ch <= 'z') v = ch - 'a' + 26;
+        else if (ch >= '0' && ch <= '9') v = ch - '0' + 52;
+        else if (ch == '-' || ch == '+') v = 62;
+        else if (ch == '_' || ch == '/') v = 63;
+        else if (ch == '=') break;
+        else return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out->push_back(static_cast<char>((acc >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+}
+
+
+int Http2Session::MatchPreface(const char* data, size_t len) {
+    size_t n = std::min(len, PREFACE_LEN);
+    if (memcmp(data, PREFACE, n) != 0) {
+        return 0;
+    }
+    return n == PREFACE_LEN ? 1 : -1;
+}
+
+bool Http2Session::IsUpgrade(const HttpRequest& request) {
+    // 升级请求的请求体要按 HTTP/1.1 接收, 只接受没有请求体的 GET / HEAD
+    if ((request.methodId() != Router::GET && request.methodId() != Router::HEAD) || !request.BodyComplete()) {
+        return false;
+    }
+    return request.HasHeaderToken("Upgrade", "h2c") && !request.GetHeader("HTTP2-Settings").empty();
+}
+
+Http2Session::Http2Session(const char* srcDir, const std::string& ip, RateLimiter::Slot* limit)
+    : srcDir_(srcDir), ip_(ip), limit_(limit), prefaceReceived_(false), settingsSent_(false), goaway_(false),
+      lastStreamId_(0), pendingStream_(0), headerStream_(0), headerEndStream_(false),
+      connSendWindow_(DEFAULT_WINDOW), initialSendWindow_(DEFAULT_WINDOW), peerMaxFrame_(MAX_FRAME_SIZE),
+      connRecvConsumed_(0), resetWindowStart_(std::chrono::steady_clock::now()), resetCount_(0) {
+}
+
+void Http2Session::StartUpgrade(const HttpRequest& request, Buffer& out) {
+    const char SWITCHING[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    out.Append(SWITCHING, sizeof(SWITCHING) - 1);
+    WriteSettings_(out);
+
+    // HTTP2-Settings 相当于客户端的第一个 SETTINGS 帧, 由 101 隐式确认
+    std::string settings;
+    if (!Base64UrlDecode(request.GetHeader("HTTP2-Settings"), &settings) || settings.size() % 6 != 0) {
+        ConnectionError_(out, PROTOCOL_ERROR);
+        return;
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(settings.data());
+    for (size_t i = 0; i < settings.size(); i += 6) {
+        if (!ApplySetting_((p[i] << 8) | p[i + 1], ReadUint32(p + i + 2), out)) {
+            return;
+        }
+    }
+
+    // 升级请求成为半关闭的流 1
+    lastStreamId_ = 1;
+    Stream* stream = NewStream_(1, true);
+    stream->request = request;
+    Route_(stream, out);
+}
+
+Http2Session::Result Http2Session::Process(Buffer& in, Buffer& out) {
+    if (!settingsSent_) {
+        WriteSettings_(out);
+    }
+    if (!prefaceReceived_) {
+        int ret = MatchPreface(in.Peek(), in.ReadableBytes());
+        if (ret > 0) {
+            in.Retrieve(PREFACE_LEN);
+            prefaceReceived_ = true;
+        }
+        else if (ret == 0) {
+            ConnectionError_(out, PROTOCOL_ERROR);
+        }
+    }
+
+    // handler 挂起时不再处理后面的帧, 保证同一时刻只有一个线程使用会话
+    while (prefaceReceived_ && !IsClosing() && !pendingStream_ && in.ReadableBytes() >= FRAME_HEADER_LEN) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in.Peek());
+        size_t len = (static_cast<size_t>(p[0]) << 16) | (p[1] << 8) | p[2];
+        if (len > MAX_FRAME_SIZE) {
+            ConnectionError_(out, FRAME_SIZE_ERROR);
+            break;
+        }
+        if (in.ReadableBytes() < FRAME_HEADER_LEN + len) {
+            break;
+        }
+        OnFrame_(p[3], p[4], ReadUint32(p + 5) & 0x7fffffff, p + FRAME_HEADER_LEN, len, out);
+        in.Retrieve(FRAME_HEADER_LEN + len);
+    }
+
+    if (connRecvConsumed_ > 0 && !IsClosing()) {
+        WriteWindowUpdate_(out, 0, connRecvConsumed_);
+        connRecvConsumed_ = 0;
+    }
+    if (prefaceReceived_) {
+        // 升级时等收到客户端的前言再发送 DATA, 不让 101 后面紧跟大量数据
+        Pump_(out);
+    }
+    if (pendingStream_) {
+        return PENDING;
+    }
+    return out.ReadableBytes() > 0 ? WRITE : READ;
+}
+
+void Http2Session::ProcessPending(Buffer& out) {
+    auto it = streams_.find(pendingStream_);
+    pendingStream_ = 0;
+    if (it != streams_.end()) {
+        Stream* stream = it->second.get();
+        stream->handler->HandlePending(stream->request, stream->response);
+        Respond_(stream, out);
+    }
+    if (prefaceReceived_) {
+        Pump_(out);
+    }
+}
+
+void Http2Session::WriteSettings_(Buffer& out) {
+    std::string payload;
+    const uint16_t ids[] = {SETTINGS_MAX_CONCURRENT_STREAMS, SETTINGS_INITIAL_WINDOW_SIZE};
+    const uint32_t values[] = {MAX_CONCURRENT_STREAMS, static_cast<uint32_t>(RECV_WINDOW)};
+    for (size_t i = 0; i < 2; ++i) {
+        payload.push_back(static_cast<char>(ids[i] >> 8));
+        payload.push_back(static_cast<char>(ids[i]));
+        AppendUint32(&payload, values[i]);
+    }
+    WriteFrameHeader_(out, payload.size(), SETTINGS, 0, 0);
+    out.Append(payload);
+    // 连接窗口只能通过 WINDOW_UPDATE 调大
+    WriteWindowUpdate_(out, 0, static_cast<uint32_t>(RECV_WINDOW - DEFAULT_WINDOW));
+    settingsSent_ = true;
+}
+
+void Http2Session::OnFrame_(uint8_t type, uint8_t flags, uint32_t streamId,
+                            const uint8_t* payload, size_t len, Buffer& out) {
+    if (headerStream_ && (type != CONTINUATION || streamId != headerStream_)) {
+        // 首部块必须连续
+        ConnectionError_(out, PROTOCOL_ERROR);
+        return;
+    }
+    switch (type) {
+        case DATA:
+            OnData_(flags, streamId, payload, len, out);
+            break;
+        case HEADERS:
+        case CONTINUATION:
+            OnHeaders_(type, flags, streamId, payload, len, out);
+            break;
+        case PRIORITY:
+            // 不按优先级调度, 所有流轮流发送
+            if (streamId == 0 || len != 5) {
+                ConnectionError_(out, streamId == 0 ? PROTOCOL_ERROR : FRAME_SIZE_ERROR);
+            }
+            break;
+        case RST_STREAM:
+            if (streamId == 0 || streamId > lastStreamId_) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+            }
+            else if (len != 4) {
+                ConnectionError_(out, FRAME_SIZE_ERROR);
+            }
+            else if (streams_.erase(streamId) && !CountReset_()) {
+                // 没有 Finish 的 sink 析构时丢弃已写入的请求体.
+                // 不停地打开流再立即取消(rapid reset)能绕过并发流数的限制, 让服务器白白处理请求
+                LOG_EVERY_SEC(WARNING, 1) << "Client(" << ip_ << ") HTTP/2 rapid reset: " << resetCount_
+                                  << " streams cancelled in " << RESET_WINDOW_SEC << "s";
+                ConnectionError_(out, ENHANCE_YOUR_CALM);
+            }
+            break;
+        case SETTINGS:
+            if (streamId != 0) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+            }
+            else {
+                OnSettings_(flags, payload, len, out);
+            }
+            break;
+        case PING:
+            if (streamId != 0) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+            }
+            else if (len != 8) {
+                ConnectionError_(out, FRAME_SIZE_ERROR);
+            }
+            else if (!(flags & FLAG_ACK)) {
+                WriteFrameHeader_(out, 8, PING, FLAG_ACK, 0);
+                out.Append(payload, 8);
+            }
+            break;
+        case GOAWAY:
+            // 不再接受新的流, 正在发送的响应发完后关闭连接
+            if (streamId != 0 || len < 8) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+            }
+            else if (!goaway_) {
+                goaway_ = true;
+                WriteGoaway_(out, NO_ERROR);
+            }
+            break;
+        case WINDOW_UPDATE:
+            OnWindowUpdate_(streamId, payload, len, out);
+            break;
+        case PUSH_PROMISE:
+            // 客户端不能推送
+            ConnectionError_(out, PROTOCOL_ERROR);
+            break;
+        default:
+            // 未知类型的帧忽略
+            break;
+    }
+}
+
+void Http2Session::OnData_(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len, Buffer& out) {
+    if (streamId == 0 || streamId > lastStreamId_) {
+        ConnectionError_(out, PROTOCOL_ERROR);
+        return;
+    }
+    // 整个帧(含填充)都计入流量控制
+    size_t frameLen = len;
+    connRecvConsumed_ += frameLen;
+    if (flags & FLAG_PADDED) {
+        if (len < 1 || payload[0] >= len) {
+            ConnectionError_(out, PROTOCOL_ERROR);
+            return;
+        }
+        len -= 1 + payload[0];
+        ++payload;
+    }
+    auto it = streams_.find(streamId);
+    if (it == streams_.end() || it->second->remoteClosed) {
+        // 已经关闭(或被本端重置)的流, 丢弃
+        return;
+    }
+    Stream* stream = it->second.get();
+    if (!stream->responded && len > 0) {
+        HttpRequest::HTTP_CODE ret = stream->request.AppendBody(reinterpret_cast<const char*>(payload), len,
+                                                                stream->sink.get());
+        if (ret != HttpRequest::GET_REQUEST) {
+            // 提前响应, 剩下的请求体不再接收
+            int code = 413;
+            if (ret != HttpRequest::PAYLOAD_TOO_LARGE) {
+                code = stream->sink ? stream->sink->ErrorCode() : 500;
+            }
+            RespondError_(stream, code, out);
+            return;
+        }
+    }
+    if (flags & FLAG_END_STREAM) {
+        EndStream_(stream, out);
+    }
+    else if (frameLen > 0 && !stream->responded) {
+        WriteWindowUpdate_(out, streamId, frameLen);
+    }
+}
+
+void Http2Session::OnHeaders_(uint8_t type, uint8_t flags, uint32_t streamId,
+                              const uint8_t* payload, size_t len, Buffer& out) {
+    if (type == HEADERS) {
+        if (streamId == 0 || (streamId & 1) == 0) {
+            // 客户端只能使用奇数流号
+            ConnectionError_(out, PROTOCOL_ERROR);
+            return;
+        }
+        size_t padding = 0;
+        if (flags & FLAG_PADDED) {
+            if (len < 1) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+                return;
+            }
+            padding = payload[0];
+            ++payload;
+            --len;
+        }
+        if (flags & FLAG_PRIORITY) {
+            if (len < 5) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+                return;
+            }
+            payload += 5;
+            len -= 5;
+        }
+        if (padding > len) {
+            ConnectionError_(out, PROTOCOL_ERROR);
+            return;
+        }
+        headerBlock_.assign(reinterpret_cast<const char*>(payload), len - padding);
+        headerEndStream_ = (flags & FLAG_END_STREAM) != 0;
+    }
+    else {
+        if (!headerStream_) {
+            ConnectionError_(out, PROTOCOL_ERROR);
+            return;
+        }
+        headerBlock_.append(reinterpret_cast<const char*>(payload), len);
+    }
+
+    if (headerBlock_.size() > MAX_HEADER_BLOCK) {
+        ConnectionError_(out, ENHANCE_YOUR_CALM);
+        return;
+    }
+    if (flags & FLAG_END_HEADERS) {
+        headerStream_ = 0;
+        OnHeaderBlock_(streamId, headerEndStream_, out);
+    }
+    else {
+        headerStream_ = streamId;
+    }
+}
+
+void Http2Session::OnHeaderBlock_(uint32_t streamId, bool endStream, Buffer& out) {
+    // 即使流要被拒绝, 首部块也必须解码, 否则动态表会和对端不一致
+    Hpack::HeaderList headers;
+    bool ok = decoder_.Decode(reinterpret_cast<const uint8_t*>(headerBlock_.data()), headerBlock_.size(), &headers);
+    headerBlock_.clear();
+    if (!ok) {
+        ConnectionError_(out, COMPRESSION_ERROR);
+        return;
+    }
+
+    auto it = streams_.find(streamId);
+    if (it != streams_.end()) {
+        // 请求体之后的尾部首部(内容忽略), 必须结束流
+        Stream* stream = it->second.get();
+        if (!endStream || stream->remoteClosed) {
+            ConnectionError_(out, PROTOCOL_ERROR);
+            return;
+        }
+        EndStream_(stream, out);
+        return;
+    }
+    if (streamId <= lastStreamId_) {
+        // 已经结束(或被本端重置)的流
+        return;
+    }
+    lastStreamId_ = streamId;
+    if (goaway_) {
+        return;
+    }
+    if (streams_.size() >= MAX_CONCURRENT_STREAMS) {
+        WriteRstStream_(out, streamId, REFUSED_STREAM);
+        return;
+    }
+    Stream* stream = NewStream_(streamId, endStream);
+    if (!stream->request.InitHttp2(headers, endStream)) {
+        streams_.erase(streamId);
+        WriteRstStream_(out, streamId, PROTOCOL_ERROR);
+        return;
+    }
+    if (!RateLimiter::GetInstance()->AllowRequest(limit_)) {
+        // 超过这个 IP 的请求速率: 和 HTTP/1 的每个请求一样计数, 一条连接上多路复用的流不能绕过限流
+        // 只对这个流响应 429, 不路由, 连接上的其他流不受影响
+        stream->response.Init(srcDir_, stream->request.path(), true, 429);
+        stream->response.SetHeader("Retry-After", "1");
+        stream->response.SetContent("Too Many Requests\n", "text/plain");
+        Respond_(stream, out);
+        return;
+    }
+    Route_(stream, out);
+}
+
+bool Http2Session::CountReset_() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - resetWindowStart_ >= std::chrono::seconds(RESET_WINDOW_SEC)) {
+        resetWindowStart_ = now;
+        resetCount_ = 0;
+    }
+    return ++resetCount_ <= MAX_RESETS;
+}
+
+void Http2Session::OnSettings_(uint8_t flags, const uint8_t* payload, size_t len, Buffer& out) {
+    if (flags & FLAG_ACK) {
+        if (len != 0) {
+            ConnectionError_(out, FRAME_SIZE_ERROR);
+        }
+        return;
+    }
+    if (len % 6 != 0) {
+        ConnectionError_(out, FRAME_SIZE_ERROR);
+        return;
+    }
+    for (size_t i = 0; i < len; i += 6) {
+        if (!ApplySetting_((payload[i] << 8) | payload[i + 1], ReadUint32(payload + i + 2), out)) {
+            return;
+        }
+    }
+    WriteFrameHeader_(out, 0, SETTINGS, FLAG_ACK, 0);
+}
+
+bool Http2Session::ApplySetting_(uint16_t id, uint32_t value, Buffer& out) {
+    switch (id) {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            // 编码器的动态表不超过默认大小, 对端给得再大也不多占内存
+            encoder_.SetMaxTableSize(std::min<size_t>(value, Hpack::DEFAULT_TABLE_SIZE));
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+                return false;
+            }
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE: {
+            if (value > MAX_WINDOW) {
+                ConnectionError_(out, FLOW_CONTROL_ERROR);
+                return false;
+            }
+            // 已经打开的流按差值调整(可能变成负数)
+            int64_t delta = static_cast<int64_t>(value) - initialSendWindow_;
+            initialSendWindow_ = value;
+            for (auto& entry : streams_) {
+                entry.second->sendWindow += delta;
+            }
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < MAX_FRAME_SIZE || value > MAX_PEER_FRAME) {
+                ConnectionError_(out, PROTOCOL_ERROR);
+                return false;
+            }
+            peerMaxFrame_ = value;
+            break;
+        default:
+            // MAX_CONCURRENT_STREAMS(本端不推送)和未知参数忽略
+            break;
+    }
+    return true;
+}
+
+void Http2Session::OnWindowUpdate_(uint32_t streamId, const uint8_t* payload, size_t len, Buffer& out) {
+    if (len != 4) {
+        ConnectionError_(out, FRAME_SIZE_ERROR);
+        return;
+    }
+    uint32_t increment = ReadUint32(payload) & 0x7fffffff;
+    if (streamId == 0) {
+        if (increment == 0 || connSendWindow_ + increment > MAX_WINDOW) {
+            ConnectionError_(out, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+            return;
+        }
+        connSendWindow_ += increment;
+        return;
+    }
+    auto it = streams_.find(streamId);
+    if (it == streams_.end()) {
+        return;
+    }
+    Stream* stream = it->second.get();
+    if (increment == 0 || stream->sendWindow + increment > MAX_WINDOW) {
+        WriteRstStream_(out, streamId, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+        streams_.erase(it);
+        return;
+    }
+    stream->sendWindow += increment;
+}
+
+Http2Session::Stream* Http2Session::NewStream_(uint32_t streamId, bool endStream) {
+    std::unique_ptr<Stream> stream(new Stream());
+    stream->id = streamId;
+    stream->handler = nullptr;
+    stream->remoteClosed = endStream;
+    stream->responded = false;
+    stream->sendWindow = initialSendWindow_;
+    stream->data = nullptr;
+    stream->dataLeft = 0;
+    stream->bytesSent = 0;
+    stream->sampled = AccessLog::GetInstance()->ShouldSample();
+    if (stream->sampled) {
+        stream->start = std::chrono::steady_clock::now();
+    }
+    Stream* ret = stream.get();
+    streams_[streamId] = std::move(stream);
+    return ret;
+}
+
+void Http2Session::Route_(Stream* stream, Buffer& out) {
+    HttpRequest& request = stream->request;
+    HttpResponse& response = stream->response;
+    response.Init(srcDir_, request.path(), true, 200);
+    response.SetAcceptGzip(request.AcceptsGzip());
+
+    uint32_t allow = 0;
+    switch (Router::GetInstance()->Match(request.methodId(), request.path(), &stream->handler, &stream->params, &allow)) {
+        case Router::NOT_FOUND:
+            response.SetCode(404);
+            Respond_(stream, out);
+            return;
+        case Router::METHOD_NOT_ALLOWED:
+            response.SetCode(405);
+            response.SetHeader("Allow", Router::AllowHeader(allow));
+            Respond_(stream, out);
+            return;
+        default:
+            break;
+    }
+    if (stream->remoteClosed) {
+        Dispatch_(stream, out);
+        return;
+    }
+    stream->sink = stream->handler->OpenBody(request, stream->params, response);
+    if (response.Code() >= 400) {
+        stream->sink.reset();
+        Respond_(stream, out);
+        return;
+    }
+    // content-length 是可选的, 有的话提前检查上限
+    size_t limit = stream->sink ? stream->sink->Limit() : HttpRequest::maxBodyBytes;
+    std::string length = request.GetHeader("Content-Length");
+    if (!length.empty() && strtoull(length.c_str(), nullptr, 10) > limit) {
+        RespondError_(stream, 413, out);
+    }
+}
+
+void Http2Session::EndStream_(Stream* stream, Buffer& out) {
+    stream->remoteClosed = true;
+    if (stream->responded) {
+        // 已经提前响应, 请求体丢弃
+        return;
+    }
+    if (stream->sink && !stream->sink->Finish()) {
+        RespondError_(stream, stream->sink->ErrorCode(), out);
+        return;
+    }
+    stream->request.EndBody(stream->sink.get());
+    Dispatch_(stream, out);
+}
+
+void Http2Session::Dispatch_(Stream* stream, Buffer& out) {
+    if (stream->handler->Handle(stream->request, stream->params, stream->response) == HttpHandler::PENDING) {
+        // handler 需要查数据库: 由 SQL 线程调用 ProcessPending 继续
+        pendingStream_ = stream->id;
+        return;
+    }
+    Respond_(stream, out);
+}
+
+void Http2Session::RespondError_(Stream* stream, int code, Buffer& out) {
+    stream->sink.reset();
+    stream->response.Init(srcDir_, stream->request.path(), true, code);
+    Respond_(stream, out);
+}
+
+void Http2Session::Respond_(Stream* stream, Buffer& out) {
+    stream->responded = true;
+    stream->sink.reset();
+
+    Hpack::HeaderList headers;
+    stream->response.MakeHttp2Response(&headers, &stream->inlineBody);
+    std::string block;
+    encoder_.Encode(headers, &block);
+
+    const char* data = stream->inlineBody.empty() ? stream->response.File() : stream->inlineBody.data();
+    size_t dataLen = stream->inlineBody.empty() ? stream->response.FileLen() : stream->inlineBody.size();
+    if (stream->request.methodId() == Router::HEAD) {
+        dataLen = 0;
+    }
+
+    // 首部块超过对端的最大帧时用 CONTINUATION 接着发
+    uint8_t type = HEADERS;
+    uint8_t endStream = dataLen == 0 ? FLAG_END_STREAM : 0;
+    size_t pos = 0;
+    do {
+        size_t n = std::min(block.size() - pos, peerMaxFrame_);
+        uint8_t flags = (type == HEADERS ? endStream : 0) | (pos + n == block.size() ? FLAG_END_HEADERS : 0);
+        WriteFrameHeader_(out, n, type, flags, stream->id);
+        out.Append(block.data() + pos, n);
+        pos += n;
+        type = CONTINUATION;
+    } while (pos < block.size());
+
+    if (dataLen == 0) {
+        FinishStream_(stream, out);
+        return;
+    }
+    stream->data = data;
+    stream->dataLeft = dataLen;
+    sending_.push_back(stream->id);
+}
+
+void Http2Session::Pump_(Buffer& out) {
+    // 每轮每个流最多发一帧, 写缓冲区到达上限或连接窗口用完时停下, 写完后再继续
+    while (!sending_.empty() && connSendWindow_ > 0 && out.ReadableBytes() < OUTPUT_HIGH_WATER) {
+        bool progress = false;
+        for (size_t i = sending_.size(); i > 0 && connSendWindow_ > 0 && out.ReadableBytes() < OUTPUT_HIGH_WATER; --i) {
+            uint32_t id = sending_.front();
+            sending_.pop_front();
+            auto it = streams_.find(id);
+            if (it == streams_.end()) {
+                // 已经被重置
+                continue;
+            }
+            Stream* stream = it->second.get();
+            if (stream->sendWindow <= 0) {
+                // 等待这个流的 WINDOW_UPDATE
+                sending_.push_back(id);
+                continue;
+            }
+            size_t n = std::min({stream->dataLeft, static_cast<size_t>(stream->sendWindow),
+                                 static_cast<size_t>(connSendWindow_), peerMaxFrame_});
+            bool last = (n == stream->dataLeft);
+            WriteFrameHeader_(out, n, DATA, last ? FLAG_END_STREAM : 0, id);
+            out.Append(stream->data, n);
+            stream->data += n;
+            stream->dataLeft -= n;
+            stream->bytesSent += n;
+            stream->sendWindow -= n;
+            connSendWindow_ -= n;
+            progress = true;
+            if (last) {
+                FinishStream_(stream, out);
+            }
+            else {
+                sending_.push_back(id);
+            }
+        }
+        if (!progress) {
+            break;
+        }
+    }
+}
+
+void Http2Session::FinishStream_(Stream* stream, Buffer& out) {
+    if (!stream->remoteClosed) {
+        // 不等剩下的请求体了(RFC 7540 8.1)
+        WriteRstStream_(out, stream->id, NO_ERROR);
+    }
+    if (stream->sampled) {
+        AccessRecord access;
+        access.ip = ip_;
+        access.method = stream->request.method();
+        access.path = stream->request.path();
+        access.version = stream->request.version();
+        access.referer = stream->request.GetHeader("Referer");
+        access.userAgent = stream->request.GetHeader("User-Agent");
+        access.status = stream->response.Code();
+        access.bytes = stream->bytesSent;
+        access.latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - stream->start).count();
+        access.when = time(nullptr) - access.latencyUs / 1000000;
+        AccessLog::GetInstance()->Record(access);
+    }
+    streams_.erase(stream->id);
+}
+
+void Http2Session::WriteFrameHeader_(Buffer& out, size_t len, uint8_t type, uint8_t flags, uint32_t streamId) {
+    uint8_t header[FRAME_HEADER_LEN] = {
+        static_cast<uint8_t>(len >> 16), static_cast<uint8_t>(len >> 8), static_cast<uint8_t>(len),
+        type, flags,
+        static_cast<uint8_t>(streamId >> 24), static_cast<uint8_t>(streamId >> 16),
+        static_cast<uint8_t>(streamId >> 8), static_cast<uint8_t>(streamId),
+    };
+    out.Append(header, sizeof(header));
+}
+
+void Http2Session::WriteRstStream_(Buffer& out, uint32_t streamId, uint32_t code) {
+    std::string payload;
+    AppendUint32(&payload, code);
+    WriteFrameHeader_(out, payload.size(), RST_STREAM, 0, streamId);
+    out.Append(payload);
+}
+
+void Http2Session::WriteWindowUpdate_(Buffer& out, uint32_t streamId, uint32_t increment) {
+    std::string payload;
+    AppendUint32(&payload, increment);
+    WriteFrameHeader_(out, payload.size(), WINDOW_UPDATE, 0, streamId);
+    out.Append(payload);
+}
+
+void Http2Session::WriteGoaway_(Buffer& out, uint32_t code) {
+    std::string payload;
+    AppendUint32(&payload, lastStreamId_);
+    AppendUint32(&payload, code);
+    WriteFrameHeader_(out, payload.size(), GOAWAY, 0, 0);
+    out.Append(payload);
+}
+
+void Http2Session::ConnectionError_(Buffer& out, uint32_t code) {
+    LOG_EVERY_SEC(WARNING, 1) << "Client(" << ip_ << ") HTTP/2 connection error " << code;
+    WriteGoaway_(out, code);
+    goaway_ = true;
+    streams_.clear();
+    sending_.clear();
+    headerStream_ = 0;
+}
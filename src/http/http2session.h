@@ -0,0 +1,210 @@
+/*
+    HTTP/2 明文连接(h2c, RFC 7540)
+
+    两种开始方式: 连接以 HTTP/2 前言开头(prior knowledge), 或者 HTTP/1.1 请求带 "Upgrade: h2c"
+    (回复 101 后, 该请求成为流 1).
+    每个流有自己的 HttpRequest / HttpResponse, 路由、handler、请求体 sink、静态文件查找与 HTTP/1 完全相同,
+    只是响应首部用 HPACK 编码、内容切成 DATA 帧.
+    多个流的 DATA 帧轮流发送, 受连接和流两级发送窗口限制; 收到的 DATA 处理后立即归还窗口.
+    一次 Process 最多向写缓冲区放 OUTPUT_HIGH_WATER 字节, 写完后再继续, 连接的内存占用有上限.
+    会话只在持有连接的线程中使用(EPOLLONESHOT 保证), 不加锁.
+*/
+
+#ifndef HTTP2_SESSION_H
+#define HTTP2_SESSION_H
+
+#include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <stdint.h>
+#include "../buffer/buffer.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "router.h"
+#include "hpack.h"
+#include "../pool/ratelimiter.h"
+
+class Http2Session {
+public:
+    // Process 的结果
+    enum Result {
+        READ = 0,   // 等待更多数据
+        WRITE,      // 写缓冲区中有要发送的帧
+        PENDING,    // 有流的 handler 需要在 SQL 线程中继续(见 ProcessPending)
+    };
+
+    static const size_t PREFACE_LEN = 24;
+    static const size_t MAX_FRAME_SIZE = 16384;             // 本端接收的最大帧
+    static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+    static const int64_t RECV_WINDOW = 1 << 20;             // 本端的流/连接接收窗口
+    static const size_t MAX_HEADER_BLOCK = 64 * 1024;       // HEADERS + CONTINUATION 的上限
+    static const size_t OUTPUT_HIGH_WATER = 256 * 1024;
+    static const uint32_t MAX_RESETS = 200;                 // 一个统计窗口内允许对端取消的流数(超过视为 rapid reset 攻击)
+    static const int RESET_WINDOW_SEC = 10;                 // 统计对端 RST_STREAM 的窗口
+
+    /// @brief 连接开头的数据是否是 HTTP/2 连接前言
+    /// @return 1-是, 0-不是, -1-数据不够判断
+    static int MatchPreface(const char* data, size_t len);
+
+    /// @brief HTTP/1.1 请求是否要求升级到 h2c(只接受没有请求体的 GET/HEAD)
+    static bool IsUpgrade(const HttpRequest& request);
+
+    /// @param srcDir 资源目录
+    /// @param ip 客户端地址(访问日志用)
+    /// @param limit 客户端 IP 的限流槽(每个新的流取一个令牌, nullptr 时不限制)
+    Http2Session(const char* srcDir, const std::string& ip, RateLimiter::Slot* limit);
+
+    /// @brief 由 HTTP/1.1 Upgrade 开始: 写入 101 和本端 SETTINGS, 原请求成为流 1
+    /// @param request 解析完成的升级请求
+    /// @param out 写缓冲区
+    void StartUpgrade(const HttpRequest& request, Buffer& out);
+
+    /// @brief 处理读缓冲区中完整的帧, 并把要发送的帧写入 out
+    /// @param in 读缓冲区
+    /// @param out 写缓冲区
+    /// @return 结果
+    Result Process(Buffer& in, Buffer& out);
+
+    /// @brief 在 SQL 线程中继续挂起的流, 并写入它的响应
+    /// @param out 写缓冲区
+    void ProcessPending(Buffer& out);
+
+    /// @brief 连接是否要关闭(发出或收到 GOAWAY, 且没有在发送的流)
+    bool IsClosing() const {
+        return goaway_ && streams_.empty();
+    }
+
+private:
+    enum FrameType {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9,
+    };
+
+    enum Flag {
+        FLAG_END_STREAM = 0x1,
+        FLAG_ACK = 0x1,
+        FLAG_END_HEADERS = 0x4,
+        FLAG_PADDED = 0x8,
+        FLAG_PRIORITY = 0x20,
+    };
+
+    enum ErrorCode {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        COMPRESSION_ERROR = 0x9,
+        ENHANCE_YOUR_CALM = 0xb,
+    };
+
+    enum Setting {
+        SETTINGS_HEADER_TABLE_SIZE = 0x1,
+        SETTINGS_ENABLE_PUSH = 0x2,
+        SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+        SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+        SETTINGS_MAX_FRAME_SIZE = 0x5,
+    };
+
+    struct Stream {
+        uint32_t id;
+        HttpRequest request;
+        HttpResponse response;
+        HttpHandler* handler;
+        RouteParams params;
+        std::unique_ptr<BodySink> sink;
+        bool remoteClosed;      // 收到了 END_STREAM
+        bool responded;         // 已经发出响应首部(之后收到的请求体丢弃)
+        int64_t sendWindow;
+        std::string inlineBody; // 不是文件的响应内容
+        const char* data;       // 还没发送的响应内容
+        size_t dataLeft;
+        size_t bytesSent;
+        bool sampled;           // 是否记录访问日志
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void WriteSettings_(Buffer& out);
+    /// @brief 处理一个帧
+    void OnFrame_(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len, Buffer& out);
+    void OnData_(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len, Buffer& out);
+    void OnHeaders_(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len, Buffer& out);
+    void OnSettings_(uint8_t flags, const uint8_t* payload, size_t len, Buffer& out);
+    void OnWindowUpdate_(uint32_t streamId, const uint8_t* payload, size_t len, Buffer& out);
+    /// @brief 首部块接收完整
+    void OnHeaderBlock_(uint32_t streamId, bool endStream, Buffer& out);
+    /// @brief 记录一次对端取消流(RST_STREAM)
+    /// @return false-统计窗口内取消的流超过 MAX_RESETS
+    bool CountReset_();
+    /// @brief 应用一个 SETTINGS 参数
+    /// @return false-参数值非法(已发出 GOAWAY)
+    bool ApplySetting_(uint16_t id, uint32_t value, Buffer& out);
+
+    /// @brief 建立新的流
+    /// @param endStream 首部块之后没有请求体
+    Stream* NewStream_(uint32_t streamId, bool endStream);
+    /// @brief 首部解析完成: 路由并决定请求体的去处, 没有请求体时直接交给 handler
+    void Route_(Stream* stream, Buffer& out);
+    /// @brief 收到 END_STREAM
+    void EndStream_(Stream* stream, Buffer& out);
+    /// @brief 请求体接收完整, 交给 handler
+    void Dispatch_(Stream* stream, Buffer& out);
+    /// @brief 写入响应首部, 内容交给 Pump_ 发送
+    void Respond_(Stream* stream, Buffer& out);
+    /// @brief 直接用错误码响应
+    void RespondError_(Stream* stream, int code, Buffer& out);
+    /// @brief 按窗口轮流发送各个流的 DATA
+    void Pump_(Buffer& out);
+    /// @brief 响应发送完毕, 删除流
+    void FinishStream_(Stream* stream, Buffer& out);
+
+    void WriteFrameHeader_(Buffer& out, size_t len, uint8_t type, uint8_t flags, uint32_t streamId);
+    void WriteRstStream_(Buffer& out, uint32_t streamId, uint32_t code);
+    void WriteWindowUpdate_(Buffer& out, uint32_t streamId, uint32_t increment);
+    void WriteGoaway_(Buffer& out, uint32_t code);
+    /// @brief 连接错误: 发出 GOAWAY, 丢弃所有流
+    void ConnectionError_(Buffer& out, uint32_t code);
+
+private:
+    std::string srcDir_;
+    std::string ip_;
+    RateLimiter::Slot* limit_;
+    bool prefaceReceived_;
+    bool settingsSent_;
+    bool goaway_;
+
+    Hpack::Decoder decoder_;
+    Hpack::Encoder encoder_;
+
+    std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+    std::deque<uint32_t> sending_;  // 有内容要发送的流, 轮流发送
+    uint32_t lastStreamId_;         // 对端打开过的最大流号
+    uint32_t pendingStream_;        // 挂起的流(0 表示没有)
+
+    uint32_t headerStream_;         // 正在接收 CONTINUATION 的流(0 表示没有)
+    bool headerEndStream_;
+    std::string headerBlock_;
+
+    int64_t connSendWindow_;
+    int64_t initialSendWindow_;     // 对端的 SETTINGS_INITIAL_WINDOW_SIZE
+    size_t peerMaxFrame_;           // 对端的 SETTINGS_MAX_FRAME_SIZE
+    uint32_t connRecvConsumed_;     // 已经处理、还没通过 WINDOW_UPDATE 归还的连接窗口
+
+    std::chrono::steady_clock::time_point resetWindowStart_;
+    uint32_t resetCount_;           // 当前窗口内对端取消的、还没有响应完的流数
+};
+
+
+#endif
@@ -1,41 +1,89 @@
 #include "httpconn.h"
 
+#include <fcntl.h>
+#include <sys/socket.h>
+
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
 
-HttpConn::HttpConn(): fd_(-1), isClose_(true) {
+HttpConn::HttpConn(): fd_(-1), isClose_(true), busy_(false), closeRequested_(false), pending_(false), phase_(IDLE), handler_(nullptr), limit_(nullptr),
+                      accessSampled_(false), responseBytes_(0) {
     memset(&addr_, 0, sizeof(addr_));
+    pipe_[0] = pipe_[1] = -1;
 }
 
 HttpConn::~HttpConn() {
     Close();
 }
 
-void HttpConn::Init(int sockFd, const sockaddr_in& addr) {
+void HttpConn::Init(int sockFd, const sockaddr_in& addr, RateLimiter::Slot* limit) {
     assert(sockFd > 0);
     userCount++;
     addr_ = addr;
     fd_ = sockFd;
+    limit_ = limit;
     // <fd>:<ip>:<port>
     timeOutKey = std::to_string(fd_) + ":" + GetIP() + ":" + std::to_string(GetPort());
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    phase_ = IDLE;
+    h2_.reset();
+    push_.reset();
+    proxy_.reset();
+    tls_.reset(TlsContext::GetInstance()->Enabled() ? new TlsSession(fd_) : nullptr);
+    busy_ = false;
+    closeRequested_ = false;
     isClose_ = false;
-    LOG(INFO) << "Client[" << fd_ << "](" << GetIP() << ":" << GetPort() << ") connected, userCount:" << userCount.load();
+    LOG_EVERY_SEC(INFO, 1) << "Client[" << fd_ << "](" << GetIP() << ":" << GetPort() << ") connected, userCount:" << userCount.load();
 }
 
 void HttpConn::Close() {
     response_.UnmapFile();   // ******** 重点 ********
-    if (isClose_ == false) {
-        isClose_ = true;
+    StopSplice_();
+    bodySink_.reset();       // 没接收完的请求体(上传的临时文件)被丢弃
+    TakeProxy_();            // 没转发完的上游连接被关闭(正在推进的工作线程持有副本时, 由它释放)
+    if (push_) {
+        // 在关闭 fd 之前, 之后的广播不再注册这个 fd 的事件
+        push_->Shutdown();
+    }
+    if (isClose_.exchange(true) == false) {
         userCount--;
-        LOG(INFO) << "Client[" << fd_ << "](" << GetIP() << ":" << GetPort() << ") disconnected, userCount:" << userCount.load();
+        LOG_EVERY_SEC(INFO, 1) << "Client[" << fd_ << "](" << GetIP() << ":" << GetPort() << ") disconnected, userCount:" << userCount.load();
+        if (tls_) {
+            tls_->Shutdown();
+        }
+        RateLimiter::GetInstance()->ReleaseConn(limit_);
+        limit_ = nullptr;
         close(fd_);
         fd_ = -1;  // 重新置为 -1
     }
 }
 
+bool HttpConn::BeginTask() {
+    std::lock_guard<std::mutex> lk(taskMtx_);
+    if (closeRequested_ || busy_ || isClose_) {
+        return false;
+    }
+    busy_ = true;
+    return true;
+}
+
+bool HttpConn::CheckPushStall() {
+    std::lock_guard<std::mutex> lk(taskMtx_);
+    // push_ 只在任务中设置, 没有任务时在任务锁内读取是安全的
+    return !busy_ && !isClose_ && push_ && push_->CheckStall();
+}
+
+bool HttpConn::RequestClose() {
+    std::lock_guard<std::mutex> lk(taskMtx_);
+    if (closeRequested_ || isClose_) {
+        return false;
+    }
+    closeRequested_ = true;
+    return !busy_;
+}
+
 int HttpConn::GetFd() const {
     return fd_;
 }
@@ -53,12 +101,14 @@ sockaddr_in HttpConn::GetAddr() const {
 }
 
 ssize_t HttpConn::Write(int* saveErrno) {
+    if (push_) {
+        return push_->Flush(saveErrno);
+    }
     ssize_t len = -1;
     do {
         // 多缓冲区写
-        len = writev(fd_, iov_, iovCnt_);
+        len = Writev_(iov_, iovCnt_, saveErrno);
         if (len <= 0) {
-            *saveErrno = errno;
             break;
         }
 
@@ -89,24 +139,86 @@ ssize_t HttpConn::Write(int* saveErrno) {
     return len;
 }
 
+ssize_t HttpConn::Writev_(const struct iovec* iov, int cnt, int* saveErrno) {
+    if (tls_) {
+        return tls_->Writev(iov, cnt, saveErrno);
+    }
+    ssize_t len = writev(fd_, iov, cnt);
+    if (len <= 0) {
+        *saveErrno = errno;
+    }
+    return len;
+}
+
 ssize_t HttpConn::Read(int* saveErrno) {
+    if (pipe_[0] >= 0) {
+        return SpliceBody_(saveErrno);
+    }
     ssize_t len = -1;
     do {
-        // 一次过读取
-        len = readBuff_.ReadFd(fd_, saveErrno);
+        // 一次过读取, 缓冲区攒到上限时先交给 Process 消费(EPOLLONESHOT 重新注册后会继续触发)
+        len = tls_ ? tls_->Read(readBuff_, saveErrno) : readBuff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
-    } while (isET);
+    } while (isET && readBuff_.ReadableBytes() < MAX_READ_BUFFER);
     return len;
 }
 
+ssize_t HttpConn::SpliceBody_(int* saveErrno) {
+    // socket -> 管道 -> 文件, 数据只在内核中移动
+    int fileFd = bodySink_->Fd();
+    ssize_t total = 0;
+    do {
+        size_t want = std::min(request_.BodyRemaining(), SPLICE_CHUNK);
+        ssize_t len = splice(fd_, nullptr, pipe_[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (len <= 0) {
+            if (len < 0) {
+                *saveErrno = errno;
+            }
+            return total > 0 ? total : len;
+        }
+        for (ssize_t left = len; left > 0; ) {
+            ssize_t n = splice(pipe_[0], nullptr, fileFd, nullptr, left, SPLICE_F_MOVE);
+            if (n <= 0) {
+                // 写文件失败(如磁盘满): 管道里还有数据, 只能断开连接
+                *saveErrno = (n < 0) ? errno : EIO;
+                CLOG(WARNING) << "Client[" << fd_ << "] splice body to file failed: " << strerror(*saveErrno);
+                return -1;
+            }
+            left -= n;
+        }
+        request_.ConsumeBody(len);
+        total += len;
+    } while (isET && request_.BodyRemaining() > 0);
+    return total;
+}
+
+void HttpConn::StopSplice_() {
+    if (pipe_[0] >= 0) {
+        close(pipe_[0]);
+        close(pipe_[1]);
+        pipe_[0] = pipe_[1] = -1;
+    }
+}
+
 int HttpConn::ToWriteBytes() {
     return iov_[0].iov_len + iov_[1].iov_len;
 }
 
+bool HttpConn::IsReceivingBody() const {
+    return phase_ == BODY && !proxy_;
+}
+
 bool HttpConn::IsKeepAlive() const {
-    return request_.IsKeepAlive();
+    if (push_) {
+        return !push_->ShouldClose();
+    }
+    if (h2_) {
+        return !h2_->IsClosing();
+    }
+    // 请求出错(如请求体没有读完)时响应会关闭连接
+    return response_.IsKeepAlive();
 }
 
 bool HttpConn::Process() {
@@ -117,19 +229,263 @@ bool HttpConn::Process() {
     写:
         直接返回false
     */ 
-    request_.Init();
-    if (readBuff_.ReadableBytes() <= 0) {
-        // 没有读取到数据
+    if (push_) {
+        push_->Process(readBuff_);
         return false;
     }
-    else if (request_.parse(readBuff_)) {
-        // LOG_DEBUG("Request path: %s", request_.path().c_str());
+    if (h2_) {
+        return ProcessHttp2_(h2_->Process(readBuff_, writeBuff_));
+    }
+    if (phase_ == IDLE) {
+        if (readBuff_.ReadableBytes() <= 0) {
+            // 没有读取到数据
+            return false;
+        }
+        int preface = Http2Session::MatchPreface(readBuff_.Peek(), readBuff_.ReadableBytes());
+        if (preface < 0) {
+            // 可能是 HTTP/2 前言的开头, 等待更多数据
+            return false;
+        }
+        if (preface > 0) {
+            h2_.reset(new Http2Session(srcDir, GetIP(), limit_));
+            return ProcessHttp2_(h2_->Process(readBuff_, writeBuff_));
+        }
+        if (!RateLimiter::GetInstance()->AllowRequest(limit_)) {
+            // 超过这个 IP 的请求速率: 不解析请求, 发送预先生成的 429 后关闭连接
+            readBuff_.RetrieveAll();
+            accessSampled_ = false;
+            response_.SetKeepAlive(false);
+            writeBuff_.Append(RateLimiter::RESPONSE_429, RateLimiter::RESPONSE_429_LEN);
+            iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
+            iov_[0].iov_len = writeBuff_.ReadableBytes();
+            iov_[1].iov_len = 0;
+            iovCnt_ = 1;
+            return true;
+        }
+        request_.Init();
+        phase_ = HEADER;
+        accessSampled_ = AccessLog::GetInstance()->ShouldSample();
+        if (accessSampled_) {
+            reqStart_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    if (phase_ == HEADER) {
+        HttpRequest::HTTP_CODE ret = request_.parse(readBuff_);
+        if (ret == HttpRequest::NO_REQUEST) {
+            // 首部还不完整, 等待更多数据
+            return false;
+        }
+        if (ret != HttpRequest::GET_REQUEST) {
+            return Reject_(400);
+        }
+        if (Http2Session::IsUpgrade(request_)) {
+            // 101 之后按 HTTP/2 继续, 这个请求成为流 1
+            phase_ = IDLE;
+            accessSampled_ = false;
+            h2_.reset(new Http2Session(srcDir, GetIP(), limit_));
+            h2_->StartUpgrade(request_, writeBuff_);
+            return ProcessHttp2_(h2_->Process(readBuff_, writeBuff_));
+        }
         response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        response_.SetAcceptGzip(request_.AcceptsGzip());
+        if (!Route_()) {
+            if (!request_.BodyComplete()) {
+                // 不接收请求体: 响应后关闭连接
+                response_.SetKeepAlive(false);
+            }
+            MakeResponse_();
+            return true;
+        }
+        WebSocketHandler* wsHandler = nullptr;
+        if (WebSocket::IsUpgrade(request_) && (wsHandler = dynamic_cast<WebSocketHandler*>(handler_))) {
+            int code = wsHandler->Accept(request_);
+            if (code != 0) {
+                return Reject_(code);
+            }
+            // 101 放入 WebSocket 的发送队列, 之后不再按 HTTP 处理
+            phase_ = IDLE;
+            handler_ = nullptr;
+            accessSampled_ = false;
+            std::shared_ptr<WebSocket> ws = std::make_shared<WebSocket>(fd_, wsHandler, limit_);
+            push_ = ws;
+            push_->SetTls(tls_.get());
+            ws->Open(request_);
+            return false;
+        }
+        EventStreamHandler* sseHandler = nullptr;
+        if (EventStream::Accepts(request_) && (sseHandler = dynamic_cast<EventStreamHandler*>(handler_))) {
+            // 响应首部放入事件流的发送队列, 之后的事件由 handler 追加
+            phase_ = IDLE;
+            handler_ = nullptr;
+            accessSampled_ = false;
+            std::shared_ptr<EventStream> stream = std::make_shared<EventStream>(fd_, sseHandler);
+            push_ = stream;
+            push_->SetTls(tls_.get());
+            stream->Open(request_);
+            return false;
+        }
+        phase_ = BODY;
+        if (!request_.BodyComplete() && readBuff_.ReadableBytes() == 0 && request_.ExpectsContinue()) {
+            // 客户端在等待确认才发送请求体: 和响应一样经过写缓冲区发送(支持 TLS 和部分写),
+            // 写完后仍处于 BODY 阶段, 继续接收请求体
+            static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            writeBuff_.Append(CONTINUE, sizeof(CONTINUE) - 1);
+            iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
+            iov_[0].iov_len = writeBuff_.ReadableBytes();
+            iov_[1].iov_len = 0;
+            iovCnt_ = 1;
+            return true;
+        }
+    }
+
+    HttpRequest::HTTP_CODE ret = request_.ParseBody(readBuff_, bodySink_.get());
+    switch (ret) {
+        case HttpRequest::NO_REQUEST:
+            if (!tls_ && pipe_[0] < 0 && bodySink_ && bodySink_->Fd() >= 0 && request_.BodyRemaining() > 0) {
+                // 读缓冲区里的部分已经写入, 剩下的请求体直接从 socket splice 到文件
+                if (pipe2(pipe_, O_CLOEXEC) < 0) {
+                    pipe_[0] = pipe_[1] = -1;
+                }
+            }
+            return false;
+        case HttpRequest::GET_REQUEST:
+            break;
+        case HttpRequest::PAYLOAD_TOO_LARGE:
+            return Reject_(413);
+        case HttpRequest::INTERNAL_ERROR:
+            return Reject_(bodySink_ ? bodySink_->ErrorCode() : 500);
+        default:
+            return Reject_(400);
+    }
+    StopSplice_();
+    if (bodySink_ && !bodySink_->Finish()) {
+        return Reject_(bodySink_->ErrorCode());
+    }
+    return Dispatch_();
+}
+
+bool HttpConn::ProcessPending() {
+    if (h2_) {
+        assert(pending_);
+        h2_->ProcessPending(writeBuff_);
+        pending_ = false;
+        return isClose_ ? false : ProcessHttp2_(Http2Session::WRITE);
+    }
+    assert(pending_ && handler_);
+    handler_->HandlePending(request_, response_);
+    handler_ = nullptr;
+    pending_ = false;
+    if (isClose_) {
+        return false;
+    }
+    MakeResponse_();
+    return true;
+}
+
+bool HttpConn::Route_() {
+    uint32_t allow = 0;
+    params_ = RouteParams();
+    switch (Router::GetInstance()->Match(request_.methodId(), request_.path(), &handler_, &params_, &allow)) {
+        case Router::NOT_FOUND:
+            response_.SetCode(404);
+            return false;
+        case Router::METHOD_NOT_ALLOWED:
+            response_.SetCode(405);
+            response_.SetHeader("Allow", Router::AllowHeader(allow));
+            return false;
+        default:
+            break;
+    }
+    if (!request_.BodyComplete()) {
+        bodySink_ = handler_->OpenBody(request_, params_, response_);
+        if (response_.Code() >= 400) {
+            bodySink_.reset();
+            return false;
+        }
+        size_t limit = bodySink_ ? bodySink_->Limit() : HttpRequest::maxBodyBytes;
+        if (request_.BodyRemaining() > limit) {
+            // Content-Length 已经超过上限, 不用等到接收时才拒绝
+            response_.SetCode(413);
+            bodySink_.reset();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HttpConn::Dispatch_() {
+    ProxyHandler* proxy = dynamic_cast<ProxyHandler*>(handler_);
+    if (proxy) {
+        // 由 WebServer 推进转发, 响应直接从上游写到客户端
+        std::shared_ptr<ProxyExchange> exchange = std::make_shared<ProxyExchange>(proxy, request_, GetIP(), fd_, tls_.get());
+        {
+            std::lock_guard<std::mutex> lk(taskMtx_);
+            proxy_ = exchange;
+        }
+        handler_ = nullptr;
+        bodySink_.reset();
+        return false;
     }
-    else {
-        response_.Init(srcDir, request_.path(), false, 400);
+    if (handler_->Handle(request_, params_, response_) == HttpHandler::PENDING) {
+        // handler 需要查数据库: 挂起, 由 SQL 线程调用 ProcessPending 继续
+        pending_ = true;
+        return false;
     }
+    MakeResponse_();
+    return true;
+}
 
+bool HttpConn::Reject_(int code) {
+    StopSplice_();
+    bodySink_.reset();
+    handler_ = nullptr;
+    response_.Init(srcDir, request_.path(), false, code);
+    MakeResponse_();
+    return true;
+}
+
+std::shared_ptr<ProxyExchange> HttpConn::GetProxy() {
+    std::lock_guard<std::mutex> lk(taskMtx_);
+    return proxy_;
+}
+
+std::shared_ptr<ProxyExchange> HttpConn::TakeProxy_() {
+    std::lock_guard<std::mutex> lk(taskMtx_);
+    std::shared_ptr<ProxyExchange> proxy;
+    proxy.swap(proxy_);
+    return proxy;
+}
+
+void HttpConn::EndProxy(bool keepAlive) {
+    std::shared_ptr<ProxyExchange> proxy = TakeProxy_();
+    assert(proxy);
+    phase_ = IDLE;
+    iov_[0].iov_len = iov_[1].iov_len = 0;
+    iovCnt_ = 0;
+    responseBytes_ = proxy->Bytes();
+    response_.SetKeepAlive(keepAlive);
+    if (accessSampled_) {
+        access_.method = request_.method();
+        access_.path = request_.path();
+        access_.version = request_.version();
+        access_.referer = request_.GetHeader("Referer");
+        access_.userAgent = request_.GetHeader("User-Agent");
+        access_.status = proxy->StatusCode();
+    }
+}
+
+void HttpConn::FailProxy() {
+    std::shared_ptr<ProxyExchange> proxy = TakeProxy_();
+    assert(proxy);
+    response_.SetCode(502);
+    response_.SetContent("Bad Gateway\n", "text/plain");
+    MakeResponse_();
+}
+
+void HttpConn::MakeResponse_() {
+    phase_ = IDLE;
+    bodySink_.reset();
     response_.MakeResponse(writeBuff_);
     /* 响应报文 状态行 首部行 */
     iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
@@ -142,11 +498,47 @@ bool HttpConn::Process() {
         iov_[1].iov_len = response_.FileLen();
         iovCnt_ = 2;
     }
+    responseBytes_ = ToWriteBytes();
 
-    // LOG_DEBUG("Response fileSize:%d, channel:%d, totalBytes:%d", response_.FileLen(), iovCnt_, ToWriteBytes());
-    return true;
-} 
+    if (accessSampled_) {
+        access_.method = request_.method();
+        access_.path = request_.path();
+        access_.version = request_.version();
+        access_.referer = request_.GetHeader("Referer");
+        access_.userAgent = request_.GetHeader("User-Agent");
+        access_.status = response_.Code();
+    }
+}
+
+bool HttpConn::ProcessHttp2_(Http2Session::Result result) {
+    switch (result) {
+        case Http2Session::PENDING:
+            pending_ = true;
+            return false;
+        case Http2Session::WRITE:
+            // 文件内容已经切成 DATA 帧拷贝进写缓冲区, 只用一个 iovec
+            iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
+            iov_[0].iov_len = writeBuff_.ReadableBytes();
+            iov_[1].iov_len = 0;
+            iovCnt_ = 1;
+            return true;
+        default:
+            return false;
+    }
+}
 
+void HttpConn::LogAccess() {
+    if (!accessSampled_) {
+        return;
+    }
+    accessSampled_ = false;
+    access_.ip = GetIP();
+    access_.bytes = responseBytes_ - ToWriteBytes();
+    access_.latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - reqStart_).count();
+    access_.when = time(nullptr) - access_.latencyUs / 1000000;
+    AccessLog::GetInstance()->Record(access_);
+}
 
 std::string HttpConn::GetTimeOutKey() const {
     return timeOutKey;
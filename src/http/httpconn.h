@@ -9,11 +9,21 @@
 #include <arpa/inet.h>     // sockaddr_in
 #include <atomic>
 #include <string>
-#include "../pool/sqlconnRAII.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include "../buffer/buffer.h"
-#include "../../lizy_log/include/logging.h"
+#include "../log/logsite.h"
+#include "../pool/ratelimiter.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "router.h"
+#include "accesslog.h"
+#include "http2session.h"
+#include "websocket.h"
+#include "eventstream.h"
+#include "tlscontext.h"
+#include "proxy.h"
 
 
 class HttpConn {
@@ -21,17 +31,18 @@ public:
     HttpConn();
     ~HttpConn();
 
-    /// @brief 初始化函数
+    /// @brief 初始化函数(开启了 TLS 时建立 TLS 会话, 握手见 Handshake)
     /// @param sockFd socket 文件描述符
     /// @param addr 通信信息结构体
-    void Init(int sockFd, const sockaddr_in& addr);
+    /// @param limit 客户端 IP 的限流槽(accept 时占用了连接名额, 关闭时归还; 不限流时为 nullptr)
+    void Init(int sockFd, const sockaddr_in& addr, RateLimiter::Slot* limit = nullptr);
 
-    /// @brief 从 socket 读取数据
+    /// @brief 从 socket 读取数据(转存请求体时直接 splice 到文件, 不经过读缓冲区; TLS 连接读取解密后的数据)
     /// @param saveErrno 出错时 保存的错误码
     /// @return 读取的长度
     ssize_t Read(int* saveErrno);
 
-    /// @brief 往 socketFd 写数据
+    /// @brief 往 socketFd 写数据(WebSocket / 事件流连接写发送队列中的帧)
     /// @param saveErrno 出错时 保存的错误码
     /// @return 写入的长度
     ssize_t Write(int* saveErrno);
@@ -39,6 +50,48 @@ public:
     /// @brief 关闭连接, 资源回收
     void Close();
 
+    // 任务状态: 主线程把事件分发给工作线程起, 到任务(包括 SQL 线程的验证、转发)重新注册事件为止, 连接由任务独占;
+    // 期间定时器(超时)和主线程(对端关闭)不能关闭连接, 关闭推迟到任务结束时
+    /// @brief 主线程分发事件之前调用
+    /// @return false-连接已经关闭(或已经决定关闭), 忽略这个事件
+    bool BeginTask();
+
+    /// @brief 任务结束: 没有关闭请求时调用 arm 重新注册事件(持有任务锁, 期间不能关闭连接)
+    /// @param arm 重新注册事件的操作
+    /// @return false-任务期间收到了关闭请求: 没有调用 arm, 由调用者关闭连接
+    template<class Arm>
+    bool EndTask(Arm&& arm) {
+        std::lock_guard<std::mutex> lk(taskMtx_);
+        if (closeRequested_) {
+            return false;
+        }
+        busy_ = false;
+        arm();
+        return true;
+    }
+
+    /// @brief 定时器(超时)或主线程(对端关闭)请求关闭连接
+    /// @return true-连接空闲, 由调用者关闭; false-有任务在进行(任务结束时关闭)或者已经关闭
+    bool RequestClose();
+
+    /// @brief TLS 连接是否还在握手
+    /// @return true-yes, false-no
+    bool IsHandshaking() const {
+        return tls_ && !tls_->Established();
+    }
+
+    /// @brief 推进 TLS 握手
+    /// @param saveErrno 出错时 保存的错误码
+    /// @return 1-完成, 0-等待 socket 可读/可写(见 HandshakeWantsWrite), -1-失败
+    int Handshake(int* saveErrno) {
+        return tls_->Handshake(saveErrno);
+    }
+
+    /// @brief 握手是否在等待 socket 可写
+    bool HandshakeWantsWrite() const {
+        return tls_->WantWrite();
+    }
+
     /// @brief 返回 socket 描述符
     /// @return socketFd
     int GetFd() const;
@@ -56,17 +109,76 @@ public:
     sockaddr_in GetAddr() const;
 
     /// @brief request_解析请求报文, 并准备 response_ 对象(组织响应报文)
-    /// @return true-成功, false-失败
+    /// 请求可以分多次到达: 首部解析完成后先路由, 请求体边读边交给 handler 提供的 BodySink
+    /// 连接以 HTTP/2 前言开头或请求 "Upgrade: h2c" 时, 之后的数据都交给 Http2Session
+    /// 路由到 WebSocketHandler 的升级请求完成握手后, 之后的数据都交给 WebSocket(总是返回 false)
+    /// 路由到 EventStreamHandler 的 GET 请求发出响应首部后, 连接保持为事件流(总是返回 false)
+    /// 路由到 ProxyHandler 的请求接收完整后转发给上游(返回 false, 之后见 IsProxying)
+    /// @return true-可以发送响应, false-需要更多数据(或者在等待数据库验证, 见 IsPending)
     bool Process();
 
+    /// @brief 是否有请求在等待数据库验证
+    /// @return true-yes, false-no
+    bool IsPending() const {
+        return pending_;
+    }
+
+    /// @brief 在 SQL 线程中继续挂起的 handler, 并准备 response_ 对象
+    /// @return true-可以发送响应, false-连接已关闭
+    bool ProcessPending();
+
     /// @brief 剩余还没写入的字节数
     /// @return 字节数
     int ToWriteBytes();
 
+    /// @brief 是否已经成为推送连接(WebSocket 或事件流, 之后的读写见 WebServer::OnPushStream_)
+    /// @return true-yes, false-no
+    bool IsPushStream() const {
+        return push_ != nullptr;
+    }
+
+    /// @brief 推送连接的发送队列是否长时间写不出去(定时器线程调用, 见 PushStream::CheckStall)
+    /// @return true-应该断开; 有任务在进行时返回 false(由工作线程自己检查)
+    bool CheckPushStall();
+
+    /// @brief 推送连接收到事件时在主线程调用
+    /// @return false-已经有工作线程在处理, 忽略这个事件
+    bool AcquirePushStream() {
+        return push_->Acquire();
+    }
+
+    /// @brief 推送连接处理结束, 按发送队列重新注册事件
+    void ReleasePushStream() {
+        push_->Release();
+    }
+
+    /// @brief 当前请求是否正在转发给上游(之后的事件见 WebServer::OnProxy_)
+    /// @return true-yes, false-no
+    bool IsProxying() const {
+        return proxy_ != nullptr;
+    }
+
+    /// @brief 正在进行的转发
+    /// @return 转发的副本(没有时为 nullptr), 推进期间连接被关闭也不会释放
+    std::shared_ptr<ProxyExchange> GetProxy();
+
+    /// @brief 转发结束, 记录响应的状态码和字节数(用于访问日志)
+    /// @param keepAlive 客户端连接是否可以继续下一个请求
+    void EndProxy(bool keepAlive);
+
+    /// @brief 转发在发送任何数据之前失败: 改为准备 502 响应
+    void FailProxy();
+
     /// @brief 是否是 keepAlive
     /// @return true-Yes, false-No
     bool IsKeepAlive() const;
 
+    /// @brief 是否还在接收请求体(此时写完的只能是 100 Continue, 不是最终响应)
+    bool IsReceivingBody() const;
+
+    /// @brief 响应写完(或写失败)时记录访问日志, 未被采样的请求直接返回
+    void LogAccess();
+
     /// @brief 获取conn对像超时任务的 key
     /// @return key
     std::string GetTimeOutKey() const;
@@ -74,13 +186,65 @@ public:
     static bool isET;
     static const char* srcDir;
     static std::atomic<int> userCount;
+    static const size_t MAX_READ_BUFFER = 64 * 1024;    // 读缓冲区超过该大小时先处理再继续读
+    static const size_t SPLICE_CHUNK = 64 * 1024;       // 一次 splice 的字节数(管道的默认容量)
+
+private:
+    // 当前请求的处理阶段
+    enum Phase {
+        IDLE = 0,   // 等待新请求
+        HEADER,     // 接收请求行和首部
+        BODY,       // 接收请求体
+    };
+
+    /// @brief 首部解析完成: 按方法和路径找到 handler, 并由 handler 决定请求体的去处
+    /// @return false-不用接收请求体, 直接响应(404/405/handler 拒绝)
+    bool Route_();
+    /// @brief 请求体接收完整后交给 handler 处理
+    /// @return true-可以发送响应, false-挂起等待数据库
+    bool Dispatch_();
+    /// @brief 请求出错: 发送错误响应后关闭连接(剩下的请求体不再接收)
+    /// @param code 状态码
+    /// @return true
+    bool Reject_(int code);
+    /// @brief 取走正在进行的转发(持有 taskMtx_, 和 GetProxy 互斥)
+    std::shared_ptr<ProxyExchange> TakeProxy_();
+    /// @brief Content-Length 的请求体剩下的部分 splice 到 sink 的文件
+    /// @param saveErrno 出错时 保存的错误码
+    /// @return 转存的长度
+    ssize_t SpliceBody_(int* saveErrno);
+    /// @brief 结束 splice, 关闭管道
+    void StopSplice_();
+    /// @brief 根据 response_ 的设置组织响应报文
+    void MakeResponse_();
+    /// @brief 写多个缓冲区(TLS 连接经过 TlsSession)
+    /// @param saveErrno 出错时 保存的错误码
+    /// @return 写入的长度
+    ssize_t Writev_(const struct iovec* iov, int cnt, int* saveErrno);
+    /// @brief 处理 HTTP/2 会话的结果
+    /// @return 同 Process
+    bool ProcessHttp2_(Http2Session::Result result);
 
 private:
     int fd_;
     struct sockaddr_in addr_;
     std::string timeOutKey;
 
-    bool isClose_;
+    std::atomic<bool> isClose_;
+    std::mutex taskMtx_;
+    bool busy_;             // 有任务在处理这个连接
+    bool closeRequested_;   // 已经决定关闭(空闲时由请求者关闭, 否则由任务结束时关闭)
+    bool pending_;    // 等待数据库验证结果
+    Phase phase_;
+    HttpHandler* handler_;  // 处理当前请求的 handler(挂起时由 ProcessPending 继续)
+    RouteParams params_;    // 路径参数(指向 request_ 的路径)
+    std::unique_ptr<BodySink> bodySink_;   // 请求体的去处(nullptr 时保存在 request_ 中)
+    int pipe_[2];           // splice 请求体用的管道(只在转存时打开)
+    std::unique_ptr<Http2Session> h2_;     // HTTP/2 连接的会话(HTTP/1 时为 nullptr)
+    std::shared_ptr<PushStream> push_;     // 升级后的 WebSocket 或事件流(广播时其他线程也会持有)
+    std::unique_ptr<TlsSession> tls_;      // TLS 会话(明文连接时为 nullptr)
+    std::shared_ptr<ProxyExchange> proxy_; // 正在转发给上游的请求(设置和取走都持有 taskMtx_)
+    RateLimiter::Slot* limit_;             // 客户端 IP 的限流槽
 
     int iovCnt_;
     struct iovec iov_[2];
@@ -90,6 +254,11 @@ private:
 
     HttpRequest request_;
     HttpResponse response_;
+
+    bool accessSampled_;    // 当前请求是否需要记录访问日志
+    size_t responseBytes_;  // 当前响应的总字节数
+    std::chrono::steady_clock::time_point reqStart_;
+    AccessRecord access_;
 };
 
 
@@ -1,12 +1,28 @@
 #include "httprequest.h"
 
-const std::unordered_set<std::string> HttpRequest::DEFAULT_HTML = {
-    "/index", "/register", "/login", "/welcome", "/video", "/picture"
-};
+#include <strings.h>
+#include <algorithm>
+#include "multipart.h"
 
-const std::unordered_map<std::string, int> HttpRequest::DEFAULT_HTML_TAG = {
-    {"/register.html", 0}, {"/login.html", 1}
-};
+size_t HttpRequest::maxBodyBytes = 1 << 20;
+
+namespace {
+
+// 首部名规范成 Content-Type 的写法: 首字母和 '-' 后的字母大写, 其余小写(首部名不区分大小写)
+void CanonicalName(std::string& name) {
+    bool upper = true;
+    for (char& ch : name) {
+        if (upper && ch >= 'a' && ch <= 'z') {
+            ch = static_cast<char>(ch - 'a' + 'A');
+        }
+        else if (!upper && ch >= 'A' && ch <= 'Z') {
+            ch = static_cast<char>(ch - 'A' + 'a');
+        }
+        upper = (ch == '-');
+    }
+}
+
+}
 
 HttpRequest::HttpRequest() : method_(std::string()),
                              path_(std::string()),
@@ -18,71 +34,295 @@ HttpRequest::HttpRequest() : method_(std::string()),
 
 
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
+    method_ = path_ = query_ = version_ = body_ = "";
+    methodId_ = Router::METHOD_NUM;
     state_ = REQUEST_LINE;
+    headerBytes_ = bodyRemaining_ = bodyBytes_ = 0;
+    sink_ = nullptr;
+    isForm_ = false;
+    sessionUser_.clear();
     header_.clear();
     post_.clear();
 }
 
 bool HttpRequest::IsKeepAlive() const {
-    if (header_.count("Connection") > 0) {
-        return header_.at("Connection") == "keep-alive" && version_ == "1.1";
-    }
-    return false;
+    const std::string* connection = FindHeader_("Connection");
+    return connection && *connection == "keep-alive" && version_ == "1.1";
 }
 
+bool HttpRequest::ExpectsContinue() const {
+    const std::string* expect = FindHeader_("Expect");
+    return expect && strcasecmp(expect->c_str(), "100-continue") == 0;
+}
 
-bool HttpRequest::parse(Buffer& buff) {
+
+HttpRequest::HTTP_CODE HttpRequest::parse(Buffer& buff) {
     const char CRLF[] = "\r\n";
-    if (buff.ReadableBytes() <= 0) {
-        return false;
-    }
 
-    while (buff.ReadableBytes() && state_ != FINISH) {
+    while (state_ == REQUEST_LINE || state_ == HEADERS) {
         const char* lineEnd = std::search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
+        if (lineEnd == buff.BeginWriteConst()) {
+            // 行还不完整: 等待更多数据, 首部过大时拒绝
+            if (headerBytes_ + buff.ReadableBytes() > MAX_HEADER_BYTES) {
+                return BAD_REQUEST;
+            }
+            return NO_REQUEST;
+        }
 
         std::string line(buff.Peek(), lineEnd);
+        headerBytes_ += line.size() + 2;
+        buff.RetrieveUntil(lineEnd + 2); // 跳过"\r\n"
+        if (headerBytes_ > MAX_HEADER_BYTES) {
+            return BAD_REQUEST;
+        }
+
+        if (state_ == REQUEST_LINE) {
+            if (!ParseRequestLine_(line) || !ParsePath_()) {
+                return BAD_REQUEST;
+            }
+        }
+        else if (line.empty()) {
+            // 空行: 首部结束
+            if (!ParseBodyLength_()) {
+                return BAD_REQUEST;
+            }
+            ParseSession_();
+        }
+        else if (!ParseHeader_(line)) {
+            return BAD_REQUEST;
+        }
+    }
+    return GET_REQUEST;
+}
+
+HttpRequest::HTTP_CODE HttpRequest::ParseBody(Buffer& buff, BodySink* sink) {
+    const char CRLF[] = "\r\n";
+    sink_ = sink;
+
+    while (state_ != FINISH) {
         switch (state_) {
-            case REQUEST_LINE:
-                {   if (!ParseRequestLine_(line)) {
-                        return false;
-                    }
-                    ParsePath_();
-                    break;
+            case BODY:
+            case CHUNK_DATA:
+            {   size_t len = std::min(buff.ReadableBytes(), bodyRemaining_);
+                if (len == 0) {
+                    return NO_REQUEST;
+                }
+                HTTP_CODE ret = AppendBody_(buff.Peek(), len, sink);
+                if (ret != GET_REQUEST) {
+                    return ret;
+                }
+                buff.Retrieve(len);
+                bodyRemaining_ -= len;
+                if (bodyRemaining_ == 0) {
+                    state_ = (state_ == BODY) ? FINISH : CHUNK_CRLF;
+                }
+                break;
+            }
+            case CHUNK_CRLF:
+            {   if (buff.ReadableBytes() < 2) {
+                    return NO_REQUEST;
+                }
+                if (buff.Peek()[0] != '\r' || buff.Peek()[1] != '\n') {
+                    return BAD_REQUEST;
+                }
+                buff.Retrieve(2);
+                state_ = CHUNK_SIZE;
+                break;
+            }
+            case CHUNK_SIZE:
+            case CHUNK_TRAILER:
+            {   const char* lineEnd = std::search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
+                if (lineEnd == buff.BeginWriteConst()) {
+                    return buff.ReadableBytes() > MAX_CHUNK_LINE ? BAD_REQUEST : NO_REQUEST;
                 }
-            case HEADERS:
-                {   ParseHeader_(line);
-                    if (buff.ReadableBytes() <= 2) {
-                        state_ = FINISH;
+                if (state_ == CHUNK_SIZE) {
+                    if (!ParseChunkSize_(buff.Peek(), lineEnd)) {
+                        return BAD_REQUEST;
                     }
-                    break;
                 }
-            case BODY:
-                {   ParseBody_(line);
-                    break;
+                else if (lineEnd == buff.Peek()) {
+                    // 空行: 尾部首部结束(尾部首部本身忽略)
+                    state_ = FINISH;
                 }
-            default:
+                buff.RetrieveUntil(lineEnd + 2);
                 break;
+            }
+            default:
+                return BAD_REQUEST;
         }
-        if (lineEnd == buff.BeginWrite()) {
-            buff.RetrieveAll(); /*当method为 post 时, 防止下一次解析出错*/
-            break;
+    }
+    if (!sink) {
+        ParsePost_();
+    }
+    return GET_REQUEST;
+}
+
+bool HttpRequest::InitHttp2(const Hpack::HeaderList& headers, bool endStream) {
+    Init();
+    bool regular = false;
+    for (const auto& field : headers) {
+        const std::string& name = field.first;
+        if (name.empty()) {
+            return false;
         }
-        buff.RetrieveUntil(lineEnd + 2); // 跳过"\r\n"
+        if (name[0] == ':') {
+            // 伪首部只能出现在普通首部之前, 且不能重复
+            std::string* target = nullptr;
+            if (name == ":method") {
+                target = &method_;
+            }
+            else if (name == ":path") {
+                target = &path_;
+            }
+            else if (name == ":authority") {
+                target = &header_["Host"];
+            }
+            else if (name != ":scheme") {
+                return false;
+            }
+            if (regular || (target && !target->empty())) {
+                return false;
+            }
+            if (target) {
+                *target = field.second;
+            }
+            continue;
+        }
+        regular = true;
+        // HTTP/2 的首部名必须是小写的; content-type -> Content-Type, 与 HTTP/1 的写法一致
+        if (std::any_of(name.begin(), name.end(), [](char ch) { return ch >= 'A' && ch <= 'Z'; })) {
+            return false;
+        }
+        std::string key = name;
+        CanonicalName(key);
+        if (key == "Connection" || key == "Keep-Alive" || key == "Transfer-Encoding" || key == "Upgrade") {
+            // HTTP/2 中禁止的逐跳首部
+            return false;
+        }
+        std::string& value = header_[key];
+        if (!value.empty()) {
+            // 拆开的 cookie 用 "; " 拼回去, 其他重复的首部用 ", "
+            value += (key == "Cookie") ? "; " : ", ";
+        }
+        value += field.second;
+    }
+    if (method_.empty() || path_.empty()) {
+        return false;
+    }
+    methodId_ = Router::ParseMethod(method_.data(), method_.size());
+    version_ = "2.0";
+    if (!ParsePath_()) {
+        return false;
+    }
+    ParseSession_();
+    state_ = FRAMED_BODY;
+    if (endStream) {
+        EndBody(nullptr);
     }
-    // LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
     return true;
 }
 
-void HttpRequest::ParsePath_() {
-    if (path_ == "/") {
-        path_ = "/index2.html";
+HttpRequest::HTTP_CODE HttpRequest::AppendBody(const char* data, size_t len, BodySink* sink) {
+    sink_ = sink;
+    return AppendBody_(data, len, sink);
+}
+
+void HttpRequest::EndBody(BodySink* sink) {
+    sink_ = sink;
+    state_ = FINISH;
+    if (!sink) {
+        ParsePost_();
+    }
+}
+
+void HttpRequest::ConsumeBody(size_t len) {
+    assert(state_ == BODY && len <= bodyRemaining_);
+    bodyRemaining_ -= len;
+    bodyBytes_ += len;
+    if (bodyRemaining_ == 0) {
+        state_ = FINISH;
+    }
+}
+
+HttpRequest::HTTP_CODE HttpRequest::AppendBody_(const char* data, size_t len, BodySink* sink) {
+    if (bodyBytes_ + len > (sink ? sink->Limit() : maxBodyBytes)) {
+        return PAYLOAD_TOO_LARGE;
+    }
+    if (sink) {
+        if (!sink->Write(data, len)) {
+            return INTERNAL_ERROR;
+        }
     }
     else {
-        if (DEFAULT_HTML.count(path_)) {
-            path_ += ".html";
+        body_.append(data, len);
+    }
+    bodyBytes_ += len;
+    return GET_REQUEST;
+}
+
+bool HttpRequest::ParseBodyLength_() {
+    const std::string* te = FindHeader_("Transfer-Encoding");
+    const std::string* cl = FindHeader_("Content-Length");
+    if (te) {
+        // 同时有两者时两端对请求体长度的理解可能不同(请求走私), 直接拒绝(RFC 7230 3.3.3)
+        if (cl || strcasecmp(te->c_str(), "chunked") != 0) {
+            // 不支持其他传输编码
+            return false;
+        }
+        state_ = CHUNK_SIZE;
+        return true;
+    }
+    if (!cl) {
+        state_ = FINISH;
+        return true;
+    }
+    const std::string& value = *cl;
+    if (value.empty() || value.size() > 18) {
+        return false;
+    }
+    size_t len = 0;
+    for (char ch : value) {
+        if (ch < '0' || ch > '9') {
+            return false;
+        }
+        len = len * 10 + (ch - '0');
+    }
+    bodyRemaining_ = len;
+    state_ = len > 0 ? BODY : FINISH;
+    return true;
+}
+
+bool HttpRequest::ParseChunkSize_(const char* begin, const char* end) {
+    // 块大小(十六进制)[;扩展]
+    size_t len = 0;
+    const char* p = begin;
+    for (; p != end && isxdigit(static_cast<unsigned char>(*p)); ++p) {
+        if (p - begin >= 15) {
+            return false;
         }
+        len = len * 16 + ConverHex(*p);
+    }
+    if (p == begin || (p != end && *p != ';' && *p != ' ' && *p != '\t')) {
+        return false;
     }
+    bodyRemaining_ = len;
+    state_ = len > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+    return true;
+}
+
+bool HttpRequest::ParsePath_() {
+    // 查询串在规范化时被去掉, 先留一份(转发请求时要用)
+    size_t mark = path_.find('?');
+    if (mark != std::string::npos) {
+        size_t hash = path_.find('#', mark);
+        query_ = path_.substr(mark + 1, hash == std::string::npos ? std::string::npos : hash - mark - 1);
+    }
+    // 规范化路径, 拒绝 ".." 之类跳出资源目录的路径
+    if (!PathCache::Canonicalize(path_, &path_)) {
+        path_ = "/";
+        return false;
+    }
+    return true;
 }
 
 bool HttpRequest::ParseRequestLine_(const std::string& line) {
@@ -92,6 +332,7 @@ bool HttpRequest::ParseRequestLine_(const std::string& line) {
     if (std::regex_match(line, subMatch, pattern)) {
         // index == 0 是整个匹配
         method_ = subMatch.str(1);
+        methodId_ = Router::ParseMethod(method_.data(), method_.size());
         path_ = subMatch.str(2);
         version_ = subMatch.str(3);
         state_ = HEADERS;
@@ -101,100 +342,115 @@ bool HttpRequest::ParseRequestLine_(const std::string& line) {
     return false;
 }
 
-void HttpRequest::ParseHeader_(const std::string& line) {
+bool HttpRequest::ParseHeader_(const std::string& line) {
     // Host: www.baidu.com
     // Connection:Keep-Alive
-    std::regex pattern("^([^:]*): ?(.*)$");
-    std::smatch subMatch;
-
-    if (std::regex_match(line, subMatch, pattern)) {
-        header_[subMatch.str(1)] = subMatch.str(2);
+    size_t colon = line.find(':');
+    if (colon == std::string::npos || colon == 0) {
+        return false;
     }
-    else {
-        // 匹配不成功时表示首部行已读完, 切换到 BODY 部分
-        state_ = BODY;
+    std::string key = line.substr(0, colon);
+    if (key.find_first_of(" \t") != std::string::npos) {
+        // 冒号前的空白(以及续行)会让前后两端对首部名的理解不同, 必须拒绝(RFC 7230 3.2.4)
+        return false;
     }
-}
+    CanonicalName(key);
+    size_t begin = line.find_first_not_of(" \t", colon + 1);
+    size_t end = line.find_last_not_of(" \t");
+    std::string value = (begin == std::string::npos) ? std::string() : line.substr(begin, end + 1 - begin);
 
-void HttpRequest::ParseBody_(const std::string& line) {
-    body_ = line;
-    ParsePost_();
-    state_ = FINISH;
-    // LOG_DEBUG("Body: %s, len: %d", body_.c_str(), body_.size());
+    auto ret = header_.emplace(key, value);
+    if (ret.second) {
+        return true;
+    }
+    std::string& prev = ret.first->second;
+    if (key == "Content-Length") {
+        // 重复的 Content-Length 只有值都相同时才接受
+        return prev == value;
+    }
+    if (key == "Host") {
+        return false;
+    }
+    // 其他重复的首部按顺序拼起来, 与 HTTP/2 的处理一致
+    if (!value.empty()) {
+        prev += prev.empty() ? "" : (key == "Cookie" ? "; " : ", ");
+        prev += value;
+    }
+    return true;
 }
 
 void HttpRequest::ParsePost_() {
-    if (method_ == "POST" && header_.at("Content-Type") == "application/x-www-form-urlencoded") {
-        ParseFromUrlencoded_();
-        if (DEFAULT_HTML_TAG.count(path_)) {
-            // 判断是否是登陆或者注册页面
-            int tag = DEFAULT_HTML_TAG.at(path_);
-            // LOG_DEBUG("Tag:%d", tag);
-            if (tag == 0 || tag == 1) {
-                bool isLogin = (tag == 1);
-                if (UserVerify(post_.at("username"), post_.at("password"), isLogin)) {
-                    path_ = "/welcome.html";
-                }
-                else {
-                    path_ = "/error.html";
-                }
-            }
-        }
+    // 表单的内容交给路由到的 handler 处理
+    if (methodId_ != Router::POST) {
+        return;
+    }
+    std::string type = GetHeader("Content-Type");
+    if (type == "application/x-www-form-urlencoded") {
+        FormDecoder::ParseUrlencoded(body_, &formBuf_, &post_);
+        isForm_ = true;
+    }
+    else if (strncasecmp(type.c_str(), "multipart/form-data", 19) == 0) {
+        ParseMultipart_(type);
+        isForm_ = true;
     }
 }
 
-void HttpRequest::ParseFromUrlencoded_() {
-    if (body_.size() == 0) {
-        return;
+namespace {
+
+// 把 multipart 的各个部分收集成表单字段: 整个请求体一次喂给解析器, 每个部分的内容在 body 中是连续的
+class FormCollector : public MultipartParser::Handler {
+public:
+    FormCollector(std::string* names, std::vector<FormDecoder::Field>* fields)
+        : names_(names), fields_(fields) {}
+
+    bool OnPartBegin(const MultipartParser::Part& part) override {
+        // names_ 预留了足够的容量, 追加不会使之前的 string_view 失效
+        size_t offset = names_->size();
+        names_->append(part.name.data(), part.name.size());
+        fields_->emplace_back(std::string_view(names_->data() + offset, part.name.size()), std::string_view());
+        return true;
     }
 
-    // 解析 urlencoded 编码的 body_
-    /* urlencoded 编码规则 */
-    /* 
-        采用键值对方式存储, 中间用 & 分隔
-        空格用 + 代替
-        %后面是 16 进制数, 不能用ASCII码表示
-    */
-    // 例子: firstName=Mickey%26&lastName=Mouse+
-    std::string key, value;
-    int num = 0;
-    int n = body_.size();
-    int i = 0, j = 0;
-
-    for (; i < n; ++i) {
-        char ch = body_[i];
-        switch (ch) {
-            case '=':
-            {   key = body_.substr(j, i - j);
-                j = i + 1;
-                break; 
-            }
-            case '+':
-            {   body_[i] = ' ';
-                break; 
-            }
-            case '%':
-            {   num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-                body_[i + 2] = num % 10 + '0';
-                body_[i + 1] = num / 10 + '0';
-                i += 2;
-                break;
-            }
-            case '&':
-            {   value = body_.substr(j, i - j);
-                j = i + 1;
-                post_[key] = value;
-                // LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
-                break;
-            }
-            default:
-                break;
+    bool OnPartData(const char* data, size_t len) override {
+        std::string_view& value = fields_->back().second;
+        if (value.empty()) {
+            value = std::string_view(data, len);
+        }
+        else if (value.data() + value.size() == data) {
+            value = std::string_view(value.data(), value.size() + len);
+        }
+        else {
+            return false;
         }
+        return true;
+    }
+
+    bool OnPartEnd() override {
+        return true;
+    }
+
+private:
+    std::string* names_;
+    std::vector<FormDecoder::Field>* fields_;
+};
+
+}
+
+void HttpRequest::ParseMultipart_(const std::string& contentType) {
+    formBuf_.clear();
+    formBuf_.reserve(body_.size());
+    post_.clear();
+    FormCollector collector(&formBuf_, &post_);
+    MultipartParser parser(&collector);
+    if (!parser.Reset(contentType) || !parser.Feed(body_.data(), body_.size()) || !parser.Done()) {
+        post_.clear();
     }
-    assert(j <= i);
-    if (post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
+}
+
+void HttpRequest::ParseSession_() {
+    std::string token = GetCookie(SessionStore::COOKIE_NAME);
+    if (!token.empty()) {
+        SessionStore::GetInstance()->Lookup(token, &sessionUser_);
     }
 }
 
@@ -220,94 +476,127 @@ std::string HttpRequest::version() const {
     return version_;
 }
 
-std::string HttpRequest::GetPost(const std::string& key) const {
-    if (post_.count(key)) {
-        return post_.at(key);
+std::string_view HttpRequest::FindPost_(std::string_view key) const {
+    // 表单字段很少: 线性查找比建哈希表快, 也不用为每个键分配内存
+    for (const FormDecoder::Field& field : post_) {
+        if (field.first == key) {
+            return field.second;
+        }
     }
-    return std::string();
+    return std::string_view();
 }
 
-std::string HttpRequest::GetPost(const char* key) const {
-    if (post_.count(std::string(key))) {
-        return post_.at(std::string(key));
-    }
-    return std::string();
+std::string HttpRequest::GetPost(const std::string& key) const {
+    return std::string(FindPost_(key));
 }
 
+std::string HttpRequest::GetPost(const char* key) const {
+    return std::string(FindPost_(key));
+}
 
-bool HttpRequest::UserVerify(const std::string& name, const std::string& pwd, bool isLogin) {
-    if (name == "" || pwd == "") {
-        return false;
-    }
-    // LOG_DEBUG("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-
-    SqlConnRAII sql_ptr(SqlConnPool::GetInstance());
-
-    assert(sql_ptr.HasPtr());
+const std::string* HttpRequest::FindHeader_(std::string key) const {
+    CanonicalName(key);
+    auto it = header_.find(key);
+    return it != header_.end() ? &it->second : nullptr;
+}
 
-    bool flag = false;
-    MYSQL_RES* res = nullptr;
-    std::string order;
+std::string HttpRequest::GetHeader(const std::string& key) const {
+    const std::string* value = FindHeader_(key);
+    return value ? *value : std::string();
+}
 
-    order = "SELECT username, password FROM user WHERE username= '"; // 查询语句
-    order.append(name);
-    order += "'";
-    // LOG_DEBUG("%s", order.c_str());
-    
-    if (mysql_query(sql_ptr.GetPtr(), order.c_str()) != 0) {
+bool HttpRequest::HasHeaderToken(const std::string& key, const char* token) const {
+    const std::string* header = FindHeader_(key);
+    if (!header) {
         return false;
     }
+    const std::string& value = *header;
+    size_t len = strlen(token);
+    size_t pos = 0;
+    while (pos <= value.size()) {
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        size_t next = end + 1;
+        while (pos < end && (value[pos] == ' ' || value[pos] == '\t')) {
+            ++pos;
+        }
+        while (end > pos && (value[end - 1] == ' ' || value[end - 1] == '\t')) {
+            --end;
+        }
+        if (end - pos == len && strncasecmp(value.data() + pos, token, len) == 0) {
+            return true;
+        }
+        pos = next;
+    }
+    return false;
+}
 
-    res = mysql_store_result(sql_ptr.GetPtr()); // 获取结果集
-    if (res == nullptr) {
-        return false;
+std::string HttpRequest::GetCookie(const std::string& name) const {
+    const std::string* header = FindHeader_("Cookie");
+    if (!header) {
+        return std::string();
     }
-    int row = mysql_num_rows(res);
-    if (row == 0) {
-        // 查询结果为空
-        if (isLogin) {
-            // LOG_DEBUG("No this user!");
-            flag = false;
+    // 例子: Cookie: a=1; sid=0123abcd; theme="dark"
+    const std::string& cookie = *header;
+    size_t pos = 0;
+    while (pos < cookie.size()) {
+        while (pos < cookie.size() && (cookie[pos] == ' ' || cookie[pos] == ';')) {
+            ++pos;
         }
-        else {
-            // 注册行为
-            // LOG_DEBUG("Register!");
-            order.clear();
-            order = "INSERT INTO user(username, password) VALUE";
-            order.append("('");
-            order.append(name);
-            order.append("','");
-            order.append(pwd);
-            order.append("')");
-            // LOG_DEBUG("%s", order.c_str());
-            if (mysql_query(sql_ptr.GetPtr(), order.c_str()) != 0) {
-                // LOG_DEBUG("INSERT error!");
-            }
-            flag = true;
+        size_t end = cookie.find(';', pos);
+        if (end == std::string::npos) {
+            end = cookie.size();
         }
-    }
-    else {
-        MYSQL_ROW r = mysql_fetch_row(res); // 取出第一行记录
-        // LOG_DEBUG("MYSQL ROW: %s %s", r[0], r[1]);
-        std::string password(r[1]);
-        if (isLogin) {
-            if (pwd == password) {
-                flag = true;
-                // LOG_DEBUG("Login Success!");
+        size_t eq = pos + name.size();
+        if (eq < end && cookie[eq] == '=' && cookie.compare(pos, name.size(), name) == 0) {
+            size_t begin = eq + 1;
+            while (end > begin && cookie[end - 1] == ' ') {
+                --end;
             }
-            else {
-                flag = false;
-                // LOG_DEBUG("pwd error!");
+            if (end - begin >= 2 && cookie[begin] == '"' && cookie[end - 1] == '"') {
+                ++begin;
+                --end;
             }
+            return cookie.substr(begin, end - begin);
         }
-        else {
-            // 注册行为
-            flag = false;
-            // LOG_DEBUG("user used!");
-        }
+        pos = end + 1;
     }
+    return std::string();
+}
 
-    mysql_free_result(res);
-    // LOG_DEBUG("UserVerify Finish!");
-    return flag;
-}
\ No newline at end of file
+bool HttpRequest::AcceptsGzip() const {
+    const std::string* header = FindHeader_("Accept-Encoding");
+    if (!header) {
+        return false;
+    }
+    // 例子: Accept-Encoding: gzip, deflate;q=0.5, br;q=0
+    const std::string& value = *header;
+    size_t pos = 0;
+    while (pos < value.size()) {
+        while (pos < value.size() && (value[pos] == ' ' || value[pos] == ',')) {
+            ++pos;
+        }
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        size_t semi = value.find(';', pos);
+        size_t nameEnd = (semi < end) ? semi : end;
+        while (nameEnd > pos && value[nameEnd - 1] == ' ') {
+            --nameEnd;
+        }
+        std::string coding = value.substr(pos, nameEnd - pos);
+        if (coding == "gzip" || coding == "*") {
+            // q=0 表示明确拒绝
+            size_t q = (semi < end) ? value.find("q=", semi) : std::string::npos;
+            if (q == std::string::npos || q >= end) {
+                return true;
+            }
+            return atof(value.substr(q + 2, end - q - 2).c_str()) > 0;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
@@ -8,20 +8,29 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include <string_view>
 #include <regex>
 #include <errno.h>
-#include <mysql/mysql.h>
 
 #include "../buffer/buffer.h"
-#include "../pool/sqlconnpool.h"
-#include "../pool/sqlconnRAII.h"
+#include "../pool/sessionstore.h"
+#include "pathcache.h"
+#include "router.h"
+#include "formdecoder.h"
+#include "hpack.h"
 
 class HttpRequest {
 public:
     enum PARSE_STATE {
         REQUEST_LINE,
         HEADERS,
-        BODY,
+        BODY,           // Content-Length 请求体
+        CHUNK_SIZE,     // chunked: 块大小行
+        CHUNK_DATA,     // chunked: 块数据
+        CHUNK_CRLF,     // chunked: 块数据后的 "\r\n"
+        CHUNK_TRAILER,  // chunked: 最后一块之后的尾部首部
+        FRAMED_BODY,    // HTTP/2: 请求体由 DATA 帧送来, END_STREAM 结束
         FINISH
     };
 
@@ -33,9 +42,14 @@ public:
         FORBIDDENT_REQUEST,
         FILE_REQUEST,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        PAYLOAD_TOO_LARGE
     };
 
+    static const size_t MAX_HEADER_BYTES = 16 * 1024;   // 请求行 + 首部的上限
+    static const size_t MAX_CHUNK_LINE = 1024;          // chunked 块大小行/尾部首部行的上限
+    static size_t maxBodyBytes;                         // 保存在内存中的请求体上限
+
     HttpRequest();
 
     ~HttpRequest() = default;
@@ -43,18 +57,90 @@ public:
     /// @brief 初始化函数
     void Init();
 
-    /// @brief 解析请求报文
-    /// @param buff 请求报文
-    /// @return 是否解析成功
-    bool parse(Buffer& buff);
+    /// @brief 解析请求行和首部(数据不完整时保留状态, 收到更多数据后继续)
+    /// @param buff 读缓冲区, 只取走完整的行
+    /// @return NO_REQUEST-首部还不完整, GET_REQUEST-首部解析完成(请求体用 ParseBody 接收), BAD_REQUEST-报文错误
+    HTTP_CODE parse(Buffer& buff);
+
+    /// @brief 接收请求体(Content-Length 或 chunked), 可以分多次调用
+    /// @param buff 读缓冲区, 取走已经接收的部分
+    /// @param sink 请求体的去处(nullptr 时保存在 body() 中, 最多 maxBodyBytes 字节)
+    /// @return NO_REQUEST-还没接收完, GET_REQUEST-接收完整, BAD_REQUEST-分块格式错误,
+    ///         PAYLOAD_TOO_LARGE-超过上限, INTERNAL_ERROR-写入 sink 失败
+    HTTP_CODE ParseBody(Buffer& buff, BodySink* sink);
+
+    /// @brief 由 HTTP/2 的首部块建立请求(请求体由 DATA 帧通过 AppendBody 送来)
+    /// @param headers 解码后的首部(名字为小写)
+    /// @param endStream 首部块之后没有请求体
+    /// @return false-请求不合法(缺少伪首部、伪首部在普通首部之后、名字有大写、路径非法)
+    bool InitHttp2(const Hpack::HeaderList& headers, bool endStream);
+
+    /// @brief 追加一段 HTTP/2 请求体
+    /// @param data 数据
+    /// @param len 长度
+    /// @param sink 请求体的去处(nullptr 时保存在 body() 中)
+    /// @return GET_REQUEST-成功, PAYLOAD_TOO_LARGE / INTERNAL_ERROR-失败
+    HTTP_CODE AppendBody(const char* data, size_t len, BodySink* sink);
+
+    /// @brief HTTP/2 请求体结束(END_STREAM)
+    /// @param sink 请求体的去处
+    void EndBody(BodySink* sink);
+
+    /// @brief 请求体是否已经接收完整(没有请求体时首部解析完即完整)
+    /// @return true-yes, false-no
+    bool BodyComplete() const {
+        return state_ == FINISH;
+    }
+
+    /// @brief Content-Length 请求体还没接收的字节数
+    /// @return 字节数(chunked 请求体返回 0)
+    size_t BodyRemaining() const {
+        return state_ == BODY ? bodyRemaining_ : 0;
+    }
+
+    /// @brief 请求体直接从 socket 转存(splice)到了文件
+    /// @param len 转存的字节数(不超过 BodyRemaining)
+    void ConsumeBody(size_t len);
+
+    /// @brief 已经接收的请求体字节数(chunked 时为解码后的长度)
+    /// @return 字节数
+    size_t BodyBytes() const {
+        return bodyBytes_;
+    }
+
+    /// @brief 接收请求体的 sink(只在 handler 处理请求期间有效)
+    /// @return sink(请求体保存在内存中时为 nullptr)
+    BodySink* Sink() const {
+        return sink_;
+    }
+
+    /// @brief 保存在内存中的请求体
+    /// @return 请求体(交给 sink 时为空)
+    const std::string& body() const {
+        return body_;
+    }
+
+    /// @brief 客户端是否在等待 "100 Continue" 才发送请求体
+    /// @return true-yes, false-no
+    bool ExpectsContinue() const;
 
     /// @brief 获取请求报文路径
     /// @return 路径字符串
     std::string path() const;
     std::string& path();
+    /// @brief 获取请求目标中的查询串(不含 '?')
+    /// @return 查询串(没有时为空)
+    const std::string& query() const {
+        return query_;
+    }
     /// @brief 获取请求报文方法
     /// @return 方法字符串
     std::string method() const;
+    /// @brief 获取请求报文方法(解析请求行时转换一次)
+    /// @return 方法(不支持的方法为 Router::METHOD_NUM)
+    Router::Method methodId() const {
+        return methodId_;
+    }
     /// @brief 获取请求报文HTTP版本
     /// @return 版本号
     std::string version() const;
@@ -63,6 +149,38 @@ public:
     /// @return 值
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
+    /// @brief 请求体是否是表单(urlencoded 或 multipart/form-data), 字段用 GetPost 获取
+    /// @return true-yes, false-no
+    bool IsForm() const {
+        return isForm_;
+    }
+    /// @brief 获取首部行字段
+    /// @param key 字段名(不区分大小写)
+    /// @return 字段值(不存在时返回空串)
+    std::string GetHeader(const std::string& key) const;
+    /// @brief 逗号分隔的首部值中是否有某个 token(不区分大小写, 如 Connection: keep-alive, Upgrade)
+    /// @param key 字段名
+    /// @param token 要找的 token
+    /// @return true-yes, false-no
+    bool HasHeaderToken(const std::string& key, const char* token) const;
+    /// @brief 获取全部首部行(转发请求时用)
+    /// @return 字段名(规范成 Content-Type 的写法)-字段值, 重复的首部已经拼在一起
+    const std::unordered_map<std::string, std::string>& headers() const {
+        return header_;
+    }
+    /// @brief 获取 Cookie 首部中的一个字段
+    /// @param name 字段名
+    /// @return 字段值(不存在时返回空串)
+    std::string GetCookie(const std::string& name) const;
+    /// @brief 客户端是否接受 gzip 编码的内容(Accept-Encoding)
+    /// @return true-yes, false-no
+    bool AcceptsGzip() const;
+
+    /// @brief 请求携带的有效会话所属的用户
+    /// @return 用户名(没有有效会话时为空串)
+    const std::string& SessionUser() const {
+        return sessionUser_;
+    }
 
     /// @brief 请求是否是 keep-alive 的
     /// @return true-yes, false-no
@@ -75,35 +193,55 @@ private:
     bool ParseRequestLine_(const std::string& line);
     /// @brief 解析首部行
     /// @param line 首部行字符串
-    void ParseHeader_(const std::string& line);
-    /// @brief 解析正文
-    /// @param line 正文字符串 
-    void ParseBody_(const std::string& line);
-
-    /// @brief 解析路径
-    void ParsePath_();
+    /// @return 首部行是否正确(冒号前有空白、Content-Length 重复且不同、Host 重复 都算错误)
+    bool ParseHeader_(const std::string& line);
+    /// @brief 按不区分大小写的字段名查找首部
+    /// @param key 字段名
+    /// @return 字段值(不存在时为 nullptr)
+    const std::string* FindHeader_(std::string key) const;
+    /// @brief 首部结束: 根据 Transfer-Encoding / Content-Length 确定请求体的长度
+    /// @return 首部是否正确
+    bool ParseBodyLength_();
+    /// @brief 解析 chunked 的块大小行
+    /// @param begin 行首
+    /// @param end 行尾(不含 "\r\n")
+    /// @return 格式是否正确
+    bool ParseChunkSize_(const char* begin, const char* end);
+    /// @brief 把一段请求体交给 sink 或保存在 body_ 中
+    /// @return GET_REQUEST-成功, PAYLOAD_TOO_LARGE / INTERNAL_ERROR-失败
+    HTTP_CODE AppendBody_(const char* data, size_t len, BodySink* sink);
+
+    /// @brief 规范化路径
+    /// @return 路径是否合法
+    bool ParsePath_();
     /// @brief 解析方法为 POST 的 BODY
     void ParsePost_();
-    /// @brief 解析 urlencoded 编码的键值对
-    void ParseFromUrlencoded_();
-
-    /// @brief 身份密码验证
-    /// @param name 用户名
-    /// @param pwd 密码
-    /// @param isLogin 登陆选项(注册/登陆)
-    /// @return 是否成功
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
+    /// @brief 解析内存中的 multipart/form-data 请求体, 字段值指向 body_
+    /// @param contentType Content-Type 首部的值
+    void ParseMultipart_(const std::string& contentType);
+    /// @brief 按键查找表单字段
+    /// @return 字段值(不存在时为空)
+    std::string_view FindPost_(std::string_view key) const;
+    /// @brief 根据 Cookie 中的会话令牌找到已登陆的用户
+    void ParseSession_();
 
     PARSE_STATE state_;
+    size_t headerBytes_;        // 已经解析的请求行 + 首部字节数
+    size_t bodyRemaining_;      // Content-Length 请求体 / 当前块 还没接收的字节数
+    size_t bodyBytes_;          // 已经接收的请求体字节数
+    BodySink* sink_;            // 接收请求体的 sink(不持有)
+    bool isForm_;               // 请求体按表单解析过
+    std::string sessionUser_;
     std::string method_;
+    Router::Method methodId_;
     std::string path_;
+    std::string query_;
     std::string version_;
     std::string body_;
     std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
+    std::string formBuf_;       // 解码后的表单键值(multipart 时是字段名), post_ 指向这里
+    std::vector<FormDecoder::Field> post_;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
     // 十六进制转换为 十进制
     static int ConverHex(char ch);
 };
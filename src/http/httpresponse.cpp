@@ -1,49 +1,19 @@
 #include "httpresponse.h"
+#include "resourcecache.h"
+#include "resourcepack.h"
+#include "httptables.h"
 
 
-
-const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE = {
-    {".html", "text/html"},
-    {".xml",  "text/xml"},
-    {".xhtml","application/xhtml+xml"},
-    {".txt",  "text/plain"},
-    {".rtf",  "application/rtf"},
-    {".pdf",  "application/pdf"},
-    {".word", "application/nsword"},
-    {".png",  "image/png"},
-    {".gif",  "image/gif"},
-    {".jpg",  "image/jpeg"},
-    {".jpeg", "image/jpeg"},
-    {".au",   "audio/basic"},
-    {".mpeg", "video/mpeg"},
-    {".mpg",  "video/mpeg"},
-    {".avi",  "video/x-msvideo"},
-    {".gz",   "application/x-gzip"},
-    {".tar",  "application/x-tar"},
-    {".css",  "text/css "},
-    {".js",   "text/javascript "}
-};
-
-const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
-    {200, "OK"},
-    {400, "Bad Request"},
-    {403, "Forbidden"},
-    {404, "Not Found"}
-};
-
-const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
-    {400, "/400.html"},
-    {403, "/403.html"},
-    {404, "/404.html"}
-};
+SingleFlight<std::string, std::shared_ptr<const MappedFile>> HttpResponse::fileFlight_;
 
 
 HttpResponse::HttpResponse() : code_(-1),
                                isKeepAlive_(false),
-                               mmFile_(nullptr)
-{
-    memset(&mmFileStat_, 0, sizeof(mmFileStat_));
-}
+                               acceptGzip_(false),
+                               gzipped_(false),
+                               varyEncoding_(false),
+                               hasContent_(false)
+{ }
 
 HttpResponse::~HttpResponse() {
     UnmapFile();
@@ -52,57 +22,206 @@ HttpResponse::~HttpResponse() {
 
 void HttpResponse::Init(const std::string& srcDir, std::string& path, bool isKeepAlive, int code) {
     assert(srcDir != "");
-    if (mmFile_) {
-        UnmapFile();
-    }
+    UnmapFile();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
-    mmFile_ = nullptr;
-    memset(&mmFileStat_, 0, sizeof(mmFileStat_));
+    extraHeaders_.clear();
+    acceptGzip_ = false;
+    gzipped_ = false;
+    varyEncoding_ = false;
+    hasContent_ = false;
+    content_.clear();
+    contentType_.clear();
+}
+
+void HttpResponse::SetHeader(const std::string& key, const std::string& value) {
+    extraHeaders_ += key + ": " + value + "\r\n";
+}
+
+void HttpResponse::SetContent(const std::string& body, const std::string& contentType) {
+    hasContent_ = true;
+    content_ = body;
+    contentType_ = contentType;
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) {
-    // 判断请求的文件
-    // 文件错误 或 该文件的类型是文件夹
-    if (stat((srcDir_ + path_).c_str(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;
+    if (hasContent_) {
+        // handler 生成的内容: 不查找文件
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        AddContentLength_(buff, content_.size());
+        buff.Append(content_);
+        return;
+    }
+    PrepareFile_();
+    AddStateLine_(buff);
+    AddHeader_(buff);
+    AddContent_(buff);
+}
+
+void HttpResponse::MakeHttp2Response(Hpack::HeaderList* headers, std::string* body) {
+    body->clear();
+    if (!hasContent_) {
+        PrepareFile_();
     }
-    else if (!(mmFileStat_.st_mode & S_IROTH)) {
-        // 其他用户可读(Forbidden)
-        code_ = 403;
+    if (!HttpTables::StatusText(code_)) {
+        code_ = 400;
+    }
+    char num[32];
+    snprintf(num, sizeof(num), "%d", code_);
+    headers->emplace_back(":status", num);
+
+    size_t len = 0;
+    if (hasContent_) {
+        headers->emplace_back("content-type", contentType_);
+        *body = content_;
+        len = body->size();
+    }
+    else {
+        headers->emplace_back("content-type", HttpTables::MimeType(path_.data(), path_.size()));
+        if (FileFound_()) {
+            len = file_->st.st_size;
+        }
+        else {
+            *body = ErrorBody_("File NotFound!");
+            len = body->size();
+        }
+    }
+    snprintf(num, sizeof(num), "%zu", len);
+    headers->emplace_back("content-length", num);
+    if (gzipped_) {
+        headers->emplace_back("content-encoding", "gzip");
     }
-    else if (code_ == -1) {
-        code_ = 200;
+    if (varyEncoding_) {
+        headers->emplace_back("vary", "Accept-Encoding");
     }
+    // SetHeader 添加的首部: 名字转成小写, 去掉 HTTP/2 中禁止的逐跳首部
+    size_t pos = 0;
+    while (pos < extraHeaders_.size()) {
+        size_t lineEnd = extraHeaders_.find("\r\n", pos);
+        size_t colon = extraHeaders_.find(':', pos);
+        if (lineEnd == std::string::npos || colon == std::string::npos || colon > lineEnd) {
+            break;
+        }
+        std::string name = extraHeaders_.substr(pos, colon - pos);
+        for (char& ch : name) {
+            ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+        }
+        size_t valueBegin = colon + 1;
+        while (valueBegin < lineEnd && extraHeaders_[valueBegin] == ' ') {
+            ++valueBegin;
+        }
+        if (name != "connection" && name != "keep-alive" && name != "transfer-encoding" && name != "upgrade") {
+            headers->emplace_back(std::move(name), extraHeaders_.substr(valueBegin, lineEnd - valueBegin));
+        }
+        pos = lineEnd + 2;
+    }
+}
 
+void HttpResponse::PrepareFile_() {
+    // 判断请求的文件(已经出错的请求直接给出错误页面)
+    std::shared_ptr<const MappedFile> cached;
+    if (code_ == -1 || code_ == 200) {
+        switch (Resolve_(&cached)) {
+            case PathCache::NOT_FOUND:
+            case PathCache::DIRECTORY:
+                // 文件错误 或 该文件的类型是文件夹
+                code_ = 404;
+                break;
+            case PathCache::FORBIDDEN:
+                // 其他用户不可读(Forbidden)
+                code_ = 403;
+                break;
+            default:
+                code_ = 200;
+                break;
+        }
+    }
+
+    if (code_ == 200) {
+        file_ = cached ? cached : LoadFile_(srcDir_ + path_);
+    }
     ErrorHtml_();
-    AddStateLine_(buff);
-    AddHeader_(buff);
-    AddContent_(buff);
+}
+
+bool HttpResponse::FileFound_() const {
+    return file_ && file_->found && (file_->addr || file_->st.st_size == 0);
 }
 
 
 void HttpResponse::ErrorHtml_() {
-    if (CODE_PATH.count(code_)) {
-        path_ = CODE_PATH.at(code_);
-        stat((srcDir_ + path_).c_str(), &mmFileStat_);
+    const char* page = HttpTables::ErrorPage(code_);
+    if (page) {
+        path_ = page;
+        // 错误页面不存在时(缓存的结果)直接生成错误文本
+        std::shared_ptr<const MappedFile> cached;
+        if (Resolve_(&cached) == PathCache::REGULAR_FILE) {
+            file_ = cached ? cached : LoadFile_(srcDir_ + path_);
+        }
+    }
+}
+
+PathCache::Resolution HttpResponse::Resolve_(std::shared_ptr<const MappedFile>* cached) {
+    ResourcePack::Entry packed;
+    if (ResourcePack::GetInstance()->Lookup(path_, &packed)) {
+        gzipped_ = acceptGzip_ && packed.gzFile;
+        varyEncoding_ = static_cast<bool>(packed.gzFile);
+        *cached = gzipped_ ? packed.gzFile : packed.file;
+        return packed.resolution;
     }
+    ResourceCache::Entry entry;
+    if (ResourceCache::GetInstance()->Lookup(path_, &entry)) {
+        *cached = entry.file;
+        return entry.resolution;
+    }
+    cached->reset();
+    return PathCache::GetInstance()->Resolve(srcDir_ + path_);
+}
+
+std::shared_ptr<const MappedFile> HttpResponse::LoadFile_(const std::string& path) {
+    return fileFlight_.Do(path, [&path]() {
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+        // 以只读方式打开, 用 fstat 取打开的这个文件的大小
+        int srcFd = open(path.c_str(), O_RDONLY);
+        if (srcFd < 0) {
+            return std::shared_ptr<const MappedFile>(file);
+        }
+        if (fstat(srcFd, &file->st) < 0) {
+            close(srcFd);
+            return std::shared_ptr<const MappedFile>(file);
+        }
+        file->found = true;
+        if (!S_ISREG(file->st.st_mode) || !(file->st.st_mode & S_IROTH) || file->st.st_size == 0) {
+            close(srcFd);
+            return std::shared_ptr<const MappedFile>(file);
+        }
+        /*
+            将文件映射到内存提高文件的访问速度
+            MAP_PRIVATE 建立一个写入时拷贝的私有映射
+        */
+        void* mmRet = mmap(NULL, file->st.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+        close(srcFd);
+        if (mmRet != MAP_FAILED) {
+            file->addr = static_cast<char*>(mmRet);
+            file->mapped = true;
+        }
+        return std::shared_ptr<const MappedFile>(file);
+    });
 }
 
 void HttpResponse::AddStateLine_(Buffer& buff) {
-    std::string status;
     // 状态码映射状态信息
-    if (CODE_STATUS.count(code_)) {
-        status = CODE_STATUS.at(code_);
-    }
-    else {
+    const char* status = HttpTables::StatusText(code_);
+    if (!status) {
         code_ = 400;
-        status = CODE_STATUS.at(400);
+        status = HttpTables::StatusText(400);
     }
     // 添加状态行
-    buff.Append("HTTP/1.1 " + std::to_string(code_) + " " + status + "\r\n");
+    char line[64];
+    int len = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", code_, status);
+    buff.Append(line, len);
 }
 
 void HttpResponse::AddHeader_(Buffer& buff) {
@@ -114,79 +233,68 @@ void HttpResponse::AddHeader_(Buffer& buff) {
     else {
         buff.Append("close\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    buff.Append("Content-type: ");
+    if (hasContent_) {
+        buff.Append(contentType_);
+    }
+    else {
+        buff.Append(HttpTables::MimeType(path_.data(), path_.size()));
+    }
+    buff.Append("\r\n");
+    if (gzipped_) {
+        buff.Append("Content-Encoding: gzip\r\n");
+    }
+    if (varyEncoding_) {
+        buff.Append("Vary: Accept-Encoding\r\n");
+    }
+    buff.Append(extraHeaders_);
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
-    // 以只读方式打开
-    int srcFd = open((srcDir_ + path_).c_str(), O_RDONLY);
-    if (srcFd < 0) {
-        ErrorContent(buff, "File NotFound!");
-        return;
-    }
-
-    /*
-        将文件映射到内存提高文件的访问速度
-        MAP_PRIVATE 建立一个写入时拷贝的私有映射
-    */
-    // LOG_DEBUG("Content file path: %s", (srcDir_ + path_).c_str());
-    // 把 文件 fd 的 offset 偏移量开始的 length 字节 映射到 虚拟空间 start 地址开始的 lenth 字节
-    int* mmRet = (int*)mmap(NULL, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if (*mmRet == -1) {
+    if (!FileFound_()) {
         ErrorContent(buff, "File NotFound!");
         return;
     }
-    mmFile_ = (char*)mmRet; // 记录映射的首地址
-    close(srcFd);
-    buff.Append("Content-length: " + std::to_string(mmFileStat_.st_size) + "\r\n\r\n");
-
+    AddContentLength_(buff, file_->st.st_size);
 }
 
-std::string HttpResponse::GetFileType_() {
-    std::string::size_type idx = path_.find_last_of('.');
-
-    if (idx == std::string::npos) {
-        return "text/plain";
-    }
-    std::string suffix = path_.substr(idx);
-    if (SUFFIX_TYPE.count(suffix)) {
-        return SUFFIX_TYPE.at(suffix);
-    }
-    return "text/plain";
+void HttpResponse::AddContentLength_(Buffer& buff, size_t len) {
+    char line[64];
+    int n = snprintf(line, sizeof(line), "Content-length: %zu\r\n\r\n", len);
+    buff.Append(line, n);
 }
 
 void HttpResponse::ErrorContent(Buffer& buff, std::string message) {
+    std::string body = ErrorBody_(message);
+    AddContentLength_(buff, body.size());
+    buff.Append(body);
+}
+
+std::string HttpResponse::ErrorBody_(const std::string& message) const {
     std::string body;
-    std::string status;
+    const char* status = HttpTables::StatusText(code_);
     body += "<html><title>Error</title>";
     body += "<body bgcolor=\"ffffff\">";
 
-    if (CODE_STATUS.count(code_)) {
-        status = CODE_STATUS.at(code_);
-    }
-    else {
+    if (!status) {
         status = "Bad Request";
     }
 
     body += std::to_string(code_) + " : " + status + "\n";
     body += "<p>" + message + "</p>";
     body += "<hr><em>TinyWebServer</em></body></html>";
-
-    buff.Append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+    return body;
 }
 
 char* HttpResponse::File() {
-    return mmFile_;
+    return file_ ? file_->addr : nullptr;
 }
 
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    return (file_ && file_->addr) ? file_->st.st_size : 0;
 }
 
 void HttpResponse::UnmapFile() {
-    if (mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
-    }
+    // 其他响应可能还在发送同一个映射, 由最后一个引用负责 munmap
+    file_.reset();
 }
\ No newline at end of file
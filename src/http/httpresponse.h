@@ -8,11 +8,41 @@
 
 #include <unordered_map>
 #include <string>
+#include <memory>
 #include <sys/stat.h>         // stat
 #include <fcntl.h>            // open
 #include <unistd.h>           // close
 #include <sys/mman.h>         // mmap, munmap
 #include "../buffer/buffer.h"
+#include "../pool/singleflight.hpp"
+#include "pathcache.h"
+#include "hpack.h"
+
+// 映射(或读入)到内存的文件, 可以被多个响应共享, 最后一个引用释放时 munmap / delete
+struct MappedFile {
+    bool found;           // stat 成功
+    struct stat st;
+    char* addr;           // 只有普通的、其他用户可读的非空文件才有内容
+    bool mapped;          // true-mmap 得到, false-new 出来的缓冲
+    std::shared_ptr<const void> owner;  // 非空时 addr 指向 owner 持有的内存(如资源包的映射), 不单独释放
+
+    MappedFile() : found(false), addr(nullptr), mapped(false) {
+        memset(&st, 0, sizeof(st));
+    }
+    ~MappedFile() {
+        if (owner) {
+            return;
+        }
+        if (addr && mapped) {
+            munmap(addr, st.st_size);
+        }
+        else {
+            delete[] addr;
+        }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
 
 class HttpResponse {
 public:
@@ -26,11 +56,56 @@ public:
     /// @param code 状态码
     void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
 
+    /// @brief 添加额外的首部行(在 Init 之后, MakeResponse 之前调用)
+    /// @param key 字段名
+    /// @param value 字段值
+    void SetHeader(const std::string& key, const std::string& value);
+
+    /// @brief 改为发送资源目录中的另一个文件(handler 中调用)
+    /// @param path 文件路径(以 '/' 开头)
+    void SetPath(const std::string& path) {
+        path_ = path;
+    }
+
+    /// @brief 设置状态码(handler 中调用, 非 200 时发送错误页面)
+    /// @param code 状态码
+    void SetCode(int code) {
+        code_ = code;
+    }
+
+    /// @brief 响应后是否保持连接(请求体没有读完时只能关闭)
+    /// @param isKeepAlive true-保持
+    void SetKeepAlive(bool isKeepAlive) {
+        isKeepAlive_ = isKeepAlive;
+    }
+
+    /// @brief 响应后是否保持连接
+    /// @return true-yes, false-no
+    bool IsKeepAlive() const {
+        return isKeepAlive_;
+    }
+
+    /// @brief 直接发送一段内容而不是文件(handler 中调用)
+    /// @param body 内容
+    /// @param contentType Content-type
+    void SetContent(const std::string& body, const std::string& contentType);
+
+    /// @brief 客户端是否接受 gzip(在 Init 之后, MakeResponse 之前调用), 资源包中有压缩内容时直接发送
+    /// @param accept true-接受
+    void SetAcceptGzip(bool accept) {
+        acceptGzip_ = accept;
+    }
+
     /// @brief 组织响应报文
     /// @param buff 组织报文的结果
     void MakeResponse(Buffer& buff);
 
-    /// @brief 释放虚拟地址
+    /// @brief 组织 HTTP/2 响应(与 MakeResponse 走同一套文件查找), 不含 Connection 之类的逐跳首部
+    /// @param headers 首部(名字为小写, 第一个是 :status)
+    /// @param body 不是文件时要发送的内容(SetContent 的内容、错误文本); 文件内容用 File() / FileLen()
+    void MakeHttp2Response(Hpack::HeaderList* headers, std::string* body);
+
+    /// @brief 释放对映射文件的引用
     void UnmapFile();
 
     /// @brief 返回文件映射到虚拟空间的地址
@@ -63,11 +138,28 @@ private:
     /// @param buff 拼接后的结果
     void AddContent_(Buffer& buff);
 
+    /// @brief 查找要发送的文件, 确定状态码(出错时换成错误页面)
+    void PrepareFile_();
+    /// @brief 要发送的文件是否存在且已经映射
+    bool FileFound_() const;
+    /// @brief 错误的文本信息
+    /// @param message 附加信息
+    /// @return HTML 文本
+    std::string ErrorBody_(const std::string& message) const;
     /// @brief 当错误码发生时给出错误页面
     void ErrorHtml_();
-    /// @brief 将请求的文件类型转化为 Content-type
-    /// @return Content-type
-    std::string GetFileType_();
+    /// @brief 解析 path_ (依次查资源包、资源缓存的内存快照、路径缓存)
+    /// @param cached 资源包或资源缓存中已经在内存中的文件(没有时为空)
+    /// @return 解析结果
+    PathCache::Resolution Resolve_(std::shared_ptr<const MappedFile>* cached);
+    /// @brief stat + open + mmap 一个文件, 并发请求同一个文件时只做一次
+    /// @param path 文件的完整路径
+    /// @return 文件(失败时 found == false 或 addr == nullptr)
+    static std::shared_ptr<const MappedFile> LoadFile_(const std::string& path);
+    /// @brief 添加 Content-length 首部行和空行
+    /// @param buff 拼接后的结果
+    /// @param len 内容长度
+    static void AddContentLength_(Buffer& buff, size_t len);
 
 private:
     int code_;
@@ -75,13 +167,17 @@ private:
 
     std::string path_;
     std::string srcDir_;
+    std::string extraHeaders_;  // SetHeader 添加的首部行
+    bool acceptGzip_;           // 客户端接受 gzip
+    bool gzipped_;              // 发送的是 gzip 压缩后的内容
+    bool varyEncoding_;         // 内容随 Accept-Encoding 变化
+    bool hasContent_;           // 发送 SetContent 设置的内容
+    std::string content_;
+    std::string contentType_;
 
-    char* mmFile_;
-    struct stat mmFileStat_;
+    std::shared_ptr<const MappedFile> file_;
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
-    static const std::unordered_map<int, std::string> CODE_STATUS;
-    static const std::unordered_map<int, std::string> CODE_PATH;
+    static SingleFlight<std::string, std::shared_ptr<const MappedFile>> fileFlight_;
 };
 
 
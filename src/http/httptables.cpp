@@ -0,0 +1,175 @@
+#include "httptables.h"
+
+#include <stdint.h>
+
+
+namespace {
+
+struct MimeEntry {
+    const char* suffix;     // 小写, 含 '.'
+    const char* type;
+};
+
+constexpr MimeEntry MIME_TYPES[] = {
+    {".html",  "text/html"},
+    {".htm",   "text/html"},
+    {".xml",   "text/xml"},
+    {".xhtml", "application/xhtml+xml"},
+    {".txt",   "text/plain"},
+    {".rtf",   "application/rtf"},
+    {".pdf",   "application/pdf"},
+    {".word",  "application/nsword"},
+    {".png",   "image/png"},
+    {".gif",   "image/gif"},
+    {".jpg",   "image/jpeg"},
+    {".jpeg",  "image/jpeg"},
+    {".svg",   "image/svg+xml"},
+    {".ico",   "image/x-icon"},
+    {".webp",  "image/webp"},
+    {".au",    "audio/basic"},
+    {".mpeg",  "video/mpeg"},
+    {".mpg",   "video/mpeg"},
+    {".avi",   "video/x-msvideo"},
+    {".mp4",   "video/mp4"},
+    {".webm",  "video/webm"},
+    {".gz",    "application/x-gzip"},
+    {".tar",   "application/x-tar"},
+    {".css",   "text/css"},
+    {".js",    "text/javascript"},
+    {".json",  "application/json"},
+    {".woff",  "font/woff"},
+    {".woff2", "font/woff2"},
+    {".ttf",   "font/ttf"},
+    {".otf",   "font/otf"},
+    {".eot",   "application/vnd.ms-fontobject"},
+};
+
+constexpr size_t MIME_NUM = sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]);
+constexpr size_t MIME_SLOTS = 128;          // 2 的幂, 取模变成与运算
+constexpr size_t MIME_MAX_SUFFIX = 8;       // 更长的后缀直接当作未知
+
+constexpr char Lower(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+constexpr size_t Length(const char* s) {
+    size_t len = 0;
+    while (s[len]) {
+        ++len;
+    }
+    return len;
+}
+
+// FNV-1a, 种子混入初始值
+constexpr uint32_t Hash(const char* s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(Lower(s[i]));
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+constexpr bool IsPerfect(uint32_t seed) {
+    bool used[MIME_SLOTS] = {};
+    for (size_t i = 0; i < MIME_NUM; ++i) {
+        size_t slot = Hash(MIME_TYPES[i].suffix, Length(MIME_TYPES[i].suffix), seed) & (MIME_SLOTS - 1);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t FindSeed() {
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        if (IsPerfect(seed)) {
+            return seed;
+        }
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t MIME_SEED = FindSeed();
+static_assert(MIME_SEED != UINT32_MAX, "no perfect hash seed for MIME_TYPES, enlarge MIME_SLOTS");
+
+// 槽 -> MIME_TYPES 下标 + 1 (0 表示空槽)
+struct MimeSlots {
+    uint8_t index[MIME_SLOTS];
+    uint8_t suffixLen[MIME_NUM];
+};
+
+constexpr MimeSlots BuildSlots() {
+    MimeSlots slots = {};
+    for (size_t i = 0; i < MIME_NUM; ++i) {
+        size_t len = Length(MIME_TYPES[i].suffix);
+        slots.index[Hash(MIME_TYPES[i].suffix, len, MIME_SEED) & (MIME_SLOTS - 1)] = static_cast<uint8_t>(i + 1);
+        slots.suffixLen[i] = static_cast<uint8_t>(len);
+    }
+    return slots;
+}
+
+constexpr MimeSlots MIME_SLOT_TABLE = BuildSlots();
+
+}
+
+
+const char* HttpTables::MimeType(const char* path, size_t len) {
+    // 最后一个 '.' 之后(且在最后一个 '/' 之后)是后缀
+    size_t dot = len;
+    for (size_t i = len; i > 0 && len - i < MIME_MAX_SUFFIX; --i) {
+        if (path[i - 1] == '.') {
+            dot = i - 1;
+            break;
+        }
+        if (path[i - 1] == '/') {
+            break;
+        }
+    }
+    if (dot == len) {
+        return "text/plain";
+    }
+    const char* suffix = path + dot;
+    size_t suffixLen = len - dot;
+    uint8_t idx = MIME_SLOT_TABLE.index[Hash(suffix, suffixLen, MIME_SEED) & (MIME_SLOTS - 1)];
+    if (idx == 0 || MIME_SLOT_TABLE.suffixLen[idx - 1] != suffixLen) {
+        return "text/plain";
+    }
+    const MimeEntry& entry = MIME_TYPES[idx - 1];
+    for (size_t i = 0; i < suffixLen; ++i) {
+        if (Lower(suffix[i]) != entry.suffix[i]) {
+            return "text/plain";
+        }
+    }
+    return entry.type;
+}
+
+const char* HttpTables::StatusText(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 507: return "Insufficient Storage";
+        default:  return nullptr;
+    }
+}
+
+const char* HttpTables::ErrorPage(int code) {
+    switch (code) {
+        case 400: return "/400.html";
+        case 403: return "/403.html";
+        case 404: return "/404.html";
+        case 405: return "/405.html";
+        default:  return nullptr;
+    }
+}
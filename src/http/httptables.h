@@ -0,0 +1,36 @@
+/*
+    响应用到的静态表: 文件后缀 -> MIME 类型, 状态码 -> 状态信息 / 错误页面
+
+    MIME 表是编译期生成的完美哈希表: 编译时搜索一个种子, 使所有后缀的哈希值落在不同的槽里
+    (static_assert 保证), 查找时只算一次哈希、比较一次后缀, 不分配内存.
+    状态码用 switch, 由编译器生成跳转表.
+*/
+
+#ifndef HTTP_TABLES_H
+#define HTTP_TABLES_H
+
+#include <stddef.h>
+
+class HttpTables {
+public:
+    /// @brief 根据文件路径的后缀取 MIME 类型(后缀不区分大小写)
+    /// @param path 文件路径
+    /// @param len 路径长度
+    /// @return MIME 类型(未知后缀返回 "text/plain")
+    static const char* MimeType(const char* path, size_t len);
+
+    /// @brief 状态码对应的状态信息
+    /// @param code 状态码
+    /// @return 状态信息(不支持的状态码返回 nullptr)
+    static const char* StatusText(int code);
+
+    /// @brief 状态码对应的错误页面
+    /// @param code 状态码
+    /// @return 错误页面路径(没有错误页面时返回 nullptr)
+    static const char* ErrorPage(int code);
+
+    HttpTables() = delete;
+};
+
+
+#endif
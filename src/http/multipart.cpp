@@ -0,0 +1,258 @@
+#include "multipart.h"
+
+#include <algorithm>
+#include <string.h>
+#include <strings.h>
+#include "formdecoder.h"
+
+
+namespace {
+
+inline std::string_view Trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+inline bool EqualsNoCase(std::string_view a, const char* b) {
+    size_t len = strlen(b);
+    return a.size() == len && strncasecmp(a.data(), b, len) == 0;
+}
+
+// 取出 "; key=value; key2="value2"" 中的参数值(去掉引号)
+bool GetParam(std::string_view params, const char* key, std::string_view* value) {
+    while (!params.empty()) {
+        size_t semi = params.find(';');
+        std::string_view item = Trim(params.substr(0, semi));
+        params = (semi == std::string_view::npos) ? std::string_view() : params.substr(semi + 1);
+        size_t eq = item.find('=');
+        if (eq == std::string_view::npos || !EqualsNoCase(Trim(item.substr(0, eq)), key)) {
+            continue;
+        }
+        std::string_view v = Trim(item.substr(eq + 1));
+        if (v.size() >= 2 && v.front() == '"' && v.back() == '"') {
+            v = v.substr(1, v.size() - 2);
+        }
+        *value = v;
+        return true;
+    }
+    return false;
+}
+
+}
+
+
+bool MultipartParser::ParseBoundary(std::string_view contentType, std::string_view* boundary) {
+    size_t semi = contentType.find(';');
+    if (!EqualsNoCase(Trim(contentType.substr(0, semi)), "multipart/form-data") || semi == std::string_view::npos) {
+        return false;
+    }
+    std::string_view value;
+    if (!GetParam(contentType.substr(semi + 1), "boundary", &value) || value.empty() || value.size() > MAX_BOUNDARY) {
+        return false;
+    }
+    *boundary = value;
+    return true;
+}
+
+bool MultipartParser::Reset(std::string_view contentType) {
+    std::string_view boundary;
+    if (!ParseBoundary(contentType, &boundary)) {
+        state_ = FAILED;
+        return false;
+    }
+    delim_.assign("\r\n--");
+    delim_.append(boundary.data(), boundary.size());
+    // 第一个分隔符前面没有 "\r\n": 假装请求体之前有一个, 统一按 delim_ 查找
+    carry_.assign("\r\n");
+    tail_.clear();
+    headers_.clear();
+    state_ = PREAMBLE;
+    return true;
+}
+
+bool MultipartParser::Feed(const char* data, size_t len) {
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end) {
+        switch (state_) {
+            case PREAMBLE:
+            case DATA:
+                p = ScanData_(p, end);
+                break;
+            case BOUNDARY_TAIL:
+                p = ScanBoundaryTail_(p, end);
+                break;
+            case HEADERS:
+                p = ScanHeaders_(p, end);
+                break;
+            case DONE:
+                // 结束分隔符之后的内容忽略
+                return true;
+            default:
+                return false;
+        }
+    }
+    return state_ != FAILED;
+}
+
+const char* MultipartParser::ScanData_(const char* p, const char* end) {
+    size_t delimLen = delim_.size();
+    if (!carry_.empty()) {
+        // 上一段的末尾可能是分隔符的开头: 和这一段的开头拼起来查找
+        size_t carryLen = carry_.size();
+        size_t take = std::min(static_cast<size_t>(end - p), delimLen);
+        carry_.append(p, take);
+        const char* found = FormDecoder::Find(carry_.data(), carry_.size(), delim_.data(), delimLen);
+        if (found) {
+            size_t pos = found - carry_.data();
+            if (!Emit_(carry_.data(), pos)) {
+                return end;
+            }
+            carry_.clear();
+            OnDelimiter_();
+            return p + (pos + delimLen - carryLen);
+        }
+        if (take == delimLen) {
+            // 从 carry_ 开始的分隔符一定在拼接的范围内结束: 没有找到就说明 carry_ 都是内容
+            if (!Emit_(carry_.data(), carryLen)) {
+                return end;
+            }
+            carry_.clear();
+            return p;
+        }
+        // 这一段太短, 全部并入 carry_, 只留下可能是分隔符开头的部分
+        size_t keep = std::min(carry_.size(), delimLen - 1);
+        if (!Emit_(carry_.data(), carry_.size() - keep)) {
+            return end;
+        }
+        carry_.erase(0, carry_.size() - keep);
+        return end;
+    }
+
+    const char* found = FormDecoder::Find(p, end - p, delim_.data(), delimLen);
+    if (found) {
+        if (!Emit_(p, found - p)) {
+            return end;
+        }
+        OnDelimiter_();
+        return found + delimLen;
+    }
+    size_t keep = std::min(static_cast<size_t>(end - p), delimLen - 1);
+    if (!Emit_(p, end - p - keep)) {
+        return end;
+    }
+    carry_.assign(end - keep, keep);
+    return end;
+}
+
+bool MultipartParser::Emit_(const char* data, size_t len) {
+    if (state_ == DATA && len > 0 && !handler_->OnPartData(data, len)) {
+        state_ = FAILED;
+        return false;
+    }
+    return true;
+}
+
+void MultipartParser::OnDelimiter_() {
+    if (state_ == DATA && !handler_->OnPartEnd()) {
+        state_ = FAILED;
+        return;
+    }
+    tail_.clear();
+    state_ = BOUNDARY_TAIL;
+}
+
+const char* MultipartParser::ScanBoundaryTail_(const char* p, const char* end) {
+    // "--" 结束; 否则允许若干空白后跟 "\r\n"
+    while (p < end) {
+        char ch = *p++;
+        tail_.push_back(ch);
+        if (tail_[0] == '-') {
+            if (tail_.size() == 2) {
+                state_ = (ch == '-') ? DONE : FAILED;
+                return p;
+            }
+            continue;
+        }
+        if (ch == '\n') {
+            size_t n = tail_.size();
+            bool ok = n >= 2 && tail_[n - 2] == '\r' &&
+                      std::all_of(tail_.begin(), tail_.end() - 2, [](char c) { return c == ' ' || c == '\t'; });
+            if (ok) {
+                headers_.clear();
+                state_ = HEADERS;
+            }
+            else {
+                state_ = FAILED;
+            }
+            return p;
+        }
+        if ((ch != ' ' && ch != '\t' && ch != '\r') || tail_.size() > MAX_BOUNDARY) {
+            state_ = FAILED;
+            return p;
+        }
+    }
+    return p;
+}
+
+const char* MultipartParser::ScanHeaders_(const char* p, const char* end) {
+    size_t old = headers_.size();
+    size_t take = std::min(static_cast<size_t>(end - p), MAX_PART_HEADER - old);
+    headers_.append(p, take);
+
+    size_t headerLen = 0;
+    if (headers_.size() >= 2 && headers_[0] == '\r' && headers_[1] == '\n') {
+        // 没有首部
+        headerLen = 2;
+    }
+    else {
+        size_t from = old >= 3 ? old - 3 : 0;
+        const char* found = FormDecoder::Find(headers_.data() + from, headers_.size() - from, "\r\n\r\n", 4);
+        if (!found) {
+            if (headers_.size() >= MAX_PART_HEADER) {
+                state_ = FAILED;
+            }
+            return p + take;
+        }
+        headerLen = found - headers_.data() + 4;
+    }
+    if (!ParsePartHeaders_(headerLen)) {
+        state_ = FAILED;
+        return end;
+    }
+    state_ = DATA;
+    return p + (headerLen - old);
+}
+
+bool MultipartParser::ParsePartHeaders_(size_t len) {
+    Part part;
+    part.isFile = false;
+    std::string_view headers(headers_.data(), len);
+    while (!headers.empty()) {
+        size_t lineEnd = headers.find("\r\n");
+        std::string_view line = headers.substr(0, lineEnd);
+        headers = (lineEnd == std::string_view::npos) ? std::string_view() : headers.substr(lineEnd + 2);
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string_view key = Trim(line.substr(0, colon));
+        std::string_view value = Trim(line.substr(colon + 1));
+        if (EqualsNoCase(key, "Content-Disposition")) {
+            size_t semi = value.find(';');
+            if (semi != std::string_view::npos) {
+                GetParam(value.substr(semi + 1), "name", &part.name);
+                part.isFile = GetParam(value.substr(semi + 1), "filename", &part.filename);
+            }
+        }
+        else if (EqualsNoCase(key, "Content-Type")) {
+            part.contentType = value;
+        }
+    }
+    return handler_->OnPartBegin(part);
+}
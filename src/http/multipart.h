@@ -0,0 +1,98 @@
+/*
+    multipart/form-data 的增量解析
+
+    请求体可以分任意多段喂给解析器, 每个部分的内容边解析边交给 Handler, 不在内存中攒完整.
+    解析器只保存跨段的分隔符前缀(不超过分隔符长度)和当前部分的首部(有上限).
+    分隔符用 FormDecoder::Find 查找.
+*/
+
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <string>
+#include <string_view>
+#include <stddef.h>
+
+class MultipartParser {
+public:
+    static const size_t MAX_BOUNDARY = 70;          // RFC 2046
+    static const size_t MAX_PART_HEADER = 8 * 1024; // 每个部分首部的上限
+
+    // 一个部分的首部信息, 指向解析器内部的缓冲区, 只在 OnPartBegin 中有效
+    struct Part {
+        std::string_view name;          // Content-Disposition 的 name
+        std::string_view filename;      // Content-Disposition 的 filename
+        std::string_view contentType;
+        bool isFile;                    // 带有 filename 参数
+    };
+
+    // 解析结果的接收者, 任何一个回调返回 false 时解析失败
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        /// @brief 一个部分开始
+        virtual bool OnPartBegin(const Part& part) = 0;
+        /// @brief 部分内容的一段(可能分多次)
+        virtual bool OnPartData(const char* data, size_t len) = 0;
+        /// @brief 一个部分结束
+        virtual bool OnPartEnd() = 0;
+    };
+
+    explicit MultipartParser(Handler* handler) : handler_(handler), state_(FAILED) {}
+
+    /// @brief 从 Content-Type 中取出 boundary
+    /// @param contentType Content-Type 首部的值
+    /// @param boundary 结果
+    /// @return 不是 multipart/form-data 或者 boundary 不合法时返回 false
+    static bool ParseBoundary(std::string_view contentType, std::string_view* boundary);
+
+    /// @brief 开始解析一个新的请求体
+    /// @param contentType Content-Type 首部的值
+    /// @return false-不是 multipart/form-data
+    bool Reset(std::string_view contentType);
+
+    /// @brief 喂入一段请求体
+    /// @param data 数据
+    /// @param len 长度
+    /// @return false-格式错误或 Handler 拒绝
+    bool Feed(const char* data, size_t len);
+
+    /// @brief 是否已经读到结束分隔符
+    bool Done() const {
+        return state_ == DONE;
+    }
+
+private:
+    enum State {
+        PREAMBLE,       // 第一个分隔符之前(丢弃)
+        BOUNDARY_TAIL,  // 分隔符之后: "--" 表示结束, 否则是 "\r\n"
+        HEADERS,        // 部分的首部
+        DATA,           // 部分的内容
+        DONE,
+        FAILED,
+    };
+
+    /// @brief 在 PREAMBLE / DATA 中查找分隔符
+    /// @return 处理到的位置
+    const char* ScanData_(const char* p, const char* end);
+    const char* ScanBoundaryTail_(const char* p, const char* end);
+    const char* ScanHeaders_(const char* p, const char* end);
+    /// @brief 交出一段内容(PREAMBLE 中直接丢弃)
+    bool Emit_(const char* data, size_t len);
+    /// @brief 找到了分隔符
+    void OnDelimiter_();
+    /// @brief 解析部分的首部
+    /// @param len 首部的长度(含结尾的空行)
+    bool ParsePartHeaders_(size_t len);
+
+private:
+    Handler* handler_;
+    State state_;
+    std::string delim_;     // "\r\n--" + boundary
+    std::string carry_;     // 上一段末尾可能是分隔符开头的部分
+    std::string tail_;      // 分隔符之后的字节
+    std::string headers_;   // 当前部分的首部
+};
+
+
+#endif
@@ -0,0 +1,138 @@
+#include "pathcache.h"
+
+#include <sys/stat.h>
+#include <functional>
+
+
+PathCache::PathCache() : shardCapacity_(0), foundTtl_(0), missTtl_(0),
+                         hitCount_(0), missCount_(0)
+{ }
+
+void PathCache::Init(size_t capacity, int foundTtlMS, int missTtlMS) {
+    shardCapacity_ = (capacity + SHARD_NUM - 1) / SHARD_NUM;
+    foundTtl_ = std::chrono::milliseconds(foundTtlMS);
+    missTtl_ = std::chrono::milliseconds(missTtlMS);
+    Clear();
+}
+
+PathCache::Shard& PathCache::ShardOf_(const std::string& path) {
+    return shards_[std::hash<std::string>()(path) % SHARD_NUM];
+}
+
+PathCache::Resolution PathCache::Stat_(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+        return NOT_FOUND;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return DIRECTORY;
+    }
+    if (!(st.st_mode & S_IROTH)) {
+        return FORBIDDEN;
+    }
+    return REGULAR_FILE;
+}
+
+PathCache::Resolution PathCache::Resolve(const std::string& path) {
+    if (shardCapacity_ == 0) {
+        return Stat_(path);
+    }
+    Shard& shard = ShardOf_(path);
+    {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it = shard.index.find(path);
+        if (it != shard.index.end()) {
+            if (it->second->expires >= Clock::now()) {
+                hitCount_.fetch_add(1, std::memory_order_relaxed);
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                return it->second->resolution;
+            }
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+
+    // 在锁外 stat
+    missCount_.fetch_add(1, std::memory_order_relaxed);
+    Resolution resolution = Stat_(path);
+    Clock::time_point expires = Clock::now() + (resolution == NOT_FOUND ? missTtl_ : foundTtl_);
+
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.index.find(path);
+    if (it != shard.index.end()) {
+        // 其他线程已经写入
+        it->second->resolution = resolution;
+        it->second->expires = expires;
+        return resolution;
+    }
+    if (shard.lru.size() >= shardCapacity_) {
+        // 淘汰最久没用过的
+        shard.index.erase(shard.lru.back().path);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(Entry{path, resolution, expires});
+    shard.index[path] = shard.lru.begin();
+    return resolution;
+}
+
+void PathCache::Invalidate(const std::string& path) {
+    Shard& shard = ShardOf_(path);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.index.find(path);
+    if (it != shard.index.end()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+void PathCache::Clear() {
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        shard.lru.clear();
+        shard.index.clear();
+    }
+}
+
+bool PathCache::Canonicalize(const std::string& path, std::string* out) {
+    size_t end = path.find_first_of("?#");
+    if (end == std::string::npos) {
+        end = path.size();
+    }
+    if (end == 0 || path[0] != '/') {
+        return false;
+    }
+    std::string result;
+    result.reserve(end);
+    size_t pos = 0;
+    while (pos < end) {
+        // 跳过连续的 '/'
+        while (pos < end && path[pos] == '/') {
+            ++pos;
+        }
+        size_t next = path.find('/', pos);
+        if (next == std::string::npos || next > end) {
+            next = end;
+        }
+        size_t len = next - pos;
+        if (len == 0 || (len == 1 && path[pos] == '.')) {
+            // 空段 或 "."
+        }
+        else if (len == 2 && path[pos] == '.' && path[pos + 1] == '.') {
+            // 不允许跳出资源目录
+            return false;
+        }
+        else {
+            result += '/';
+            result.append(path, pos, len);
+        }
+        pos = next;
+    }
+    if (result.find('\0') != std::string::npos) {
+        return false;
+    }
+    if (result.empty() || path[end - 1] == '/') {
+        result += '/';
+    }
+    *out = result;
+    return true;
+}
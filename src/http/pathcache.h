@@ -0,0 +1,109 @@
+/*
+    路径解析结果缓存
+
+    规范化后的完整路径 -> 解析结果(普通文件 / 不存在 / 禁止访问 / 目录), 带很短的有效期.
+    扫描器请求大量不存在的路径时, 重复的请求只需要一次哈希查找, 不再 stat.
+    按路径哈希分片, 每个分片一把锁 + LRU 链表, 容量有上限.
+*/
+
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <string>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <stdint.h>
+
+class PathCache {
+public:
+    // 路径的解析结果
+    enum Resolution {
+        REGULAR_FILE = 0,   // 存在且其他用户可读的文件
+        NOT_FOUND,
+        FORBIDDEN,          // 存在但其他用户不可读
+        DIRECTORY,
+    };
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return PathCache指针
+    static PathCache* GetInstance() {
+        static PathCache inst;
+        return &inst;
+    }
+
+    /// @brief 初始化(清空已有条目)
+    /// @param capacity 最多缓存的路径数(0 表示关闭缓存, 每次都 stat)
+    /// @param foundTtlMS 存在的路径的有效期(单位:ms)
+    /// @param missTtlMS 不存在的路径的有效期(单位:ms)
+    void Init(size_t capacity, int foundTtlMS, int missTtlMS);
+
+    /// @brief 解析路径(优先使用缓存)
+    /// @param path 规范化之后的完整路径
+    /// @return 解析结果
+    Resolution Resolve(const std::string& path);
+
+    /// @brief 删除一个路径的缓存
+    /// @param path 完整路径
+    void Invalidate(const std::string& path);
+
+    /// @brief 清空所有缓存
+    void Clear();
+
+    /// @brief 规范化请求路径: 去掉查询串和片段, 合并重复的 '/', 去掉 "." 段
+    /// @param path 请求行中的路径
+    /// @param out 规范化后的路径(以 '/' 开头)
+    /// @return false-路径非法(不以 '/' 开头, 含有 ".." 段或 '\0')
+    static bool Canonicalize(const std::string& path, std::string* out);
+
+    /// @brief 命中次数
+    uint64_t HitCount() const {
+        return hitCount_.load(std::memory_order_relaxed);
+    }
+
+    /// @brief 未命中(实际 stat)次数
+    uint64_t MissCount() const {
+        return missCount_.load(std::memory_order_relaxed);
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        std::string path;
+        Resolution resolution;
+        Clock::time_point expires;
+    };
+
+    // 一个分片: LRU 链表(表头最新) + 索引
+    struct Shard {
+        std::mutex mtx;
+        std::list<Entry> lru;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    PathCache();
+    ~PathCache() = default;
+
+    /// @brief 路径对应的分片
+    Shard& ShardOf_(const std::string& path);
+    /// @brief 实际 stat 一次
+    static Resolution Stat_(const std::string& path);
+
+private:
+    static const size_t SHARD_NUM = 16;
+
+    size_t shardCapacity_;
+    std::chrono::milliseconds foundTtl_;
+    std::chrono::milliseconds missTtl_;
+    Shard shards_[SHARD_NUM];
+
+    std::atomic<uint64_t> hitCount_;
+    std::atomic<uint64_t> missCount_;
+};
+
+
+#endif
@@ -0,0 +1,652 @@
+#include "proxy.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "tlscontext.h"
+
+
+namespace {
+
+// 逐跳首部: 只对一跳连接有意义, 不转发(Content-Length / Expect 由本端重新生成或已经处理)
+const char* const HOP_BY_HOP[] = {
+    "Connection", "Keep-Alive", "Proxy-Connection", "TE", "Trailer", "Transfer-Encoding", "Upgrade",
+};
+
+bool EqualsIgnoreCase(const char* a, size_t alen, const char* b) {
+    return strlen(b) == alen && strncasecmp(a, b, alen) == 0;
+}
+
+// Connection 首部中列出的 token(小写), 这些首部同样是逐跳的
+std::vector<std::string> ConnectionTokens(const char* value, size_t len) {
+    std::vector<std::string> tokens;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t end = pos;
+        while (end < len && value[end] != ',') {
+            ++end;
+        }
+        size_t b = pos, e = end;
+        while (b < e && (value[b] == ' ' || value[b] == '\t')) {
+            ++b;
+        }
+        while (e > b && (value[e - 1] == ' ' || value[e - 1] == '\t')) {
+            --e;
+        }
+        if (e > b) {
+            std::string token(value + b, e - b);
+            std::transform(token.begin(), token.end(), token.begin(), ::tolower);
+            tokens.push_back(token);
+        }
+        pos = end + 1;
+    }
+    return tokens;
+}
+
+bool IsHopByHop(const char* name, size_t len, const std::vector<std::string>& tokens) {
+    for (const char* hop : HOP_BY_HOP) {
+        if (EqualsIgnoreCase(name, len, hop)) {
+            return true;
+        }
+    }
+    for (const std::string& token : tokens) {
+        if (EqualsIgnoreCase(name, len, token.c_str())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HasToken(const std::vector<std::string>& tokens, const char* token) {
+    return std::find(tokens.begin(), tokens.end(), token) != tokens.end();
+}
+
+}
+
+
+ProxyHandler::ProxyHandler(const std::vector<std::string>& upstreams, const std::string& stripPrefix)
+    : group_(upstreams), stripPrefix_(stripPrefix) {
+    // splice 写 socket 没有 MSG_NOSIGNAL, 客户端断开时不能让 SIGPIPE 结束进程
+    signal(SIGPIPE, SIG_IGN);
+}
+
+HttpHandler::Result ProxyHandler::Handle(HttpRequest& /*request*/, const RouteParams& /*params*/, HttpResponse& response) {
+    response.SetCode(502);
+    response.SetContent("Proxy routes are served over HTTP/1.1 only\n", "text/plain");
+    return DONE;
+}
+
+std::string ProxyHandler::Target(const HttpRequest& request) const {
+    std::string target = request.path();
+    if (!stripPrefix_.empty() && target.compare(0, stripPrefix_.size(), stripPrefix_) == 0) {
+        target.erase(0, stripPrefix_.size());
+        if (target.empty() || target[0] != '/') {
+            target.insert(0, "/");
+        }
+    }
+    if (!request.query().empty()) {
+        target += '?';
+        target += request.query();
+    }
+    return target;
+}
+
+
+std::function<void(int)> ProxyExchange::unwatch;
+
+ProxyExchange::ProxyExchange(ProxyHandler* handler, const HttpRequest& request, const char* clientIp,
+                             int clientFd, TlsSession* tls)
+    : handler_(handler), clientFd_(clientFd), tls_(tls), clientKeepAlive_(request.IsKeepAlive()),
+      headRequest_(request.methodId() == Router::HEAD),
+      idempotent_(request.methodId() != Router::POST && request.methodId() != Router::PATCH), state_(START), tries_(0), upstream_(nullptr),
+      fd_(-1), reused_(false), watched_(false), reusable_(false), sent_(0), outOffset_(0), status_(0),
+      framing_(NO_BODY), upstreamKeepAlive_(false), remaining_(0), chunkState_(CHUNK_SIZE), chunkLeft_(0),
+      lineLen_(0), chunkDone_(false), chunkError_(false), piped_(0), bytes_(0) {
+    pipe_[0] = pipe_[1] = -1;
+
+    // 请求行 + 去掉逐跳首部的原始首部 + X-Forwarded-* + 重新生成的 Content-Length, 上游连接总是 keep-alive
+    const std::unordered_map<std::string, std::string>& headers = request.headers();
+    std::vector<std::string> tokens;
+    for (const auto& header : headers) {
+        if (strcasecmp(header.first.c_str(), "Connection") == 0) {
+            tokens = ConnectionTokens(header.second.data(), header.second.size());
+        }
+    }
+    request_.reserve(512 + request.body().size());
+    request_ += request.method();
+    request_ += ' ';
+    request_ += handler->Target(request);
+    request_ += " HTTP/1.1\r\n";
+    std::string forwardedFor;
+    for (const auto& header : headers) {
+        const std::string& name = header.first;
+        if (IsHopByHop(name.data(), name.size(), tokens) || strcasecmp(name.c_str(), "Content-Length") == 0 ||
+            strcasecmp(name.c_str(), "Expect") == 0) {
+            continue;
+        }
+        if (strcasecmp(name.c_str(), "X-Forwarded-For") == 0) {
+            forwardedFor = header.second + ", ";
+            continue;
+        }
+        if (strcasecmp(name.c_str(), "X-Forwarded-Proto") == 0) {
+            continue;
+        }
+        request_ += name;
+        request_ += ": ";
+        request_ += header.second;
+        request_ += "\r\n";
+    }
+    request_ += "X-Forwarded-For: " + forwardedFor + clientIp + "\r\n";
+    request_ += tls ? "X-Forwarded-Proto: https\r\n" : "X-Forwarded-Proto: http\r\n";
+    const std::string& body = request.body();
+    Router::Method method = request.methodId();
+    if (!body.empty() || method == Router::POST || method == Router::PUT || method == Router::PATCH) {
+        request_ += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    request_ += "Connection: keep-alive\r\n\r\n";
+    request_ += body;
+}
+
+ProxyExchange::~ProxyExchange() {
+    DropUpstream_();
+    if (upstream_) {
+        UpstreamGroup::Done(upstream_, false);
+        upstream_ = nullptr;
+    }
+    if (pipe_[0] >= 0) {
+        close(pipe_[0]);
+        close(pipe_[1]);
+    }
+}
+
+void ProxyExchange::DropUpstream_() {
+    if (fd_ < 0) {
+        return;
+    }
+    if (watched_ && unwatch) {
+        unwatch(fd_);
+    }
+    watched_ = false;
+    if (reusable_) {
+        UpstreamGroup::Release(upstream_, fd_);
+    }
+    else {
+        close(fd_);
+    }
+    fd_ = -1;
+}
+
+ProxyExchange::Status ProxyExchange::Start_() {
+    ++tries_;
+    upstream_ = handler_->Group().Pick();
+    if (!upstream_) {
+        return FAILED;
+    }
+    bool connecting = false;
+    fd_ = UpstreamGroup::Acquire(upstream_, &reused_, &connecting);
+    if (fd_ < 0) {
+        return Retry_(true);
+    }
+    if (connecting) {
+        state_ = CONNECTING;
+        return WAIT_UPSTREAM_WRITE;
+    }
+    state_ = SENDING;
+    return Step();
+}
+
+ProxyExchange::Status ProxyExchange::Retry_(bool connectFailed) {
+    DropUpstream_();
+    UpstreamGroup::Done(upstream_, connectFailed);
+    upstream_ = nullptr;
+    sent_ = 0;
+    in_.RetrieveAll();
+    if (tries_ >= MAX_TRIES) {
+        state_ = FINISHED;
+        return FAILED;
+    }
+    state_ = START;
+    return Start_();
+}
+
+ProxyExchange::Status ProxyExchange::Step() {
+    for (;;) {
+        switch (state_) {
+            case START:
+                return Start_();
+            case CONNECTING:
+            {   int err = 0;
+                socklen_t len = sizeof(err);
+                if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+                    return Retry_(true);
+                }
+                state_ = SENDING;
+                break;
+            }
+            case SENDING:
+            {   ssize_t n = send(fd_, request_.data() + sent_, request_.size() - sent_, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return WAIT_UPSTREAM_WRITE;
+                    }
+                    if (sent_ > 0 && !idempotent_) {
+                        // 请求已经发出了一部分, 上游可能已经开始处理: 不能重发的请求直接失败
+                        state_ = FINISHED;
+                        return FAILED;
+                    }
+                    // 复用的连接可能刚好被上游关闭了: 请求还没有被处理, 换一个连接重发
+                    return reused_ ? Retry_(false) : Retry_(true);
+                }
+                sent_ += n;
+                if (sent_ == request_.size()) {
+                    state_ = READING_HEAD;
+                }
+                break;
+            }
+            case READING_HEAD:
+            {   int err = 0;
+                ssize_t n = in_.ReadFd(fd_, &err);
+                if (n < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+                    return WAIT_UPSTREAM_READ;
+                }
+                if (n <= 0) {
+                    // 复用的连接在收到任何响应之前断开: 上游关闭了空闲连接, 幂等的请求重发
+                    if (reused_ && idempotent_ && in_.ReadableBytes() == 0) {
+                        return Retry_(false);
+                    }
+                    state_ = FINISHED;
+                    return FAILED;
+                }
+                int ret = ParseHead_();
+                if (ret < 0) {
+                    state_ = FINISHED;
+                    return FAILED;
+                }
+                if (ret > 0) {
+                    state_ = SENDING_HEAD;
+                }
+                break;
+            }
+            case SENDING_HEAD:
+            {   int ret = FlushOut_();
+                if (ret < 0) {
+                    return Finish_(false);
+                }
+                if (ret == 0) {
+                    return WAIT_CLIENT_WRITE;
+                }
+                if (BodyComplete_()) {
+                    return Finish_(true);
+                }
+                state_ = BODY;
+                break;
+            }
+            case BODY:
+                return CanSplice_() ? SpliceBody_() : RelayBody_();
+            default:
+                return CLOSE;
+        }
+    }
+}
+
+int ProxyExchange::ParseHead_() {
+    const char* begin = in_.Peek();
+    const char* end = in_.BeginWriteConst();
+    const char CRLF2[] = "\r\n\r\n";
+    const char* headEnd = std::search(begin, end, CRLF2, CRLF2 + 4);
+    if (headEnd == end) {
+        return in_.ReadableBytes() > MAX_HEAD_BYTES ? -1 : 0;
+    }
+    // 状态行: HTTP/1.x SSS 原因
+    const char* lineEnd = std::search(begin, headEnd + 2, CRLF2, CRLF2 + 2);
+    if (lineEnd - begin < 12 || strncmp(begin, "HTTP/1.", 7) != 0 || begin[8] != ' ') {
+        return -1;
+    }
+    int status = 0;
+    for (const char* p = begin + 9; p < begin + 12; ++p) {
+        if (*p < '0' || *p > '9') {
+            return -1;
+        }
+        status = status * 10 + (*p - '0');
+    }
+    bool http10 = (begin[7] == '0');
+    if (status < 200) {
+        if (status == 101) {
+            // 没有转发 Upgrade, 上游不应该切换协议
+            return -1;
+        }
+        // 100 Continue 之类的中间响应: 请求体已经随请求发出, 直接丢弃
+        in_.RetrieveUntil(headEnd + 4);
+        return ParseHead_();
+    }
+
+    // 先找出 Connection 列出的逐跳首部和响应体的长度
+    std::vector<std::string> tokens;
+    bool chunked = false;
+    bool hasLength = false;
+    size_t length = 0;
+    struct Field {
+        const char* name;
+        size_t nameLen;
+        const char* value;
+        size_t valueLen;
+    };
+    std::vector<Field> fields;
+    for (const char* line = lineEnd + 2; line < headEnd + 2; ) {
+        const char* eol = std::search(line, headEnd + 2, CRLF2, CRLF2 + 2);
+        const char* colon = std::find(line, eol, ':');
+        if (colon == eol || colon == line) {
+            return -1;
+        }
+        const char* value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) {
+            ++value;
+        }
+        const char* valueEnd = eol;
+        while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+            --valueEnd;
+        }
+        Field field = { line, static_cast<size_t>(colon - line), value, static_cast<size_t>(valueEnd - value) };
+        if (EqualsIgnoreCase(field.name, field.nameLen, "Connection")) {
+            std::vector<std::string> more = ConnectionTokens(field.value, field.valueLen);
+            tokens.insert(tokens.end(), more.begin(), more.end());
+        }
+        else if (EqualsIgnoreCase(field.name, field.nameLen, "Transfer-Encoding")) {
+            // 最后一个传输编码是 chunked 时按块扫描(其他编码不在这里解开)
+            std::vector<std::string> codings = ConnectionTokens(field.value, field.valueLen);
+            chunked = !codings.empty() && codings.back() == "chunked";
+        }
+        else if (EqualsIgnoreCase(field.name, field.nameLen, "Content-Length")) {
+            if (field.valueLen == 0 || field.valueLen > 18) {
+                return -1;
+            }
+            size_t len = 0;
+            for (size_t i = 0; i < field.valueLen; ++i) {
+                if (field.value[i] < '0' || field.value[i] > '9') {
+                    return -1;
+                }
+                len = len * 10 + (field.value[i] - '0');
+            }
+            if (hasLength && len != length) {
+                return -1;
+            }
+            hasLength = true;
+            length = len;
+        }
+        fields.push_back(field);
+        line = eol + 2;
+    }
+
+    status_ = status;
+    upstreamKeepAlive_ = http10 ? HasToken(tokens, "keep-alive") : !HasToken(tokens, "close");
+    if (headRequest_ || status == 204 || status == 304) {
+        framing_ = NO_BODY;
+    }
+    else if (chunked) {
+        framing_ = CHUNKED;
+    }
+    else if (hasLength) {
+        framing_ = length > 0 ? LENGTH : NO_BODY;
+        remaining_ = length;
+    }
+    else {
+        framing_ = UNTIL_CLOSE;
+        upstreamKeepAlive_ = false;
+    }
+    if (framing_ == UNTIL_CLOSE) {
+        // 客户端只能从连接关闭知道响应体结束
+        clientKeepAlive_ = false;
+    }
+
+    out_.reserve(headEnd - begin + 64);
+    out_.assign("HTTP/1.1 ");
+    out_.append(begin + 9, lineEnd);
+    out_.append("\r\n");
+    for (const Field& field : fields) {
+        // chunked 响应体原样转发, Transfer-Encoding 保留
+        if (IsHopByHop(field.name, field.nameLen, tokens) &&
+            !(chunked && EqualsIgnoreCase(field.name, field.nameLen, "Transfer-Encoding"))) {
+            continue;
+        }
+        out_.append(field.name, field.nameLen);
+        out_.append(": ");
+        out_.append(field.value, field.valueLen);
+        out_.append("\r\n");
+    }
+    out_.append(clientKeepAlive_ ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    outOffset_ = 0;
+
+    in_.RetrieveUntil(headEnd + 4);
+    TakeBody_(in_.Peek(), in_.ReadableBytes());
+    in_.RetrieveAll();
+    return 1;
+}
+
+void ProxyExchange::TakeBody_(const char* data, size_t len) {
+    size_t take = len;
+    switch (framing_) {
+        case NO_BODY:
+            take = 0;
+            break;
+        case LENGTH:
+            take = std::min(len, remaining_);
+            remaining_ -= take;
+            break;
+        case CHUNKED:
+            take = ScanChunked_(data, len);
+            break;
+        default:
+            break;
+    }
+    if (take < len) {
+        // 响应之后还有多余的数据: 上游连接的状态不可信, 不再复用
+        upstreamKeepAlive_ = false;
+    }
+    out_.append(data, take);
+}
+
+size_t ProxyExchange::ScanChunked_(const char* data, size_t len) {
+    size_t i = 0;
+    while (i < len && !chunkDone_ && !chunkError_) {
+        if (chunkState_ == CHUNK_DATA) {
+            size_t n = std::min(len - i, chunkLeft_);
+            i += n;
+            chunkLeft_ -= n;
+            if (chunkLeft_ == 0) {
+                chunkState_ = CHUNK_CRLF;
+            }
+            continue;
+        }
+        // 其余状态按行扫描
+        char ch = data[i++];
+        switch (chunkState_) {
+            case CHUNK_SIZE:
+                if (ch != '\n') {
+                    if (chunkLine_.size() >= HttpRequest::MAX_CHUNK_LINE) {
+                        chunkError_ = true;
+                    }
+                    chunkLine_ += ch;
+                    break;
+                }
+                {   // 块大小(十六进制)[;扩展]
+                    size_t size = 0;
+                    size_t digits = 0;
+                    for (char c : chunkLine_) {
+                        int v = isdigit(static_cast<unsigned char>(c)) ? c - '0' :
+                                (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                                (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                        if (v < 0) {
+                            break;
+                        }
+                        size = size * 16 + v;
+                        if (++digits > 15) {
+                            break;
+                        }
+                    }
+                    if (digits == 0 || digits > 15) {
+                        chunkError_ = true;
+                        break;
+                    }
+                    chunkLine_.clear();
+                    chunkLeft_ = size;
+                    lineLen_ = 0;
+                    chunkState_ = size > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+                }
+                break;
+            case CHUNK_CRLF:
+                if (ch == '\n') {
+                    chunkState_ = CHUNK_SIZE;
+                }
+                break;
+            case CHUNK_TRAILER:
+                if (ch == '\n') {
+                    if (lineLen_ == 0) {
+                        // 空行: 响应体结束
+                        chunkDone_ = true;
+                    }
+                    lineLen_ = 0;
+                }
+                else if (ch != '\r') {
+                    ++lineLen_;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return i;
+}
+
+bool ProxyExchange::BodyComplete_() const {
+    switch (framing_) {
+        case NO_BODY:
+            return true;
+        case LENGTH:
+            return remaining_ == 0 && piped_ == 0;
+        case CHUNKED:
+            return chunkDone_;
+        default:
+            return false;
+    }
+}
+
+bool ProxyExchange::CanSplice_() const {
+    // 明文连接或者 kTLS 发送(内核加密)时管道中的数据可以直接写到客户端 socket
+    return (framing_ == LENGTH || framing_ == UNTIL_CLOSE) && (!tls_ || tls_->KtlsSend());
+}
+
+int ProxyExchange::FlushOut_() {
+    while (outOffset_ < out_.size()) {
+        ssize_t n;
+        int err = 0;
+        if (tls_) {
+            struct iovec iov = { const_cast<char*>(out_.data()) + outOffset_, out_.size() - outOffset_ };
+            n = tls_->Writev(&iov, 1, &err);
+        }
+        else {
+            n = send(clientFd_, out_.data() + outOffset_, out_.size() - outOffset_, MSG_NOSIGNAL);
+            err = errno;
+        }
+        if (n < 0) {
+            return (err == EAGAIN || err == EWOULDBLOCK) ? 0 : -1;
+        }
+        outOffset_ += n;
+        bytes_ += n;
+    }
+    out_.clear();
+    outOffset_ = 0;
+    return 1;
+}
+
+ProxyExchange::Status ProxyExchange::SpliceBody_() {
+    // 上游 socket -> 管道 -> 客户端 socket, 数据只在内核中移动
+    if (pipe_[0] < 0 && pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        pipe_[0] = pipe_[1] = -1;
+        return Finish_(false);
+    }
+    size_t moved = 0;
+    for (;;) {
+        if (piped_ > 0) {
+            ssize_t n = splice(pipe_[0], nullptr, clientFd_, nullptr, piped_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0) {
+                return (errno == EAGAIN) ? WAIT_CLIENT_WRITE : Finish_(false);
+            }
+            piped_ -= n;
+            bytes_ += n;
+            continue;
+        }
+        if (framing_ == LENGTH && remaining_ == 0) {
+            return Finish_(true);
+        }
+        if (moved >= MAX_STEP_BYTES) {
+            // 管道已经清空: 让出工作线程, 客户端可写时(马上)继续
+            return WAIT_CLIENT_WRITE;
+        }
+        size_t want = SPLICE_CHUNK;
+        if (framing_ == LENGTH && remaining_ < want) {
+            want = remaining_;
+        }
+        ssize_t n = splice(fd_, nullptr, pipe_[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0) {
+            return (errno == EAGAIN) ? WAIT_UPSTREAM_READ : Finish_(false);
+        }
+        if (n == 0) {
+            // 上游关闭: 读到关闭为止的响应体结束, Content-Length 的响应体被截断
+            return Finish_(framing_ == UNTIL_CLOSE);
+        }
+        piped_ += n;
+        moved += n;
+        if (framing_ == LENGTH) {
+            remaining_ -= n;
+        }
+    }
+}
+
+ProxyExchange::Status ProxyExchange::RelayBody_() {
+    size_t moved = 0;
+    for (;;) {
+        int ret = FlushOut_();
+        if (ret < 0) {
+            return Finish_(false);
+        }
+        if (ret == 0) {
+            return WAIT_CLIENT_WRITE;
+        }
+        if (chunkError_) {
+            return Finish_(false);
+        }
+        if (BodyComplete_()) {
+            return Finish_(true);
+        }
+        if (moved >= MAX_STEP_BYTES) {
+            return WAIT_CLIENT_WRITE;
+        }
+        int err = 0;
+        ssize_t n = in_.ReadFd(fd_, &err);
+        if (n < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+            return WAIT_UPSTREAM_READ;
+        }
+        if (n <= 0) {
+            return Finish_(framing_ == UNTIL_CLOSE);
+        }
+        moved += n;
+        TakeBody_(in_.Peek(), in_.ReadableBytes());
+        in_.RetrieveAll();
+    }
+}
+
+ProxyExchange::Status ProxyExchange::Finish_(bool complete) {
+    state_ = FINISHED;
+    // 响应体完整读完(且上游没有要求关闭)的上游连接放回空闲池
+    reusable_ = complete && upstreamKeepAlive_ && framing_ != UNTIL_CLOSE;
+    return (complete && clientKeepAlive_) ? DONE : CLOSE;
+}
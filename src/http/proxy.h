@@ -0,0 +1,211 @@
+/*
+    反向代理
+
+    路由到 ProxyHandler 的请求(请求体接收完整后)不在本地生成响应, 而是由 ProxyExchange 转发给上游:
+    连接上游 -> 发送请求 -> 读取响应首部 -> 转发响应体, 每一步都是非阻塞的, 等待的 socket 由 WebServer 注册到 epoll,
+    事件到达后交给工作线程继续(见 WebServer::OnProxy_). 同一时刻只等待上游或客户端中的一个.
+    Content-Length / 读到关闭为止的响应体用 splice 从上游 socket 经管道直接写到客户端 socket, 不经过用户空间;
+    chunked 响应体(要找到最后一块才能复用上游连接)和 TLS 连接(没有 kTLS 发送时要在用户空间加密)经过用户空间转发.
+    响应完整读完的上游连接放回工作线程的空闲连接池, 供之后的请求复用(见 UpstreamGroup).
+*/
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "../buffer/buffer.h"
+#include "router.h"
+#include "upstream.h"
+
+class HttpRequest;
+class TlsSession;
+
+// 把请求转发给一组上游的处理者
+class ProxyHandler : public HttpHandler {
+public:
+    /// @param upstreams 上游地址("host:port")
+    /// @param stripPrefix 转发前从路径中去掉的前缀(如 "/api/proxy", 为空时原样转发)
+    ProxyHandler(const std::vector<std::string>& upstreams, const std::string& stripPrefix = std::string());
+
+    /// @brief HTTP/1.1 的请求由 ProxyExchange 转发, 只有 HTTP/2 的流会调用到这里: 响应 502
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+
+    UpstreamGroup& Group() {
+        return group_;
+    }
+
+    /// @brief 转发给上游的请求目标(去掉前缀的路径 + 查询串)
+    std::string Target(const HttpRequest& request) const;
+
+private:
+    UpstreamGroup group_;
+    std::string stripPrefix_;
+};
+
+// 一个请求的转发过程, 由 HttpConn 持有, WebServer 在工作线程中调用 Step 推进
+class ProxyExchange {
+public:
+    enum Status {
+        WAIT_UPSTREAM_READ = 0,   // 等待上游 socket 可读
+        WAIT_UPSTREAM_WRITE,      // 等待上游 socket 可写(connect / 发送请求)
+        WAIT_CLIENT_WRITE,        // 等待客户端 socket 可写(或者转发了一批数据, 让出工作线程)
+        DONE,                     // 响应转发完整, 客户端连接可以继续下一个请求
+        CLOSE,                    // 响应以关闭连接结束, 或者开始转发后出错: 关闭客户端连接
+        FAILED,                   // 还没有向客户端发送任何数据就失败了: 由 HttpConn 响应 502
+    };
+
+    static const int MAX_TRIES = 3;                     // 连接失败 / 复用的连接已被上游关闭时最多尝试的次数
+    static const size_t MAX_HEAD_BYTES = 64 * 1024;     // 上游响应首部的上限
+    static const size_t MAX_STEP_BYTES = 256 * 1024;    // 一次 Step 最多转发的字节数, 之后让其他连接先处理
+    static const size_t SPLICE_CHUNK = 64 * 1024;       // 一次 splice 的字节数(管道的默认容量)
+
+    // 上游 socket 不再等待事件时(放回空闲池或关闭之前)的回调, 由 WebServer 设置: 从 epoll 中删除
+    static std::function<void(int)> unwatch;
+
+    /// @param handler 路由到的 ProxyHandler
+    /// @param request 请求(请求体已经接收完整, 保存在 body() 中)
+    /// @param clientIp 客户端地址(加入 X-Forwarded-For)
+    /// @param clientFd 客户端 socket
+    /// @param tls 客户端的 TLS 会话(明文连接时为 nullptr)
+    ProxyExchange(ProxyHandler* handler, const HttpRequest& request, const char* clientIp, int clientFd, TlsSession* tls);
+
+    /// @brief 释放上游连接(响应完整读完时放回空闲池, 否则关闭)
+    ~ProxyExchange();
+
+    ProxyExchange(const ProxyExchange&) = delete;
+    ProxyExchange& operator=(const ProxyExchange&) = delete;
+
+    /// @brief 推进转发, 直到需要等待 socket 或者结束
+    /// @return 状态
+    Status Step();
+
+    /// @brief 正在等待的上游 socket
+    int UpstreamFd() const {
+        return fd_;
+    }
+
+    /// @brief 上游 socket 是否已经注册到 epoll(注册后由 WebServer 调用 SetWatched)
+    bool Watched() const {
+        return watched_;
+    }
+
+    void SetWatched() {
+        watched_ = true;
+    }
+
+    /// @brief 上游响应的状态码(还没有收到响应时为 0)
+    int StatusCode() const {
+        return status_;
+    }
+
+    /// @brief 已经发送给客户端的字节数
+    size_t Bytes() const {
+        return bytes_;
+    }
+
+private:
+    enum State {
+        START = 0,      // 选择上游, 取连接
+        CONNECTING,     // 等待非阻塞 connect 完成
+        SENDING,        // 发送请求
+        READING_HEAD,   // 读取响应首部
+        SENDING_HEAD,   // 发送响应首部(和已经读到的那部分响应体)
+        BODY,           // 转发响应体
+        FINISHED
+    };
+
+    // 响应体的长度
+    enum Framing {
+        NO_BODY = 0,    // HEAD 请求, 1xx / 204 / 304
+        LENGTH,         // Content-Length
+        CHUNKED,        // Transfer-Encoding: chunked(原样转发, 同时扫描找到最后一块)
+        UNTIL_CLOSE,    // 读到上游关闭为止(之后两边的连接都不能复用)
+    };
+
+    // 扫描 chunked 响应体的状态
+    enum ChunkState {
+        CHUNK_SIZE = 0, // 块大小行
+        CHUNK_DATA,     // 块数据
+        CHUNK_CRLF,     // 块数据后的 "\r\n"
+        CHUNK_TRAILER,  // 最后一块之后的尾部首部, 以空行结束
+    };
+
+    /// @brief 选择上游并取一个连接
+    /// @return 下一步的状态(失败时已经重试或 FAILED)
+    Status Start_();
+    /// @brief 放弃当前的上游连接, 重新选择上游再试(次数用完时 FAILED)
+    /// @param connectFailed 是连接失败(暂停选择这个上游)
+    Status Retry_(bool connectFailed);
+    /// @brief 放弃当前的上游连接
+    void DropUpstream_();
+    /// @brief 解析上游响应首部, 组织发给客户端的首部
+    /// @return 0-首部还不完整, 1-完成, -1-响应不合法
+    int ParseHead_();
+    /// @brief 把从上游读到的一段响应体按长度截取后放入 out_
+    /// @param data 数据
+    /// @param len 长度
+    void TakeBody_(const char* data, size_t len);
+    /// @brief 扫描 chunked 响应体
+    /// @return 属于这个响应的字节数(最后一块和尾部首部之后的数据不算)
+    size_t ScanChunked_(const char* data, size_t len);
+    /// @brief 响应体是否已经读完
+    bool BodyComplete_() const;
+    /// @brief 是否可以用 splice 转发响应体
+    bool CanSplice_() const;
+    /// @brief out_ 中的数据写给客户端
+    /// @return -1-出错, 0-socket 写满, 1-写完
+    int FlushOut_();
+    /// @brief 用 splice 转发响应体
+    Status SpliceBody_();
+    /// @brief 在用户空间转发响应体
+    Status RelayBody_();
+    /// @brief 转发结束: 响应完整且上游没有要求关闭时, 上游连接标记为可以放回空闲池
+    /// @param complete 响应完整转发给了客户端
+    /// @return DONE-客户端连接可以继续, CLOSE-关闭客户端连接
+    Status Finish_(bool complete);
+
+private:
+    ProxyHandler* handler_;
+    int clientFd_;
+    TlsSession* tls_;
+    bool clientKeepAlive_;      // 客户端请求了 keep-alive
+    bool headRequest_;
+    bool idempotent_;           // 请求可以安全地重发(不是 POST / PATCH)
+
+    State state_;
+    int tries_;
+    Upstream* upstream_;        // 当前的上游(Pick 之后, Done 之前不为空)
+    int fd_;                    // 上游 socket
+    bool reused_;               // 上游连接是从空闲池取出的
+    bool watched_;
+    bool reusable_;             // 析构时把上游连接放回空闲池
+
+    std::string request_;       // 发给上游的请求
+    size_t sent_;
+
+    Buffer in_;                 // 从上游读到的数据
+    std::string out_;           // 要写给客户端的数据
+    size_t outOffset_;
+
+    int status_;
+    Framing framing_;
+    bool upstreamKeepAlive_;
+    size_t remaining_;          // LENGTH: 还没读的响应体字节数
+
+    ChunkState chunkState_;
+    size_t chunkLeft_;          // 当前块还没扫描的字节数
+    std::string chunkLine_;     // 块大小行(可能分在两次读中)
+    size_t lineLen_;            // 当前尾部首部行的长度
+    bool chunkDone_;
+    bool chunkError_;
+
+    int pipe_[2];               // splice 响应体用的管道(第一次 splice 时打开)
+    size_t piped_;              // 管道中还没写给客户端的字节数
+    size_t bytes_;
+};
+
+
+#endif
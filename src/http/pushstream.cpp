@@ -0,0 +1,204 @@
+#include "pushstream.h"
+
+#include <errno.h>
+#include <sys/uio.h>
+#include "tlscontext.h"
+
+
+std::function<void(int, bool)> PushStream::waker;
+
+PushStream::PushStream(int fd, size_t maxQueueBytes)
+    : fd_(fd), tls_(nullptr), shutdown_(false), maxQueueBytes_(maxQueueBytes), frontOffset_(0), queuedBytes_(0),
+      progress_(std::chrono::steady_clock::now()), closing_(false), dropped_(false), idle_(false), wantWrite_(false) {}
+
+bool PushStream::Stalled_(std::chrono::steady_clock::time_point now) const {
+    return !queue_.empty() &&
+           std::chrono::duration_cast<std::chrono::milliseconds>(now - progress_).count() > STALL_TIMEOUT_MS;
+}
+
+void PushStream::Drop_() {
+    dropped_ = true;
+    queue_.clear();
+    queuedBytes_ = 0;
+    frontOffset_ = 0;
+}
+
+bool PushStream::Enqueue_(const Frame& frame) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (queue_.empty()) {
+        progress_ = now;
+    }
+    if (queuedBytes_ + frame->size() > maxQueueBytes_ || Stalled_(now)) {
+        // 客户端读得太慢: 丢弃发送队列并断开, 不让它拖住内存
+        Drop_();
+    }
+    else {
+        queue_.push_back(frame);
+        queuedBytes_ += frame->size();
+    }
+    if (idle_ && !wantWrite_ && waker) {
+        // 没有工作线程在处理: 注册写事件
+        wantWrite_ = true;
+        waker(fd_, true);
+    }
+    return !dropped_;
+}
+
+bool PushStream::Push(const Frame& frame) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (closing_ || dropped_ || shutdown_) {
+        return false;
+    }
+    return Enqueue_(frame);
+}
+
+void PushStream::End(const Frame& last) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (closing_ || dropped_ || shutdown_) {
+        return;
+    }
+    if (last && !last->empty()) {
+        Enqueue_(last);
+    }
+    else if (idle_ && !wantWrite_ && waker) {
+        // 没有要发送的数据也要让工作线程看到连接该断开了
+        wantWrite_ = true;
+        waker(fd_, true);
+    }
+    closing_ = true;
+}
+
+ssize_t PushStream::Flush(int* saveErrno) {
+    ssize_t total = 0;
+    while (total < static_cast<ssize_t>(MAX_FLUSH_BYTES)) {
+        // 持有帧的引用: 写的时候别的线程可能清空队列
+        Frame frames[MAX_IOV];
+        struct iovec iov[MAX_IOV];
+        int cnt = 0;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            for (auto it = queue_.begin(); it != queue_.end() && cnt < MAX_IOV; ++it, ++cnt) {
+                size_t offset = (cnt == 0) ? frontOffset_ : 0;
+                frames[cnt] = *it;
+                iov[cnt].iov_base = const_cast<char*>((*it)->data()) + offset;
+                iov[cnt].iov_len = (*it)->size() - offset;
+            }
+        }
+        if (cnt == 0) {
+            return total;
+        }
+        ssize_t len = tls_ ? tls_->Writev(iov, cnt, saveErrno) : writev(fd_, iov, cnt);
+        if (len < 0) {
+            if (!tls_) {
+                *saveErrno = errno;
+            }
+            return total > 0 ? total : -1;
+        }
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (dropped_) {
+            return total;
+        }
+        progress_ = std::chrono::steady_clock::now();
+        size_t left = len;
+        while (left > 0 && !queue_.empty()) {
+            size_t rest = queue_.front()->size() - frontOffset_;
+            if (left < rest) {
+                frontOffset_ += left;
+                queuedBytes_ -= left;
+                break;
+            }
+            left -= rest;
+            queuedBytes_ -= rest;
+            frontOffset_ = 0;
+            queue_.pop_front();
+        }
+        total += len;
+    }
+    // 剩下的等下一次写事件(Release 按发送队列注册), 让其他连接先写
+    return total;
+}
+
+bool PushStream::ShouldClose() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return dropped_ || shutdown_ || (closing_ && queue_.empty());
+}
+
+bool PushStream::CheckStall() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!dropped_ && !shutdown_ && Stalled_(std::chrono::steady_clock::now())) {
+        Drop_();
+    }
+    return dropped_;
+}
+
+bool PushStream::Acquire() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!idle_) {
+        return false;
+    }
+    idle_ = false;
+    return true;
+}
+
+void PushStream::Release() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (shutdown_) {
+        return;
+    }
+    idle_ = true;
+    wantWrite_ = !queue_.empty() || dropped_ || closing_;
+    if (waker) {
+        waker(fd_, wantWrite_);
+    }
+}
+
+void PushStream::Shutdown() {
+    if (shutdown_.exchange(true)) {
+        return;
+    }
+    {
+        // 之后的 Push 不再注册事件(fd 可能马上被新的连接复用)
+        std::lock_guard<std::mutex> lk(mtx_);
+        idle_ = false;
+    }
+    OnShutdown_();
+}
+
+
+void PushGroup::Join(const std::shared_ptr<PushStream>& stream) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (members_.insert(stream).second) {
+        snapshot_.reset();
+    }
+}
+
+void PushGroup::Leave(const std::shared_ptr<PushStream>& stream) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (members_.erase(stream)) {
+        snapshot_.reset();
+    }
+}
+
+size_t PushGroup::Size() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return members_.size();
+}
+
+size_t PushGroup::Broadcast(const PushStream::Frame& frame) {
+    std::shared_ptr<const Members> snapshot;
+    {
+        // 成员变化后的第一次广播重建快照, 之后的广播只复制一个指针
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (!snapshot_) {
+            snapshot_ = std::make_shared<const Members>(members_.begin(), members_.end());
+        }
+        snapshot = snapshot_;
+    }
+    size_t sent = 0;
+    for (const std::shared_ptr<PushStream>& stream : *snapshot) {
+        if (stream->Push(frame)) {
+            ++sent;
+        }
+    }
+    return sent;
+}
@@ -0,0 +1,142 @@
+/*
+    服务端推送的长连接(WebSocket / Server-Sent Events)的发送队列
+
+    要发送的数据是不可变的共享缓冲区(Frame), 放入每个连接的发送队列, 用 writev 一次发出多个;
+    广播时数据只编码一次, 所有连接共享同一个 Frame, 开销只与连接数有关, 与消息大小无关.
+    写入节奏: 一次 Flush 最多写 MAX_FLUSH_BYTES, 剩下的等下一次写事件, 一个连接不会长时间占住工作线程;
+    发送队列超过上限, 或者有数据却长时间写不出去(STALL_TIMEOUT)的慢客户端直接断开, 不让它一直占着内存.
+
+    线程: Push 可以在任何线程调用. 连接空闲(没有工作线程处理)时 Push 通过 waker 注册写事件;
+    工作线程处理期间的 Push 只入队, 由 Release 在处理结束时根据发送队列重新注册事件.
+*/
+
+#ifndef PUSH_STREAM_H
+#define PUSH_STREAM_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <sys/types.h>
+#include "../buffer/buffer.h"
+
+class TlsSession;
+
+class PushStream {
+public:
+    // 编码好的数据, 多个连接共享
+    typedef std::shared_ptr<const std::string> Frame;
+
+    static const int MAX_IOV = 64;                      // 一次 writev 的帧数
+    static const size_t MAX_FLUSH_BYTES = 256 * 1024;   // 一次 Flush 写入的上限
+    static const int STALL_TIMEOUT_MS = 30000;          // 发送队列不为空却一直写不出去的时限
+
+    // 注册连接的事件: fd, 是否需要写事件(由 WebServer 设置)
+    static std::function<void(int, bool)> waker;
+
+    /// @param fd 连接的 socket
+    /// @param maxQueueBytes 发送队列的上限
+    PushStream(int fd, size_t maxQueueBytes);
+    virtual ~PushStream() = default;
+
+    PushStream(const PushStream&) = delete;
+    PushStream& operator=(const PushStream&) = delete;
+
+    /// @brief TLS 连接: 发送经过 TLS 会话(会话由连接持有, 比推送连接先建立、后释放)
+    void SetTls(TlsSession* tls) {
+        tls_ = tls;
+    }
+
+    /// @brief 处理连接上收到的数据(在处理连接的工作线程中调用)
+    /// @param in 读缓冲区
+    virtual void Process(Buffer& in) = 0;
+
+    /// @brief 发送一个帧(线程安全)
+    /// @return false-连接已经关闭(或正在关闭)
+    bool Push(const Frame& frame);
+
+    /// @brief 发送最后一个帧, 发送完毕后断开连接(线程安全)
+    /// @param last 最后一个帧(nullptr 表示没有)
+    void End(const Frame& last = Frame());
+
+    /// @brief 把发送队列写入 socket(只在处理连接的工作线程中调用)
+    /// @param saveErrno 出错时保存的错误码
+    /// @return 写入的字节数, 出错时返回 -1
+    ssize_t Flush(int* saveErrno);
+
+    /// @brief 连接是否应该断开(最后一个帧已经发送完毕, 或者客户端太慢被丢弃)
+    bool ShouldClose();
+
+    /// @brief 检查发送队列是否超过 STALL_TIMEOUT 没有写出数据(由定时器调用, 没有新的帧入队时也能发现)
+    /// @return true-客户端太慢, 发送队列已经丢弃, 连接应该断开
+    bool CheckStall();
+
+    /// @brief 主线程收到事件时调用: 标记连接由工作线程处理
+    /// @return false-已经有工作线程在处理(这个事件忽略, 处理结束时会重新注册)
+    bool Acquire();
+
+    /// @brief 工作线程处理结束: 根据发送队列重新注册事件
+    void Release();
+
+    /// @brief 连接断开: 丢弃发送队列, 调用 OnShutdown_(只生效一次)
+    void Shutdown();
+
+protected:
+    /// @brief 连接断开(只调用一次, 可能在定时器线程中调用)
+    virtual void OnShutdown_() {}
+
+private:
+    /// @brief 入队(调用者持有 mtx_)
+    bool Enqueue_(const Frame& frame);
+    /// @brief 发送队列是否超过 STALL_TIMEOUT 没有进展(调用者持有 mtx_)
+    bool Stalled_(std::chrono::steady_clock::time_point now) const;
+    /// @brief 丢弃发送队列, 标记连接需要断开(调用者持有 mtx_)
+    void Drop_();
+
+private:
+    int fd_;
+    TlsSession* tls_;
+    std::atomic<bool> shutdown_;
+    size_t maxQueueBytes_;
+
+    std::mutex mtx_;
+    std::deque<Frame> queue_;
+    size_t frontOffset_;        // 队首的帧已经发送的字节数
+    size_t queuedBytes_;
+    std::chrono::steady_clock::time_point progress_;   // 上一次写出数据(或队列由空变为不空)的时间
+    bool closing_;              // 最后一个帧已经入队, 不再接受新的帧
+    bool dropped_;              // 客户端太慢, 需要断开
+    bool idle_;                 // 没有工作线程在处理, 事件已经注册
+    bool wantWrite_;            // 注册了写事件
+};
+
+// 一组推送连接(如同一个频道的订阅者)
+// 成员快照只在成员变化后的第一次广播时重建, 广播不在锁内逐个发送
+class PushGroup {
+public:
+    /// @brief 加入(重复加入无效果)
+    void Join(const std::shared_ptr<PushStream>& stream);
+    /// @brief 离开
+    void Leave(const std::shared_ptr<PushStream>& stream);
+    /// @brief 成员数
+    size_t Size() const;
+
+    /// @brief 广播一个帧
+    /// @return 放入了发送队列的连接数
+    size_t Broadcast(const PushStream::Frame& frame);
+
+private:
+    typedef std::vector<std::shared_ptr<PushStream>> Members;
+
+    mutable std::mutex mtx_;
+    std::unordered_set<std::shared_ptr<PushStream>> members_;
+    std::shared_ptr<const Members> snapshot_;   // nullptr 表示成员变化过, 需要重建
+};
+
+
+#endif
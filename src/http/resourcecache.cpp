@@ -0,0 +1,290 @@
+#include "resourcecache.h"
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <limits.h>
+#include "../log/logsite.h"
+
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                            IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+
+// 收到第一个事件后再等一小会儿, 把同一次部署产生的一串事件合并成一次快照更新
+const int COALESCE_MS = 5;
+
+/// @brief 拼接相对路径
+std::string JoinPath(const std::string& dir, const std::string& name) {
+    return dir == "/" ? "/" + name : dir + "/" + name;
+}
+
+/// @brief 把文件内容读入内存
+std::shared_ptr<const MappedFile> ReadFile(const std::string& path, const struct stat& st) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    file->found = true;
+    file->st = st;
+    if (st.st_size == 0) {
+        return file;
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    std::unique_ptr<char[]> buff(new char[st.st_size]);
+    off_t total = 0;
+    while (total < st.st_size) {
+        ssize_t len = read(fd, buff.get() + total, st.st_size - total);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            break;
+        }
+        total += len;
+    }
+    close(fd);
+    // 读的过程中文件被截断: 以实际读到的为准, 随后的 IN_CLOSE_WRITE 会再刷新一次
+    file->st.st_size = total;
+    file->addr = buff.release();
+    return file;
+}
+
+}
+
+
+ResourceCache::ResourceCache() : maxFileBytes_(0), inotifyFd_(-1), wakeFd_(-1)
+{ }
+
+ResourceCache::~ResourceCache() {
+    Close();
+}
+
+bool ResourceCache::Init(const std::string& root, size_t maxFileBytes) {
+    Close();
+    root_ = root;
+    if (!root_.empty() && root_.back() == '/') {
+        root_.pop_back();
+    }
+    maxFileBytes_ = maxFileBytes;
+
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotifyFd_ < 0 || wakeFd_ < 0) {
+        CLOG(WARNING) << "ResourceCache: inotify init error, errno: " << errno;
+        Close();
+        return false;
+    }
+
+    std::shared_ptr<Snapshot> snap = std::make_shared<Snapshot>();
+    Scan_("/", EntryMap(), &snap->entries);
+    Publish_(snap);
+    watcher_.reset(new std::thread(&ResourceCache::Watch_, this));
+    CLOG(INFO) << "ResourceCache: " << snap->entries.size() << " paths under " << root_
+               << ", watching " << watchDirs_.size() << " directories";
+    return true;
+}
+
+void ResourceCache::Close() {
+    if (watcher_) {
+        uint64_t one = 1;
+        write(wakeFd_, &one, sizeof(one));
+        watcher_->join();
+        watcher_.reset();
+    }
+    if (inotifyFd_ >= 0) {
+        close(inotifyFd_);
+        inotifyFd_ = -1;
+    }
+    if (wakeFd_ >= 0) {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
+    watchDirs_.clear();
+    Publish_(nullptr);
+}
+
+void ResourceCache::Publish_(std::shared_ptr<Snapshot> snap) {
+    // 旧快照在这里释放引用, 正在查找的请求释放最后一个引用时回收
+    std::atomic_exchange(&current_, std::shared_ptr<const Snapshot>(std::move(snap)));
+}
+
+bool ResourceCache::Lookup(const std::string& path, Entry* entry) {
+    // 只在这一次查找期间持有快照: 条目的内容由 entry->file 单独引用
+    std::shared_ptr<const Snapshot> snap = std::atomic_load(&current_);
+    if (!snap) {
+        return false;
+    }
+    EntryMap::const_iterator it;
+    if (path.size() > 1 && path.back() == '/') {
+        it = snap->entries.find(path.substr(0, path.size() - 1));
+    }
+    else {
+        it = snap->entries.find(path);
+    }
+    if (it == snap->entries.end()) {
+        entry->resolution = PathCache::NOT_FOUND;
+        entry->file.reset();
+    }
+    else {
+        *entry = it->second;
+    }
+    return true;
+}
+
+bool ResourceCache::Load_(const std::string& rel, const EntryMap& old, Entry* entry) {
+    std::string path = root_ + (rel == "/" ? "" : rel);
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+        return false;
+    }
+    entry->file.reset();
+    if (S_ISDIR(st.st_mode)) {
+        entry->resolution = PathCache::DIRECTORY;
+        return true;
+    }
+    if (!(st.st_mode & S_IROTH)) {
+        entry->resolution = PathCache::FORBIDDEN;
+        return true;
+    }
+    entry->resolution = PathCache::REGULAR_FILE;
+    if (!S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) > maxFileBytes_) {
+        // 太大的文件请求时再 mmap
+        return true;
+    }
+    auto it = old.find(rel);
+    if (it != old.end() && it->second.file &&
+        it->second.file->st.st_ino == st.st_ino &&
+        it->second.file->st.st_size == st.st_size &&
+        it->second.file->st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+        it->second.file->st.st_mtim.tv_nsec == st.st_mtim.tv_nsec) {
+        // 没有变化, 复用旧内容
+        entry->file = it->second.file;
+    }
+    else {
+        entry->file = ReadFile(path, st);
+    }
+    return true;
+}
+
+void ResourceCache::Scan_(const std::string& rel, const EntryMap& old, EntryMap* entries) {
+    Entry entry;
+    if (!Load_(rel, old, &entry)) {
+        return;
+    }
+    (*entries)[rel] = entry;
+    if (entry.resolution != PathCache::DIRECTORY) {
+        return;
+    }
+
+    std::string path = root_ + (rel == "/" ? "" : rel);
+    int wd = inotify_add_watch(inotifyFd_, path.c_str(), WATCH_MASK);
+    if (wd >= 0) {
+        watchDirs_[wd] = rel;
+    }
+    else {
+        CLOG(WARNING) << "ResourceCache: watch " << path << " error, errno: " << errno;
+    }
+
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return;
+    }
+    while (struct dirent* ent = readdir(dir)) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        Scan_(JoinPath(rel, name), old, entries);
+    }
+    closedir(dir);
+}
+
+void ResourceCache::Watch_() {
+    alignas(struct inotify_event) char buff[64 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    struct pollfd fds[2];
+    fds[0].fd = inotifyFd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+
+    std::unordered_set<std::string> changed;
+    bool rescan = false;
+    while (true) {
+        // 有未处理的事件时只等一小会儿, 没有更多事件就更新快照
+        int timeout = (changed.empty() && !rescan) ? -1 : COALESCE_MS;
+        int ret = poll(fds, 2, timeout);
+        if (ret < 0 && errno != EINTR) {
+            CLOG(ERROR) << "ResourceCache: poll error, errno: " << errno;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+
+        if (ret > 0 && (fds[0].revents & POLLIN)) {
+            ssize_t len;
+            while ((len = read(inotifyFd_, buff, sizeof(buff))) > 0) {
+                for (char* p = buff; p < buff + len; ) {
+                    const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+                    p += sizeof(struct inotify_event) + ev->len;
+                    if (ev->mask & IN_Q_OVERFLOW) {
+                        rescan = true;
+                        continue;
+                    }
+                    if (ev->mask & IN_IGNORED) {
+                        watchDirs_.erase(ev->wd);
+                        continue;
+                    }
+                    if (ev->mask & (IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                        // 目录的增删和改名: 重新扫描整棵树(未变化的文件复用旧内容)
+                        rescan = true;
+                        continue;
+                    }
+                    auto dir = watchDirs_.find(ev->wd);
+                    if (dir != watchDirs_.end() && ev->len > 0) {
+                        changed.insert(JoinPath(dir->second, ev->name));
+                    }
+                }
+            }
+            continue;
+        }
+        if (changed.empty() && !rescan) {
+            continue;
+        }
+
+        // 复制当前快照, 更新受影响的条目后整体替换
+        std::shared_ptr<const Snapshot> cur = std::atomic_load(&current_);
+        const EntryMap empty;
+        const EntryMap& old = cur ? cur->entries : empty;
+        std::shared_ptr<Snapshot> snap = std::make_shared<Snapshot>();
+        if (rescan) {
+            Scan_("/", old, &snap->entries);
+            PathCache::GetInstance()->Clear();
+        }
+        else {
+            snap->entries = old;
+            for (const std::string& rel : changed) {
+                Entry entry;
+                if (Load_(rel, old, &entry)) {
+                    snap->entries[rel] = entry;
+                }
+                else {
+                    snap->entries.erase(rel);
+                }
+                PathCache::GetInstance()->Invalidate(root_ + "/" + rel);
+            }
+        }
+        if (rescan) {
+            CLOG(INFO) << "ResourceCache: rescanned, " << snap->entries.size() << " paths";
+        }
+        else {
+            CLOG(INFO) << "ResourceCache: refreshed " << changed.size() << " paths";
+        }
+        Publish_(snap);
+        changed.clear();
+        rescan = false;
+    }
+}
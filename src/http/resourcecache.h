@@ -0,0 +1,98 @@
+/*
+    资源目录的内存快照 + inotify 实时失效
+
+    启动时遍历资源目录, 把每个路径的解析结果和(不太大的)文件内容读入一个只读快照.
+    后台线程用 inotify 监听整个目录树, 文件变化后复制一份快照、只更新受影响的条目,
+    然后整体替换(RCU 方式): 正在使用旧快照的请求不受影响, 旧快照在最后一个引用释放时回收.
+    读者每次查找用 std::atomic_load 取当前快照, 查找结束就释放引用, 不加锁也不做任何系统调用;
+    空闲的工作线程不会留住旧快照, 同一时刻最多只有正在处理中的请求引用旧快照.
+*/
+
+#ifndef RESOURCE_CACHE_H
+#define RESOURCE_CACHE_H
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdint.h>
+#include "httpresponse.h"
+#include "pathcache.h"
+
+class ResourceCache {
+public:
+    // 一个路径的解析结果
+    struct Entry {
+        PathCache::Resolution resolution;
+        std::shared_ptr<const MappedFile> file;   // 读入内存的内容(目录和太大的文件为空)
+
+        Entry() : resolution(PathCache::NOT_FOUND) {}
+    };
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return ResourceCache指针
+    static ResourceCache* GetInstance() {
+        static ResourceCache inst;
+        return &inst;
+    }
+
+    /// @brief 扫描资源目录, 并启动 inotify 监听线程
+    /// @param root 资源目录(以 '/' 结尾)
+    /// @param maxFileBytes 超过该大小的文件不读入内存(请求时再 mmap)
+    /// @return 是否成功(失败时 Lookup 总是返回 false)
+    bool Init(const std::string& root, size_t maxFileBytes);
+
+    /// @brief 在当前快照中查找路径
+    /// @param path 规范化之后的请求路径(以 '/' 开头)
+    /// @param entry 查找结果(快照中没有的路径为 NOT_FOUND)
+    /// @return false-缓存没有开启, 需要自行解析
+    bool Lookup(const std::string& path, Entry* entry);
+
+    /// @brief 停止监听并丢弃快照
+    void Close();
+
+private:
+    typedef std::unordered_map<std::string, Entry> EntryMap;
+
+    // 只读快照
+    struct Snapshot {
+        EntryMap entries;   // 请求路径(目录不带结尾的 '/') -> 解析结果
+    };
+
+    ResourceCache();
+    ~ResourceCache();
+
+    /// @brief 发布新快照
+    void Publish_(std::shared_ptr<Snapshot> snap);
+
+    /// @brief 递归扫描目录, 并对子目录添加监听
+    /// @param rel 相对资源目录的路径("/" 表示根目录)
+    /// @param old 旧快照中的条目, 文件没有变化时直接复用内容
+    /// @param entries 扫描结果
+    void Scan_(const std::string& rel, const EntryMap& old, EntryMap* entries);
+    /// @brief 解析一个路径(目录不递归)
+    /// @param rel 相对资源目录的路径
+    /// @param old 旧快照中的条目
+    /// @param entry 解析结果
+    /// @return 路径是否存在
+    bool Load_(const std::string& rel, const EntryMap& old, Entry* entry);
+    /// @brief inotify 监听线程
+    void Watch_();
+
+private:
+    std::string root_;
+    size_t maxFileBytes_;
+
+    // 当前快照: 只通过 std::atomic_load / std::atomic_exchange 访问
+    std::shared_ptr<const Snapshot> current_;
+
+    int inotifyFd_;
+    int wakeFd_;        // eventfd, 用于唤醒监听线程退出
+    std::unordered_map<int, std::string> watchDirs_;   // 监听描述符 -> 相对路径(只在监听线程和 Init 中访问)
+    std::unique_ptr<std::thread> watcher_;
+};
+
+
+#endif
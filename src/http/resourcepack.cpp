@@ -0,0 +1,391 @@
+#include "resourcepack.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <zlib.h>
+#include "../log/logsite.h"
+
+
+// 文件头
+struct PackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;         // 索引条目数
+    uint64_t namesOff;      // 路径字符串的偏移
+    uint64_t dataOff;       // 数据区的偏移(页对齐)
+    uint64_t fileSize;      // 整个文件的大小, 用于检查是否写完整
+};
+
+// 索引条目
+struct PackEntry {
+    uint64_t nameOff;       // 相对路径字符串区
+    uint32_t nameLen;
+    uint32_t resolution;    // PathCache::Resolution
+    uint64_t dataOff;       // 相对文件开头
+    uint64_t dataLen;
+    uint64_t gzOff;         // 没有压缩内容时 gzLen == 0
+    uint64_t gzLen;
+    int64_t mtime;
+};
+
+// 整个资源包的映射, 所有 MappedFile 共同持有
+struct ResourcePack::Mapping {
+    void* addr;
+    size_t len;
+
+    Mapping(void* a, size_t l) : addr(a), len(l) {}
+    ~Mapping() {
+        munmap(addr, len);
+    }
+};
+
+
+namespace {
+
+const char PACK_MAGIC[8] = {'L', 'Z', 'W', 'S', 'P', 'A', 'C', 'K'};
+const uint32_t PACK_VERSION = 1;
+const uint64_t PAGE_ALIGN = 4096;
+const uint64_t DATA_ALIGN = 16;
+
+// 已经压缩过的格式不再 gzip
+const char* const INCOMPRESSIBLE[] = {
+    ".png", ".gif", ".jpg", ".jpeg", ".mpeg", ".mpg", ".avi", ".mp4", ".webm",
+    ".gz", ".woff", ".woff2", ".ico"
+};
+
+uint64_t AlignUp(uint64_t n, uint64_t align) {
+    return (n + align - 1) / align * align;
+}
+
+/// @brief 打包时的一个路径
+struct PackItem {
+    std::string rel;        // 相对资源目录的路径("/" 表示根目录)
+    PathCache::Resolution resolution;
+    struct stat st;
+};
+
+/// @brief 递归收集资源目录下的所有路径
+void Collect(const std::string& root, const std::string& rel, std::vector<PackItem>* items) {
+    PackItem item;
+    item.rel = rel;
+    std::string path = root + (rel == "/" ? "" : rel);
+    if (stat(path.c_str(), &item.st) < 0) {
+        return;
+    }
+    if (S_ISDIR(item.st.st_mode)) {
+        item.resolution = PathCache::DIRECTORY;
+    }
+    else if (!(item.st.st_mode & S_IROTH)) {
+        item.resolution = PathCache::FORBIDDEN;
+    }
+    else {
+        item.resolution = PathCache::REGULAR_FILE;
+    }
+    items->push_back(item);
+    if (item.resolution != PathCache::DIRECTORY) {
+        return;
+    }
+
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return;
+    }
+    while (struct dirent* ent = readdir(dir)) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        Collect(root, rel == "/" ? "/" + name : rel + "/" + name, items);
+    }
+    closedir(dir);
+}
+
+/// @brief 读取整个文件
+bool ReadAll(const std::string& path, std::string* content) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    content->clear();
+    char buff[65536];
+    while (true) {
+        ssize_t len = read(fd, buff, sizeof(buff));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            close(fd);
+            return len == 0;
+        }
+        content->append(buff, len);
+    }
+}
+
+/// @brief gzip 压缩
+bool Gzip(const std::string& src, std::string* dst) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits + 16: 输出 gzip 格式而不是 zlib 格式
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    dst->resize(deflateBound(&zs, src.size()) + 32);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(src.data()));
+    zs.avail_in = src.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&(*dst)[0]);
+    zs.avail_out = dst->size();
+    int ret = deflate(&zs, Z_FINISH);
+    dst->resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+bool Compressible(const std::string& rel) {
+    std::string::size_type idx = rel.find_last_of('.');
+    if (idx == std::string::npos) {
+        return true;
+    }
+    std::string suffix = rel.substr(idx);
+    std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+    for (const char* s : INCOMPRESSIBLE) {
+        if (suffix == s) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteAt(int fd, const void* data, size_t len, uint64_t off) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+        off += n;
+    }
+    return true;
+}
+
+/// @brief 为映射中的一段内容生成 MappedFile(不拷贝)
+std::shared_ptr<const MappedFile> MakeFile(const std::shared_ptr<const void>& owner, const char* base,
+                                           uint64_t off, uint64_t len, int64_t mtime) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    file->found = true;
+    file->st.st_mode = S_IFREG | 0644;
+    file->st.st_size = len;
+    file->st.st_mtime = mtime;
+    file->addr = len > 0 ? const_cast<char*>(base + off) : nullptr;
+    file->owner = owner;
+    return file;
+}
+
+}
+
+
+bool ResourcePack::Build(const std::string& srcDir, const std::string& packPath, bool compress) {
+    std::string root = srcDir;
+    if (!root.empty() && root.back() == '/') {
+        root.pop_back();
+    }
+    std::vector<PackItem> items;
+    Collect(root, "/", &items);
+    if (items.empty()) {
+        CLOG(ERROR) << "ResourcePack: " << srcDir << " not found";
+        return false;
+    }
+    // 按路径排序, 查找时二分
+    std::sort(items.begin(), items.end(), [](const PackItem& a, const PackItem& b) {
+        return a.rel < b.rel;
+    });
+
+    // 先确定索引和路径字符串的布局, 数据区在写入时依次分配
+    std::vector<PackEntry> index(items.size());
+    std::string names;
+    for (size_t i = 0; i < items.size(); ++i) {
+        memset(&index[i], 0, sizeof(PackEntry));
+        index[i].nameOff = names.size();
+        index[i].nameLen = items[i].rel.size();
+        index[i].resolution = items[i].resolution;
+        index[i].mtime = items[i].st.st_mtime;
+        names += items[i].rel;
+    }
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = PACK_VERSION;
+    header.count = items.size();
+    header.namesOff = sizeof(PackHeader) + sizeof(PackEntry) * items.size();
+    header.dataOff = AlignUp(header.namesOff + names.size(), PAGE_ALIGN);
+
+    std::string tmpPath = packPath + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        CLOG(ERROR) << "ResourcePack: create " << tmpPath << " error, errno: " << errno;
+        return false;
+    }
+
+    bool ok = true;
+    uint64_t off = header.dataOff;
+    uint64_t rawBytes = 0, gzBytes = 0;
+    std::string content, gz;
+    for (size_t i = 0; i < items.size() && ok; ++i) {
+        if (items[i].resolution != PathCache::REGULAR_FILE) {
+            continue;
+        }
+        if (!ReadAll(root + items[i].rel, &content)) {
+            CLOG(ERROR) << "ResourcePack: read " << items[i].rel << " error, errno: " << errno;
+            ok = false;
+            break;
+        }
+        index[i].dataOff = off;
+        index[i].dataLen = content.size();
+        ok = WriteAt(fd, content.data(), content.size(), off);
+        off = AlignUp(off + content.size(), DATA_ALIGN);
+        rawBytes += content.size();
+
+        // 压缩后至少小 10% 才保存
+        if (ok && compress && !content.empty() && Compressible(items[i].rel) &&
+            Gzip(content, &gz) && gz.size() < content.size() / 10 * 9) {
+            index[i].gzOff = off;
+            index[i].gzLen = gz.size();
+            ok = WriteAt(fd, gz.data(), gz.size(), off);
+            off = AlignUp(off + gz.size(), DATA_ALIGN);
+            gzBytes += gz.size();
+        }
+    }
+    header.fileSize = off;
+    ok = ok && WriteAt(fd, index.data(), sizeof(PackEntry) * index.size(), sizeof(PackHeader))
+            && WriteAt(fd, names.data(), names.size(), header.namesOff)
+            && ftruncate(fd, off) == 0
+            // 文件头最后写, 没写完整的包打不开
+            && WriteAt(fd, &header, sizeof(header), 0)
+            && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmpPath.c_str(), packPath.c_str()) < 0) {
+        CLOG(ERROR) << "ResourcePack: write " << packPath << " error, errno: " << errno;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    CLOG(INFO) << "ResourcePack: packed " << items.size() << " paths from " << srcDir << " into "
+               << packPath << ", " << rawBytes << " bytes, " << gzBytes << " bytes gzip";
+    return true;
+}
+
+bool ResourcePack::Open(const std::string& packPath) {
+    Close();
+    int fd = open(packPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(PackHeader)) {
+        close(fd);
+        CLOG(ERROR) << "ResourcePack: " << packPath << " is not a resource pack";
+        return false;
+    }
+    // MAP_SHARED: 所有进程共享同一份 page cache
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        CLOG(ERROR) << "ResourcePack: mmap " << packPath << " error, errno: " << errno;
+        return false;
+    }
+    std::shared_ptr<const Mapping> mapping = std::make_shared<Mapping>(addr, st.st_size);
+    const char* base = static_cast<const char*>(addr);
+
+    const PackHeader* header = reinterpret_cast<const PackHeader*>(base);
+    uint64_t size = st.st_size;
+    if (memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+        header->version != PACK_VERSION || header->fileSize != size ||
+        header->namesOff != sizeof(PackHeader) + sizeof(PackEntry) * static_cast<uint64_t>(header->count) ||
+        header->namesOff > size || header->dataOff > size) {
+        CLOG(ERROR) << "ResourcePack: " << packPath << " is corrupt or from another version";
+        return false;
+    }
+    const PackEntry* entries = reinterpret_cast<const PackEntry*>(base + sizeof(PackHeader));
+    for (uint32_t i = 0; i < header->count; ++i) {
+        const PackEntry& e = entries[i];
+        if (header->namesOff + e.nameOff + e.nameLen > header->dataOff ||
+            e.dataOff + e.dataLen > size || e.gzOff + e.gzLen > size) {
+            CLOG(ERROR) << "ResourcePack: " << packPath << " is corrupt";
+            return false;
+        }
+    }
+
+    // 每个条目的 MappedFile 预先生成好, 请求时只增加引用计数
+    std::vector<Entry> resolved(header->count);
+    std::shared_ptr<const void> owner = mapping;
+    for (uint32_t i = 0; i < header->count; ++i) {
+        const PackEntry& e = entries[i];
+        resolved[i].resolution = static_cast<PathCache::Resolution>(e.resolution);
+        if (resolved[i].resolution != PathCache::REGULAR_FILE) {
+            continue;
+        }
+        resolved[i].file = MakeFile(owner, base, e.dataOff, e.dataLen, e.mtime);
+        if (e.gzLen > 0) {
+            resolved[i].gzFile = MakeFile(owner, base, e.gzOff, e.gzLen, e.mtime);
+        }
+    }
+    // 资源包一般不大, 启动时一次性读入 page cache
+    madvise(addr, st.st_size, MADV_WILLNEED);
+
+    mapping_ = mapping;
+    count_ = header->count;
+    entries_ = entries;
+    names_ = base + header->namesOff;
+    resolved_.swap(resolved);
+    CLOG(INFO) << "ResourcePack: serving " << count_ << " paths from " << packPath;
+    return true;
+}
+
+bool ResourcePack::Lookup(const std::string& path, Entry* entry) const {
+    if (!mapping_) {
+        return false;
+    }
+    size_t len = path.size();
+    if (len > 1 && path.back() == '/') {
+        --len;
+    }
+    // 二分查找(与打包时 std::string 的比较顺序一致)
+    uint32_t lo = 0, hi = count_;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const PackEntry& e = entries_[mid];
+        int cmp = memcmp(names_ + e.nameOff, path.data(), std::min<size_t>(e.nameLen, len));
+        if (cmp == 0) {
+            cmp = e.nameLen < len ? -1 : (e.nameLen > len ? 1 : 0);
+        }
+        if (cmp == 0) {
+            *entry = resolved_[mid];
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    entry->resolution = PathCache::NOT_FOUND;
+    entry->file.reset();
+    entry->gzFile.reset();
+    return true;
+}
+
+void ResourcePack::Close() {
+    // 正在发送的内容还持有映射, 最后一个引用释放时才 munmap
+    resolved_.clear();
+    entries_ = nullptr;
+    names_ = nullptr;
+    count_ = 0;
+    mapping_.reset();
+}
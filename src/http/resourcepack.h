@@ -0,0 +1,77 @@
+/*
+    资源包: 把整个资源目录打包成一个可以直接 mmap 的文件
+
+    文件布局(主机字节序, 只在同一台机器/同一架构上生成和使用):
+        PackHeader | PackEntry[count](按路径排序) | 路径字符串 | 对齐到页 | 数据
+    每个普通文件在数据区中连续存放, 可选地再存一份预先 gzip 压缩的内容.
+    服务器启动时只 mmap 一次, 请求时二分查找索引并直接发送映射中的内容,
+    不再有 open / stat / mmap; 多个进程共享同一份 page cache.
+    资源包是只读的, 使用资源包时不监听资源目录的变化, 修改资源后需要重新打包.
+*/
+
+#ifndef RESOURCE_PACK_H
+#define RESOURCE_PACK_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "httpresponse.h"
+#include "pathcache.h"
+
+class ResourcePack {
+public:
+    // 一个路径的解析结果
+    struct Entry {
+        PathCache::Resolution resolution;
+        std::shared_ptr<const MappedFile> file;     // 原始内容(目录和禁止访问的文件为空)
+        std::shared_ptr<const MappedFile> gzFile;   // gzip 压缩后的内容(没有时为空)
+
+        Entry() : resolution(PathCache::NOT_FOUND) {}
+    };
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return ResourcePack指针
+    static ResourcePack* GetInstance() {
+        static ResourcePack inst;
+        return &inst;
+    }
+
+    /// @brief 打包资源目录(先写临时文件再改名, 不影响正在使用旧包的进程)
+    /// @param srcDir 资源目录
+    /// @param packPath 资源包文件
+    /// @param compress 是否为可压缩的文件额外保存 gzip 内容
+    /// @return 是否成功
+    static bool Build(const std::string& srcDir, const std::string& packPath, bool compress);
+
+    /// @brief 映射资源包(只在服务器启动前调用)
+    /// @param packPath 资源包文件
+    /// @return 是否成功(失败时 Lookup 总是返回 false)
+    bool Open(const std::string& packPath);
+
+    /// @brief 在资源包中查找路径
+    /// @param path 规范化之后的请求路径(以 '/' 开头)
+    /// @param entry 查找结果(包中没有的路径为 NOT_FOUND)
+    /// @return false-没有打开资源包
+    bool Lookup(const std::string& path, Entry* entry) const;
+
+    /// @brief 关闭资源包(只在服务器停止后调用, 正在发送的内容在最后一个引用释放后才 munmap)
+    void Close();
+
+private:
+    struct Mapping;
+
+    ResourcePack() : count_(0), entries_(nullptr), names_(nullptr) {}
+    ~ResourcePack() = default;
+
+private:
+    std::shared_ptr<const Mapping> mapping_;
+    uint32_t count_;
+    const struct PackEntry* entries_;   // 指向映射中的索引
+    const char* names_;                 // 指向映射中的路径字符串
+    std::vector<Entry> resolved_;       // 与索引一一对应, Open 时生成
+};
+
+
+#endif
@@ -0,0 +1,218 @@
+#include "router.h"
+
+#include <string.h>
+#include "../log/logsite.h"
+
+
+namespace {
+
+// 与 Router::Method 的顺序一致
+const char* const METHOD_NAMES[] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"
+};
+
+}
+
+std::string RouteParams::Get(const std::string& name) const {
+    for (size_t i = 0; i < size_; ++i) {
+        if (*params_[i].name == name) {
+            return std::string(params_[i].value, params_[i].len);
+        }
+    }
+    return std::string();
+}
+
+
+uint32_t Router::Node::Allow() const {
+    uint32_t allow = 0;
+    for (int i = 0; i < METHOD_NUM; ++i) {
+        if (handlers[i]) {
+            allow |= 1u << i;
+        }
+    }
+    return allow;
+}
+
+Router::Method Router::ParseMethod(const char* method, size_t len) {
+    // 长度 + 首字母就能区分所有方法, 再比较一次确认
+    Method id = METHOD_NUM;
+    switch (len) {
+        case 3: id = (method[0] == 'G') ? GET : PUT; break;
+        case 4: id = (method[0] == 'H') ? HEAD : POST; break;
+        case 5: id = PATCH; break;
+        case 6: id = DELETE; break;
+        case 7: id = OPTIONS; break;
+        default: return METHOD_NUM;
+    }
+    return memcmp(method, METHOD_NAMES[id], len) == 0 ? id : METHOD_NUM;
+}
+
+std::string Router::AllowHeader(uint32_t allow) {
+    std::string value;
+    for (int i = 0; i < METHOD_NUM; ++i) {
+        if (allow & (1u << i)) {
+            if (!value.empty()) {
+                value += ", ";
+            }
+            value += METHOD_NAMES[i];
+        }
+    }
+    return value;
+}
+
+Router::Node* Router::InsertStatic_(Node* node, const std::string& s) {
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t idx = node->indices.find(s[pos]);
+        if (idx == std::string::npos) {
+            // 没有共同前缀的子节点: 新建
+            std::unique_ptr<Node> child(new Node());
+            child->prefix = s.substr(pos);
+            node->indices += s[pos];
+            node->children.push_back(std::move(child));
+            return node->children.back().get();
+        }
+        Node* child = node->children[idx].get();
+        size_t len = 0;
+        while (len < child->prefix.size() && pos + len < s.size() && child->prefix[len] == s[pos + len]) {
+            ++len;
+        }
+        if (len < child->prefix.size()) {
+            // 只有部分前缀相同: 分裂成 公共前缀 -> 剩余部分
+            std::unique_ptr<Node> mid(new Node());
+            mid->prefix = child->prefix.substr(0, len);
+            std::unique_ptr<Node> old = std::move(node->children[idx]);
+            old->prefix.erase(0, len);
+            mid->indices += old->prefix[0];
+            mid->children.push_back(std::move(old));
+            node->children[idx] = std::move(mid);
+            child = node->children[idx].get();
+        }
+        node = child;
+        pos += len;
+    }
+    return node;
+}
+
+bool Router::Add(Method method, const std::string& pattern, std::shared_ptr<HttpHandler> handler) {
+    if (method >= METHOD_NUM || !handler || pattern.empty() || pattern[0] != '/') {
+        CLOG(ERROR) << "Router: invalid route " << pattern;
+        return false;
+    }
+    Node* node = root_.get();
+    size_t paramNum = 0;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        char ch = pattern[pos];
+        if (ch == ':' || ch == '*') {
+            size_t end = pattern.find('/', pos);
+            if (end == std::string::npos) {
+                end = pattern.size();
+            }
+            std::string name = pattern.substr(pos + 1, end - pos - 1);
+            if (name.empty() || (ch == '*' && end != pattern.size()) ||
+                pattern[pos - 1] != '/' || ++paramNum > RouteParams::MAX_PARAMS) {
+                // 参数必须占满一个路径段, 通配符只能在最后
+                CLOG(ERROR) << "Router: invalid route " << pattern;
+                return false;
+            }
+            std::unique_ptr<Node>& child = (ch == ':') ? node->paramChild : node->wildChild;
+            if (!child) {
+                child.reset(new Node());
+                child->paramName = name;
+            }
+            else if (child->paramName != name) {
+                CLOG(ERROR) << "Router: " << pattern << " conflicts with parameter " << child->paramName;
+                return false;
+            }
+            node = child.get();
+            pos = end;
+        }
+        else {
+            size_t end = pattern.find_first_of(":*", pos);
+            if (end == std::string::npos) {
+                end = pattern.size();
+            }
+            node = InsertStatic_(node, pattern.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+    if (node->handlers[method]) {
+        CLOG(ERROR) << "Router: duplicate route " << pattern;
+        return false;
+    }
+    node->handlers[method] = handler.get();
+    handlers_.push_back(std::move(handler));
+    return true;
+}
+
+HttpHandler* Router::Match_(const Node* node, const std::string& path, size_t pos,
+                            int method, RouteParams* params, uint32_t* allow) {
+    if (pos == path.size()) {
+        if (method < METHOD_NUM && node->handlers[method]) {
+            return node->handlers[method];
+        }
+        *allow |= node->Allow();
+        // 通配符可以匹配空串
+        if (!node->wildChild) {
+            return nullptr;
+        }
+    }
+
+    // 1. 静态子节点
+    if (pos < path.size()) {
+        const char* p = static_cast<const char*>(memchr(node->indices.data(), path[pos], node->indices.size()));
+        if (p) {
+            const Node* child = node->children[p - node->indices.data()].get();
+            size_t len = child->prefix.size();
+            if (path.size() - pos >= len && path.compare(pos, len, child->prefix) == 0) {
+                HttpHandler* handler = Match_(child, path, pos + len, method, params, allow);
+                if (handler) {
+                    return handler;
+                }
+            }
+        }
+    }
+
+    // 2. :param 匹配一个非空的路径段
+    if (node->paramChild && pos < path.size() && path[pos] != '/' && params->size_ < RouteParams::MAX_PARAMS) {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        const Node* child = node->paramChild.get();
+        params->params_[params->size_++] = {&child->paramName, path.data() + pos, end - pos};
+        HttpHandler* handler = Match_(child, path, end, method, params, allow);
+        if (handler) {
+            return handler;
+        }
+        --params->size_;
+    }
+
+    // 3. *wildcard 匹配剩下的全部
+    if (node->wildChild && params->size_ < RouteParams::MAX_PARAMS) {
+        const Node* child = node->wildChild.get();
+        if (method < METHOD_NUM && child->handlers[method]) {
+            params->params_[params->size_++] = {&child->paramName, path.data() + pos, path.size() - pos};
+            return child->handlers[method];
+        }
+        *allow |= child->Allow();
+    }
+    return nullptr;
+}
+
+Router::MatchResult Router::Match(Method method, const std::string& path,
+                                  HttpHandler** handler, RouteParams* params, uint32_t* allow) const {
+    params->size_ = 0;
+    *allow = 0;
+    *handler = Match_(root_.get(), path, 0, method, params, allow);
+    if (*handler) {
+        return MATCHED;
+    }
+    return *allow ? METHOD_NOT_ALLOWED : NOT_FOUND;
+}
+
+void Router::Clear() {
+    root_.reset(new Node());
+    handlers_.clear();
+}
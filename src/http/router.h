@@ -0,0 +1,213 @@
+// 路由: 压缩基数树(radix tree), 按 方法 + 路径 找到处理请求的 handler
+//
+// 路由模式由静态片段和参数组成:
+//     /api/user/:id/profile     :name 匹配一个路径段(不含 '/')
+//     /static/*filepath         *name 匹配剩下的全部路径(只能在最后)
+// 同一位置上静态片段优先于 :param, :param 优先于 *wildcard, 匹配失败时回溯.
+// 查找只沿着路径走一遍树, 不分配内存, 路径参数指向请求路径中的片段.
+// 路由只在服务器启动前注册, 之后只读, 查找不加锁.
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+class HttpRequest;
+class HttpResponse;
+
+// 路径参数: 指向请求路径中的片段
+class RouteParams {
+public:
+    static const size_t MAX_PARAMS = 8;
+
+    RouteParams() : size_(0) {}
+
+    /// @brief 参数个数
+    size_t Size() const {
+        return size_;
+    }
+
+    /// @brief 按名字取参数
+    /// @param name 参数名(不含 ':' / '*')
+    /// @return 参数值(不存在时返回空串)
+    std::string Get(const std::string& name) const;
+
+private:
+    friend class Router;
+
+    struct Param {
+        const std::string* name;
+        const char* value;
+        size_t len;
+    };
+
+    Param params_[MAX_PARAMS];
+    size_t size_;
+};
+
+// 请求体的去处: handler 在首部解析完成后提供, 请求体边接收边写入, 不在内存中攒完整
+class BodySink {
+public:
+    /// @brief 没有 Finish 就析构表示请求体不完整(连接断开或出错), 需要丢弃已写入的内容
+    virtual ~BodySink() = default;
+
+    /// @brief 可以直接 splice 写入的文件描述符(Content-Length 请求体不经过用户空间)
+    /// @return -1 表示只能通过 Write 写入
+    virtual int Fd() const {
+        return -1;
+    }
+
+    /// @brief 请求体的大小上限
+    /// @return 字节数, 超过时响应 413
+    virtual size_t Limit() const = 0;
+
+    /// @brief 写入一段请求体(已经读入用户空间的部分、chunked 解码后的内容)
+    /// @param data 数据
+    /// @param len 长度
+    /// @return false-写入失败(响应 ErrorCode())
+    virtual bool Write(const char* data, size_t len) = 0;
+
+    /// @brief 请求体接收完整, 在 Handle 之前调用
+    /// @return false-失败(响应 ErrorCode())
+    virtual bool Finish() {
+        return true;
+    }
+
+    /// @brief Write / Finish 失败时响应的状态码
+    /// @return 默认 500
+    virtual int ErrorCode() const {
+        return 500;
+    }
+};
+
+// 请求的处理者
+class HttpHandler {
+public:
+    enum Result {
+        DONE = 0,     // 已经准备好响应
+        PENDING,      // 需要阻塞的操作(如访问数据库), 由 SQL 线程调用 HandlePending 继续
+    };
+
+    virtual ~HttpHandler() = default;
+
+    /// @brief 首部解析完成、接收请求体之前调用, 决定请求体的去处
+    /// @param request 只解析了请求行和首部的请求
+    /// @param params 路径参数
+    /// @param response 已经 Init 过的响应, 拒绝请求时设置 >= 400 的状态码
+    /// @return nullptr-请求体保存在 request.body() 中(最多 HttpRequest::maxBodyBytes 字节)
+    virtual std::unique_ptr<BodySink> OpenBody(HttpRequest& /*request*/, const RouteParams& /*params*/, HttpResponse& /*response*/) {
+        return nullptr;
+    }
+
+    /// @brief 在工作线程中处理请求(不能阻塞), 通过 response 设置要发送的文件/内容/状态码
+    /// @param request 解析完成的请求(请求体已经接收完整)
+    /// @param params 路径参数(只在本次调用中有效)
+    /// @param response 已经 Init 过的响应
+    /// @return DONE / PENDING
+    virtual Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) = 0;
+
+    /// @brief Handle 返回 PENDING 后, 在 SQL 线程中继续处理
+    /// @param request 请求
+    /// @param response 响应
+    virtual void HandlePending(HttpRequest& /*request*/, HttpResponse& /*response*/) {}
+};
+
+class Router {
+public:
+    // 支持的方法, 同时是 Allow 掩码的位序号
+    enum Method {
+        GET = 0,
+        HEAD,
+        POST,
+        PUT,
+        DELETE,
+        PATCH,
+        OPTIONS,
+        METHOD_NUM
+    };
+
+    // 查找结果
+    enum MatchResult {
+        MATCHED = 0,
+        NOT_FOUND,            // 没有匹配的路径
+        METHOD_NOT_ALLOWED,   // 路径匹配, 但没有注册该方法
+    };
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return Router指针
+    static Router* GetInstance() {
+        static Router inst;
+        return &inst;
+    }
+
+    /// @brief 注册路由(只在服务器启动前调用)
+    /// @param method 方法
+    /// @param pattern 路由模式, 以 '/' 开头
+    /// @param handler 处理者(同一个 handler 可以注册到多个路由)
+    /// @return false-模式非法或与已有路由冲突
+    bool Add(Method method, const std::string& pattern, std::shared_ptr<HttpHandler> handler);
+
+    /// @brief 查找路由
+    /// @param method 请求方法(不支持的方法为 METHOD_NUM)
+    /// @param path 规范化之后的请求路径
+    /// @param handler 匹配的处理者
+    /// @param params 路径参数(指向 path 中的片段)
+    /// @param allow METHOD_NOT_ALLOWED 时返回该路径注册过的方法掩码
+    /// @return 查找结果
+    MatchResult Match(Method method, const std::string& path,
+                      HttpHandler** handler, RouteParams* params, uint32_t* allow) const;
+
+    /// @brief 清空所有路由
+    void Clear();
+
+    /// @brief 方法名 -> Method
+    /// @param method 方法名
+    /// @param len 方法名长度
+    /// @return 不支持的方法返回 METHOD_NUM
+    static Method ParseMethod(const char* method, size_t len);
+
+    /// @brief 方法掩码 -> Allow 首部的值
+    static std::string AllowHeader(uint32_t allow);
+
+private:
+    struct Node {
+        std::string prefix;                         // 压缩的静态片段
+        std::string indices;                        // 各个静态子节点 prefix 的首字节, 与 children 一一对应
+        std::vector<std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> paramChild;           // :param 子节点
+        std::unique_ptr<Node> wildChild;            // *wildcard 子节点
+        std::string paramName;                      // paramChild / wildChild 节点的参数名
+        HttpHandler* handlers[METHOD_NUM];
+
+        Node() {
+            for (HttpHandler*& h : handlers) {
+                h = nullptr;
+            }
+        }
+        uint32_t Allow() const;
+    };
+
+    Router() : root_(new Node()) {}
+    ~Router() = default;
+
+    /// @brief 把静态片段插入 node 的静态子树, 必要时分裂节点
+    /// @return 片段结束处的节点
+    static Node* InsertStatic_(Node* node, const std::string& s);
+
+    /// @brief 从 node 开始匹配 path[pos:], 失败时回溯
+    /// @param allow 记录路径匹配但方法不匹配的节点的方法掩码
+    /// @return 匹配的处理者
+    static HttpHandler* Match_(const Node* node, const std::string& path, size_t pos,
+                               int method, RouteParams* params, uint32_t* allow);
+
+private:
+    std::unique_ptr<Node> root_;
+    std::vector<std::shared_ptr<HttpHandler>> handlers_;    // 持有所有注册过的处理者
+};
+
+
+#endif
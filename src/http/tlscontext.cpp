@@ -0,0 +1,320 @@
+#include "tlscontext.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/core_names.h>
+#include "../log/logsite.h"
+
+
+namespace {
+
+// ALPN 协议列表(长度前缀), 按本端的偏好排序
+const unsigned char ALPN_H2[] = "\x02h2";
+const unsigned char ALPN_HTTP11[] = "\x08http/1.1";
+
+// 会话缓存的 id 上下文(同一个服务器的会话才能恢复)
+const unsigned char SESSION_ID_CONTEXT[] = "lizyWebServer";
+
+// TLS 1.3 的套件: AES-GCM 在前(内核 kTLS 支持得最早), 然后是 ChaCha20
+const char TLS13_CIPHERS[] = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256";
+const char TLS12_CIPHERS[] = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                             "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                             "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305";
+
+std::string LastError() {
+    char buf[256];
+    ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+    return buf;
+}
+
+}
+
+
+TlsContext::TlsContext()
+    : fullHandshakes(0), resumedHandshakes(0), ktlsSend(0), ktlsRecv(0), ctx_(nullptr), hasPrevKey_(false) {
+    memset(keys_, 0, sizeof(keys_));
+}
+
+TlsContext::~TlsContext() {
+    Close();
+}
+
+bool TlsContext::Init(const char* certFile, const char* keyFile, bool ktls) {
+    Close();
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        CLOG(ERROR) << "TLS: SSL_CTX_new failed: " << LastError();
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_ciphersuites(ctx, TLS13_CIPHERS);
+    SSL_CTX_set_cipher_list(ctx, TLS12_CIPHERS);
+    if (SSL_CTX_use_certificate_chain_file(ctx, certFile) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, keyFile, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        CLOG(ERROR) << "TLS: load " << certFile << " / " << keyFile << " failed: " << LastError();
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    uint64_t options = SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_RENEGOTIATION;
+    if (ktls) {
+        options |= SSL_OP_ENABLE_KTLS;
+    }
+    SSL_CTX_set_options(ctx, options);
+    // 部分写: SSL_write 写出一部分记录就返回(配合非阻塞 socket 和 writev 式的偏移推进)
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    // 会话恢复: 服务端缓存(客户端不支持票据时) + 票据
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT_SEC);
+    SSL_CTX_set_num_tickets(ctx, 1);
+    {
+        std::lock_guard<std::mutex> lk(ticketMtx_);
+        hasPrevKey_ = false;
+        if (!RotateTicketKey_()) {
+            CLOG(ERROR) << "TLS: generate ticket key failed";
+            SSL_CTX_free(ctx);
+            return false;
+        }
+    }
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &TlsContext::TicketKeyCallback_);
+    SSL_CTX_set_alpn_select_cb(ctx, &TlsContext::AlpnSelect_, nullptr);
+
+    // OpenSSL 用 write 写 socket, 对端断开时不能让 SIGPIPE 结束进程
+    signal(SIGPIPE, SIG_IGN);
+    ctx_ = ctx;
+    CLOG(INFO) << "TLS: cert " << certFile << ", kTLS " << (ktls ? "on" : "off");
+    return true;
+}
+
+void TlsContext::Close() {
+    if (ctx_) {
+        SSL_CTX_free(ctx_);
+        ctx_ = nullptr;
+    }
+}
+
+std::string TlsContext::Stats() const {
+    return "full handshakes " + std::to_string(fullHandshakes.load()) +
+           ", resumed " + std::to_string(resumedHandshakes.load()) +
+           ", kTLS send " + std::to_string(ktlsSend.load()) +
+           ", kTLS recv " + std::to_string(ktlsRecv.load());
+}
+
+bool TlsContext::RotateTicketKey_() {
+    TicketKey key;
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 || RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1 ||
+        RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1) {
+        return false;
+    }
+    keys_[1] = keys_[0];
+    hasPrevKey_ = (keyCreated_ != std::chrono::steady_clock::time_point());
+    keys_[0] = key;
+    keyCreated_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+int TlsContext::TicketKeyCallback_(SSL* /*ssl*/, unsigned char* keyName, unsigned char* iv,
+                                   EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* macCtx, int enc) {
+    TlsContext* self = GetInstance();
+    TicketKey key;
+    int ret = 1;
+    {
+        std::lock_guard<std::mutex> lk(self->ticketMtx_);
+        if (enc) {
+            // 发新票据时顺便检查是否到了轮换时间
+            if (std::chrono::steady_clock::now() - self->keyCreated_ > std::chrono::seconds(TICKET_KEY_ROTATE_SEC)) {
+                self->RotateTicketKey_();
+            }
+            key = self->keys_[0];
+        }
+        else if (memcmp(keyName, self->keys_[0].name, sizeof(key.name)) == 0) {
+            key = self->keys_[0];
+        }
+        else if (self->hasPrevKey_ && memcmp(keyName, self->keys_[1].name, sizeof(key.name)) == 0) {
+            // 上一把密钥的票据: 可以恢复, 并换发新票据
+            key = self->keys_[1];
+            ret = 2;
+        }
+        else {
+            // 不认识的票据: 完整握手
+            return 0;
+        }
+    }
+
+    OSSL_PARAM params[3];
+    params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey, sizeof(key.hmacKey));
+    params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+    params[2] = OSSL_PARAM_construct_end();
+    if (enc) {
+        memcpy(keyName, key.name, sizeof(key.name));
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) != 1 ||
+            EVP_EncryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr, key.aesKey, iv) != 1) {
+            return -1;
+        }
+    }
+    else if (EVP_DecryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr, key.aesKey, iv) != 1) {
+        return -1;
+    }
+    if (EVP_MAC_CTX_set_params(macCtx, params) != 1) {
+        return -1;
+    }
+    return ret;
+}
+
+int TlsContext::AlpnSelect_(SSL* /*ssl*/, const unsigned char** out, unsigned char* outLen,
+                            const unsigned char* in, unsigned int inLen, void* /*arg*/) {
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outLen, ALPN_H2, sizeof(ALPN_H2) - 1, in, inLen) == OPENSSL_NPN_NEGOTIATED ||
+        SSL_select_next_proto(&selected, outLen, ALPN_HTTP11, sizeof(ALPN_HTTP11) - 1, in, inLen) == OPENSSL_NPN_NEGOTIATED) {
+        *out = selected;
+        return SSL_TLSEXT_ERR_OK;
+    }
+    // 客户端只支持别的协议: 不协商 ALPN, 按 HTTP/1.1 处理
+    return SSL_TLSEXT_ERR_NOACK;
+}
+
+
+TlsSession::TlsSession(int fd)
+    : fd_(fd), ssl_(SSL_new(TlsContext::GetInstance()->Ctx())), established_(false), wantWrite_(false), ktlsSend_(false) {
+    if (ssl_) {
+        SSL_set_fd(ssl_, fd_);
+        SSL_set_accept_state(ssl_);
+    }
+}
+
+TlsSession::~TlsSession() {
+    if (ssl_) {
+        SSL_free(ssl_);
+    }
+}
+
+int TlsSession::ErrnoOf_(int ret) {
+    switch (SSL_get_error(ssl_, ret)) {
+        case SSL_ERROR_WANT_READ:
+            wantWrite_ = false;
+            return EAGAIN;
+        case SSL_ERROR_WANT_WRITE:
+            wantWrite_ = true;
+            return EAGAIN;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            // errno 为 0 表示对端没有发 close_notify 就断开了
+            return errno;
+        default:
+            return EPROTO;
+    }
+}
+
+int TlsSession::Handshake(int* saveErrno) {
+    if (established_) {
+        return 1;
+    }
+    if (!ssl_) {
+        *saveErrno = ENOMEM;
+        return -1;
+    }
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl_);
+    if (ret != 1) {
+        int err = ErrnoOf_(ret);
+        if (err == EAGAIN) {
+            return 0;
+        }
+        *saveErrno = err ? err : ECONNRESET;
+        LOG_EVERY_SEC(INFO, 1) << "TLS handshake with client[" << fd_ << "] failed: " << strerror(*saveErrno);
+        return -1;
+    }
+    established_ = true;
+    wantWrite_ = false;
+    TlsContext* tls = TlsContext::GetInstance();
+    if (SSL_session_reused(ssl_)) {
+        tls->resumedHandshakes++;
+    }
+    else {
+        tls->fullHandshakes++;
+    }
+#ifndef OPENSSL_NO_KTLS
+    ktlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+    if (ktlsSend_) {
+        tls->ktlsSend++;
+    }
+    if (BIO_get_ktls_recv(SSL_get_rbio(ssl_))) {
+        tls->ktlsRecv++;
+    }
+#endif
+    return 1;
+}
+
+ssize_t TlsSession::Read(Buffer& buff, int* saveErrno) {
+    ssize_t total = 0;
+    do {
+        // 一条 TLS 记录最多 16KB; 解密好还没取走的部分(SSL_pending)不会再触发 socket 可读, 要一次取完
+        buff.EnsureWritable(16 * 1024);
+        ERR_clear_error();
+        int ret = SSL_read(ssl_, buff.BeginWrite(), static_cast<int>(buff.WritableBytes()));
+        if (ret <= 0) {
+            int err = ErrnoOf_(ret);
+            if (total > 0) {
+                return total;
+            }
+            if (err == 0) {
+                return 0;
+            }
+            *saveErrno = err;
+            return -1;
+        }
+        buff.HasWritten(ret);
+        total += ret;
+    } while (SSL_pending(ssl_) > 0);
+    return total;
+}
+
+ssize_t TlsSession::Writev(const struct iovec* iov, int cnt, int* saveErrno) {
+    if (ktlsSend_) {
+        // 内核加密: 和明文连接一样直接写 socket(文件内容不经过用户空间)
+        ssize_t len = writev(fd_, iov, cnt);
+        if (len < 0) {
+            *saveErrno = errno;
+        }
+        return len;
+    }
+    ssize_t total = 0;
+    for (int i = 0; i < cnt; ++i) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        ERR_clear_error();
+        int ret = SSL_write(ssl_, iov[i].iov_base, static_cast<int>(std::min<size_t>(iov[i].iov_len, INT32_MAX)));
+        if (ret <= 0) {
+            int err = ErrnoOf_(ret);
+            if (total > 0) {
+                return total;
+            }
+            *saveErrno = err ? err : EPIPE;
+            return -1;
+        }
+        total += ret;
+        if (static_cast<size_t>(ret) < iov[i].iov_len) {
+            // 部分写: socket 写满了
+            break;
+        }
+    }
+    return total;
+}
+
+void TlsSession::Shutdown() {
+    if (ssl_ && established_) {
+        ERR_clear_error();
+        SSL_shutdown(ssl_);
+    }
+}
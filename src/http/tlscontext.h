@@ -0,0 +1,156 @@
+/*
+    TLS(OpenSSL)
+
+    TlsContext: 进程内唯一的 SSL_CTX(证书、协议版本、ALPN、会话恢复), 由 main 在启动前初始化, 没有初始化时监听明文.
+    会话恢复: 同时开启服务端会话缓存和会话票据(TLS 1.2 的 session id / ticket, TLS 1.3 的 PSK 票据);
+    票据密钥由本端生成并定期轮换, 上一把密钥解开的票据仍然有效并会被换发新票据.
+
+    TlsSession: 每个连接一个, 握手由 WebServer 在工作线程中非阻塞地推进.
+    开启 kTLS 且内核支持时, 握手后对称加密交给内核: 发送直接对 socket 调 writev(mmap 的文件内容不经过用户空间加密),
+    否则由 SSL_write 在用户空间加密. 接收总是经过 SSL_read(kTLS 接收时 OpenSSL 只是转交内核解密好的数据).
+*/
+
+#ifndef TLS_CONTEXT_H
+#define TLS_CONTEXT_H
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <openssl/ssl.h>
+#include "../buffer/buffer.h"
+
+class TlsContext {
+public:
+    static const int TICKET_KEY_ROTATE_SEC = 12 * 3600;    // 票据密钥的轮换间隔
+    static const long SESSION_CACHE_SIZE = 20480;          // 服务端会话缓存的条目数
+    static const long SESSION_TIMEOUT_SEC = 24 * 3600;     // 会话(票据)的有效期
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return TlsContext指针
+    static TlsContext* GetInstance() {
+        static TlsContext inst;
+        return &inst;
+    }
+
+    /// @brief 初始化(加载证书和私钥)
+    /// @param certFile 证书链文件(PEM)
+    /// @param keyFile 私钥文件(PEM)
+    /// @param ktls 是否尝试把对称加密交给内核(kTLS)
+    /// @return true-成功, false-失败(已记录日志)
+    bool Init(const char* certFile, const char* keyFile, bool ktls = true);
+
+    /// @brief 是否开启了 TLS
+    bool Enabled() const {
+        return ctx_ != nullptr;
+    }
+
+    SSL_CTX* Ctx() const {
+        return ctx_;
+    }
+
+    /// @brief 握手统计(完整握手/会话恢复/kTLS 发送/kTLS 接收)
+    std::string Stats() const;
+
+    /// @brief 释放 SSL_CTX
+    void Close();
+
+    std::atomic<uint64_t> fullHandshakes;
+    std::atomic<uint64_t> resumedHandshakes;
+    std::atomic<uint64_t> ktlsSend;
+    std::atomic<uint64_t> ktlsRecv;
+
+private:
+    TlsContext();
+    ~TlsContext();
+
+    // 票据密钥: 名字 + AES-128 密钥 + HMAC-SHA256 密钥
+    struct TicketKey {
+        unsigned char name[16];
+        unsigned char aesKey[16];
+        unsigned char hmacKey[32];
+    };
+
+    /// @brief 生成新的票据密钥, 原来的成为上一把密钥(调用者持有 ticketMtx_)
+    bool RotateTicketKey_();
+
+    /// @brief OpenSSL 加密/解密票据时的回调
+    static int TicketKeyCallback_(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* macCtx, int enc);
+
+    /// @brief ALPN: 客户端支持时选择 h2, 否则 http/1.1
+    static int AlpnSelect_(SSL* ssl, const unsigned char** out, unsigned char* outLen,
+                           const unsigned char* in, unsigned int inLen, void* arg);
+
+private:
+    SSL_CTX* ctx_;
+
+    std::mutex ticketMtx_;
+    TicketKey keys_[2];         // 0-当前, 1-上一把
+    bool hasPrevKey_;
+    std::chrono::steady_clock::time_point keyCreated_;
+};
+
+class TlsSession {
+public:
+    /// @param fd 连接的 socket(非阻塞)
+    explicit TlsSession(int fd);
+    ~TlsSession();
+
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    /// @brief 推进握手
+    /// @param saveErrno 出错时保存的错误码
+    /// @return 1-完成, 0-等待 socket 可读/可写(见 WantWrite), -1-失败
+    int Handshake(int* saveErrno);
+
+    /// @brief 握手是否已经完成
+    bool Established() const {
+        return established_;
+    }
+
+    /// @brief 握手是否在等待 socket 可写
+    bool WantWrite() const {
+        return wantWrite_;
+    }
+
+    /// @brief 发送是否交给了内核(kTLS)
+    bool KtlsSend() const {
+        return ktlsSend_;
+    }
+
+    /// @brief 读取并解密数据追加到缓冲区(读完当前的 TLS 记录)
+    /// @param buff 读缓冲区
+    /// @param saveErrno 出错时保存的错误码(没有数据时是 EAGAIN)
+    /// @return 读取的长度, 0-对端关闭, -1-出错
+    ssize_t Read(Buffer& buff, int* saveErrno);
+
+    /// @brief 加密并发送多个缓冲区(语义同 writev)
+    /// @param iov 缓冲区
+    /// @param cnt 缓冲区个数
+    /// @param saveErrno 出错时保存的错误码(socket 写满时是 EAGAIN)
+    /// @return 发送的明文长度, -1-出错
+    ssize_t Writev(const struct iovec* iov, int cnt, int* saveErrno);
+
+    /// @brief 发送 close_notify(不等待对端回应)
+    void Shutdown();
+
+private:
+    /// @brief SSL_get_error 转换为 errno
+    int ErrnoOf_(int ret);
+
+private:
+    int fd_;
+    SSL* ssl_;
+    bool established_;
+    bool wantWrite_;
+    bool ktlsSend_;
+};
+
+
+#endif
@@ -0,0 +1,155 @@
+#include "upstream.h"
+
+#include <chrono>
+#include <unordered_map>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "../log/logsite.h"
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+
+struct IdleConn {
+    int fd;
+    Clock::time_point since;
+};
+
+// 本线程到各个上游的空闲连接(后放回的先取出, 最近用过的连接最不可能被上游关闭)
+thread_local std::unordered_map<const Upstream*, std::vector<IdleConn>> idlePool;
+
+// 空闲连接是否还能用: 上游关闭(读到 EOF)或者发来了多余的数据都不能再用
+bool Alive(int fd) {
+    char ch;
+    ssize_t n = recv(fd, &ch, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+}
+
+Upstream::Upstream(const std::string& hostPort)
+    : outstanding(0), downUntilMs(0), name_(hostPort), valid_(false) {
+    memset(&addr_, 0, sizeof(addr_));
+    size_t colon = hostPort.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        return;
+    }
+    std::string host = hostPort.substr(0, colon);
+    int port = atoi(hostPort.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) {
+        return;
+    }
+    // 只在启动时解析一次, 之后 connect 不再查 DNS
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+        return;
+    }
+    addr_ = *reinterpret_cast<struct sockaddr_in*>(result->ai_addr);
+    addr_.sin_port = htons(port);
+    freeaddrinfo(result);
+    valid_ = true;
+}
+
+UpstreamGroup::UpstreamGroup(const std::vector<std::string>& addrs) : next_(0) {
+    for (const std::string& addr : addrs) {
+        std::unique_ptr<Upstream> upstream(new Upstream(addr));
+        if (!upstream->Valid()) {
+            CLOG(ERROR) << "Proxy: cannot resolve upstream " << addr;
+            continue;
+        }
+        upstreams_.push_back(std::move(upstream));
+    }
+}
+
+Upstream* UpstreamGroup::Pick() {
+    size_t n = upstreams_.size();
+    if (n == 0) {
+        return nullptr;
+    }
+    // 在途数只是近似的(读和加一之间可能被别的线程选走), 足够把请求摊开
+    int64_t now = NowMs();
+    size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    Upstream* best = nullptr;
+    bool bestDown = true;
+    for (size_t i = 0; i < n; ++i) {
+        Upstream* upstream = upstreams_[(start + i) % n].get();
+        bool down = upstream->downUntilMs.load(std::memory_order_relaxed) > now;
+        if (!best || (bestDown && !down) ||
+            (down == bestDown && upstream->outstanding.load(std::memory_order_relaxed) <
+                                 best->outstanding.load(std::memory_order_relaxed))) {
+            best = upstream;
+            bestDown = down;
+        }
+    }
+    best->outstanding.fetch_add(1, std::memory_order_relaxed);
+    return best;
+}
+
+void UpstreamGroup::Done(Upstream* upstream, bool connectFailed) {
+    upstream->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    if (connectFailed) {
+        upstream->downUntilMs.store(NowMs() + DOWN_BACKOFF_MS, std::memory_order_relaxed);
+        LOG_EVERY_SEC(WARNING, 1) << "Proxy: connect to upstream " << upstream->Name() << " failed";
+    }
+    else if (upstream->downUntilMs.load(std::memory_order_relaxed) != 0) {
+        // 恢复了: 只在需要时写, 不让每个请求都写这条共享的缓存行
+        upstream->downUntilMs.store(0, std::memory_order_relaxed);
+    }
+}
+
+int UpstreamGroup::Acquire(Upstream* upstream, bool* reused, bool* connecting) {
+    std::vector<IdleConn>& idle = idlePool[upstream];
+    Clock::time_point now = Clock::now();
+    while (!idle.empty()) {
+        IdleConn conn = idle.back();
+        idle.pop_back();
+        if (now - conn.since < std::chrono::milliseconds(IDLE_TIMEOUT_MS) && Alive(conn.fd)) {
+            *reused = true;
+            *connecting = false;
+            return conn.fd;
+        }
+        close(conn.fd);
+    }
+
+    *reused = false;
+    *connecting = false;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    const struct sockaddr_in& addr = upstream->Addr();
+    if (connect(fd, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return -1;
+        }
+        *connecting = true;
+    }
+    return fd;
+}
+
+void UpstreamGroup::Release(Upstream* upstream, int fd) {
+    std::vector<IdleConn>& idle = idlePool[upstream];
+    if (idle.size() >= MAX_IDLE_PER_THREAD) {
+        close(fd);
+        return;
+    }
+    idle.push_back(IdleConn{fd, Clock::now()});
+}
@@ -0,0 +1,88 @@
+/*
+    反向代理的上游
+
+    UpstreamGroup: 一组等价的上游地址, 每个请求选择在途请求最少的上游(least outstanding requests),
+    在途数相同时从轮转的起点开始选, 避免总是压在第一个上游上. 连接失败的上游在一小段时间内不参与选择.
+    到上游的连接是非阻塞的 keep-alive 连接, 用完放回当前工作线程自己的空闲连接池(thread_local, 取放不加锁),
+    同一个线程之后的请求直接复用, 省去 connect 的往返; 空闲太久或已经被上游关闭的连接在取出时丢弃.
+*/
+
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+#include <netinet/in.h>
+
+class Upstream {
+public:
+    /// @param hostPort "host:port"(host 在构造时解析一次)
+    explicit Upstream(const std::string& hostPort);
+
+    /// @brief 地址是否解析成功
+    bool Valid() const {
+        return valid_;
+    }
+
+    const std::string& Name() const {
+        return name_;
+    }
+
+    const struct sockaddr_in& Addr() const {
+        return addr_;
+    }
+
+    std::atomic<int> outstanding;       // 在途请求数
+    std::atomic<int64_t> downUntilMs;   // 连接失败后暂停选择的截止时间(steady_clock 毫秒)
+
+private:
+    std::string name_;
+    struct sockaddr_in addr_;
+    bool valid_;
+};
+
+class UpstreamGroup {
+public:
+    static const size_t MAX_IDLE_PER_THREAD = 32;  // 每个线程对每个上游最多保留的空闲连接
+    static const int IDLE_TIMEOUT_MS = 15000;      // 空闲连接的保留时间(要短于上游的 keep-alive 超时)
+    static const int DOWN_BACKOFF_MS = 2000;       // 连接失败的上游暂停选择的时间
+
+    /// @param addrs 上游地址("host:port"), 解析失败的地址被忽略(已记录日志)
+    explicit UpstreamGroup(const std::vector<std::string>& addrs);
+
+    /// @brief 可用的上游个数
+    size_t Size() const {
+        return upstreams_.size();
+    }
+
+    /// @brief 选择在途请求最少的上游(所有上游都暂停时也从中选择), 在途数加一
+    /// @return 上游(没有上游时为 nullptr), 请求结束时调用 Done
+    Upstream* Pick();
+
+    /// @brief 请求结束, 在途数减一
+    /// @param upstream Pick 得到的上游
+    /// @param connectFailed 连接失败: 暂停选择这个上游
+    static void Done(Upstream* upstream, bool connectFailed);
+
+    /// @brief 取一个到上游的连接: 先从本线程的空闲池取, 没有时发起非阻塞 connect
+    /// @param upstream 上游
+    /// @param reused 取到的是复用的连接(上游可能刚好关闭了它)
+    /// @param connecting connect 还在进行, 等 socket 可写后用 SO_ERROR 确认
+    /// @return socket, -1-失败
+    static int Acquire(Upstream* upstream, bool* reused, bool* connecting);
+
+    /// @brief 响应完整读完的连接放回本线程的空闲池(池满时关闭)
+    /// @param upstream 上游
+    /// @param fd socket
+    static void Release(Upstream* upstream, int fd);
+
+private:
+    std::vector<std::unique_ptr<Upstream>> upstreams_;
+    std::atomic<size_t> next_;  // 轮转的起点
+};
+
+
+#endif
@@ -0,0 +1,421 @@
+#include "websocket.h"
+
+#include <algorithm>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+namespace {
+
+const char HANDSHAKE_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const size_t MAX_CONTROL_PAYLOAD = 125;
+
+inline uint32_t Rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+// SHA-1(只用于握手)
+void Sha1(const std::string& msg, uint8_t digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::string data = msg;
+    uint64_t bits = static_cast<uint64_t>(msg.size()) * 8;
+    data.push_back(static_cast<char>(0x80));
+    while (data.size() % 64 != 56) {
+        data.push_back(0);
+    }
+    for (int i = 7; i >= 0; --i) {
+        data.push_back(static_cast<char>(bits >> (i * 8)));
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data());
+    for (size_t block = 0; block < data.size(); block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const uint8_t* q = p + block + i * 4;
+            w[i] = (static_cast<uint32_t>(q[0]) << 24) | (q[1] << 16) | (q[2] << 8) | q[3];
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = Rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = Rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = Rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+    }
+}
+
+std::string Base64Encode(const uint8_t* data, size_t len) {
+    static const char TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < len) v |= data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        out.push_back(TABLE[(v >> 18) & 0x3f]);
+        out.push_back(TABLE[(v >> 12) & 0x3f]);
+        out.push_back(i + 1 < len ? TABLE[(v >> 6) & 0x3f] : '=');
+        out.push_back(i + 2 < len ? TABLE[v & 0x3f] : '=');
+    }
+    return out;
+}
+
+// 允许出现在关闭帧中的关闭码(RFC 6455 7.4)
+bool ValidCloseCode(uint16_t code) {
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) || (code >= 3000 && code <= 4999);
+}
+
+}
+
+
+HttpHandler::Result WebSocketHandler::Handle(HttpRequest& /*request*/, const RouteParams& /*params*/, HttpResponse& response) {
+    // 升级请求在 HttpConn 中直接完成握手, 走到这里的是普通请求
+    response.SetCode(400);
+    response.SetHeader("Sec-WebSocket-Version", "13");
+    return DONE;
+}
+
+size_t WebSocketHandler::MaxMessage() const {
+    return WebSocket::MAX_MESSAGE;
+}
+
+
+bool WebSocket::IsUpgrade(const HttpRequest& request) {
+    return request.methodId() == Router::GET && request.BodyComplete() &&
+           request.HasHeaderToken("Upgrade", "websocket") && request.HasHeaderToken("Connection", "upgrade") &&
+           request.GetHeader("Sec-WebSocket-Version") == "13" && request.GetHeader("Sec-WebSocket-Key").size() == 24;
+}
+
+std::string WebSocket::AcceptKey(const std::string& key) {
+    uint8_t digest[20];
+    Sha1(key + HANDSHAKE_GUID, digest);
+    return Base64Encode(digest, sizeof(digest));
+}
+
+WebSocket::Frame WebSocket::MakeFrame(Opcode opcode, const char* data, size_t len) {
+    std::string* frame = new std::string();
+    frame->reserve(len + 10);
+    frame->push_back(static_cast<char>(0x80 | opcode));
+    if (len < 126) {
+        frame->push_back(static_cast<char>(len));
+    }
+    else if (len <= 0xffff) {
+        frame->push_back(126);
+        frame->push_back(static_cast<char>(len >> 8));
+        frame->push_back(static_cast<char>(len));
+    }
+    else {
+        frame->push_back(127);
+        for (int i = 7; i >= 0; --i) {
+            frame->push_back(static_cast<char>(static_cast<uint64_t>(len) >> (i * 8)));
+        }
+    }
+    frame->append(data, len);
+    return Frame(frame);
+}
+
+void WebSocket::Unmask(char* data, size_t len, const uint8_t mask[4], size_t offset) {
+    // 把掩码按 offset 转一下, 之后每 4 字节对齐一次, 可以整块异或
+    uint8_t rotated[4];
+    for (int i = 0; i < 4; ++i) {
+        rotated[i] = mask[(offset + i) & 3];
+    }
+    uint32_t key;
+    memcpy(&key, rotated, 4);
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i key256 = _mm256_set1_epi32(static_cast<int>(key));
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(block, key256));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i key128 = _mm_set1_epi32(static_cast<int>(key));
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(block, key128));
+    }
+#endif
+    uint64_t key64 = (static_cast<uint64_t>(key) << 32) | key;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= key64;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i < len; ++i) {
+        data[i] ^= rotated[i & 3];
+    }
+}
+
+bool WebSocket::ValidUtf8(const char* data, size_t len) {
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(data);
+    size_t i = 0;
+    while (i < len) {
+        // ASCII 一次跳过 8 字节
+        if (i + 8 <= len) {
+            uint64_t v;
+            memcpy(&v, s + i, 8);
+            if ((v & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        uint8_t c = s[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t n;
+        uint32_t cp;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+            cp = c & 0x1F;
+        }
+        else if ((c & 0xF0) == 0xE0) {
+            n = 2;
+            cp = c & 0x0F;
+        }
+        else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            cp = c & 0x07;
+        }
+        else {
+            return false;
+        }
+        if (i + n >= len) {
+            return false;
+        }
+        for (size_t k = 1; k <= n; ++k) {
+            if ((s[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (s[i + k] & 0x3F);
+        }
+        // 过长编码、代理区、超过 U+10FFFF
+        if ((n == 2 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) || (n == 3 && (cp < 0x10000 || cp > 0x10FFFF))) {
+            return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+WebSocket::WebSocket(int fd, WebSocketHandler* handler, RateLimiter::Slot* limit)
+    : PushStream(fd, MAX_QUEUE_BYTES), handler_(handler),
+      maxMessage_(handler->MaxMessage() < MAX_MESSAGE ? handler->MaxMessage() : MAX_MESSAGE), limit_(limit),
+      failed_(false), headerDone_(false), fin_(false), opcode_(0), frameLen_(0), frameRead_(0), messageOpcode_(0) {
+    memset(mask_, 0, sizeof(mask_));
+}
+
+void WebSocket::Open(const HttpRequest& request) {
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " + AcceptKey(request.GetHeader("Sec-WebSocket-Key")) + "\r\n\r\n";
+    Push(std::make_shared<const std::string>(std::move(response)));
+    handler_->OnOpen(shared_from_this());
+}
+
+void WebSocket::Process(Buffer& in) {
+    while (!failed_ && in.ReadableBytes() > 0) {
+        if (!headerDone_) {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(in.Peek());
+            size_t n = in.ReadableBytes();
+            if (n < 2) {
+                return;
+            }
+            if (!(p[1] & 0x80)) {
+                // 客户端的帧必须加掩码
+                Fail_(PROTOCOL_ERROR);
+                return;
+            }
+            uint64_t len = p[1] & 0x7f;
+            size_t need = 2 + (len == 126 ? 2 : (len == 127 ? 8 : 0)) + 4;
+            if (n < need) {
+                return;
+            }
+            if (len == 126) {
+                len = (p[2] << 8) | p[3];
+            }
+            else if (len == 127) {
+                len = 0;
+                for (int i = 0; i < 8; ++i) {
+                    len = (len << 8) | p[2 + i];
+                }
+            }
+            fin_ = (p[0] & 0x80) != 0;
+            opcode_ = p[0] & 0x0f;
+            memcpy(mask_, p + need - 4, 4);
+            if (p[0] & 0x70) {
+                // 没有协商扩展, RSV 位必须是 0
+                Fail_(PROTOCOL_ERROR);
+                return;
+            }
+            if (opcode_ & 0x8) {
+                if (!fin_ || len > MAX_CONTROL_PAYLOAD || (opcode_ != CLOSE && opcode_ != PING && opcode_ != PONG)) {
+                    Fail_(PROTOCOL_ERROR);
+                    return;
+                }
+                control_.clear();
+            }
+            else {
+                if (opcode_ == CONTINUATION) {
+                    if (!messageOpcode_) {
+                        Fail_(PROTOCOL_ERROR);
+                        return;
+                    }
+                }
+                else if ((opcode_ == TEXT || opcode_ == BINARY) && !messageOpcode_) {
+                    messageOpcode_ = opcode_;
+                    message_.clear();
+                }
+                else {
+                    // 未知的操作码, 或者上一条消息的分片还没结束
+                    Fail_(PROTOCOL_ERROR);
+                    return;
+                }
+                if (len > maxMessage_ - message_.size()) {
+                    Fail_(MESSAGE_TOO_BIG);
+                    return;
+                }
+                if (!RateLimiter::GetInstance()->AllowRequest(limit_)) {
+                    // 升级后的连接不再经过 HTTP 的限流: 每个数据帧(包括分片)按一个请求计数
+                    Fail_(POLICY_VIOLATION);
+                    return;
+                }
+            }
+            frameLen_ = len;
+            frameRead_ = 0;
+            headerDone_ = true;
+            in.Retrieve(need);
+        }
+
+        // 负载边到达边解除掩码, 不等整个帧
+        std::string& target = (opcode_ & 0x8) ? control_ : message_;
+        size_t take = static_cast<size_t>(std::min<uint64_t>(in.ReadableBytes(), frameLen_ - frameRead_));
+        if (take > 0) {
+            size_t old = target.size();
+            target.append(in.Peek(), take);
+            Unmask(&target[old], take, mask_, frameRead_);
+            frameRead_ += take;
+            in.Retrieve(take);
+        }
+        if (frameRead_ < frameLen_) {
+            return;
+        }
+        headerDone_ = false;
+        if (opcode_ & 0x8) {
+            OnControlFrame_();
+        }
+        else {
+            OnDataFrame_(fin_);
+        }
+    }
+}
+
+void WebSocket::OnDataFrame_(bool fin) {
+    if (!fin) {
+        return;
+    }
+    bool binary = (messageOpcode_ == BINARY);
+    messageOpcode_ = 0;
+    if (!binary && !ValidUtf8(message_.data(), message_.size())) {
+        Fail_(INVALID_PAYLOAD);
+        return;
+    }
+    handler_->OnMessage(shared_from_this(), binary, message_);
+    message_.clear();
+    if (message_.capacity() > 64 * 1024) {
+        // 大消息之后不一直占着内存
+        std::string().swap(message_);
+    }
+}
+
+void WebSocket::OnControlFrame_() {
+    switch (opcode_) {
+        case PING:
+            Send(MakeFrame(PONG, control_.data(), control_.size()));
+            break;
+        case CLOSE: {
+            // 回应同样的关闭码, 发送完毕后断开
+            uint16_t code = NORMAL_CLOSURE;
+            if (control_.size() == 1) {
+                Fail_(PROTOCOL_ERROR);
+                return;
+            }
+            if (control_.size() >= 2) {
+                code = static_cast<uint16_t>((static_cast<uint8_t>(control_[0]) << 8) | static_cast<uint8_t>(control_[1]));
+                if (!ValidCloseCode(code)) {
+                    Fail_(PROTOCOL_ERROR);
+                    return;
+                }
+                if (!ValidUtf8(control_.data() + 2, control_.size() - 2)) {
+                    Fail_(INVALID_PAYLOAD);
+                    return;
+                }
+            }
+            failed_ = true;
+            Close(code);
+            break;
+        }
+        default:
+            // PONG
+            break;
+    }
+}
+
+void WebSocket::Fail_(uint16_t code) {
+    failed_ = true;
+    Close(code);
+}
+
+void WebSocket::Close(uint16_t code, const std::string& reason) {
+    std::string payload;
+    payload.push_back(static_cast<char>(code >> 8));
+    payload.push_back(static_cast<char>(code));
+    payload.append(reason, 0, MAX_CONTROL_PAYLOAD - 2);
+    End(MakeFrame(CLOSE, payload.data(), payload.size()));
+}
+
+void WebSocket::OnShutdown_() {
+    handler_->OnClose(shared_from_this());
+}
+
@@ -0,0 +1,169 @@
+/*
+    WebSocket(RFC 6455)
+
+    GET 请求带 "Upgrade: websocket" 且路由到 WebSocketHandler 时完成握手, 之后连接上收发的都是帧.
+    收到的帧边到达边解除掩码(SSE2/AVX2 一次处理 16/32 字节), 分片拼成完整消息后交给 handler;
+    ping / close 等控制帧可以夹在分片之间.
+    发送队列、写入节奏和广播见 PushStream: 广播时消息只序列化一次, 所有连接共享同一个帧.
+
+    线程: 帧的解析和 handler 回调在处理该连接的工作线程中进行; Send 可以在任何线程调用.
+*/
+
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <string>
+#include <memory>
+#include <stdint.h>
+#include "../buffer/buffer.h"
+#include "router.h"
+#include "pushstream.h"
+#include "../pool/ratelimiter.h"
+
+class WebSocket;
+class HttpRequest;
+
+// WebSocket 消息的处理者, 注册到路由上的 GET 路径
+// 不是升级请求的 GET 由 Handle 响应 400
+class WebSocketHandler : public HttpHandler {
+public:
+    Result Handle(HttpRequest& request, const RouteParams& params, HttpResponse& response) override;
+
+    /// @brief 是否接受升级请求(在握手之前调用, 不能阻塞)
+    /// @return 0-接受, 否则是拒绝时响应的状态码(之后关闭连接)
+    virtual int Accept(const HttpRequest& /*request*/) { return 0; }
+
+    /// @brief 收到的一条消息(所有分片之和)的上限, 超过时以 1009 关闭连接
+    /// @return 字节数(大于 WebSocket::MAX_MESSAGE 时按 MAX_MESSAGE)
+    virtual size_t MaxMessage() const;
+
+    /// @brief 握手完成(在工作线程中调用)
+    virtual void OnOpen(const std::shared_ptr<WebSocket>& /*ws*/) {}
+
+    /// @brief 收到一条完整的消息(在工作线程中调用, 不能阻塞)
+    /// @param ws 连接
+    /// @param binary true-二进制消息, false-文本消息(已经检查过 UTF-8)
+    /// @param message 消息内容(可以移走)
+    virtual void OnMessage(const std::shared_ptr<WebSocket>& ws, bool binary, std::string& message) = 0;
+
+    /// @brief 连接关闭(只调用一次, 可能在定时器线程中调用)
+    virtual void OnClose(const std::shared_ptr<WebSocket>& /*ws*/) {}
+};
+
+class WebSocket : public PushStream, public std::enable_shared_from_this<WebSocket> {
+public:
+    enum Opcode {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xa,
+    };
+
+    // 关闭码
+    enum CloseCode {
+        NORMAL_CLOSURE = 1000,
+        GOING_AWAY = 1001,
+        PROTOCOL_ERROR = 1002,
+        INVALID_PAYLOAD = 1007,
+        POLICY_VIOLATION = 1008,
+        MESSAGE_TOO_BIG = 1009,
+    };
+
+    static const size_t MAX_MESSAGE = 1 << 20;          // 收到的消息(所有分片之和)的上限
+    static const size_t MAX_QUEUE_BYTES = 8 << 20;      // 发送队列的上限, 超过时断开(客户端太慢)
+
+    /// @brief 请求是否是 WebSocket 升级请求
+    static bool IsUpgrade(const HttpRequest& request);
+
+    /// @brief 由 Sec-WebSocket-Key 计算 Sec-WebSocket-Accept
+    static std::string AcceptKey(const std::string& key);
+
+    /// @brief 序列化一个服务端帧(不加掩码)
+    /// @param opcode 操作码
+    /// @param data 负载
+    /// @param len 长度
+    /// @return 可以发送给任意多个连接的帧
+    static Frame MakeFrame(Opcode opcode, const char* data, size_t len);
+
+    /// @brief 解除(或加上)掩码
+    /// @param data 负载(原地修改)
+    /// @param len 长度
+    /// @param mask 4 字节掩码
+    /// @param offset data[0] 在帧负载中的位置(决定从掩码的哪个字节开始)
+    static void Unmask(char* data, size_t len, const uint8_t mask[4], size_t offset);
+
+    /// @brief 检查 UTF-8 编码
+    static bool ValidUtf8(const char* data, size_t len);
+
+    /// @param fd 连接的 socket
+    /// @param handler 消息的处理者
+    /// @param limit 客户端 IP 的限流槽(每个数据帧取一个令牌, 超过速率时以 1008 关闭; nullptr 时不限制)
+    WebSocket(int fd, WebSocketHandler* handler, RateLimiter::Slot* limit);
+
+    /// @brief 完成握手: 101 响应放入发送队列, 并调用 OnOpen
+    /// @param request 升级请求(已经检查过 IsUpgrade)
+    void Open(const HttpRequest& request);
+
+    /// @brief 解析读缓冲区中的帧, 完整的消息交给 handler
+    /// @param in 读缓冲区
+    void Process(Buffer& in) override;
+
+    /// @brief 发送一个帧(线程安全)
+    /// @return false-连接已经关闭(或正在关闭)
+    bool Send(const Frame& frame) {
+        return Push(frame);
+    }
+    /// @brief 发送一条消息(线程安全)
+    bool Send(const std::string& message, bool binary = false) {
+        return Send(MakeFrame(binary ? BINARY : TEXT, message.data(), message.size()));
+    }
+
+    /// @brief 发送关闭帧, 发送完毕后断开连接(线程安全)
+    void Close(uint16_t code, const std::string& reason = std::string());
+
+protected:
+    /// @brief 连接断开: 调用 handler 的 OnClose
+    void OnShutdown_() override;
+
+private:
+    /// @brief 出错: 发送关闭帧, 不再解析后面的数据
+    void Fail_(uint16_t code);
+    /// @brief 一个数据帧(或分片)接收完整
+    void OnDataFrame_(bool fin);
+    /// @brief 一个控制帧接收完整
+    void OnControlFrame_();
+
+private:
+    WebSocketHandler* handler_;
+    const size_t maxMessage_;
+    RateLimiter::Slot* limit_;
+
+    // 接收(只在工作线程中访问)
+    bool failed_;
+    bool headerDone_;           // 当前帧的首部已经解析
+    bool fin_;
+    uint8_t opcode_;
+    uint8_t mask_[4];
+    uint64_t frameLen_;
+    uint64_t frameRead_;
+    uint8_t messageOpcode_;     // 正在拼接的消息的类型(0 表示没有)
+    std::string message_;
+    std::string control_;
+};
+
+// 一组 WebSocket 连接, 广播的消息只序列化一次
+class WebSocketGroup : public PushGroup {
+public:
+    using PushGroup::Broadcast;
+
+    /// @brief 广播一条消息
+    /// @return 放入了发送队列的连接数
+    size_t Broadcast(const std::string& message, bool binary = false) {
+        return Broadcast(WebSocket::MakeFrame(binary ? WebSocket::BINARY : WebSocket::TEXT, message.data(), message.size()));
+    }
+};
+
+
+#endif
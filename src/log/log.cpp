@@ -2,12 +2,17 @@
 
 
 
-Log::Log(): lineCount_(0),
+Log::Log(): path_(nullptr),
+            suffix_(nullptr),
+            lineCount_(0),
+            toDay_(0),
+            isOpen_(false),
+            level_(1),
             isAsync_(false),
-            writeThread_(nullptr),
+            fp_(nullptr),
             deque_(nullptr),
-            toDay_(0),
-            fp_(nullptr)
+            reportedLost_(0),
+            writeThread_(nullptr)
 { }
 
 Log::~Log() {
@@ -35,13 +40,13 @@ void Log::Setlevel(int level) {
     level_ = level;
 }
 
-void Log::init(int level, const char* path, const char* suffix, int maxQueueSize) {
+void Log::init(int level, const char* path, const char* suffix, int maxQueueSize, OverflowPolicy policy) {
     isOpen_ = true;
     level_ = level;
     if (maxQueueSize > 0) {
         isAsync_ = true;
         if (!deque_) {
-            std::unique_ptr<BlockQueue<std::string>> newQueue(new BlockQueue<std::string>(maxQueueSize));
+            std::unique_ptr<RingQueue<std::string>> newQueue(new RingQueue<std::string>(maxQueueSize, policy));
             deque_ = std::move(newQueue);
 
             std::unique_ptr<std::thread> newThread(new std::thread(FlushLogThread));
@@ -70,7 +75,6 @@ void Log::init(int level, const char* path, const char* suffix, int maxQueueSize
 
     {
         std::lock_guard<std::mutex> lk(mtx_);
-        buff_.RetrieveAll();
         if (fp_) {
             flushAll();
             fclose(fp_);
@@ -91,7 +95,8 @@ void Log::write(int level, const char* format, ...) {
     gettimeofday(&now, nullptr);
 
     time_t tSec = now.tv_sec;
-    struct tm* sysTime = localtime(&tSec);
+    struct tm tmBuf;
+    struct tm* sysTime = localtime_r(&tSec, &tmBuf); // 格式化不再持锁, 需要线程安全的版本
     
     va_list vaList; // 参数列表
 
@@ -126,53 +131,61 @@ void Log::write(int level, const char* format, ...) {
         }
     }
 
-    {
-        std::unique_lock<std::mutex> lk(mtx_);
-        // 写文件
-        ++lineCount_;
-        int n = snprintf(buff_.BeginWrite(), 128, "%04u-%02u-%02u %02u:%02u:%02u.%06ld",
-                        sysTime->tm_year + 1900, sysTime->tm_mon + 1, sysTime->tm_mday, 
-                        sysTime->tm_hour, sysTime->tm_min, sysTime->tm_sec, now.tv_usec);
-
-        buff_.HasWritten(n); // 先写入时间
-        AppendLogLevelTitle_(level);
-
-        // 格式化提取参数
+    // 每个线程各自格式化, 不再持有全局锁
+    thread_local Buffer buff;
+    buff.RetrieveAll();
+    ++lineCount_;
+    buff.EnsureWritable(128);
+    int n = snprintf(buff.BeginWrite(), 128, "%04u-%02u-%02u %02u:%02u:%02u.%06ld",
+                    sysTime->tm_year + 1900, sysTime->tm_mon + 1, sysTime->tm_mday, 
+                    sysTime->tm_hour, sysTime->tm_min, sysTime->tm_sec, now.tv_usec);
+
+    buff.HasWritten(n); // 先写入时间
+    AppendLogLevelTitle_(buff, level);
+
+    // 格式化提取参数
+    va_start(vaList, format);
+    int m = vsnprintf(buff.BeginWrite(), buff.WritableBytes(), format, vaList);
+    va_end(vaList);
+    if (m >= 0 && static_cast<size_t>(m) >= buff.WritableBytes()) {
+        // 缓冲区不够, 扩容后重新格式化
+        buff.EnsureWritable(m + 1);
         va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
+        m = vsnprintf(buff.BeginWrite(), buff.WritableBytes(), format, vaList);
         va_end(vaList);
+    }
 
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
+    buff.HasWritten(m > 0 ? m : 0);
+    buff.Append("\n", 1);
 
-        if (isAsync_ && deque_ && !deque_->full()) {
-            deque_->push_back(buff_.RetrieveAllToStr());
-        }
-        else {
-            // 非异步
-            fputs(buff_.Peek(), fp_);
-        }
-        buff_.RetrieveAll();
+    if (isAsync_ && deque_) {
+        // 无锁入队, 队列满时按照 policy 处理(丢弃/阻塞/覆盖)
+        deque_->push_back(buff.RetrieveAllToStr());
+    }
+    else {
+        // 非异步
+        std::lock_guard<std::mutex> lk(mtx_);
+        fwrite(buff.Peek(), 1, buff.ReadableBytes(), fp_);
+        buff.RetrieveAll();
     }
-
 }
 
-void Log::AppendLogLevelTitle_(int level) {
+void Log::AppendLogLevelTitle_(Buffer& buff, int level) {
     switch(level) {
         case 0:
-            buff_.Append("[debug]: ", 9);
+            buff.Append("[debug]: ", 9);
             break;
         case 1:
-            buff_.Append("[info] : ", 9);
+            buff.Append("[info] : ", 9);
             break;
         case 2:
-            buff_.Append("[warn] : ", 9);
+            buff.Append("[warn] : ", 9);
             break;
         case 3:
-            buff_.Append("[error]: ", 9);
+            buff.Append("[error]: ", 9);
             break;
         default:
-            buff_.Append("[info] : ", 9);
+            buff.Append("[info] : ", 9);
             break;
     }
 }
@@ -204,7 +217,18 @@ void Log::AsyncWrite_() {
     while (deque_->pop(str)) {
         std::lock_guard<std::mutex> lk(mtx_);
         fputs(str.c_str(), fp_);
+        WriteOverflowSummary_();
+    }
+}
+
+void Log::WriteOverflowSummary_() {
+    size_t lost = deque_->DroppedCount() + deque_->OverwrittenCount();
+    if (lost == reportedLost_) {
+        return;
     }
+    fprintf(fp_, "[warn] : log queue overflow, %zu lines dropped, %zu lines overwritten\n",
+            deque_->DroppedCount(), deque_->OverwrittenCount());
+    reportedLost_ = lost;
 }
 
 void Log::FlushLogThread() {
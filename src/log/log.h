@@ -10,10 +10,11 @@
 #include <sys/time.h>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <sys/stat.h>  // mkdir
 #include <stdarg.h>    // vastart va_end
 #include "../buffer/buffer.h"
-#include "blockqueue.hpp"
+#include "ringqueue.hpp"
 
 class Log {
 public:
@@ -22,7 +23,9 @@ public:
     /// @param path 保存路径
     /// @param suffix 文件后缀
     /// @param maxQueueCapacity 队列最大容量
-    void init(int level = 1, const char* path = "../logFile", const char* suffix = ".log", int maxQueueCapacity = 1024);
+    /// @param policy 队列满时的处理策略(丢弃/阻塞/覆盖最旧)
+    void init(int level = 1, const char* path = "../logFile", const char* suffix = ".log", int maxQueueCapacity = 1024,
+              OverflowPolicy policy = OverflowPolicy::DROP);
     
     // 单例模式
     /// @brief 获取单例指针
@@ -62,12 +65,15 @@ private:
     /// @brief 构造函数
     Log();
     /// @brief 确定对应的写入水平
+    /// @param buff 拼接的缓冲区
     /// @param level 0-debug, 1-info, 2-warn, 3-error, default-info
-    void AppendLogLevelTitle_(int level);
+    static void AppendLogLevelTitle_(Buffer& buff, int level);
     /// @brief 析构函数
     virtual ~Log();
     /// @brief 异步写函数
     void AsyncWrite_();
+    /// @brief 队列溢出时写一行汇总信息(丢弃/覆盖的条数)
+    void WriteOverflowSummary_();
 
 private:
     static const int LOG_PATH_LEN = 256;
@@ -77,17 +83,17 @@ private:
     const char* path_;
     const char* suffix_;
 
-    int lineCount_;
+    std::atomic<int> lineCount_;
     int toDay_;
 
     bool isOpen_;
 
-    Buffer buff_;
     int level_;
     bool isAsync_;
 
     FILE* fp_;
-    std::unique_ptr<BlockQueue<std::string>> deque_;
+    std::unique_ptr<RingQueue<std::string>> deque_;
+    size_t reportedLost_;   // 已经汇总报告过的丢失条数
     std::unique_ptr<std::thread> writeThread_;
     std::mutex mtx_;
 };
@@ -0,0 +1,120 @@
+/*
+    日志调用点控制: 编译期等级过滤 + 调用点限流
+
+    CLOG(severity)               低于 LOG_MIN_LEVEL 的等级在编译期被消除(参数不会被求值)
+    LOG_EVERY_N(severity, n)     同一调用点每 n 次只输出 1 次
+    LOG_EVERY_SEC(severity, sec) 同一调用点每 sec 秒最多输出 1 次
+    被限流掉的条数会以 "[suppressed N] " 前缀汇总在下一次输出的行首
+*/
+
+#ifndef LOG_SITE_H
+#define LOG_SITE_H
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <stdint.h>
+#include "../../lizy_log/include/logging.h"
+
+// 等级数值与 lizy_log 的 LOG_INFO / LOG_WARNING / LOG_ERROR / LOG_FATAL 一致
+#define LOG_LEVEL_INFO    0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_ERROR   2
+#define LOG_LEVEL_FATAL   3
+
+// 编译期最低日志等级, 由 CMake 的 LOG_MIN_LEVEL 选项传入
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_ENABLED(severity) (LOG_LEVEL_##severity >= LOG_MIN_LEVEL)
+
+// 吞掉流表达式的结果, 使三目运算符两边类型一致(void)
+struct LogVoidify {
+    void operator&(std::ostream&) {}
+};
+
+// 一次限流判断的结果
+class LogTicket {
+public:
+    LogTicket() : allowed_(false), suppressed_(0) {}
+    explicit LogTicket(uint64_t suppressed) : allowed_(true), suppressed_(suppressed) {}
+
+    explicit operator bool() const {
+        return allowed_;
+    }
+    /// @brief 输出完成, 结束 for 循环
+    void Done() {
+        allowed_ = false;
+    }
+    uint64_t Suppressed() const {
+        return suppressed_;
+    }
+
+private:
+    bool allowed_;
+    uint64_t suppressed_;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const LogTicket& ticket) {
+    if (ticket.Suppressed() > 0) {
+        os << "[suppressed " << ticket.Suppressed() << "] ";
+    }
+    return os;
+}
+
+// 每个调用点一个静态对象, 记录计数和下一次允许输出的时间
+class LogSite {
+public:
+    LogSite() : count_(0), suppressed_(0), nextNs_(0) {}
+
+    /// @brief 每 n 次放行 1 次
+    /// @param n 间隔次数
+    /// @return 放行时返回有效的 ticket(附带被限流的条数)
+    LogTicket EveryN(uint64_t n) {
+        if (n <= 1 || count_.fetch_add(1, std::memory_order_relaxed) % n == 0) {
+            return LogTicket(suppressed_.exchange(0, std::memory_order_relaxed));
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return LogTicket();
+    }
+
+    /// @brief 每 sec 秒放行 1 次
+    /// @param sec 间隔秒数
+    /// @return 放行时返回有效的 ticket(附带被限流的条数)
+    LogTicket EverySec(double sec) {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t next = nextNs_.load(std::memory_order_relaxed);
+        if (now >= next &&
+            nextNs_.compare_exchange_strong(next, now + static_cast<int64_t>(sec * 1e9),
+                                            std::memory_order_relaxed)) {
+            return LogTicket(suppressed_.exchange(0, std::memory_order_relaxed));
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return LogTicket();
+    }
+
+private:
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> suppressed_;
+    std::atomic<int64_t> nextNs_;
+};
+
+// lambda 内的静态变量: 每个调用点各自独立的 LogSite
+#define LOG_SITE_() ([]() -> LogSite& { static LogSite site; return site; }())
+
+#define CLOG(severity) \
+    !LOG_ENABLED(severity) ? (void)0 : LogVoidify() & LOG(severity)
+
+#define LOG_RATE_LIMITED_(severity, decide) \
+    for (LogTicket logTicket_ = LOG_ENABLED(severity) ? LOG_SITE_().decide : LogTicket(); \
+         logTicket_; logTicket_.Done()) \
+        LOG(severity) << logTicket_
+
+#define LOG_EVERY_N(severity, n) LOG_RATE_LIMITED_(severity, EveryN(n))
+
+#define LOG_EVERY_SEC(severity, sec) LOG_RATE_LIMITED_(severity, EverySec(sec))
+
+
+#endif
@@ -0,0 +1,404 @@
+/*
+    有界无锁环形队列(多生产者, 出队端同样可以并发)
+
+    基于序号槽位(sequence slot)的环形数组:
+        每个槽位保存一个序号 seq, 生产者通过 CAS 抢占写位置 enqPos_,
+        写入数据后把 seq 置为 pos + 1 发布给消费者;
+        消费者通过 CAS 抢占读位置 deqPos_, 读取数据后把 seq 置为 pos + capacity 归还给生产者.
+    生产者之间只竞争一个原子变量, 不再经过互斥锁.
+    出队也用 CAS: OVERWRITE 策略下队列满的生产者会自己出队最旧的元素, 与消费者并发出队.
+    只有在消费者等待数据 / 生产者等待空位(BLOCK 策略)时才会用到条件变量.
+    关闭后不再接受新元素, 但 pop 会先取完队列中剩余的元素才返回 false:
+    Close 在 enqPos_ 上置关闭位, 之后生产者抢占写位置的 CAS 都会失败, 写位置不再变化;
+    关闭后 pop 一直取到这个位置为止(等待已经抢占但还没发布的槽位), 生产者一侧没有额外开销.
+*/
+
+
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <assert.h>
+
+// 队列满时的处理策略
+enum class OverflowPolicy {
+    DROP,       // 丢弃新元素并计数
+    BLOCK,      // 阻塞生产者直到有空位
+    OVERWRITE   // 覆盖最旧的元素并计数
+};
+
+template<class T>
+class RingQueue {
+public:
+    /// @brief 构造函数
+    /// @param MaxCapacity 最大容量(向上取整为 2 的幂)
+    /// @param policy 队列满时的处理策略
+    explicit RingQueue(size_t MaxCapacity = 1024, OverflowPolicy policy = OverflowPolicy::DROP);
+
+    ~RingQueue();
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    /// @brief 是否为空
+    /// @return true - 空, false - 非空
+    bool empty() const;
+    /// @brief 是否已满
+    /// @return true - 满, false - 未满
+    bool full() const;
+    /// @brief 关闭队列, 唤醒所有等待的线程
+    void Close();
+    /// @brief 返回当前队列长度(近似值)
+    /// @return 长度
+    size_t size() const;
+    /// @brief 返回当前队列的容量
+    /// @return 容量
+    size_t capacity() const;
+
+    /// @brief 在队尾插入元素, 队列满时按照 policy 处理
+    /// @param item 元素对象
+    /// @return true - 成功入队, false - 被丢弃或队列已关闭
+    bool push_back(T item);
+    /// @brief 尝试在队尾插入元素, 不阻塞
+    /// @param item 元素对象(失败时不会被移走)
+    /// @return true - 成功, false - 队列已满
+    bool try_push(T& item);
+
+    /// @brief 从队头出队, 队列为空时阻塞
+    /// @param item 出队的元素
+    /// @return 是否成功(队列关闭且已经取空时返回 false)
+    bool pop(T& item);
+    /// @brief 带超时功能的从队头出队
+    /// @param item 出队的元素
+    /// @param timeout 超时时间, 单位 s
+    /// @return 是否成功(超时, 或者队列关闭且已经取空时返回 false)
+    bool pop(T& item, int timeout);
+    /// @brief 带超时功能的从队头出队
+    /// @param item 出队的元素
+    /// @param timeout 超时时间
+    /// @return 是否成功(超时, 或者队列关闭且已经取空时返回 false)
+    template<class Rep, class Period>
+    bool pop(T& item, const std::chrono::duration<Rep, Period>& timeout);
+    /// @brief 尝试从队头出队, 不阻塞
+    /// @param item 出队的元素
+    /// @return true - 成功, false - 队列为空
+    bool try_pop(T& item);
+
+    /// @brief 唤醒消费者刷盘一次
+    void flush();
+
+    /// @brief 取出队列中所有的数据
+    /// @return 数据数组
+    std::vector<T> GetAllData();
+
+    /// @brief 是否已经关闭
+    bool closed() const {
+        return isClose_.load(std::memory_order_relaxed);
+    }
+
+    /// @brief 因队列满被丢弃的元素个数
+    size_t DroppedCount() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+    /// @brief 因队列满被覆盖的元素个数
+    size_t OverwrittenCount() const {
+        return overwritten_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    /// @brief 队列已经关闭: 出队到关闭时的写位置为止
+    /// @return true - 取到元素, false - 已经取完
+    bool PopClosed_(T& item);
+    /// @brief 有新数据时唤醒等待中的消费者
+    void NotifyConsumer_();
+    /// @brief 有空位时唤醒等待中的生产者
+    void NotifyProducer_();
+
+    static size_t RoundUpPow2_(size_t n) {
+        size_t cap = 2;
+        while (cap < n) {
+            cap <<= 1;
+        }
+        return cap;
+    }
+
+private:
+    // 避免伪共享
+    static const size_t CACHE_LINE = 64;
+    // enqPos_ 的最高位: 队列已关闭, 不能再抢占写位置
+    static const size_t CLOSED_BIT = static_cast<size_t>(1) << (sizeof(size_t) * 8 - 1);
+
+    const size_t capacity_;
+    const size_t mask_;
+    const OverflowPolicy policy_;
+    std::vector<Slot> buffer_;
+
+    alignas(CACHE_LINE) std::atomic<size_t> enqPos_;
+    alignas(CACHE_LINE) std::atomic<size_t> deqPos_;
+
+    alignas(CACHE_LINE) std::atomic<size_t> dropped_;
+    std::atomic<size_t> overwritten_;
+
+    std::atomic<bool> isClose_;
+    std::atomic<int> consumerWaiting_;
+    std::atomic<int> producerWaiting_;
+
+    std::mutex mtx_;
+    std::condition_variable condConsumer_;
+    std::condition_variable condProducer_;
+};
+
+template<class T>
+RingQueue<T>::RingQueue(size_t MaxCapacity, OverflowPolicy policy) :
+    capacity_(RoundUpPow2_(MaxCapacity)), mask_(capacity_ - 1), policy_(policy),
+    buffer_(capacity_), enqPos_(0), deqPos_(0), dropped_(0), overwritten_(0),
+    isClose_(false), consumerWaiting_(0), producerWaiting_(0)
+{
+    assert(MaxCapacity > 0);
+    for (size_t i = 0; i < capacity_; ++i) {
+        buffer_[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<class T>
+RingQueue<T>::~RingQueue() {
+    Close();
+}
+
+template<class T>
+void RingQueue<T>::Close() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        isClose_.store(true);
+        enqPos_.fetch_or(CLOSED_BIT);
+    }
+    condProducer_.notify_all();
+    condConsumer_.notify_all();
+}
+
+template<class T>
+void RingQueue<T>::flush() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    condConsumer_.notify_one();
+}
+
+template<class T>
+bool RingQueue<T>::empty() const {
+    return size() == 0;
+}
+
+template<class T>
+bool RingQueue<T>::full() const {
+    return size() >= capacity_;
+}
+
+template<class T>
+size_t RingQueue<T>::size() const {
+    size_t deq = deqPos_.load(std::memory_order_acquire);
+    size_t enq = enqPos_.load(std::memory_order_acquire) & ~CLOSED_BIT;
+    return enq > deq ? enq - deq : 0;
+}
+
+template<class T>
+size_t RingQueue<T>::capacity() const {
+    return capacity_;
+}
+
+template<class T>
+bool RingQueue<T>::try_push(T& item) {
+    size_t pos = enqPos_.load(std::memory_order_relaxed);
+    while (true) {
+        if (pos & CLOSED_BIT) {
+            // 已经关闭: 带着关闭位的 pos 做 CAS 也会失败, 这里直接返回
+            return false;
+        }
+        Slot& slot = buffer_[pos & mask_];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            // 槽位空闲, 抢占写位置
+            if (enqPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.data = std::move(item);
+                slot.seq.store(pos + 1, std::memory_order_release);
+                NotifyConsumer_();
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            // 槽位还没被消费者归还: 队列满
+            return false;
+        }
+        else {
+            // 其他生产者抢先了, 重新读取写位置
+            pos = enqPos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<class T>
+bool RingQueue<T>::try_pop(T& item) {
+    size_t pos = deqPos_.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = buffer_[pos & mask_];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            // OVERWRITE 策略下生产者也会出队, 所以这里同样用 CAS
+            if (deqPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                item = std::move(slot.data);
+                slot.seq.store(pos + capacity_, std::memory_order_release);
+                NotifyProducer_();
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            // 槽位还没被生产者发布: 队列空
+            return false;
+        }
+        else {
+            pos = deqPos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<class T>
+bool RingQueue<T>::push_back(T item) {
+    while (!isClose_.load(std::memory_order_relaxed)) {
+        if (try_push(item)) {
+            return true;
+        }
+        if (enqPos_.load(std::memory_order_relaxed) & CLOSED_BIT) {
+            // 失败是因为刚刚关闭, 不是队列满: 不计丢弃, 也不能再覆盖(出队)消费者要取的元素
+            return false;
+        }
+        switch (policy_) {
+            case OverflowPolicy::DROP:
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case OverflowPolicy::OVERWRITE:
+            {   T oldest;
+                if (try_pop(oldest)) {
+                    overwritten_.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            }
+            case OverflowPolicy::BLOCK:
+            default:
+            {   std::unique_lock<std::mutex> lk(mtx_);
+                producerWaiting_.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                condProducer_.wait_for(lk, std::chrono::milliseconds(10), [this]() {
+                    return !full() || isClose_.load();
+                });
+                producerWaiting_.fetch_sub(1);
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+template<class T>
+bool RingQueue<T>::pop(T& item) {
+    while (true) {
+        if (try_pop(item)) {
+            return true;
+        }
+        if (isClose_.load()) {
+            return PopClosed_(item);
+        }
+        std::unique_lock<std::mutex> lk(mtx_);
+        consumerWaiting_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        condConsumer_.wait(lk, [this]() {
+            return !empty() || isClose_.load();
+        });
+        consumerWaiting_.fetch_sub(1);
+    }
+}
+
+template<class T>
+bool RingQueue<T>::pop(T& item, int timeout) {
+    return pop(item, std::chrono::seconds(timeout));
+}
+
+template<class T>
+template<class Rep, class Period>
+bool RingQueue<T>::pop(T& item, const std::chrono::duration<Rep, Period>& timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        if (try_pop(item)) {
+            return true;
+        }
+        if (isClose_.load()) {
+            return PopClosed_(item);
+        }
+        std::unique_lock<std::mutex> lk(mtx_);
+        consumerWaiting_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ready = condConsumer_.wait_until(lk, deadline, [this]() {
+            return !empty() || isClose_.load();
+        });
+        consumerWaiting_.fetch_sub(1);
+        if (!ready) {
+            // 超时
+            return false;
+        }
+    }
+}
+
+template<class T>
+bool RingQueue<T>::PopClosed_(T& item) {
+    // 关闭后写位置不再变化; 在它之前抢占的槽位可能还没发布, 等生产者写完, 不能把这些元素丢掉
+    size_t end = enqPos_.load(std::memory_order_acquire) & ~CLOSED_BIT;
+    while (deqPos_.load(std::memory_order_acquire) != end) {
+        if (try_pop(item)) {
+            return true;
+        }
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+template<class T>
+std::vector<T> RingQueue<T>::GetAllData() {
+    std::vector<T> result;
+    T item;
+    while (try_pop(item)) {
+        result.push_back(std::move(item));
+    }
+    return result;
+}
+
+template<class T>
+void RingQueue<T>::NotifyConsumer_() {
+    // 与 pop 中 consumerWaiting_ 的 seq_cst 操作配对, 避免丢失唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumerWaiting_.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        condConsumer_.notify_one();
+    }
+}
+
+template<class T>
+void RingQueue<T>::NotifyProducer_() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (producerWaiting_.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        condProducer_.notify_all();
+    }
+}
+
+
+#endif
@@ -2,6 +2,56 @@
 
 int main(int argc, char const *argv[])
 {
+    // ./server --pack: 把资源目录打包成资源包后退出(部署时执行)
+    // ./server --tls:  监听 TLS(证书和私钥见下面的 TlsContext 初始化)
+    // ./server --upstream=127.0.0.1:9001 --upstream=127.0.0.1:9002: /api/proxy/ 下的请求转发给这些上游
+    // ./server --store=mysql|sqlite|memory: 用户存储后端(默认 mysql, 编译时关闭 WITH_MYSQL 则默认 sqlite)
+    // ./server --store-path=../user.db: SQLite 后端的数据库文件(":memory:" 表示内存数据库)
+    // ./server --ratelimit: 开启按 IP 的连接数和请求速率限制(默认关闭, 用 webbench 从本机压测时不要开启)
+    bool packOnly = false;
+    bool useTls = false;
+    bool rateLimit = false;
+    std::vector<std::string> upstreams;
+#ifdef USE_MYSQL
+    int userStore = UserStore::MYSQL;
+#else
+    int userStore = UserStore::SQLITE;
+#endif
+    const char* userStorePath = "../user.db";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--pack") == 0) {
+            packOnly = true;
+        }
+        else if (strcmp(argv[i], "--tls") == 0) {
+            useTls = true;
+        }
+        else if (strcmp(argv[i], "--ratelimit") == 0) {
+            rateLimit = true;
+        }
+        else if (strncmp(argv[i], "--upstream=", 11) == 0) {
+            upstreams.push_back(argv[i] + 11);
+        }
+        else if (strncmp(argv[i], "--store=", 8) == 0) {
+            const char* name = argv[i] + 8;
+            if (strcmp(name, "mysql") == 0) {
+                userStore = UserStore::MYSQL;
+            }
+            else if (strcmp(name, "sqlite") == 0) {
+                userStore = UserStore::SQLITE;
+            }
+            else if (strcmp(name, "memory") == 0) {
+                userStore = UserStore::MEMORY;
+            }
+            else {
+                fprintf(stderr, "unknown user store: %s (mysql|sqlite|memory)\n", name);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--store-path=", 13) == 0) {
+            userStorePath = argv[i] + 13;
+        }
+    }
+
     InitLogging(argv[0]);
     SetLogDir("../logs/");
     SetLogDestination(LOG_INFO, "webserver");
@@ -11,6 +61,43 @@ int main(int argc, char const *argv[])
     SetTimestampInLogfileName(false);
     SetLogBufSecs(10);
 
+    /// @param path 访问日志文件
+    /// @param sampleRate 采样率(每 N 个请求记录 1 个)
+    /// @param fields 记录的字段(FIELD_COMBINED / FIELD_BILLING / 自定义组合)
+    AccessLog::GetInstance()->Init("../logs/access.log", 1, AccessLog::FIELD_COMBINED);
+
+    /// @param capacity 登陆缓存最多缓存的用户数(0 表示关闭)
+    /// @param ttlSec 缓存有效期(单位:s)
+    LoginCache::GetInstance()->Init(65536, 300);
+
+    /// @param capacity 最多保存的登陆会话数(0 表示关闭)
+    /// @param ttlSec 会话多久没有访问后过期(单位:s)
+    SessionStore::GetInstance()->Init(1 << 20, 1800);
+
+    /// @param capacity 最多跟踪的客户端 IP 数(0 表示关闭限流, 只有 --ratelimit 时开启)
+    /// @param maxConnsPerIp 每个 IP 的并发连接上限
+    /// @param ratePerSec 每个 IP 每秒的请求数(HTTP/1 的请求、HTTP/2 的流、WebSocket 的数据帧都算一个)
+    /// @param burst 每个 IP 允许的突发请求数
+    RateLimiter::GetInstance()->Init(rateLimit ? 65536 : 0, 256, 500, 1000);
+
+    /// @param capacity 路径解析缓存最多缓存的路径数(0 表示关闭)
+    /// @param foundTtlMS 存在的路径的有效期(单位:ms)
+    /// @param missTtlMS 不存在的路径的有效期(单位:ms)
+    PathCache::GetInstance()->Init(65536, 2000, 1000);
+
+    /// @param srcDir 资源目录
+    /// @param packPath 资源包文件
+    /// @param compress 是否额外保存 gzip 压缩的内容
+    if (packOnly) {
+        return ResourcePack::Build("../resources/", "../resources.pack", true) ? 0 : 1;
+    }
+
+    /// @param certFile 证书链文件(PEM)
+    /// @param keyFile 私钥文件(PEM)
+    /// @param ktls 是否尝试把对称加密交给内核(kTLS, 需要内核加载 tls 模块)
+    if (useTls && !TlsContext::GetInstance()->Init("../tls/server.crt", "../tls/server.key", true)) {
+        return 1;
+    }
 
 
     /// @param port 服务端口号
@@ -24,10 +111,26 @@ int main(int argc, char const *argv[])
     /// @param sqlPoolNum 数据库连接池数量
     /// @param threadNum 线程池数量
     /// @param MaxEvent 最大同时发生的事件数
+    /// @param userStore 用户存储后端 0-MySQL 1-SQLite 2-内存
+    /// @param userStorePath SQLite 数据库文件
+    /// @param resourcePack 资源包文件(nullptr 表示直接读资源目录, 例如 "../resources.pack")
     WebServer server(8888, 3, 60000, false,                   /*端口 ET模式 timeoutMs 优雅退出*/
                     3306, "root", "123456", "webserver",       /* mysql 配置 */
-                    12, 6, 10240);               /* 连接池数量 线程池数量 最大同时发生的事件数*/
+                    12, 6, 10240,                /* 连接池数量 线程池数量 最大同时发生的事件数*/
+                    userStore, userStorePath,                  /* 用户存储后端 SQLite 文件 */
+                    nullptr);                                  /* 资源包 */
+
+    // 在这里(Start 之前)可以用 Router::GetInstance()->Add 注册其他接口, 例如:
+    // Router::GetInstance()->Add(Router::GET, "/api/user/:name", std::make_shared<MyHandler>());
 
+    /// @param upstreams 上游地址("host:port")
+    /// @param stripPrefix 转发前从路径中去掉的前缀: /api/proxy/users?id=1 -> 上游的 /users?id=1
+    if (!upstreams.empty()) {
+        std::shared_ptr<HttpHandler> proxy = std::make_shared<ProxyHandler>(upstreams, "/api/proxy");
+        for (int method = Router::GET; method < Router::METHOD_NUM; ++method) {
+            Router::GetInstance()->Add(static_cast<Router::Method>(method), "/api/proxy/*path", proxy);
+        }
+    }
     server.Start();
     return 0;
 }
@@ -0,0 +1,96 @@
+/*
+    无锁直方图
+
+    Log2Histogram: 以 2 的幂为桶边界(适合等待时间这类长尾数据)
+    LinearHistogram: 0~100 等分为 10 个桶(适合利用率百分比)
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <stdint.h>
+
+class Log2Histogram {
+public:
+    Log2Histogram() {
+        Reset();
+    }
+
+    /// @brief 记录一个值: 桶 i 统计 [2^(i-1), 2^i) 范围内的值, 桶 0 统计 0
+    /// @param value 值
+    void Add(uint64_t value) {
+        int i = 0;
+        while (value && i < BUCKET_NUM - 1) {
+            value >>= 1;
+            ++i;
+        }
+        buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief 清零
+    void Reset() {
+        for (int i = 0; i < BUCKET_NUM; ++i) {
+            buckets_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief 输出非空的桶, 例如 "<1us:3 <2us:10 <1024us:2"
+    /// @param unit 单位
+    std::string ToString(const char* unit) const {
+        std::ostringstream os;
+        for (int i = 0; i < BUCKET_NUM; ++i) {
+            uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+            if (n) {
+                os << "<" << (1ULL << i) << unit << ":" << n << " ";
+            }
+        }
+        return os.str();
+    }
+
+private:
+    static const int BUCKET_NUM = 40;
+    std::atomic<uint64_t> buckets_[BUCKET_NUM];
+};
+
+class LinearHistogram {
+public:
+    LinearHistogram() {
+        Reset();
+    }
+
+    /// @brief 记录一个百分比
+    /// @param percent 0~100
+    void Add(int percent) {
+        int i = percent / 10;
+        if (i < 0) i = 0;
+        if (i >= BUCKET_NUM) i = BUCKET_NUM - 1;
+        buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief 清零
+    void Reset() {
+        for (int i = 0; i < BUCKET_NUM; ++i) {
+            buckets_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief 输出所有桶, 例如 "0-9%:5 10-19%:0 ... 90-100%:1"
+    std::string ToString() const {
+        std::ostringstream os;
+        for (int i = 0; i < BUCKET_NUM; ++i) {
+            os << i * 10 << "-" << (i == BUCKET_NUM - 1 ? 100 : i * 10 + 9) << "%:"
+               << buckets_[i].load(std::memory_order_relaxed) << " ";
+        }
+        return os.str();
+    }
+
+private:
+    static const int BUCKET_NUM = 10;
+    std::atomic<uint64_t> buckets_[BUCKET_NUM];
+};
+
+
+#endif
@@ -0,0 +1,149 @@
+#include "logincache.h"
+
+#include <random>
+#include <cstring>
+#include <functional>
+
+
+namespace {
+
+inline uint64_t Rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+inline void SipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = Rotl(v1, 13); v1 ^= v0; v0 = Rotl(v0, 32);
+    v2 += v3; v3 = Rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = Rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = Rotl(v1, 17); v1 ^= v2; v2 = Rotl(v2, 32);
+}
+
+// SipHash-2-4
+uint64_t SipHash(const uint64_t key[2], const char* data, size_t len) {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+    const char* end = data + (len & ~size_t(7));
+    for (; data != end; data += 8) {
+        uint64_t m;
+        memcpy(&m, data, 8);
+        v3 ^= m;
+        SipRound(v0, v1, v2, v3);
+        SipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    uint64_t b = static_cast<uint64_t>(len) << 56;
+    for (size_t i = 0; i < (len & 7); ++i) {
+        b |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    v3 ^= b;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i) {
+        SipRound(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+}
+
+
+LoginCache::LoginCache() : shardCapacity_(4096), ttl_(300) {
+    std::random_device rd;
+    key_[0] = (static_cast<uint64_t>(rd()) << 32) | rd();
+    key_[1] = (static_cast<uint64_t>(rd()) << 32) | rd();
+}
+
+void LoginCache::Init(size_t capacity, int ttlSec) {
+    shardCapacity_ = (capacity + SHARD_NUM - 1) / SHARD_NUM;
+    ttl_ = std::chrono::seconds(ttlSec);
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        shard.lru.clear();
+        shard.index.clear();
+    }
+}
+
+LoginCache::Shard& LoginCache::ShardOf_(const std::string& name) {
+    return shards_[std::hash<std::string>()(name) % SHARD_NUM];
+}
+
+uint64_t LoginCache::Digest_(const std::string& name, const std::string& pwd) const {
+    std::string msg;
+    msg.reserve(name.size() + pwd.size() + 1);
+    msg.append(name).append(1, '\0').append(pwd);
+    return SipHash(key_, msg.data(), msg.size());
+}
+
+bool LoginCache::Verify(const std::string& name, const std::string& pwd) {
+    if (shardCapacity_ == 0 || name.empty() || pwd.empty()) {
+        return false;
+    }
+    uint64_t digest = Digest_(name, pwd);
+    Shard& shard = ShardOf_(name);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.index.find(name);
+    if (it == shard.index.end()) {
+        return false;
+    }
+    if (it->second->expires < Clock::now()) {
+        // 过期
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        return false;
+    }
+    if (it->second->digest != digest) {
+        // 密码不一致时不下结论, 交给数据库判断(密码可能在别处被修改过)
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return true;
+}
+
+void LoginCache::Put(const std::string& name, const std::string& pwd) {
+    if (shardCapacity_ == 0 || name.empty()) {
+        return;
+    }
+    uint64_t digest = Digest_(name, pwd);
+    Shard& shard = ShardOf_(name);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.index.find(name);
+    if (it != shard.index.end()) {
+        it->second->digest = digest;
+        it->second->expires = Clock::now() + ttl_;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    if (shard.lru.size() >= shardCapacity_) {
+        // 淘汰最久没用过的
+        shard.index.erase(shard.lru.back().name);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(Entry{name, digest, Clock::now() + ttl_});
+    shard.index[name] = shard.lru.begin();
+}
+
+void LoginCache::Invalidate(const std::string& name) {
+    Shard& shard = ShardOf_(name);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.index.find(name);
+    if (it != shard.index.end()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+size_t LoginCache::Size() {
+    size_t total = 0;
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        total += shard.lru.size();
+    }
+    return total;
+}
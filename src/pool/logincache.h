@@ -0,0 +1,87 @@
+/*
+    登陆结果缓存
+
+    username -> 带密钥的密码摘要(SipHash-2-4), 不保存明文密码.
+    按用户名哈希分片, 每个分片一把锁 + LRU 链表, 条目带过期时间.
+    近期登陆过的用户再次登陆时直接在内存中比对, 不再访问数据库.
+*/
+
+#ifndef LOGIN_CACHE_H
+#define LOGIN_CACHE_H
+
+#include <string>
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+class LoginCache {
+public:
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return LoginCache指针
+    static LoginCache* GetInstance() {
+        static LoginCache inst;
+        return &inst;
+    }
+
+    /// @brief 初始化(清空已有条目)
+    /// @param capacity 最多缓存的用户数(0 表示关闭缓存)
+    /// @param ttlSec 条目有效期(单位:s)
+    void Init(size_t capacity, int ttlSec);
+
+    /// @brief 用缓存验证登陆
+    /// @param name 用户名
+    /// @param pwd 密码
+    /// @return true-命中且密码一致, false-未命中/过期/密码不一致(需要查数据库)
+    bool Verify(const std::string& name, const std::string& pwd);
+
+    /// @brief 登陆或注册成功后写入缓存
+    /// @param name 用户名
+    /// @param pwd 密码
+    void Put(const std::string& name, const std::string& pwd);
+
+    /// @brief 删除指定用户的缓存
+    /// @param name 用户名
+    void Invalidate(const std::string& name);
+
+    /// @brief 当前缓存的条目数
+    size_t Size();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        std::string name;
+        uint64_t digest;
+        Clock::time_point expires;
+    };
+
+    // 一个分片: LRU 链表(表头最新) + 索引
+    struct Shard {
+        std::mutex mtx;
+        std::list<Entry> lru;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    LoginCache();
+    ~LoginCache() = default;
+
+    /// @brief 用户名对应的分片
+    Shard& ShardOf_(const std::string& name);
+    /// @brief 计算 用户名 + 密码 的带密钥摘要
+    uint64_t Digest_(const std::string& name, const std::string& pwd) const;
+
+private:
+    static const size_t SHARD_NUM = 16;
+
+    size_t shardCapacity_;
+    std::chrono::seconds ttl_;
+    uint64_t key_[2];   // 进程启动时随机生成的摘要密钥
+    Shard shards_[SHARD_NUM];
+};
+
+
+#endif
@@ -0,0 +1,35 @@
+#include "memuserstore.h"
+
+
+MemUserStore::Shard& MemUserStore::ShardOf_(const std::string& name) {
+    return shards_[std::hash<std::string>()(name) % SHARD_NUM];
+}
+
+UserStore::Status MemUserStore::Find_(const std::string& name, std::string* pwd) {
+    Shard& shard = ShardOf_(name);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.users.find(name);
+    if (it == shard.users.end()) {
+        return NOT_FOUND;
+    }
+    if (pwd) {
+        *pwd = it->second;
+    }
+    return OK;
+}
+
+UserStore::Status MemUserStore::Insert_(const std::string& name, const std::string& pwd) {
+    Shard& shard = ShardOf_(name);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    return shard.users.emplace(name, pwd).second ? OK : DUPLICATE;
+}
+
+bool MemUserStore::ForEachName(const std::function<void(const std::string&)>& fn) {
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        for (const auto& user : shard.users) {
+            fn(user.first);
+        }
+    }
+    return true;
+}
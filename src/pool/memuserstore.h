@@ -0,0 +1,38 @@
+/*
+    内存用户存储: 按用户名哈希分段, 每段一把锁
+*/
+
+#ifndef MEM_USER_STORE_H
+#define MEM_USER_STORE_H
+
+#include <mutex>
+#include <unordered_map>
+#include "userstore.h"
+
+class MemUserStore : public UserStore {
+public:
+    bool ForEachName(const std::function<void(const std::string&)>& fn) override;
+    const char* Name() const override {
+        return "memory";
+    }
+
+protected:
+    Status Find_(const std::string& name, std::string* pwd) override;
+    Status Insert_(const std::string& name, const std::string& pwd) override;
+
+private:
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, std::string> users;   // 用户名 -> 密码
+    };
+
+    /// @brief 用户名对应的分段
+    Shard& ShardOf_(const std::string& name);
+
+private:
+    static const size_t SHARD_NUM = 64;
+    Shard shards_[SHARD_NUM];
+};
+
+
+#endif
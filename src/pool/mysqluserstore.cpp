@@ -0,0 +1,57 @@
+#include "mysqluserstore.h"
+
+#include <vector>
+#include "sqlconnRAII.h"
+#include "registerbatcher.h"
+
+
+const char* MysqlUserStore::SQL_SELECT_USER = "SELECT username, password FROM user WHERE username = ? LIMIT 1";
+const char* MysqlUserStore::SQL_SELECT_NAMES = "SELECT username FROM user";
+
+UserStore::Status MysqlUserStore::Find_(const std::string& name, std::string* pwd) {
+    SqlConnRAII sql_ptr(SqlConnPool::GetInstance());
+    if (!sql_ptr.HasPtr()) {
+        return STORE_ERROR;
+    }
+    // 预编译语句缓存在连接上, 参数按二进制协议绑定
+    SqlStmt* query = sql_ptr.GetStmt(SQL_SELECT_USER);
+    if (!query || !query->Execute({name})) {
+        return STORE_ERROR;
+    }
+    std::vector<std::string> row;
+    bool found = query->FetchRow(&row);
+    query->FreeResult();
+    if (!found) {
+        return NOT_FOUND;
+    }
+    if (pwd) {
+        *pwd = row[1];
+    }
+    return OK;
+}
+
+UserStore::Status MysqlUserStore::Insert_(const std::string& name, const std::string& pwd) {
+    // 和其他并发的注册合并成一个事务提交, 并发注册同名用户时由唯一索引保证只有一个成功
+    switch (RegisterBatcher::GetInstance()->Insert(name, pwd)) {
+    case RegisterBatcher::INSERTED:
+        return OK;
+    case RegisterBatcher::DUPLICATE:
+        return DUPLICATE;
+    default:
+        return STORE_ERROR;
+    }
+}
+
+bool MysqlUserStore::ForEachName(const std::function<void(const std::string&)>& fn) {
+    SqlConnRAII sql_ptr(SqlConnPool::GetInstance());
+    SqlStmt* stmt = sql_ptr.GetStmt(SQL_SELECT_NAMES);
+    if (!stmt || !stmt->Execute({})) {
+        return false;
+    }
+    std::vector<std::string> row;
+    while (stmt->FetchRow(&row)) {
+        fn(row[0]);
+    }
+    stmt->FreeResult();
+    return true;
+}
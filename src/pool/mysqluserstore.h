@@ -0,0 +1,27 @@
+/*
+    MySQL 用户存储: 查询用连接池 + 预编译语句, 注册走 RegisterBatcher 组提交
+*/
+
+#ifndef MYSQL_USER_STORE_H
+#define MYSQL_USER_STORE_H
+
+#include "userstore.h"
+
+class MysqlUserStore : public UserStore {
+public:
+    bool ForEachName(const std::function<void(const std::string&)>& fn) override;
+    const char* Name() const override {
+        return "mysql";
+    }
+
+protected:
+    Status Find_(const std::string& name, std::string* pwd) override;
+    Status Insert_(const std::string& name, const std::string& pwd) override;
+
+private:
+    static const char* SQL_SELECT_USER;
+    static const char* SQL_SELECT_NAMES;
+};
+
+
+#endif
@@ -0,0 +1,201 @@
+#include "ratelimiter.h"
+
+#include <time.h>
+#include <sstream>
+
+
+const char RateLimiter::RESPONSE_429[] =
+    "HTTP/1.1 429 Too Many Requests\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n\r\n";
+const size_t RateLimiter::RESPONSE_429_LEN = sizeof(RateLimiter::RESPONSE_429) - 1;
+
+namespace {
+
+const uint64_t MILLI = 1000;     // 一个令牌
+const uint32_t CLAIMING = 1u << 31;     // 连接数中的保留位: 槽刚被占用, 令牌桶还没有初始化
+
+inline uint64_t Hash(uint32_t ip) {
+    // 斐波那契散列: 高位用来选分片, 低位用来选探测起点
+    return ip * 0x9E3779B97F4A7C15ULL;
+}
+
+inline uint32_t Owner(uint64_t state) {
+    return static_cast<uint32_t>(state >> 32);
+}
+
+inline uint32_t Conns(uint64_t state) {
+    return static_cast<uint32_t>(state);
+}
+
+}
+
+RateLimiter::RateLimiter()
+    : shardSize_(0), maxConns_(0), rate_(0), capacity_(0), rejectedConns_(0), rejectedRequests_(0), untracked_(0) {}
+
+void RateLimiter::Init(size_t capacity, uint32_t maxConnsPerIp, uint32_t ratePerSec, uint32_t burst) {
+    slots_.reset();
+    if (capacity == 0 || maxConnsPerIp == 0 || ratePerSec == 0) {
+        return;
+    }
+    // 每个分片至少 MAX_PROBE 个槽, 总数向上取 2 的幂
+    size_t shards = static_cast<size_t>(1) << SHARD_BITS;
+    shardSize_ = MAX_PROBE;
+    while (shardSize_ * shards < capacity) {
+        shardSize_ <<= 1;
+    }
+    maxConns_ = maxConnsPerIp;
+    rate_ = ratePerSec;
+    capacity_ = static_cast<uint64_t>(burst > 0 ? burst : 1) * MILLI;
+    slots_.reset(new Slot[shardSize_ * shards]);
+    for (size_t i = 0; i < shardSize_ * shards; ++i) {
+        slots_[i].state.store(0, std::memory_order_relaxed);
+        slots_[i].bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32_t RateLimiter::NowMs_() {
+    // 粗粒度时钟只读 vDSO 中的一个值, 精度(几毫秒)对限流足够
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint32_t>(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+uint64_t RateLimiter::Refill_(uint64_t bucket, uint32_t now) const {
+    uint32_t last = static_cast<uint32_t>(bucket >> 32);
+    uint64_t tokens = static_cast<uint32_t>(bucket);
+    // 回绕的时间按无符号差值计算; 每毫秒补充 rate_ 个千分之一令牌
+    uint64_t elapsed = static_cast<uint32_t>(now - last);
+    tokens += elapsed * rate_;
+    return tokens < capacity_ ? tokens : capacity_;
+}
+
+bool RateLimiter::AcquireConn(uint32_t ip, Slot** slot) {
+    *slot = nullptr;
+    if (!slots_ || ip == 0) {
+        return true;
+    }
+    uint64_t h = Hash(ip);
+    Slot* shard = &slots_[(h >> (64 - SHARD_BITS)) * shardSize_];
+    size_t mask = shardSize_ - 1;
+    size_t start = static_cast<size_t>(h) & mask;
+
+    // 先找已有的槽(前面的槽可能被回收过, 不能在第一个空槽处停下), 同时记住第一个空槽
+    Slot* empty = nullptr;
+    for (int i = 0; i < MAX_PROBE; ++i) {
+        Slot* s = &shard[(start + i) & mask];
+        uint64_t state = s->state.load(std::memory_order_acquire);
+        if (Owner(state) == ip) {
+            for (;;) {
+                if (Conns(state) & CLAIMING) {
+                    // 另一个连接正在初始化这个槽的令牌桶(只有两次写), 等它发布
+                    state = s->state.load(std::memory_order_acquire);
+                    continue;
+                }
+                if (Conns(state) >= maxConns_) {
+                    rejectedConns_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                if (s->state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel)) {
+                    *slot = s;
+                    return true;
+                }
+                if (Owner(state) != ip) {
+                    // 刚好被回收了: 重新查找
+                    return AcquireConn(ip, slot);
+                }
+            }
+        }
+        if (state == 0 && !empty) {
+            empty = s;
+        }
+    }
+
+    // 新的 IP: 占用空槽(和别的线程抢同一个空槽时换下一个)
+    uint64_t claiming = (static_cast<uint64_t>(ip) << 32) | CLAIMING;
+    for (int i = 0; i < MAX_PROBE && empty; ++i) {
+        Slot* s = &shard[(start + i) & mask];
+        uint64_t state = s->state.load(std::memory_order_acquire);
+        if (state == 0 && s->state.compare_exchange_strong(state, claiming, std::memory_order_acq_rel)) {
+            // 先用"正在初始化"标记占住槽, 只有赢家写令牌桶(从满的开始), 再发布连接数 1:
+            // 同一个 IP 的其他连接等到发布之后才使用这个槽, 看到的已经是新的桶; 回收也会跳过连接数非 0 的槽
+            s->bucket.store((static_cast<uint64_t>(NowMs_()) << 32) | capacity_, std::memory_order_relaxed);
+            s->state.store((static_cast<uint64_t>(ip) << 32) | 1, std::memory_order_release);
+            *slot = s;
+            return true;
+        }
+        if (Owner(state) == ip) {
+            // 同一个 IP 的另一个连接先占了槽
+            return AcquireConn(ip, slot);
+        }
+    }
+    // 分片的探测范围已满: 不跟踪这个连接
+    untracked_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool RateLimiter::AllowRequest(Slot* slot) {
+    if (!slot) {
+        return true;
+    }
+    uint32_t now = NowMs_();
+    uint64_t bucket = slot->bucket.load(std::memory_order_relaxed);
+    for (;;) {
+        uint64_t tokens = Refill_(bucket, now);
+        if (tokens < MILLI) {
+            // 不够一个令牌: 不写回, 下次按原来的时间继续补充
+            rejectedRequests_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        uint64_t next = (static_cast<uint64_t>(now) << 32) | (tokens - MILLI);
+        if (slot->bucket.compare_exchange_weak(bucket, next, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+size_t RateLimiter::Sweep() {
+    if (!slots_) {
+        return 0;
+    }
+    uint32_t now = NowMs_();
+    size_t removed = 0;
+    size_t total = shardSize_ << SHARD_BITS;
+    for (size_t i = 0; i < total; ++i) {
+        Slot& s = slots_[i];
+        uint64_t state = s.state.load(std::memory_order_acquire);
+        if (state == 0 || Conns(state) != 0) {
+            continue;
+        }
+        // 令牌已经补满: 回收后重新开始的桶和现在一样, 不会放松限制
+        if (Refill_(s.bucket.load(std::memory_order_relaxed), now) < capacity_) {
+            continue;
+        }
+        // 和 AcquireConn 的加一是同一个原子量: 期间有新连接时 CAS 失败, 槽保留
+        if (s.state.compare_exchange_strong(state, 0, std::memory_order_acq_rel)) {
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+std::string RateLimiter::Stats() const {
+    std::ostringstream os;
+    if (!slots_) {
+        os << "off";
+        return os.str();
+    }
+    size_t used = 0;
+    size_t total = shardSize_ << SHARD_BITS;
+    for (size_t i = 0; i < total; ++i) {
+        if (slots_[i].state.load(std::memory_order_relaxed) != 0) {
+            ++used;
+        }
+    }
+    os << "slots=" << used << "/" << total
+       << ", rejectedConns=" << rejectedConns_.load(std::memory_order_relaxed)
+       << ", rejectedRequests=" << rejectedRequests_.load(std::memory_order_relaxed)
+       << ", untracked=" << untracked_.load(std::memory_order_relaxed);
+    return os.str();
+}
@@ -0,0 +1,103 @@
+/*
+    按来源 IP 限流
+
+    每个 IP 一个槽: 当前连接数 + 令牌桶(请求速率). 槽放在按 IP 哈希分片的开放寻址表中,
+    每个分片是一段连续的槽, 在分片内线性探测(最多 MAX_PROBE 个槽), 不加锁:
+      - 槽的归属和连接数在同一个 64 位原子量中(IP << 32 | 连接数), 占用空槽、增减连接数、回收都是一次 CAS;
+        占用空槽时连接数先是保留的"正在初始化"位, 占到的线程写好令牌桶后才发布连接数 1;
+      - 令牌桶是另一个 64 位原子量(上次补充的时间 << 32 | 千分之一令牌数), 检查时按经过的时间惰性补充, 一次 CAS 扣除.
+    连接数为 0 且令牌已经补满的槽由定时器回收(回收后等同于从没见过这个 IP), 表满时新的 IP 不受限制(计数).
+    超过连接上限的连接在 accept 后直接关闭, 超过速率的请求收到预先生成的 429 后关闭连接.
+*/
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+class RateLimiter {
+public:
+    static const int SHARD_BITS = 6;        // 2^6 个分片
+    static const int MAX_PROBE = 16;        // 分片内最多探测的槽数
+    static const char RESPONSE_429[];       // 超过速率时发送的完整响应(关闭连接)
+    static const size_t RESPONSE_429_LEN;
+
+    // 一个 IP 的状态(HttpConn 持有指针, 直到连接关闭)
+    struct Slot {
+        std::atomic<uint64_t> state;    // IP << 32 | 连接数, 0 表示空槽
+        std::atomic<uint64_t> bucket;   // 上次补充的时间(ms) << 32 | 千分之一令牌数
+    };
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return RateLimiter指针
+    static RateLimiter* GetInstance() {
+        static RateLimiter inst;
+        return &inst;
+    }
+
+    /// @brief 初始化(只在服务器启动前调用)
+    /// @param capacity 最多跟踪的 IP 数(0 表示关闭限流)
+    /// @param maxConnsPerIp 每个 IP 的并发连接上限
+    /// @param ratePerSec 每个 IP 每秒补充的请求数
+    /// @param burst 令牌桶容量(允许的突发请求数)
+    void Init(size_t capacity, uint32_t maxConnsPerIp, uint32_t ratePerSec, uint32_t burst);
+
+    /// @brief 是否开启了限流
+    bool Enabled() const {
+        return slots_ != nullptr;
+    }
+
+    /// @brief accept 之后占用一个连接名额
+    /// @param ip IPv4 地址(网络字节序)
+    /// @param slot 这个 IP 的槽(关闭限流或表满时为 nullptr), 连接关闭时交给 ReleaseConn
+    /// @return false-这个 IP 的连接数已经到上限
+    bool AcquireConn(uint32_t ip, Slot** slot);
+
+    /// @brief 连接关闭, 归还连接名额
+    /// @param slot AcquireConn 得到的槽(可以为 nullptr)
+    void ReleaseConn(Slot* slot) {
+        if (slot) {
+            slot->state.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    /// @brief 新的请求: 从这个 IP 的令牌桶中取一个令牌
+    /// @param slot AcquireConn 得到的槽(nullptr 时总是允许)
+    /// @return false-超过请求速率
+    bool AllowRequest(Slot* slot);
+
+    /// @brief 回收没有连接且令牌已经补满的槽(由定时器调用)
+    /// @return 回收的个数
+    size_t Sweep();
+
+    /// @brief 统计信息(用于日志)
+    std::string Stats() const;
+
+private:
+    RateLimiter();
+    ~RateLimiter() = default;
+
+    /// @brief 粗粒度的单调时钟(ms, 32 位回绕, 只用差值)
+    static uint32_t NowMs_();
+
+    /// @brief 令牌桶补充到当前时间后的令牌数(千分之一)
+    uint64_t Refill_(uint64_t bucket, uint32_t now) const;
+
+private:
+    std::unique_ptr<Slot[]> slots_;
+    size_t shardSize_;          // 每个分片的槽数(2 的幂)
+    uint32_t maxConns_;
+    uint32_t rate_;             // 每毫秒补充的千分之一令牌数(= 每秒请求数)
+    uint64_t capacity_;         // 令牌桶容量(千分之一令牌)
+
+    std::atomic<uint64_t> rejectedConns_;
+    std::atomic<uint64_t> rejectedRequests_;
+    std::atomic<uint64_t> untracked_;   // 表满没有跟踪的连接数
+};
+
+
+#endif
@@ -0,0 +1,157 @@
+#include "registerbatcher.h"
+
+#include <unordered_set>
+#include <assert.h>
+#include <mysql/mysqld_error.h> // ER_DUP_ENTRY
+#include "sqlconnRAII.h"
+
+
+RegisterBatcher::RegisterBatcher() : maxBatch_(1), window_(0), isClose_(true)
+{ }
+
+RegisterBatcher::~RegisterBatcher() {
+    Close();
+}
+
+void RegisterBatcher::Init(int maxBatch, int windowUS) {
+    assert(maxBatch > 0 && windowUS >= 0);
+    Close();
+    maxBatch_ = maxBatch;
+    window_ = std::chrono::microseconds(windowUS);
+    isClose_ = false;
+    worker_.reset(new std::thread(&RegisterBatcher::Work_, this));
+}
+
+RegisterBatcher::Result RegisterBatcher::Insert(const std::string& name, const std::string& pwd) {
+    Request req{&name, &pwd, DB_ERROR, false};
+    std::unique_lock<std::mutex> lk(mtx_);
+    if (isClose_) {
+        lk.unlock();
+        std::vector<Request*> batch{&req};
+        Commit_(batch);
+        return req.result;
+    }
+    queue_.push_back(&req);
+    if (queue_.size() == 1 || static_cast<int>(queue_.size()) >= maxBatch_) {
+        // 新批次开始计时 / 凑够一批
+        condWork_.notify_one();
+    }
+    condDone_.wait(lk, [&req] { return req.done; });
+    return req.result;
+}
+
+void RegisterBatcher::Work_() {
+    std::vector<Request*> batch;
+    std::unique_lock<std::mutex> lk(mtx_);
+    while (true) {
+        condWork_.wait(lk, [this] { return isClose_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            break;
+        }
+        // 等其他并发的注册请求加入同一批
+        Clock::time_point deadline = Clock::now() + window_;
+        condWork_.wait_until(lk, deadline, [this] {
+            return isClose_ || static_cast<int>(queue_.size()) >= maxBatch_;
+        });
+
+        size_t n = std::min(queue_.size(), static_cast<size_t>(maxBatch_));
+        batch.assign(queue_.begin(), queue_.begin() + n);
+        queue_.erase(queue_.begin(), queue_.begin() + n);
+
+        lk.unlock();
+        Commit_(batch);
+        lk.lock();
+
+        for (Request* req : batch) {
+            req->done = true;
+        }
+        condDone_.notify_all();
+    }
+}
+
+std::string RegisterBatcher::BatchSql_(size_t n) {
+    std::string sql = "INSERT INTO user(username, password) VALUES(?, ?)";
+    for (size_t i = 1; i < n; ++i) {
+        sql += ", (?, ?)";
+    }
+    return sql;
+}
+
+void RegisterBatcher::Commit_(std::vector<Request*>& batch) {
+    // 同一批中重复的用户名只有第一个可能成功
+    std::vector<Request*> rows;
+    std::unordered_set<std::string> names;
+    for (Request* req : batch) {
+        if (names.insert(*req->name).second) {
+            req->result = DB_ERROR;
+            rows.push_back(req);
+        }
+        else {
+            req->result = DUPLICATE;
+        }
+    }
+
+    SqlConnRAII sql_ptr(SqlConnPool::GetInstance());
+    if (!sql_ptr.HasPtr()) {
+        return;
+    }
+    MYSQL* sql_h = sql_ptr.GetPtr();
+    if (mysql_query(sql_h, "START TRANSACTION") != 0) {
+        CLOG(WARNING) << "Register batch begin error: " << mysql_error(sql_h);
+        return;
+    }
+
+    std::vector<std::string> params;
+    params.reserve(rows.size() * 2);
+    for (Request* req : rows) {
+        params.push_back(*req->name);
+        params.push_back(*req->pwd);
+    }
+    SqlStmt* insert = sql_ptr.GetStmt(BatchSql_(rows.size()));
+    if (insert && insert->Execute(params)) {
+        for (Request* req : rows) {
+            req->result = INSERTED;
+        }
+    }
+    else if (rows.size() > 1 && insert && insert->Errno() == ER_DUP_ENTRY) {
+        // 有用户名已存在, 整条语句被撤销: 在同一个事务中逐行插入
+        SqlStmt* single = sql_ptr.GetStmt(BatchSql_(1));
+        for (Request* req : rows) {
+            if (!single) {
+                break;
+            }
+            if (single->Execute({*req->name, *req->pwd})) {
+                req->result = INSERTED;
+            }
+            else if (single->Errno() == ER_DUP_ENTRY) {
+                req->result = DUPLICATE;
+            }
+        }
+    }
+    else if (insert && insert->Errno() == ER_DUP_ENTRY) {
+        rows[0]->result = DUPLICATE;
+    }
+
+    if (mysql_commit(sql_h) != 0) {
+        CLOG(WARNING) << "Register batch commit error: " << mysql_error(sql_h);
+        mysql_rollback(sql_h);
+        for (Request* req : rows) {
+            if (req->result == INSERTED) {
+                req->result = DB_ERROR;
+            }
+        }
+    }
+}
+
+void RegisterBatcher::Close() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        isClose_ = true;
+    }
+    condWork_.notify_all();
+    // 后台线程会先提交完队列中剩余的请求
+    if (worker_ && worker_->joinable()) {
+        worker_->join();
+    }
+    worker_.reset();
+}
@@ -0,0 +1,87 @@
+/*
+    注册 INSERT 的组提交(group commit)
+
+    并发到来的注册请求先进入队列, 后台线程在一个很短的时间窗口内(或凑够 N 行)
+    把它们合并成一条多行 INSERT, 在一个事务中提交, 数据库端只需要一次刷盘.
+    某个用户名重复时整条多行 INSERT 会失败, 此时在同一个事务中逐行插入,
+    每个请求拿到各自的结果.
+*/
+
+#ifndef REGISTER_BATCHER_H
+#define REGISTER_BATCHER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+
+class RegisterBatcher {
+public:
+    // 单条注册的结果
+    enum Result {
+        INSERTED = 0,
+        DUPLICATE,  // 用户名已存在
+        DB_ERROR,   // 数据库错误
+    };
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return RegisterBatcher指针
+    static RegisterBatcher* GetInstance() {
+        static RegisterBatcher inst;
+        return &inst;
+    }
+
+    /// @brief 启动后台合并线程(需要先初始化 SqlConnPool)
+    /// @param maxBatch 一批最多合并的行数
+    /// @param windowUS 第一条请求到来后最多等待的时间(单位:us)
+    void Init(int maxBatch, int windowUS);
+
+    /// @brief 插入一个用户, 阻塞直到所在的批次提交完成
+    /// 未初始化时直接单独插入
+    /// @param name 用户名
+    /// @param pwd 密码
+    /// @return 该用户的插入结果
+    Result Insert(const std::string& name, const std::string& pwd);
+
+    /// @brief 提交剩余的请求并停止后台线程
+    void Close();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // 一个等待中的注册请求(位于调用线程的栈上)
+    struct Request {
+        const std::string* name;
+        const std::string* pwd;
+        Result result;
+        bool done;
+    };
+
+    RegisterBatcher();
+    ~RegisterBatcher();
+
+    /// @brief 后台线程: 攒批 -> 提交 -> 唤醒等待者
+    void Work_();
+    /// @brief 在一个事务中插入一批用户, 结果写回各个请求
+    static void Commit_(std::vector<Request*>& batch);
+    /// @brief 多行 INSERT 的 SQL, 例如 n = 2 时为 "... VALUES(?, ?), (?, ?)"
+    static std::string BatchSql_(size_t n);
+
+private:
+    int maxBatch_;
+    std::chrono::microseconds window_;
+    bool isClose_;
+
+    std::vector<Request*> queue_;
+    std::mutex mtx_;
+    std::condition_variable condWork_;   // 通知后台线程
+    std::condition_variable condDone_;   // 通知等待结果的线程
+    std::unique_ptr<std::thread> worker_;
+};
+
+
+#endif
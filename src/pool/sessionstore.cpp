@@ -0,0 +1,143 @@
+#include "sessionstore.h"
+
+#include <sys/random.h>
+#include <errno.h>
+#include <string.h>
+#include <functional>
+#include <stdint.h>
+#include "../log/logsite.h"
+
+
+const char* SessionStore::COOKIE_NAME = "sid";
+
+SessionStore::SessionStore() : shardCapacity_(0), ttl_(1800)
+{ }
+
+void SessionStore::Init(size_t capacity, int ttlSec) {
+    shardCapacity_ = (capacity + SHARD_NUM - 1) / SHARD_NUM;
+    ttl_ = std::chrono::seconds(ttlSec);
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        shard.lru.clear();
+        shard.index.clear();
+    }
+}
+
+SessionStore::Shard& SessionStore::ShardOf_(const std::string& token) {
+    return shards_[std::hash<std::string>()(token) % SHARD_NUM];
+}
+
+bool SessionStore::NewToken_(std::string* token) {
+    // 每个线程批量取随机数, 减少系统调用
+    static const size_t POOL_SIZE = 4096;
+    static thread_local unsigned char pool[POOL_SIZE];
+    static thread_local size_t used = POOL_SIZE;
+    static const char HEX[] = "0123456789abcdef";
+    static const size_t TOKEN_BYTES = 16;
+
+    if (used + TOKEN_BYTES > POOL_SIZE) {
+        size_t got = 0;
+        while (got < POOL_SIZE) {
+            ssize_t n = getrandom(pool + got, POOL_SIZE - got, 0);
+            if (n > 0) {
+                got += n;
+            }
+            else if (n < 0 && errno != EINTR) {
+                // ENOSYS / EPERM(seccomp) 等重试也不会成功, 不能退回到可预测的令牌
+                LOG_EVERY_SEC(ERROR, 10) << "SessionStore: getrandom error: " << strerror(errno);
+                return false;
+            }
+        }
+        used = 0;
+    }
+    token->assign(TOKEN_BYTES * 2, '0');
+    for (size_t i = 0; i < TOKEN_BYTES; ++i) {
+        (*token)[2 * i] = HEX[pool[used + i] >> 4];
+        (*token)[2 * i + 1] = HEX[pool[used + i] & 0xf];
+    }
+    used += TOKEN_BYTES;
+    return true;
+}
+
+std::string SessionStore::Create(const std::string& user) {
+    if (shardCapacity_ == 0) {
+        return std::string();
+    }
+    std::string token;
+    if (!NewToken_(&token)) {
+        return std::string();
+    }
+    Shard& shard = ShardOf_(token);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    if (shard.lru.size() >= shardCapacity_) {
+        // 淘汰最久没有访问的会话
+        shard.index.erase(shard.lru.back().token);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(Session{token, user, Clock::now() + ttl_});
+    shard.index[token] = shard.lru.begin();
+    return token;
+}
+
+bool SessionStore::Lookup(const std::string& token, std::string* user) {
+    if (shardCapacity_ == 0 || token.empty()) {
+        return false;
+    }
+    Shard& shard = ShardOf_(token);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.index.find(token);
+    if (it == shard.index.end()) {
+        return false;
+    }
+    Clock::time_point now = Clock::now();
+    if (it->second->expires < now) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        return false;
+    }
+    it->second->expires = now + ttl_;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    if (user) {
+        *user = it->second->user;
+    }
+    return true;
+}
+
+void SessionStore::Remove(const std::string& token) {
+    Shard& shard = ShardOf_(token);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it = shard.index.find(token);
+    if (it != shard.index.end()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+size_t SessionStore::Sweep() {
+    size_t removed = 0;
+    Clock::time_point now = Clock::now();
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        // 表尾最早过期, 遇到第一个没过期的就可以停下
+        while (!shard.lru.empty() && shard.lru.back().expires < now) {
+            shard.index.erase(shard.lru.back().token);
+            shard.lru.pop_back();
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+size_t SessionStore::Size() {
+    size_t total = 0;
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        total += shard.lru.size();
+    }
+    return total;
+}
+
+std::string SessionStore::SetCookieValue(const std::string& token) const {
+    return std::string(COOKIE_NAME) + "=" + token + "; Path=/; Max-Age=" +
+           std::to_string(ttl_.count()) + "; HttpOnly; SameSite=Lax";
+}
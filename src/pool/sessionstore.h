@@ -0,0 +1,97 @@
+/*
+    会话存储
+
+    登陆成功后发放随机令牌(写入 Cookie), 令牌 -> 用户名 保存在内存中.
+    按令牌哈希分片, 每个分片一把锁 + LRU 链表; 每次访问都会顺延过期时间,
+    所以链表尾部就是最早过期的会话, 由服务器的定时器周期性地从尾部清理.
+*/
+
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <string>
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+class SessionStore {
+public:
+    // Cookie 中保存令牌的字段名
+    static const char* COOKIE_NAME;
+
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return SessionStore指针
+    static SessionStore* GetInstance() {
+        static SessionStore inst;
+        return &inst;
+    }
+
+    /// @brief 初始化(清空已有会话)
+    /// @param capacity 最多保存的会话数(0 表示关闭会话)
+    /// @param ttlSec 会话在多久没有访问后过期(单位:s)
+    void Init(size_t capacity, int ttlSec);
+
+    /// @brief 为用户创建一个会话
+    /// @param user 用户名
+    /// @return 会话令牌(会话关闭或取随机数失败时返回空串)
+    std::string Create(const std::string& user);
+
+    /// @brief 查找会话, 找到时顺延过期时间
+    /// @param token 会话令牌
+    /// @param user 会话所属的用户名
+    /// @return 是否是有效的会话
+    bool Lookup(const std::string& token, std::string* user);
+
+    /// @brief 删除会话
+    /// @param token 会话令牌
+    void Remove(const std::string& token);
+
+    /// @brief 清理所有过期的会话(由定时器调用)
+    /// @return 清理的个数
+    size_t Sweep();
+
+    /// @brief 当前的会话数
+    size_t Size();
+
+    /// @brief 生成 Set-Cookie 首部的值
+    /// @param token 会话令牌
+    std::string SetCookieValue(const std::string& token) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Session {
+        std::string token;
+        std::string user;
+        Clock::time_point expires;
+    };
+
+    // 一个分片: LRU 链表(表头最近访问) + 索引
+    struct Shard {
+        std::mutex mtx;
+        std::list<Session> lru;
+        std::unordered_map<std::string, std::list<Session>::iterator> index;
+    };
+
+    SessionStore();
+    ~SessionStore() = default;
+
+    /// @brief 令牌对应的分片
+    Shard& ShardOf_(const std::string& token);
+    /// @brief 生成 128 位的随机令牌(十六进制)
+    /// @param token 生成的令牌
+    /// @return 是否成功(getrandom 除 EINTR 外的错误直接失败)
+    static bool NewToken_(std::string* token);
+
+private:
+    static const size_t SHARD_NUM = 16;
+
+    size_t shardCapacity_;
+    std::chrono::seconds ttl_;
+    Shard shards_[SHARD_NUM];
+};
+
+
+#endif
@@ -0,0 +1,91 @@
+/*
+    single-flight: 合并并发的相同请求
+
+    同一个 key 同一时刻只有第一个调用者(leader)真正执行, 其他并发的调用者
+    等待并共享它的结果. 执行完成后 key 立即移除, 之后的调用会重新执行,
+    所以这里只消除"同时"的重复工作, 不做缓存.
+*/
+
+#ifndef SINGLEFLIGHT_H_
+#define SINGLEFLIGHT_H_
+
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
+
+template<class Key, class Value, class Hash = std::hash<Key>>
+class SingleFlight {
+public:
+    SingleFlight() : leaderCount_(0), sharedCount_(0) {}
+
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    /// @brief 执行 key 对应的工作, 或等待正在执行的同一个 key 的结果
+    /// @tparam _Callable 可调用对象类型, 返回 Value
+    /// @param key 键
+    /// @param _f 实际的工作(只在 leader 中调用, fn 抛出的异常会传给所有等待者)
+    /// @param shared 返回结果是否来自其他调用者(可以为 nullptr)
+    /// @return 结果
+    template<class _Callable>
+    Value Do(const Key& key, _Callable&& _f, bool* shared = nullptr) {
+        std::promise<Value> promise;
+        {
+            std::unique_lock<std::mutex> lk(mtx_);
+            auto it = calls_.find(key);
+            if (it != calls_.end()) {
+                std::shared_future<Value> future = it->second;
+                lk.unlock();
+                ++sharedCount_;
+                if (shared) {
+                    *shared = true;
+                }
+                return future.get();
+            }
+            calls_.emplace(key, promise.get_future().share());
+        }
+
+        ++leaderCount_;
+        if (shared) {
+            *shared = false;
+        }
+        try {
+            Value value = _f();
+            promise.set_value(value);
+            Forget_(key);
+            return value;
+        }
+        catch (...) {
+            promise.set_exception(std::current_exception());
+            Forget_(key);
+            throw;
+        }
+    }
+
+    /// @brief 真正执行的次数
+    uint64_t LeaderCount() const {
+        return leaderCount_.load(std::memory_order_relaxed);
+    }
+
+    /// @brief 共享了别人结果的次数(省下的重复工作)
+    uint64_t SharedCount() const {
+        return sharedCount_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Forget_(const Key& key) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        calls_.erase(key);
+    }
+
+private:
+    std::mutex mtx_;
+    std::unordered_map<Key, std::shared_future<Value>, Hash> calls_;
+    std::atomic<uint64_t> leaderCount_;
+    std::atomic<uint64_t> sharedCount_;
+};
+
+
+#endif
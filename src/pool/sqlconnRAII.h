@@ -10,10 +10,12 @@
 
 class SqlConnRAII {
 public:
-    SqlConnRAII(SqlConnPool* connpool): sql_h_(nullptr) {
+    /// @param connpool 连接池
+    /// @param timeoutMS 取连接的最长等待时间(单位:ms), -1 表示使用连接池的默认值
+    SqlConnRAII(SqlConnPool* connpool, int timeoutMS = -1): sql_h_(nullptr) {
         assert(connpool);
         if (connpool) {
-            sql_h_ = connpool->GetConn();
+            sql_h_ = connpool->GetConn(timeoutMS);
             connpool_ = connpool;
         }
     }
@@ -32,6 +34,13 @@ public:
         return sql_h_;
     }
 
+    /// @brief 获取当前连接上缓存的预编译语句
+    /// @param sql 带 ? 占位符的 SQL 语句
+    /// @return 语句指针(失败返回 nullptr)
+    SqlStmt* GetStmt(const std::string& sql) {
+        return sql_h_ ? connpool_->GetStmt(sql_h_, sql) : nullptr;
+    }
+
 
 private:
     MYSQL* sql_h_;
@@ -1,79 +1,314 @@
 #include "sqlconnpool.h"
 
+#include <vector>
+#include <sstream>
 
-SqlConnPool::SqlConnPool(): useCount_(0), freeCount_(0) 
+
+SqlConnPool::SqlConnPool(): port_(0), MAX_CONN_(0), minConn_(0), acquireTimeoutMS_(1000),
+                            checkInterval_(30), totalCount_(0), useCount_(0), isClose_(true),
+                            timeoutCount_(0), reconnectCount_(0)
 { }
 
-void SqlConnPool::Init(const char* host, int port, 
+void SqlConnPool::Init(const char* host, int port,
               const char* user, const char* pwd,
-              const char* dbName, int connSize) {
-    assert(connSize > 0);
-    for (int i = 0; i < connSize; ++i) {
-        MYSQL* sql_h = nullptr;
-        sql_h = mysql_init(sql_h);
-        if (!sql_h) {
-            // LOG_ERROR("MySql init error");
-            assert(sql_h);
-        }
+              const char* dbName, int connSize,
+              int minSize, int acquireTimeoutMS,
+              int checkIntervalSec) {
+    assert(connSize > 0 && checkIntervalSec > 0);
+    host_ = host;
+    port_ = port;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    MAX_CONN_ = connSize;
+    minConn_ = std::max(0, std::min(minSize, connSize));
+    acquireTimeoutMS_ = acquireTimeoutMS;
+    checkInterval_ = std::chrono::seconds(checkIntervalSec);
+    isClose_ = false;
 
-        sql_h = mysql_real_connect(sql_h, host, user,
-                                   pwd, dbName, port, nullptr, 0);
-        
+    // 先建立最少连接数, 其余在 GetConn 时按需建立
+    for (int i = 0; i < minConn_; ++i) {
+        MYSQL* sql_h = Connect_();
         if (!sql_h) {
-            LOG(ERROR) << "MySql connect error";
+            break;
         }
-
-        connQue_.push(sql_h);
+        std::lock_guard<std::mutex> lk(mtx_);
+        ++totalCount_;
+        stmtCache_[sql_h];
+        idleQue_.push_back({sql_h, Clock::now()});
+    }
+    if (totalCount_ < minConn_) {
+        CLOG(ERROR) << "MySql connect error, " << totalCount_ << "/" << minConn_ << " connections ready";
     }
-    MAX_CONN_ = connSize;
 
-    // 线程间通信的信号量
-    // 初始化为 MAX_CONN_
-    sem_init(&semId_, 0, MAX_CONN_);
+    checkThread_.reset(new std::thread(&SqlConnPool::HealthCheck_, this));
 }
 
-MYSQL* SqlConnPool::GetConn() {
-    MYSQL* sql_h = nullptr;
-    if (connQue_.empty()) {
-        LOG(WARNING) << "SqlConnPool busy!";
+MYSQL* SqlConnPool::Connect_() {
+    MYSQL* sql_h = mysql_init(nullptr);
+    if (!sql_h) {
+        CLOG(ERROR) << "MySql init error";
         return nullptr;
     }
-    sem_wait(&semId_); // 等待 semId_ > 0
+    // 断线后由 mysql_ping 自动重连, 预编译语句在 SqlStmt 中重新准备
+    bool reconnect = true;
+    mysql_options(sql_h, MYSQL_OPT_RECONNECT, &reconnect);
+    // 数据库不可用时不要让取连接的线程卡太久
+    unsigned int connectTimeout = 3;
+    mysql_options(sql_h, MYSQL_OPT_CONNECT_TIMEOUT, &connectTimeout);
 
+    if (!mysql_real_connect(sql_h, host_.c_str(), user_.c_str(),
+                            pwd_.c_str(), dbName_.c_str(), port_, nullptr, 0)) {
+        LOG_EVERY_SEC(ERROR, 1) << "MySql connect error: " << mysql_error(sql_h);
+        mysql_close(sql_h);
+        return nullptr;
+    }
+    return sql_h;
+}
+
+void SqlConnPool::Disconnect_(MYSQL* conn) {
+    StmtMap stmts;
     {
         std::lock_guard<std::mutex> lk(mtx_);
-        sql_h = connQue_.front();
-        connQue_.pop();
+        auto it = stmtCache_.find(conn);
+        if (it != stmtCache_.end()) {
+            stmts.swap(it->second);
+            stmtCache_.erase(it);
+        }
+        --totalCount_;
     }
+    // 空出了一个名额, 等待中的线程可以新建连接
+    condFree_.notify_one();
+    // 语句句柄要先于连接关闭
+    stmts.clear();
+    mysql_close(conn);
+}
 
+MYSQL* SqlConnPool::GetConn(int timeoutMS) {
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::milliseconds(
+                                 timeoutMS < 0 ? acquireTimeoutMS_ : timeoutMS);
+    MYSQL* sql_h = nullptr;
+    int util = 0;
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        while (!sql_h) {
+            if (isClose_) {
+                return nullptr;
+            }
+            if (!idleQue_.empty()) {
+                sql_h = idleQue_.front().conn;
+                idleQue_.pop_front();
+                break;
+            }
+            if (totalCount_ < MAX_CONN_) {
+                // 先占住名额, 在锁外建立连接
+                ++totalCount_;
+                lk.unlock();
+                sql_h = Connect_();
+                lk.lock();
+                if (sql_h) {
+                    stmtCache_[sql_h];
+                    break;
+                }
+                --totalCount_;
+                return nullptr;
+            }
+            if (Clock::now() >= deadline) {
+                ++timeoutCount_;
+                LOG_EVERY_SEC(WARNING, 1) << "SqlConnPool busy!";
+                return nullptr;
+            }
+            condFree_.wait_until(lk, deadline);
+        }
+        ++useCount_;
+        util = useCount_ * 100 / MAX_CONN_;
+    }
+
+    waitHist_.Add(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+    utilHist_.Add(util);
     return sql_h;
 }
 
 void SqlConnPool::FreeConn(MYSQL* conn) {
     assert(conn);
+    bool closed;
     {
         std::lock_guard<std::mutex> lk(mtx_);
-        // 重新入队
-        connQue_.push(conn);
-        sem_post(&semId_); // semId_ + 1
+        --useCount_;
+        closed = isClose_;
+        if (!closed) {
+            // 放回表头, 最近用过的连接优先被取出
+            idleQue_.push_front({conn, Clock::now()});
+        }
+    }
+    if (closed) {
+        Disconnect_(conn);
+    }
+    else {
+        condFree_.notify_one();
     }
 }
 
+SqlStmt* SqlConnPool::GetStmt(MYSQL* conn, const std::string& sql) {
+    StmtMap* stmts = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto cache = stmtCache_.find(conn);
+        if (cache == stmtCache_.end()) {
+            return nullptr;
+        }
+        // unordered_map 的节点地址在 rehash 后不变
+        stmts = &cache->second;
+    }
+    std::unique_ptr<SqlStmt>& stmt = (*stmts)[sql];
+    if (!stmt) {
+        stmt.reset(new SqlStmt(conn, sql));
+    }
+    return stmt.get();
+}
+
 int SqlConnPool::GetFreeConnCount() {
     std::lock_guard<std::mutex> lk(mtx_);
-    return connQue_.size();
+    return idleQue_.size();
+}
+
+void SqlConnPool::HealthCheck_() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(mtx_);
+            condCheck_.wait_for(lk, checkInterval_, [this] { return isClose_; });
+            if (isClose_) {
+                break;
+            }
+        }
+        CheckOnce_();
+        CLOG(INFO) << "SqlConnPool " << Stats();
+    }
+}
+
+void SqlConnPool::CheckOnce_() {
+    std::vector<IdleConn> checking;
+    std::vector<MYSQL*> closing;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        // 只检查空闲超过一个检查周期的连接, 最近用过的连接显然是好的
+        Clock::time_point staleTime = Clock::now() - checkInterval_;
+        int remain = totalCount_;
+        while (!idleQue_.empty() && idleQue_.back().lastUsed <= staleTime) {
+            if (remain > minConn_) {
+                // 一直用不上的多余连接
+                closing.push_back(idleQue_.back().conn);
+                --remain;
+            }
+            else {
+                checking.push_back(idleQue_.back());
+            }
+            idleQue_.pop_back();
+        }
+    }
+
+    for (MYSQL* conn : closing) {
+        Disconnect_(conn);
+    }
+
+    for (const IdleConn& idle : checking) {
+        unsigned long threadId = mysql_thread_id(idle.conn);
+        if (mysql_ping(idle.conn) != 0) {
+            LOG_EVERY_SEC(WARNING, 1) << "MySql ping error: " << mysql_error(idle.conn);
+            Disconnect_(idle.conn);
+            continue;
+        }
+        bool closed;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            // ping 期间 ClosePool 已经取走了空闲队列: 不能再放回去, 否则这个连接不会被关闭
+            closed = isClose_;
+            if (!closed) {
+                if (mysql_thread_id(idle.conn) != threadId) {
+                    // ping 时自动重连了, 服务端的预编译语句已经失效
+                    ++reconnectCount_;
+                    for (auto& stmt : stmtCache_[idle.conn]) {
+                        stmt.second->Invalidate();
+                    }
+                }
+                // 保留原来的空闲时间, 下个周期继续保活
+                idleQue_.push_back(idle);
+            }
+        }
+        if (closed) {
+            Disconnect_(idle.conn);
+        }
+        else {
+            condFree_.notify_one();
+        }
+    }
+
+    // 补足最少连接数(例如数据库重启之后)
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (isClose_ || totalCount_ >= minConn_) {
+                break;
+            }
+            ++totalCount_;
+        }
+        MYSQL* sql_h = Connect_();
+        bool closed;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (!sql_h) {
+                --totalCount_;
+                break;
+            }
+            stmtCache_[sql_h];
+            // 连接期间关闭了连接池: 同上, 直接关闭
+            closed = isClose_;
+            if (!closed) {
+                idleQue_.push_back({sql_h, Clock::now()});
+            }
+        }
+        if (closed) {
+            Disconnect_(sql_h);
+            break;
+        }
+        condFree_.notify_one();
+    }
+}
+
+std::string SqlConnPool::Stats() {
+    std::ostringstream os;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        os << "total=" << totalCount_ << "/" << MAX_CONN_
+           << ", inUse=" << useCount_ << ", idle=" << idleQue_.size();
+    }
+    os << ", timeouts=" << timeoutCount_.load()
+       << ", reconnects=" << reconnectCount_.load()
+       << ", wait: " << waitHist_.ToString("us")
+       << ", util: " << utilHist_.ToString();
+    return os.str();
 }
 
 void SqlConnPool::ClosePool() {
-    std::lock_guard<std::mutex> lk(mtx_);
-    while (!connQue_.empty()) {
-        MYSQL* sql_h = connQue_.front();
-        connQue_.pop();
-        mysql_close(sql_h);
+    std::deque<IdleConn> idles;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        isClose_ = true;
+        idles.swap(idleQue_);
+    }
+    condFree_.notify_all();
+    condCheck_.notify_all();
+    if (checkThread_ && checkThread_->joinable()) {
+        checkThread_->join();
+    }
+    // 使用中的连接在 FreeConn 时关闭
+    for (const IdleConn& idle : idles) {
+        Disconnect_(idle.conn);
     }
-    mysql_library_end();
 }
 
 SqlConnPool::~SqlConnPool() {
     ClosePool();
-}
\ No newline at end of file
+    mysql_library_end();
+}
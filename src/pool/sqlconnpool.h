@@ -7,12 +7,20 @@
 #define SQLCONNPOOL_H
 
 #include <mysql/mysql.h>
-#include <queue>
+#include <deque>
+#include <string>
+#include <memory>
 #include <thread>
 #include <mutex>
-#include <semaphore.h>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <unordered_map>
 #include <assert.h>
-#include "../../lizy_log/include/logging.h"
+#include "../log/logsite.h"
+#include "sqlstmt.h"
+#include "histogram.h"
 
 class SqlConnPool {
 public:
@@ -25,13 +33,21 @@ public:
     }
 
     /// @brief 获得一个数据库连接句柄
-    /// @return 数据库连接句柄指针
-    MYSQL* GetConn();
+    /// 有空闲句柄直接返回; 没有且未达上限时新建; 否则等待直到超时
+    /// @param timeoutMS 最长等待时间(单位:ms), -1 表示使用 Init 时配置的默认值
+    /// @return 数据库连接句柄指针(超时或无法连接时返回 nullptr)
+    MYSQL* GetConn(int timeoutMS = -1);
 
     /// @brief 释放一个数据库连接句柄
     /// @param conn 要释放的句柄指针
     void FreeConn(MYSQL* conn);
 
+    /// @brief 获取连接句柄上缓存的预编译语句, 第一次使用时预编译
+    /// @param conn 已经从连接池取出的连接句柄(同一时刻只被一个线程持有)
+    /// @param sql 带 ? 占位符的 SQL 语句
+    /// @return 语句指针, 生命周期和连接句柄一致(失败返回 nullptr)
+    SqlStmt* GetStmt(MYSQL* conn, const std::string& sql);
+
     /// @brief 获得当前空闲的数据库连接句柄
     /// @return 空闲个数
     int GetFreeConnCount();
@@ -42,31 +58,79 @@ public:
     /// @param user 数据库用户名
     /// @param pwd  数据库用户对应的密码
     /// @param dbName 要连接的数据库名
-    /// @param connSize 连接数
+    /// @param connSize 最大连接数
+    /// @param minSize 最少保持的连接数(启动时建立, 其余按需建立)
+    /// @param acquireTimeoutMS GetConn 默认的最长等待时间(单位:ms)
+    /// @param checkIntervalSec 后台健康检查间隔(单位:s): ping 空闲连接, 关闭多余的空闲连接
     void Init(const char* host, int port, 
               const char* user, const char* pwd,
-              const char* dbName, int connSize = 10);
+              const char* dbName, int connSize = 10,
+              int minSize = 2, int acquireTimeoutMS = 1000,
+              int checkIntervalSec = 30);
 
     /// @brief 关闭数据库连接池
     void ClosePool();
 
+    /// @brief 统计信息: 连接数, 获取等待时间和利用率的直方图
+    std::string Stats();
+
 private:
     SqlConnPool();
     ~SqlConnPool();
 
+    typedef std::chrono::steady_clock Clock;
+
+    // 空闲的连接句柄
+    struct IdleConn {
+        MYSQL* conn;
+        Clock::time_point lastUsed;
+    };
+
+    /// @brief 建立一个新连接(不持锁调用)
+    /// @return 连接句柄(失败返回 nullptr)
+    MYSQL* Connect_();
+    /// @brief 关闭一个连接及其语句缓存(不持锁调用)
+    void Disconnect_(MYSQL* conn);
+    /// @brief 后台健康检查线程
+    void HealthCheck_();
+    /// @brief 取出空闲太久的连接, ping 检查, 断开多余/失效的连接, 补足最少连接数
+    void CheckOnce_();
+
 private:
+    std::string host_;
+    int port_;
+    std::string user_;
+    std::string pwd_;
+    std::string dbName_;
 
     int MAX_CONN_;
-    int useCount_;
-    int freeCount_;
+    int minConn_;
+    int acquireTimeoutMS_;
+    std::chrono::seconds checkInterval_;
+
+    int totalCount_;    // 已建立(含正在建立)的连接数
+    int useCount_;      // 被取出使用中的连接数
+    bool isClose_;
 
-    std::queue<MYSQL*> connQue_;
+    std::deque<IdleConn> idleQue_;   // 表头是最近归还的(LIFO, 让多余的连接自然空闲下来)
+
+    // 每个连接句柄各自的语句缓存: 外层的增删在 mtx_ 下进行,
+    // 内层只会被当前持有该句柄的线程访问, 所以不需要加锁
+    typedef std::unordered_map<std::string, std::unique_ptr<SqlStmt>> StmtMap;
+    std::unordered_map<MYSQL*, StmtMap> stmtCache_;
     std::mutex mtx_;
+    std::condition_variable condFree_;
+
+    std::unique_ptr<std::thread> checkThread_;
+    std::condition_variable condCheck_;
 
-    sem_t semId_;
+    Log2Histogram waitHist_;      // 获取连接的等待时间(us)
+    LinearHistogram utilHist_;    // 获取连接时的利用率(使用中 / 最大连接数)
+    std::atomic<uint64_t> timeoutCount_;
+    std::atomic<uint64_t> reconnectCount_;
 };
 
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,138 @@
+#include "sqliteuserstore.h"
+
+#include <thread>
+#include "../log/logsite.h"
+
+
+SqliteUserStore::SqliteUserStore(int connNum) : connNum_(connNum > 0 ? connNum : 1)
+{ }
+
+SqliteUserStore::~SqliteUserStore() {
+    Close_();
+}
+
+bool SqliteUserStore::Open(const std::string& path) {
+    Close_();
+    // 每个内存数据库连接都是独立的库, 只能共用一个连接
+    int connNum = (path == ":memory:") ? 1 : connNum_;
+    for (int i = 0; i < connNum; ++i) {
+        std::unique_ptr<Conn> conn(new Conn);
+        // 连接自己加锁, 不需要 SQLite 内部的互斥
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+        if (sqlite3_open_v2(path.c_str(), &conn->db, flags, nullptr) != SQLITE_OK) {
+            CLOG(ERROR) << "sqlite open error: " << sqlite3_errmsg(conn->db);
+            sqlite3_close(conn->db);
+            return false;
+        }
+        sqlite3_busy_timeout(conn->db, 5000);
+        const char* init = (i == 0) ?
+            "PRAGMA journal_mode=WAL;"
+            "PRAGMA synchronous=NORMAL;"
+            "CREATE TABLE IF NOT EXISTS user("
+            "    username TEXT PRIMARY KEY NOT NULL,"
+            "    password TEXT NOT NULL"
+            ");" :
+            "PRAGMA synchronous=NORMAL;";
+        char* err = nullptr;
+        if (sqlite3_exec(conn->db, init, nullptr, nullptr, &err) != SQLITE_OK ||
+            sqlite3_prepare_v2(conn->db, "SELECT password FROM user WHERE username = ?",
+                               -1, &conn->select, nullptr) != SQLITE_OK ||
+            sqlite3_prepare_v2(conn->db, "INSERT INTO user(username, password) VALUES(?, ?)",
+                               -1, &conn->insert, nullptr) != SQLITE_OK) {
+            CLOG(ERROR) << "sqlite init error: " << (err ? err : sqlite3_errmsg(conn->db));
+            sqlite3_free(err);
+            sqlite3_finalize(conn->select);
+            sqlite3_finalize(conn->insert);
+            sqlite3_close(conn->db);
+            return false;
+        }
+        conns_.push_back(std::move(conn));
+    }
+    return true;
+}
+
+void SqliteUserStore::Close_() {
+    for (auto& conn : conns_) {
+        std::lock_guard<std::mutex> lk(conn->mtx);
+        sqlite3_finalize(conn->select);
+        sqlite3_finalize(conn->insert);
+        sqlite3_close(conn->db);
+    }
+    conns_.clear();
+}
+
+SqliteUserStore::Conn& SqliteUserStore::Pick_() {
+    return *conns_[std::hash<std::thread::id>()(std::this_thread::get_id()) % conns_.size()];
+}
+
+UserStore::Status SqliteUserStore::Find_(const std::string& name, std::string* pwd) {
+    if (conns_.empty()) {
+        return STORE_ERROR;
+    }
+    Conn& conn = Pick_();
+    std::lock_guard<std::mutex> lk(conn.mtx);
+    sqlite3_bind_text(conn.select, 1, name.data(), name.size(), SQLITE_STATIC);
+    Status status;
+    int rc = sqlite3_step(conn.select);
+    if (rc == SQLITE_ROW) {
+        if (pwd) {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(conn.select, 0));
+            pwd->assign(text ? text : "", sqlite3_column_bytes(conn.select, 0));
+        }
+        status = OK;
+    }
+    else if (rc == SQLITE_DONE) {
+        status = NOT_FOUND;
+    }
+    else {
+        LOG_EVERY_SEC(WARNING, 1) << "sqlite select error: " << sqlite3_errmsg(conn.db);
+        status = STORE_ERROR;
+    }
+    sqlite3_reset(conn.select);
+    sqlite3_clear_bindings(conn.select);
+    return status;
+}
+
+UserStore::Status SqliteUserStore::Insert_(const std::string& name, const std::string& pwd) {
+    if (conns_.empty()) {
+        return STORE_ERROR;
+    }
+    Conn& conn = Pick_();
+    std::lock_guard<std::mutex> lk(conn.mtx);
+    sqlite3_bind_text(conn.insert, 1, name.data(), name.size(), SQLITE_STATIC);
+    sqlite3_bind_text(conn.insert, 2, pwd.data(), pwd.size(), SQLITE_STATIC);
+    Status status;
+    int rc = sqlite3_step(conn.insert);
+    if (rc == SQLITE_DONE) {
+        status = OK;
+    }
+    else if ((rc & 0xff) == SQLITE_CONSTRAINT) {
+        status = DUPLICATE;
+    }
+    else {
+        LOG_EVERY_SEC(WARNING, 1) << "sqlite insert error: " << sqlite3_errmsg(conn.db);
+        status = STORE_ERROR;
+    }
+    sqlite3_reset(conn.insert);
+    sqlite3_clear_bindings(conn.insert);
+    return status;
+}
+
+bool SqliteUserStore::ForEachName(const std::function<void(const std::string&)>& fn) {
+    if (conns_.empty()) {
+        return false;
+    }
+    Conn& conn = Pick_();
+    std::lock_guard<std::mutex> lk(conn.mtx);
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(conn.db, "SELECT username FROM user", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        fn(std::string(text ? text : "", sqlite3_column_bytes(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
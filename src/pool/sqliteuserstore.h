@@ -0,0 +1,55 @@
+/*
+    SQLite 用户存储
+
+    打开多个连接(WAL 模式下读互不阻塞), 每个连接一把锁, 按线程选择连接;
+    每个连接上的查询/插入语句只预编译一次. 写冲突由 busy_timeout 等待.
+*/
+
+#ifndef SQLITE_USER_STORE_H
+#define SQLITE_USER_STORE_H
+
+#include <sqlite3.h>
+#include <mutex>
+#include <vector>
+#include "userstore.h"
+
+class SqliteUserStore : public UserStore {
+public:
+    /// @param connNum 连接数(内存数据库只能用 1 个)
+    explicit SqliteUserStore(int connNum = 4);
+    ~SqliteUserStore();
+
+    /// @brief 打开数据库文件, 不存在时创建 user 表
+    /// @param path 数据库文件路径, ":memory:" 表示内存数据库
+    /// @return 是否成功
+    bool Open(const std::string& path);
+
+    bool ForEachName(const std::function<void(const std::string&)>& fn) override;
+    const char* Name() const override {
+        return "sqlite";
+    }
+
+protected:
+    Status Find_(const std::string& name, std::string* pwd) override;
+    Status Insert_(const std::string& name, const std::string& pwd) override;
+
+private:
+    struct Conn {
+        std::mutex mtx;
+        sqlite3* db = nullptr;
+        sqlite3_stmt* select = nullptr;
+        sqlite3_stmt* insert = nullptr;
+    };
+
+    /// @brief 当前线程使用的连接
+    Conn& Pick_();
+    /// @brief 关闭所有连接
+    void Close_();
+
+private:
+    int connNum_;
+    std::vector<std::unique_ptr<Conn>> conns_;
+};
+
+
+#endif
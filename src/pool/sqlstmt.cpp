@@ -0,0 +1,159 @@
+#include "sqlstmt.h"
+
+#include <cstring>
+#include <assert.h>
+#include <mysql/errmsg.h>       // CR_* 客户端错误码(IsConnLost_ 用到)
+#include <mysql/mysqld_error.h> // ER_* 服务器错误码(IsConnLost_ 用到)
+#include "../log/logsite.h"
+
+
+SqlStmt::SqlStmt(MYSQL* conn, const std::string& sql) : conn_(conn), sql_(sql), stmt_(nullptr),
+                                                         errno_(0), hasResult_(false)
+{
+    Prepare_();
+}
+
+SqlStmt::~SqlStmt() {
+    Invalidate();
+}
+
+void SqlStmt::Invalidate() {
+    if (stmt_) {
+        FreeResult();
+        mysql_stmt_close(stmt_);
+        stmt_ = nullptr;
+    }
+}
+
+bool SqlStmt::Prepare_() {
+    if (!conn_) {
+        return false;
+    }
+    stmt_ = mysql_stmt_init(conn_);
+    if (!stmt_) {
+        errno_ = mysql_errno(conn_);
+        return false;
+    }
+    if (mysql_stmt_prepare(stmt_, sql_.c_str(), sql_.size()) != 0) {
+        errno_ = mysql_stmt_errno(stmt_);
+        LOG_EVERY_SEC(ERROR, 1) << "Prepare \"" << sql_ << "\" error: " << mysql_stmt_error(stmt_);
+        mysql_stmt_close(stmt_);
+        stmt_ = nullptr;
+        return false;
+    }
+
+    paramBind_.assign(mysql_stmt_param_count(stmt_), MYSQL_BIND());
+    paramLen_.assign(paramBind_.size(), 0);
+
+    // 结果列统一按字符串取回
+    unsigned int fieldCount = mysql_stmt_field_count(stmt_);
+    resultBind_.assign(fieldCount, MYSQL_BIND());
+    resultBuff_.assign(fieldCount, std::vector<char>(COLUMN_BUFF_LEN));
+    resultLen_.assign(fieldCount, 0);
+    resultNull_.reset(new NullFlag[fieldCount]());
+    for (unsigned int i = 0; i < fieldCount; ++i) {
+        memset(&resultBind_[i], 0, sizeof(MYSQL_BIND));
+        resultBind_[i].buffer_type = MYSQL_TYPE_STRING;
+        resultBind_[i].buffer = resultBuff_[i].data();
+        resultBind_[i].buffer_length = resultBuff_[i].size();
+        resultBind_[i].length = &resultLen_[i];
+        resultBind_[i].is_null = &resultNull_[i];
+    }
+    errno_ = 0;
+    return true;
+}
+
+bool SqlStmt::IsConnLost_(unsigned int err) {
+    return err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST ||
+           err == CR_STMT_CLOSED || err == ER_UNKNOWN_STMT_HANDLER ||
+           err == ER_NEED_REPREPARE;
+}
+
+bool SqlStmt::Execute(const std::vector<std::string>& params) {
+    FreeResult();
+    if ((stmt_ || Prepare_()) && ExecuteOnce_(params)) {
+        return true;
+    }
+    if (!IsConnLost_(errno_)) {
+        return false;
+    }
+    // 连接断开过(或已被自动重连), 旧的语句句柄作废: 重连 -> 重新预编译 -> 重试一次
+    Invalidate();
+    mysql_ping(conn_);
+    return Prepare_() && ExecuteOnce_(params);
+}
+
+bool SqlStmt::ExecuteOnce_(const std::vector<std::string>& params) {
+    assert(params.size() == paramBind_.size());
+    for (size_t i = 0; i < paramBind_.size(); ++i) {
+        memset(&paramBind_[i], 0, sizeof(MYSQL_BIND));
+        paramLen_[i] = params[i].size();
+        paramBind_[i].buffer_type = MYSQL_TYPE_STRING;
+        paramBind_[i].buffer = const_cast<char*>(params[i].data());
+        paramBind_[i].buffer_length = params[i].size();
+        paramBind_[i].length = &paramLen_[i];
+    }
+
+    if ((!paramBind_.empty() && mysql_stmt_bind_param(stmt_, paramBind_.data()) != 0) ||
+        mysql_stmt_execute(stmt_) != 0) {
+        errno_ = mysql_stmt_errno(stmt_);
+        return false;
+    }
+
+    if (!resultBind_.empty()) {
+        // 把结果集一次性取到客户端, 尽快释放服务端资源
+        if (mysql_stmt_bind_result(stmt_, resultBind_.data()) != 0 ||
+            mysql_stmt_store_result(stmt_) != 0) {
+            errno_ = mysql_stmt_errno(stmt_);
+            return false;
+        }
+        hasResult_ = true;
+    }
+    errno_ = 0;
+    return true;
+}
+
+bool SqlStmt::FetchRow(std::vector<std::string>* row) {
+    assert(row);
+    if (!hasResult_) {
+        return false;
+    }
+    int ret = mysql_stmt_fetch(stmt_);
+    if (ret == 1 || ret == MYSQL_NO_DATA) {
+        return false;
+    }
+
+    row->resize(resultBind_.size());
+    for (size_t i = 0; i < resultBind_.size(); ++i) {
+        if (resultNull_[i]) {
+            (*row)[i].clear();
+            continue;
+        }
+        if (resultLen_[i] > resultBuff_[i].size()) {
+            // 列被截断: 按实际长度单独取这一列
+            std::string& col = (*row)[i];
+            col.assign(resultLen_[i], '\0');
+            MYSQL_BIND bind;
+            memset(&bind, 0, sizeof(bind));
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = &col[0];
+            bind.buffer_length = col.size();
+            mysql_stmt_fetch_column(stmt_, &bind, i, 0);
+        }
+        else {
+            (*row)[i].assign(resultBuff_[i].data(), resultLen_[i]);
+        }
+    }
+    return true;
+}
+
+void SqlStmt::FreeResult() {
+    if (hasResult_) {
+        mysql_stmt_free_result(stmt_);
+        hasResult_ = false;
+    }
+}
+
+my_ulonglong SqlStmt::AffectedRows() {
+    return stmt_ ? mysql_stmt_affected_rows(stmt_) : 0;
+}
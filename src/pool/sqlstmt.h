@@ -0,0 +1,92 @@
+/*
+    预编译语句(prepared statement)的封装
+
+    每个连接句柄上的同一条 SQL 只在服务端解析一次, 之后每次执行只传参数;
+    参数按二进制协议绑定, 不再拼接字符串, 也就没有注入问题.
+    连接断开重连后语句句柄会失效, Execute 会自动重新预编译并重试一次.
+*/
+
+#ifndef SQLSTMT_H
+#define SQLSTMT_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <type_traits>
+
+class SqlStmt {
+public:
+    /// @brief 构造函数(立即预编译)
+    /// @param conn 所属的数据库连接句柄
+    /// @param sql 带 ? 占位符的 SQL 语句
+    SqlStmt(MYSQL* conn, const std::string& sql);
+    ~SqlStmt();
+
+    SqlStmt(const SqlStmt&) = delete;
+    SqlStmt& operator=(const SqlStmt&) = delete;
+
+    /// @brief 语句是否预编译成功
+    bool IsValid() const {
+        return stmt_ != nullptr;
+    }
+
+    /// @brief 绑定参数并执行, 结果集缓存在客户端
+    /// @param params 参数(都按字符串绑定, 个数要和 ? 一致)
+    /// @return true-成功, false-失败(可用 Errno() 查看错误码)
+    bool Execute(const std::vector<std::string>& params);
+
+    /// @brief 取下一行结果
+    /// @param row 该行各列的值(NULL 列为空串)
+    /// @return true-取到一行, false-没有更多数据
+    bool FetchRow(std::vector<std::string>* row);
+
+    /// @brief 释放当前结果集
+    void FreeResult();
+
+    /// @brief 上一次执行影响的行数
+    my_ulonglong AffectedRows();
+
+    /// @brief 最近一次错误码
+    unsigned int Errno() const {
+        return errno_;
+    }
+
+    /// @brief 关闭语句句柄(连接重连后调用, 下次执行时重新预编译)
+    void Invalidate();
+
+private:
+    /// @brief 在服务端预编译语句, 并准备结果集的绑定缓冲
+    /// @return 是否成功
+    bool Prepare_();
+    /// @brief 绑定参数并执行一次
+    /// @return 是否成功
+    bool ExecuteOnce_(const std::vector<std::string>& params);
+    /// @brief 错误码是否表示连接已断开或语句句柄已失效
+    static bool IsConnLost_(unsigned int err);
+
+private:
+    // 结果列的初始缓冲大小, 被截断时按实际长度重新取
+    static const unsigned long COLUMN_BUFF_LEN = 64;
+
+    MYSQL* conn_;
+    std::string sql_;
+    MYSQL_STMT* stmt_;
+    unsigned int errno_;
+    bool hasResult_;
+
+    // 参数绑定
+    std::vector<MYSQL_BIND> paramBind_;
+    std::vector<unsigned long> paramLen_;
+
+    // 结果绑定
+    std::vector<MYSQL_BIND> resultBind_;
+    std::vector<std::vector<char>> resultBuff_;
+    std::vector<unsigned long> resultLen_;
+    // MySQL 8 中是 bool, MariaDB 中是 my_bool (不能用 vector<bool>, 需要取元素地址)
+    typedef std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type NullFlag;
+    std::unique_ptr<NullFlag[]> resultNull_;
+};
+
+
+#endif
@@ -0,0 +1,114 @@
+#include "userbloom.h"
+
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <assert.h>
+#include "userstore.h"
+#include "../log/logsite.h"
+
+
+UserBloom::UserBloom() : enabled_(false), bitNum_(0), hashNum_(0),
+                         itemNum_(0), definitelyNew_(0), falsePositive_(0)
+{ }
+
+void UserBloom::Init(size_t expectedNum, double fpRate) {
+    assert(expectedNum > 0 && fpRate > 0 && fpRate < 1);
+    enabled_ = false;
+    // m = -n * ln(p) / (ln2)^2, k = m / n * ln2
+    double ln2 = std::log(2.0);
+    size_t bits = static_cast<size_t>(std::ceil(-static_cast<double>(expectedNum) * std::log(fpRate) / (ln2 * ln2)));
+    bitNum_ = (bits + 63) / 64 * 64;
+    hashNum_ = std::max(1, static_cast<int>(std::round(static_cast<double>(bitNum_) / expectedNum * ln2)));
+    bits_.reset(new std::atomic<uint64_t>[bitNum_ / 64]);
+    for (size_t i = 0; i < bitNum_ / 64; ++i) {
+        bits_[i].store(0, std::memory_order_relaxed);
+    }
+    itemNum_ = 0;
+    definitelyNew_ = 0;
+    falsePositive_ = 0;
+}
+
+bool UserBloom::LoadFromStore() {
+    UserStore* store = UserStore::GetInstance();
+    if (!bits_ || !store) {
+        return false;
+    }
+    if (!store->ForEachName([this](const std::string& name) { Add(name); })) {
+        CLOG(WARNING) << "UserBloom load error, registration always queries the user store";
+        return false;
+    }
+    enabled_ = true;
+    CLOG(INFO) << "UserBloom loaded: " << Report();
+    return true;
+}
+
+void UserBloom::Hash_(const std::string& name, uint64_t* h1, uint64_t* h2) {
+    // FNV-1a 64 + splitmix64 混合
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char ch : name) {
+        h ^= ch;
+        h *= 0x100000001b3ULL;
+    }
+    h += 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    *h1 = h;
+    *h2 = ((h >> 32) | (h << 32)) | 1; // 奇数步长
+}
+
+bool UserBloom::MayExist(const std::string& name) {
+    if (!enabled_.load(std::memory_order_acquire)) {
+        return true;
+    }
+    uint64_t h1, h2;
+    Hash_(name, &h1, &h2);
+    for (int i = 0; i < hashNum_; ++i) {
+        size_t bit = (h1 + i * h2) % bitNum_;
+        if (!(bits_[bit / 64].load(std::memory_order_relaxed) & (1ULL << (bit % 64)))) {
+            definitelyNew_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    return true;
+}
+
+void UserBloom::Add(const std::string& name) {
+    if (!bits_) {
+        return;
+    }
+    uint64_t h1, h2;
+    Hash_(name, &h1, &h2);
+    for (int i = 0; i < hashNum_; ++i) {
+        size_t bit = (h1 + i * h2) % bitNum_;
+        bits_[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+    }
+    itemNum_.fetch_add(1, std::memory_order_relaxed);
+}
+
+double UserBloom::MeasuredFpRate() const {
+    size_t fp = falsePositive_.load(std::memory_order_relaxed);
+    size_t negative = fp + definitelyNew_.load(std::memory_order_relaxed);
+    return negative ? static_cast<double>(fp) / negative : 0.0;
+}
+
+double UserBloom::EstimatedFpRate() const {
+    if (bitNum_ == 0) {
+        return 1.0;
+    }
+    // (1 - e^(-kn/m))^k
+    double n = static_cast<double>(itemNum_.load(std::memory_order_relaxed));
+    return std::pow(1.0 - std::exp(-hashNum_ * n / bitNum_), hashNum_);
+}
+
+std::string UserBloom::Report() const {
+    std::ostringstream os;
+    os << "bits=" << bitNum_ << ", hashes=" << hashNum_
+       << ", items=" << itemNum_.load(std::memory_order_relaxed)
+       << ", skipped=" << definitelyNew_.load(std::memory_order_relaxed)
+       << ", falsePositive=" << falsePositive_.load(std::memory_order_relaxed)
+       << ", measuredFp=" << MeasuredFpRate()
+       << ", estimatedFp=" << EstimatedFpRate();
+    return os.str();
+}
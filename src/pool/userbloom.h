@@ -0,0 +1,79 @@
+/*
+    用户名布隆过滤器
+
+    启动时从用户存储加载所有用户名, 注册成功后追加.
+    MayExist 返回 false 时用户名一定不存在, 注册时可以跳过查询直接插入
+    (唯一索引依然兜底); 返回 true 时才需要查询用户存储.
+    位数组用原子操作更新, 查询和插入都不加锁.
+*/
+
+#ifndef USER_BLOOM_H
+#define USER_BLOOM_H
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+class UserBloom {
+public:
+    // 单例模式
+    /// @brief 获取单例指针
+    /// @return UserBloom指针
+    static UserBloom* GetInstance() {
+        static UserBloom inst;
+        return &inst;
+    }
+
+    /// @brief 初始化位数组
+    /// @param expectedNum 预计的用户数
+    /// @param fpRate 期望的误判率
+    void Init(size_t expectedNum, double fpRate = 0.01);
+
+    /// @brief 从用户存储加载所有用户名(需要先初始化 UserStore)
+    /// @return 加载成功返回 true; 失败时过滤器保持关闭, MayExist 总是返回 true
+    bool LoadFromStore();
+
+    /// @brief 用户名是否可能已存在
+    /// @param name 用户名
+    /// @return false-一定不存在, true-可能存在
+    bool MayExist(const std::string& name);
+
+    /// @brief 加入一个用户名
+    /// @param name 用户名
+    void Add(const std::string& name);
+
+    /// @brief 记录一次误判(MayExist 为 true 但数据库中不存在)
+    void RecordFalsePositive() {
+        falsePositive_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief 实测误判率 = 误判次数 / 实际不存在的查询次数
+    double MeasuredFpRate() const;
+
+    /// @brief 根据当前元素个数估算的理论误判率
+    double EstimatedFpRate() const;
+
+    /// @brief 统计信息(用于日志)
+    std::string Report() const;
+
+private:
+    UserBloom();
+    ~UserBloom() = default;
+
+    /// @brief 计算两个基础哈希值(双重哈希生成 k 个位置)
+    static void Hash_(const std::string& name, uint64_t* h1, uint64_t* h2);
+
+private:
+    std::atomic<bool> enabled_;
+    size_t bitNum_;
+    int hashNum_;
+    std::unique_ptr<std::atomic<uint64_t>[]> bits_;
+
+    std::atomic<size_t> itemNum_;
+    std::atomic<size_t> definitelyNew_;  // MayExist 返回 false 的次数
+    std::atomic<size_t> falsePositive_;
+};
+
+
+#endif
@@ -0,0 +1,78 @@
+#include "userstore.h"
+
+#include <chrono>
+#ifdef USE_MYSQL
+#include "mysqluserstore.h"
+#endif
+#include "sqliteuserstore.h"
+#include "memuserstore.h"
+#include "../log/logsite.h"
+
+
+std::unique_ptr<UserStore> UserStore::inst_;
+
+bool UserStore::Init(Backend backend, const char* path) {
+    switch (backend) {
+    case MYSQL:
+#ifdef USE_MYSQL
+        inst_.reset(new MysqlUserStore());
+        break;
+#else
+        CLOG(ERROR) << "UserStore: built without MySQL support (cmake -DWITH_MYSQL=ON)";
+        inst_.reset();
+        return false;
+#endif
+    case SQLITE: {
+        std::unique_ptr<SqliteUserStore> store(new SqliteUserStore());
+        if (!store->Open(path ? path : ":memory:")) {
+            CLOG(ERROR) << "UserStore: open sqlite \"" << (path ? path : ":memory:") << "\" error";
+            inst_.reset();
+            return false;
+        }
+        inst_ = std::move(store);
+        break;
+    }
+    case MEMORY:
+        inst_.reset(new MemUserStore());
+        break;
+    default:
+        inst_.reset();
+        return false;
+    }
+    CLOG(INFO) << "UserStore backend: " << inst_->Name();
+    return true;
+}
+
+UserStore* UserStore::GetInstance() {
+    return inst_.get();
+}
+
+void UserStore::Close() {
+    inst_.reset();
+}
+
+namespace {
+
+uint64_t ElapsedUs(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+}
+
+UserStore::Status UserStore::Find(const std::string& name, std::string* pwd) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Status status = Find_(name, pwd);
+    findUs_.Add(ElapsedUs(begin));
+    return status;
+}
+
+UserStore::Status UserStore::Insert(const std::string& name, const std::string& pwd) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Status status = Insert_(name, pwd);
+    insertUs_.Add(ElapsedUs(begin));
+    return status;
+}
+
+std::string UserStore::Stats() const {
+    return std::string(Name()) + " find: " + findUs_.ToString("us") + "| insert: " + insertUs_.ToString("us");
+}
@@ -0,0 +1,88 @@
+/*
+    用户存储接口
+
+    登陆/注册只依赖这个接口, 后端可以是:
+        MYSQL  - 数据库连接池(注册走组提交)
+        SQLITE - 嵌入式 SQLite 数据库文件, 不需要单独的数据库服务
+        MEMORY - 进程内分段加锁的哈希表, 重启后数据丢失
+    后两者用于单机压测和对比各个后端的延迟.
+*/
+
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <string>
+#include <memory>
+#include <functional>
+#include "histogram.h"
+
+class UserStore {
+public:
+    // 后端类型
+    enum Backend {
+        MYSQL = 0,
+        SQLITE,
+        MEMORY,
+    };
+
+    // 操作结果
+    enum Status {
+        OK = 0,         // 查询到 / 插入成功
+        NOT_FOUND,      // 用户不存在
+        DUPLICATE,      // 用户名已存在
+        STORE_ERROR,    // 后端错误
+    };
+
+    /// @brief 创建并切换到指定的后端(在服务线程启动前调用)
+    /// MYSQL 后端需要先初始化 SqlConnPool, 且只有定义了 USE_MYSQL(cmake -DWITH_MYSQL=ON)时可用
+    /// @param backend 后端类型
+    /// @param path SQLITE 后端的数据库文件(":memory:" 表示内存数据库), 其他后端忽略
+    /// @return 是否成功
+    static bool Init(Backend backend, const char* path = nullptr);
+
+    /// @brief 获取当前使用的后端
+    /// @return UserStore指针(未初始化时为 nullptr)
+    static UserStore* GetInstance();
+
+    /// @brief 关闭当前后端
+    static void Close();
+
+    virtual ~UserStore() = default;
+
+    /// @brief 查询用户的密码(记录耗时)
+    /// @param name 用户名
+    /// @param pwd 查询到的密码
+    /// @return OK / NOT_FOUND / STORE_ERROR
+    Status Find(const std::string& name, std::string* pwd);
+
+    /// @brief 插入新用户(记录耗时)
+    /// @param name 用户名
+    /// @param pwd 密码
+    /// @return OK / DUPLICATE / STORE_ERROR
+    Status Insert(const std::string& name, const std::string& pwd);
+
+    /// @brief 遍历所有用户名(用于启动时加载布隆过滤器)
+    /// @param fn 对每个用户名调用
+    /// @return 是否成功
+    virtual bool ForEachName(const std::function<void(const std::string&)>& fn) = 0;
+
+    /// @brief 后端名称(用于日志)
+    virtual const char* Name() const = 0;
+
+    /// @brief 查询/插入的耗时分布(用于对比各个后端的延迟)
+    std::string Stats() const;
+
+protected:
+    /// @brief 各后端的查询/插入实现, 含义同 Find / Insert
+    virtual Status Find_(const std::string& name, std::string* pwd) = 0;
+    virtual Status Insert_(const std::string& name, const std::string& pwd) = 0;
+
+private:
+    static std::unique_ptr<UserStore> inst_;
+
+    Log2Histogram findUs_;      // 查询耗时(单位:us)
+    Log2Histogram insertUs_;    // 插入耗时(单位:us)
+};
+
+
+#endif
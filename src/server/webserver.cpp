@@ -1,53 +1,121 @@
 #include "webserver.h"
 #include "../pool/ThreadPool.hpp"
 
+const char* WebServer::SESSION_TIMER_KEY = "session-sweep";
+
 WebServer::WebServer(int port, int trigMode, int timeoutMS, bool OpenLinger,
               int sqlPort, const char* sqlUser, const char* sqlPwd,
               const char* dbName, int sqlPoolNum, int threadNum,
-              int MaxEvent) :
+              int MaxEvent, int userStore, const char* userStorePath,
+              const char* resourcePack) :
               port_(port), openLinger_(OpenLinger), timeoutMS_(timeoutMS), isClose_(false),
-              timeWheel_(new TimeWheel()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller(MaxEvent))
+              timeWheel_(new TimeWheel()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller(MaxEvent)),
+              sqlExecutor_(new ThreadPool(sqlPoolNum))
 {
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
     strncat(srcDir_, "/../resources/", 16);
 
     HttpConn::srcDir = srcDir_;
+    HttpRequest::maxBodyBytes = MAX_BODY_BYTES;
+    if (resourcePack) {
+        // 直接从资源包的映射发送静态文件, 包不存在时先打包
+        if (!ResourcePack::GetInstance()->Open(resourcePack) &&
+            !(ResourcePack::Build(srcDir_, resourcePack, true) && ResourcePack::GetInstance()->Open(resourcePack))) {
+            isClose_ = true;
+        }
+    }
+    else {
+        // 资源目录的内存快照, 文件变化由 inotify 实时刷新
+        ResourceCache::GetInstance()->Init(srcDir_, RESOURCE_CACHE_MAX_FILE);
+    }
     HttpConn::userCount = 0;
-    SqlConnPool::GetInstance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, sqlPoolNum);
+#ifdef USE_MYSQL
+    if (userStore == UserStore::MYSQL) {
+        SqlConnPool::GetInstance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, sqlPoolNum);
+        // 注册的 INSERT 合并成批次提交
+        RegisterBatcher::GetInstance()->Init(REGISTER_BATCH_MAX, REGISTER_BATCH_WINDOW_US);
+    }
+#else
+    // 没有编译 MySQL 后端: 数据库的连接参数用不上
+    (void)sqlPort;
+    (void)sqlUser;
+    (void)sqlPwd;
+    (void)dbName;
+#endif
+    if (!UserStore::Init(static_cast<UserStore::Backend>(userStore), userStorePath)) {
+        isClose_ = true;
+    }
+    // 注册时用来跳过"用户名是否存在"查询的布隆过滤器
+    UserBloom::GetInstance()->Init(USER_BLOOM_EXPECTED);
+    UserBloom::GetInstance()->LoadFromStore();
 
     InitEventMode_(trigMode);
-    if (!InitSocket_()) {
+    InitRoutes_();
+    // 广播等其他线程往空闲的推送连接(WebSocket / 事件流)发消息时, 重新注册它的事件
+    PushStream::waker = [this](int fd, bool write) {
+        epoller_->ModFd(fd, connEvent_ | EPOLLIN | (write ? static_cast<uint32_t>(EPOLLOUT) : 0u));
+    };
+    // 转发结束(或放弃)的上游连接从 epoll 中删除, 之后放回工作线程的空闲池或关闭
+    ProxyExchange::unwatch = [this](int fd) {
+        epoller_->DelFd(fd);
+        std::lock_guard<std::mutex> lk(users_lock_);
+        upstreams_.erase(fd);
+    };
+    if (!isClose_ && !InitSocket_()) {
         isClose_ = true;
     }
     if (isClose_) {
-        LOG(INFO) << "========================= Server init error! =======================";
+        CLOG(INFO) << "========================= Server init error! =======================";
     }
     else {
-        LOG(INFO) << "========================= Server init! =============================";
-        LOG(INFO) << "Port: " << port_ << ", OpenLinger: " << (openLinger_ ? "true" : "false");
-        LOG(INFO) << "Listen Mode: "<< (listenEvent_ & EPOLLET ? "ET" : "LT") 
+        CLOG(INFO) << "========================= Server init! =============================";
+        CLOG(INFO) << "Port: " << port_ << ", OpenLinger: " << (openLinger_ ? "true" : "false");
+        CLOG(INFO) << "Listen Mode: "<< (listenEvent_ & EPOLLET ? "ET" : "LT") 
                   << ", OpenConn Mode: " << (connEvent_ & EPOLLET ? "ET" : "LT");
-        LOG(INFO) << "srcDir: " << HttpConn::srcDir;
-        LOG(INFO) << "SqlConnPool num: " << sqlPoolNum << ", ThreadPool num: " <<  threadNum;
+        CLOG(INFO) << "srcDir: " << HttpConn::srcDir << ", resourcePack: " << (resourcePack ? resourcePack : "none");
+        CLOG(INFO) << "SqlConnPool num: " << sqlPoolNum << ", ThreadPool num: " <<  threadNum
+                   << ", SqlExecutor num: " << sqlPoolNum;
     }
 }
 
 WebServer::~WebServer() {
+    CLOG(INFO) << "UserBloom: " << UserBloom::GetInstance()->Report();
+#ifdef USE_MYSQL
+    CLOG(INFO) << "SqlConnPool: " << SqlConnPool::GetInstance()->Stats();
+#endif
+    if (UserStore::GetInstance()) {
+        CLOG(INFO) << "UserStore: " << UserStore::GetInstance()->Stats();
+    }
+    CLOG(INFO) << "RateLimiter: " << RateLimiter::GetInstance()->Stats();
+    if (TlsContext::GetInstance()->Enabled()) {
+        CLOG(INFO) << "TLS: " << TlsContext::GetInstance()->Stats();
+    }
     close(listenFd_);
     isClose_ = true;
     free(srcDir_);
+#ifdef USE_MYSQL
+    RegisterBatcher::GetInstance()->Close();
+#endif
+    UserStore::Close();
+#ifdef USE_MYSQL
     SqlConnPool::GetInstance()->ClosePool();
+#endif
     timeWheel_->Close();
+    PushStream::waker = nullptr;
+    ProxyExchange::unwatch = nullptr;
+    ResourceCache::GetInstance()->Close();
+    ResourcePack::GetInstance()->Close();
 }
 
 
 void WebServer::Start() {
     int timeMS = -1; // epoll_wait timeout == -1 表示没有事件发生就阻塞
     if (!isClose_) {
-        LOG(INFO) << "========================= Server Start! =======================";
+        CLOG(INFO) << "========================= Server Start! =======================";
         // 开启定时器
         timeWheel_->Run();
+        timeWheel_->Addtask(SESSION_TIMER_KEY, SESSION_SWEEP_MS, &WebServer::OnSessionTimer_, this);
     }
     while (!isClose_) {
         int eventCnt = epoller_->Wait(timeMS); // 阻塞等待下一个事件发生
@@ -58,10 +126,17 @@ void WebServer::Start() {
             if (fd == listenFd_) {
                 DealListen_();
             }
+            else if (connPtr client = FindUpstream_(fd)) {
+                // 上游 socket 的可读/可写/出错都交给转发处理
+                DealProxy_(client);
+            }
             else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 assert(users_.count(fd) > 0);
                 timeWheel_->RemoveTask(users_[fd]->GetTimeOutKey());
-                CloseConn_(users_[fd]);
+                // 推送连接可能正在被工作线程处理: 关闭推迟到处理结束
+                if (users_[fd]->RequestClose()) {
+                    CloseConn_(users_[fd]);
+                }
             }
             else if (events & EPOLLIN) {
                 assert(users_.count(fd) > 0);
@@ -72,7 +147,7 @@ void WebServer::Start() {
                 DealWrite_(users_[fd]);
             }
             else {
-                LOG(ERROR) << "Unexpected event";
+                CLOG(ERROR) << "Unexpected event";
             }
         }
     }
@@ -84,7 +159,7 @@ bool WebServer::InitSocket_() {
     int ret;
     struct sockaddr_in addr;
     if (port_ > 65535 || port_ < 1024) {
-        LOG(ERROR) << "Port: " << port_ << " error!";
+        CLOG(ERROR) << "Port: " << port_ << " error!";
         return false;
     }
 
@@ -103,14 +178,14 @@ bool WebServer::InitSocket_() {
 
     listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
     if (listenFd_ < 0) {
-        LOG(ERROR) << "Create socket error!";
+        CLOG(ERROR) << "Create socket error!";
         return false;
     }
 
     ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
     if (ret < 0) {
         close(listenFd_);
-        LOG(ERROR) << "Init linget error!";
+        CLOG(ERROR) << "Init linget error!";
         return false;
     }
 
@@ -120,28 +195,28 @@ bool WebServer::InitSocket_() {
     ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
     if (ret < 0) {
         close(listenFd_);
-        LOG(ERROR) << "Set socket setsocketopt error!";
+        CLOG(ERROR) << "Set socket setsocketopt error!";
         return false;
     }
 
     ret = bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr));
     if (ret < 0) {
         close(listenFd_);
-        LOG(ERROR) << "Bind error!";
+        CLOG(ERROR) << "Bind error!";
         return false;
     }
 
     ret = listen(listenFd_, 6);
     if (ret < 0) {
         close(listenFd_);
-        LOG(ERROR) << "Listen error!";
+        CLOG(ERROR) << "Listen error!";
         return false;
     }
 
     ret = epoller_->AddFd(listenFd_, listenEvent_ | EPOLLIN);
     if (ret == 0) {
         close(listenFd_);
-        LOG(ERROR) << "Add listenfd error!";
+        CLOG(ERROR) << "Add listenfd error!";
         return false;
     }
     
@@ -154,6 +229,46 @@ int WebServer::SetFdNonBlock(int fd) {
     return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
 }
 
+void WebServer::InitRoutes_() {
+    Router* router = Router::GetInstance();
+    std::shared_ptr<HttpHandler> files = std::make_shared<StaticFileHandler>();
+    std::shared_ptr<HttpHandler> loginPage = std::make_shared<LoginPageHandler>();
+    std::shared_ptr<HttpHandler> login = std::make_shared<AuthHandler>(true);
+    std::shared_ptr<HttpHandler> reg = std::make_shared<AuthHandler>(false);
+
+    // 静态页面对 GET 和 POST 一视同仁(与表单提交到页面时的行为一致)
+    for (Router::Method method : {Router::GET, Router::POST}) {
+        router->Add(method, "/", std::make_shared<StaticFileHandler>("/index2.html"));
+        router->Add(method, "/*filepath", files);
+        // 页面的简写: /video -> /video.html
+        for (const char* page : {"/index", "/welcome", "/video", "/picture"}) {
+            router->Add(method, page, std::make_shared<StaticFileHandler>(std::string(page) + ".html"));
+        }
+    }
+    router->Add(Router::GET, "/register", std::make_shared<StaticFileHandler>("/register.html"));
+    router->Add(Router::GET, "/login", loginPage);
+    router->Add(Router::GET, "/login.html", loginPage);
+    router->Add(Router::POST, "/login", login);
+    router->Add(Router::POST, "/login.html", login);
+    router->Add(Router::POST, "/register", reg);
+    router->Add(Router::POST, "/register.html", reg);
+    router->Add(Router::GET, "/api/session", std::make_shared<SessionInfoHandler>());
+
+    // 上传到与资源目录同级的 uploads 目录, 不会被当作静态文件发送; 只有登陆的用户可以上传
+    std::string uploadDir = std::string(srcDir_) + "../uploads/";
+    std::shared_ptr<HttpHandler> upload = std::make_shared<UploadHandler>(uploadDir, MAX_UPLOAD_BYTES,
+                                                                          MAX_UPLOAD_DIR_BYTES, MAX_UPLOAD_FILES);
+    router->Add(Router::PUT, "/upload/:name", upload);
+    router->Add(Router::POST, "/upload/:name", upload);
+    router->Add(Router::POST, "/upload", upload);
+
+    router->Add(Router::GET, "/ws/chat", std::make_shared<ChatHandler>(CHAT_MAX_MESSAGE));
+
+    std::shared_ptr<EventChannel> events = std::make_shared<EventChannel>();
+    router->Add(Router::GET, "/events", std::make_shared<EventsHandler>(events));
+    router->Add(Router::POST, "/events", std::make_shared<PublishHandler>(events));
+}
+
 void WebServer::InitEventMode_(int trigMode) {
     /*
         EPOLLRDHUB:
@@ -197,14 +312,14 @@ void WebServer::SendError_(int fd, const char* info) {
     assert(fd > 0);
     int ret = send(fd, info, strlen(info), 0);
     if (ret < 0) {
-        LOG(WARNING) << "Send error to client [" << fd << "] error!";
+        CLOG(WARNING) << "Send error to client [" << fd << "] error!";
     }
     close(fd);
 }
 
 void WebServer::CloseConn_(connPtr client) {
     assert(client);
-    LOG(INFO) << "Client[" << client->GetFd() << "] quit!";
+    LOG_EVERY_SEC(INFO, 1) << "Client[" << client->GetFd() << "] quit!";
     epoller_->DelFd(client->GetFd());
 
     client->Close();
@@ -214,25 +329,47 @@ void WebServer::CloseConn_(connPtr client) {
     users_.erase(fd); // ***** 这里要把 fd 对应地从 users_ 删除 *****
 }
 
+void WebServer::OnTimeout_(connPtr client) {
+    assert(client);
+    if (client->RequestClose()) {
+        CloseConn_(client);
+    }
+}
+
+template<class Arm>
+void WebServer::EndTask_(const connPtr& client, Arm&& arm) {
+    if (!client->EndTask(arm)) {
+        // 任务期间超时或对端关闭了
+        timeWheel_->RemoveTask(client->GetTimeOutKey());
+        CloseConn_(client);
+    }
+}
+
+void WebServer::ArmClient_(const connPtr& client, uint32_t events) {
+    EndTask_(client, [&]() {
+        epoller_->ModFd(client->GetFd(), connEvent_ | events);
+    });
+}
+
 void WebServer::ExtentTime_(connPtr client) {
     assert(client);
     if (timeoutMS_ > 0) {
-        timeWheel_->Addtask(client->GetTimeOutKey(), timeoutMS_, &WebServer::CloseConn_, this, client);
+        timeWheel_->Addtask(client->GetTimeOutKey(), timeoutMS_, &WebServer::OnTimeout_, this, client);
     }
 }
 
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
+void WebServer::AddClient_(int fd, sockaddr_in addr, RateLimiter::Slot* limit) {
     assert(fd > 0);
 
     connPtr hc = std::make_shared<HttpConn>();
-    hc->Init(fd, addr);
+    hc->Init(fd, addr, limit);
 
     if (timeoutMS_ > 0) {
-        timeWheel_->Addtask(hc->GetTimeOutKey(), timeoutMS_, &WebServer::CloseConn_, this, hc);
+        timeWheel_->Addtask(hc->GetTimeOutKey(), timeoutMS_, &WebServer::OnTimeout_, this, hc);
     }
     epoller_->AddFd(fd, EPOLLIN | connEvent_);
     SetFdNonBlock(fd);
-    LOG(INFO) << "Client[" << hc->GetFd() << "] connected!";
+    LOG_EVERY_SEC(INFO, 1) << "Client[" << hc->GetFd() << "] connected!";
     std::lock_guard<std::mutex> lk(users_lock_);
     users_[fd] = hc;
 }
@@ -247,15 +384,40 @@ void WebServer::DealListen_() {
         }
         else if (HttpConn::userCount >= MAX_FD) {
             SendError_(fd, "Server busy!, ");
-            LOG(WARNING) << "Client is full!";
+            LOG_EVERY_SEC(WARNING, 1) << "Client is full!";
             return;
         }
-        AddClient_(fd, addr);
+        RateLimiter::Slot* limit = nullptr;
+        if (!RateLimiter::GetInstance()->AcquireConn(addr.sin_addr.s_addr, &limit)) {
+            // 这个 IP 的连接数到了上限: 不创建连接对象, 明文连接发送预先生成的 429 后直接关闭
+            if (!TlsContext::GetInstance()->Enabled()) {
+                send(fd, RateLimiter::RESPONSE_429, RateLimiter::RESPONSE_429_LEN, MSG_DONTWAIT | MSG_NOSIGNAL);
+            }
+            close(fd);
+            LOG_EVERY_SEC(WARNING, 1) << "Client " << inet_ntoa(addr.sin_addr) << " exceeds the connection limit";
+            continue;
+        }
+        AddClient_(fd, addr, limit);
     } while (listenEvent_ & EPOLLET); //保证读完
 }
 
 void WebServer::DealRead_(connPtr client) {
     assert(client);
+    if (client->IsProxying()) {
+        DealProxy_(client);
+        return;
+    }
+    if (client->IsHandshaking()) {
+        DealHandshake_(client);
+        return;
+    }
+    if (client->IsPushStream()) {
+        DealPushStream_(client);
+        return;
+    }
+    if (!client->BeginTask()) {
+        return;
+    }
     ExtentTime_(client); // 延长时间
     // threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client)); // 线程池处理
     threadpool_->enqueue(&WebServer::OnRead_, this, client); // 线程池处理
@@ -263,6 +425,21 @@ void WebServer::DealRead_(connPtr client) {
 
 void WebServer::DealWrite_(connPtr client) {
     assert(client);
+    if (client->IsProxying()) {
+        DealProxy_(client);
+        return;
+    }
+    if (client->IsHandshaking()) {
+        DealHandshake_(client);
+        return;
+    }
+    if (client->IsPushStream()) {
+        DealPushStream_(client);
+        return;
+    }
+    if (!client->BeginTask()) {
+        return;
+    }
     ExtentTime_(client); // 延长时间
     // threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client)); // 线程池处理
     threadpool_->enqueue(&WebServer::OnWrite_, this, client); // 线程池处理
@@ -281,15 +458,208 @@ void WebServer::OnRead_(connPtr client) {
     OnProcess(client);
 }
 
+void WebServer::DealHandshake_(connPtr client) {
+    if (!client->BeginTask()) {
+        return;
+    }
+    ExtentTime_(client);
+    threadpool_->enqueue(&WebServer::OnHandshake_, this, client);
+}
+
+void WebServer::OnHandshake_(connPtr client) {
+    assert(client);
+    int saveErrno = 0;
+    int ret = client->Handshake(&saveErrno);
+    if (ret < 0) {
+        timeWheel_->RemoveTask(client->GetTimeOutKey());
+        CloseConn_(client);
+    }
+    else if (ret == 0) {
+        ArmClient_(client, client->HandshakeWantsWrite() ? EPOLLOUT : EPOLLIN);
+    }
+    else {
+        // 握手完成: 第一个请求可能已经跟着到达了
+        OnRead_(client);
+    }
+}
+
+void WebServer::DealPushStream_(connPtr client) {
+    // 广播注册的写事件可能和工作线程的处理重叠, 已经在处理的连接忽略这个事件
+    if (!client->AcquirePushStream()) {
+        return;
+    }
+    if (!client->BeginTask()) {
+        return;
+    }
+    ExtentTime_(client);
+    threadpool_->enqueue(&WebServer::OnPushStream_, this, client);
+}
+
+void WebServer::OnPushStream_(connPtr client) {
+    assert(client);
+    int saveErrno = 0;
+    ssize_t ret = client->Read(&saveErrno);
+    bool alive = (ret > 0 || (ret < 0 && saveErrno == EAGAIN));
+    if (alive) {
+        client->Process();
+        saveErrno = 0;
+        ret = client->Write(&saveErrno);
+        alive = (ret >= 0 || saveErrno == EAGAIN) && client->IsKeepAlive();
+    }
+    if (!alive) {
+        timeWheel_->RemoveTask(client->GetTimeOutKey());
+        CloseConn_(client);
+        return;
+    }
+    EndTask_(client, [&]() {
+        client->ReleasePushStream();
+    });
+}
+
 void WebServer::OnProcess(connPtr client) {
-    if (client->Process()) {
+    bool ready = client->Process();
+    if (client->IsProxying()) {
+        OnProxy_(client);
+        return;
+    }
+    if (client->IsPushStream()) {
+        // 刚成为推送连接: 发送响应首部(WebSocket 还要处理紧跟在握手之后的帧)
+        OnPushStream_(client);
+        return;
+    }
+    if (ready) {
         // 读数据并成功解析请求报文, 准备发送响应报文
         // 所以变成 EPOLLOUT 
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        ArmClient_(client, EPOLLOUT);
+    }
+    else if (client->IsPending()) {
+        // 需要查数据库: 交给 SQL 线程, 工作线程继续处理其他连接
+        // EPOLLONESHOT 下该 fd 在此期间不会再触发事件, 任务没有结束, 定时器也不会关闭连接
+        sqlExecutor_->enqueue(&WebServer::OnVerify_, this, client);
     }
     else {
         // 写数据结束, 改为读 EPOLLIN
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        ArmClient_(client, EPOLLIN);
+    }
+}
+
+void WebServer::DealProxy_(connPtr client) {
+    if (!client->BeginTask()) {
+        return;
+    }
+    ExtentTime_(client);
+    threadpool_->enqueue(&WebServer::OnProxy_, this, client);
+}
+
+void WebServer::OnProxy_(connPtr client) {
+    assert(client);
+    // 持有副本: 推进期间连接被关闭(Close 取走 proxy_)也不会释放正在使用的转发
+    std::shared_ptr<ProxyExchange> proxy = client->GetProxy();
+    if (!proxy) {
+        // 连接已经关闭
+        return;
+    }
+    ProxyExchange::Status status = proxy->Step();
+    switch (status) {
+        case ProxyExchange::WAIT_UPSTREAM_READ:
+        case ProxyExchange::WAIT_UPSTREAM_WRITE:
+        {   // 上游 socket 用水平触发 + ONESHOT: Step 总是读写到 EAGAIN, 每次等待重新注册
+            int fd = proxy->UpstreamFd();
+            uint32_t events = EPOLLONESHOT | (status == ProxyExchange::WAIT_UPSTREAM_READ ? EPOLLIN : EPOLLOUT);
+            EndTask_(client, [&]() {
+                if (proxy->Watched()) {
+                    epoller_->ModFd(fd, events);
+                    return;
+                }
+                {
+                    // 先登记再注册: 事件可能马上到达主线程
+                    std::lock_guard<std::mutex> lk(users_lock_);
+                    upstreams_[fd] = client;
+                }
+                proxy->SetWatched();
+                epoller_->AddFd(fd, events);
+            });
+            break;
+        }
+        case ProxyExchange::WAIT_CLIENT_WRITE:
+            ArmClient_(client, EPOLLOUT);
+            break;
+        case ProxyExchange::FAILED:
+            client->FailProxy();
+            ArmClient_(client, EPOLLOUT);
+            break;
+        case ProxyExchange::DONE:
+            client->EndProxy(true);
+            // 上游连接先放回空闲池, 流水线的下一个请求可以复用
+            proxy.reset();
+            client->LogAccess();
+            // 继续处理读缓冲区中流水线的请求, 没有时等待下一个请求
+            OnProcess(client);
+            break;
+        default:
+            client->EndProxy(false);
+            client->LogAccess();
+            timeWheel_->RemoveTask(client->GetTimeOutKey());
+            CloseConn_(client);
+            break;
+    }
+}
+
+WebServer::connPtr WebServer::FindUpstream_(int fd) {
+    std::lock_guard<std::mutex> lk(users_lock_);
+    if (upstreams_.empty()) {
+        return nullptr;
+    }
+    auto it = upstreams_.find(fd);
+    return it == upstreams_.end() ? nullptr : it->second;
+}
+
+void WebServer::OnVerify_(connPtr client) {
+    assert(client);
+    if (client->ProcessPending()) {
+        ArmClient_(client, EPOLLOUT);
+    }
+}
+
+void WebServer::OnSessionTimer_() {
+    if (!isClose_) {
+        threadpool_->enqueue(&WebServer::SweepSessions_, this);
+    }
+}
+
+void WebServer::SweepSessions_() {
+    size_t removed = SessionStore::GetInstance()->Sweep();
+    if (removed) {
+        CLOG(INFO) << "Session sweep: removed " << removed << ", remain " << SessionStore::GetInstance()->Size();
+    }
+    removed = RateLimiter::GetInstance()->Sweep();
+    if (removed) {
+        CLOG(INFO) << "RateLimiter sweep: removed " << removed;
+    }
+    SweepPushStreams_();
+    if (!isClose_) {
+        timeWheel_->Addtask(SESSION_TIMER_KEY, SESSION_SWEEP_MS, &WebServer::OnSessionTimer_, this);
+    }
+}
+
+void WebServer::SweepPushStreams_() {
+    std::vector<connPtr> stalled;
+    {
+        std::lock_guard<std::mutex> lk(users_lock_);
+        for (auto& kv : users_) {
+            if (kv.second->CheckPushStall()) {
+                stalled.push_back(kv.second);
+            }
+        }
+    }
+    for (connPtr& client : stalled) {
+        timeWheel_->RemoveTask(client->GetTimeOutKey());
+        if (client->RequestClose()) {
+            CloseConn_(client);
+        }
+    }
+    if (!stalled.empty()) {
+        CLOG(INFO) << "Push stream sweep: closed " << stalled.size() << " stalled clients";
     }
 }
 
@@ -300,7 +670,13 @@ void WebServer::OnWrite_(connPtr client) {
     int writeErrno = 0;
     ret = client->Write(&writeErrno);
     if (client->ToWriteBytes() == 0) {
+        if (client->IsReceivingBody()) {
+            // 写完的是 100 Continue: 继续接收请求体
+            OnProcess(client);
+            return;
+        }
         // 传输完成
+        client->LogAccess();
         if (client->IsKeepAlive()) {
             OnProcess(client);
             return;
@@ -309,11 +685,12 @@ void WebServer::OnWrite_(connPtr client) {
     else if(ret < 0) {
         if (writeErrno == EAGAIN) {
             // 继续传输
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            ArmClient_(client, EPOLLOUT);
             return;
         }
     }
     // 其他情况
+    client->LogAccess();
     timeWheel_->RemoveTask(client->GetTimeOutKey());
     CloseConn_(client);
 }
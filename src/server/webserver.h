@@ -13,14 +13,26 @@
 #include <errno.h>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "epoller.h"
+#ifdef USE_MYSQL
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/registerbatcher.h"
+#endif
+#include "../pool/userbloom.h"
+#include "../pool/logincache.h"
+#include "../pool/userstore.h"
+#include "../pool/sessionstore.h"
+#include "../pool/ratelimiter.h"
 // #include "../pool/ThreadPool.hpp"
 // #include "../pool/threadpool.h"
 #include "../http/httpconn.h"
-#include "../../lizy_log/include/logging.h"
+#include "../http/resourcecache.h"
+#include "../http/resourcepack.h"
+#include "../http/handlers.h"
+#include "../log/logsite.h"
 #include "../../lizy_timewheel/include/timewheel.h"
 
 class ThreadPool;
@@ -39,10 +51,14 @@ public:
     /// @param sqlPoolNum 数据库连接池数量
     /// @param threadNum 线程池数量
     /// @param MaxEvent 最大同时发生的事件数
+    /// @param userStore 用户存储后端 0-MySQL 1-SQLite 2-内存 (非 MySQL 时不连接数据库)
+    /// @param userStorePath SQLite 数据库文件
+    /// @param resourcePack 资源包文件(nullptr-直接读资源目录并监听变化; 非空-从资源包发送静态文件, 不存在时启动时打包)
     WebServer(int port, int trigMode, int timeoutMS, bool OpenLinger,
               int sqlPort, const char* sqlUser, const char* sqlPwd,
               const char* dbName, int sqlPoolNum, int threadNum,
-              int MaxEvent);
+              int MaxEvent, int userStore = UserStore::MYSQL,
+              const char* userStorePath = nullptr, const char* resourcePack = nullptr);
     
     ~WebServer();
     /// @brief 服务器运行函数
@@ -56,10 +72,13 @@ private:
     /// @brief 设置触发模式
     /// @param trigMode 0-水平触发 1-连接边缘触发 2-监听边缘触发 3-连接和监听都是边缘触发(默认)
     void InitEventMode_(int trigMode);
+    /// @brief 注册内置的路由(页面简写、登陆/注册、静态文件)
+    void InitRoutes_();
     /// @brief 添加连接上的客户端
     /// @param fd socketFd
     /// @param addr 通讯信息结构体
-    void AddClient_(int fd, sockaddr_in addr);
+    /// @param limit 客户端 IP 的限流槽(不限流时为 nullptr)
+    void AddClient_(int fd, sockaddr_in addr, RateLimiter::Slot* limit);
 
     /// @brief 处理 accept 的业务
     void DealListen_();
@@ -79,6 +98,21 @@ private:
     /// @param client 客户端结构体指针
     void CloseConn_(connPtr client);
 
+    /// @brief 连接超时: 空闲时关闭, 有任务在进行时推迟到任务结束
+    /// @param client 客户端结构体指针
+    void OnTimeout_(connPtr client);
+
+    /// @brief 任务结束: 重新注册事件, 任务期间收到了关闭请求(超时/对端关闭)时改为关闭连接
+    /// @param client 客户端指针
+    /// @param arm 重新注册事件的操作
+    template<class Arm>
+    void EndTask_(const connPtr& client, Arm&& arm);
+
+    /// @brief 任务结束并重新注册客户端 socket 的事件
+    /// @param client 客户端指针
+    /// @param events 事件(EPOLLIN / EPOLLOUT)
+    void ArmClient_(const connPtr& client, uint32_t events);
+
     /// @brief 延长客户端超时时间
     /// @param client 客户端结构体指针
     void ExtentTime_(connPtr client);
@@ -90,6 +124,38 @@ private:
     /// @param client 客户端指针
     void OnWrite_(connPtr client);
     void OnProcess(connPtr client);
+    /// @brief TLS 连接握手期间的事件: 交给线程池
+    /// @param client 客户端指针
+    void DealHandshake_(connPtr client);
+    /// @brief 推进 TLS 握手, 完成后按普通连接读取请求
+    /// @param client 客户端指针
+    void OnHandshake_(connPtr client);
+    /// @brief 推送连接(WebSocket / 事件流)的事件: 交给线程池(已经在处理时忽略)
+    /// @param client 客户端指针
+    void DealPushStream_(connPtr client);
+    /// @brief 推送连接的读-处理-写, 结束时按发送队列重新注册事件
+    /// @param client 客户端指针
+    void OnPushStream_(connPtr client);
+    /// @brief 转发中的事件(上游 socket 或等待可写的客户端 socket): 交给线程池
+    /// @param client 客户端指针
+    void DealProxy_(connPtr client);
+    /// @brief 推进转发, 按结果注册上游或客户端的事件, 结束后继续下一个请求
+    /// @param client 客户端指针
+    void OnProxy_(connPtr client);
+    /// @brief 上游 socket 对应的客户端
+    /// @param fd 上游 socket
+    /// @return 客户端指针(不是上游 socket 时为空)
+    connPtr FindUpstream_(int fd);
+    /// @brief 在 SQL 线程中完成数据库验证, 然后注册写事件
+    /// @param client 客户端指针
+    void OnVerify_(connPtr client);
+
+    /// @brief 会话清理定时器到期: 把清理交给线程池
+    void OnSessionTimer_();
+    /// @brief 清理过期会话、空闲的限流槽和写不出去的推送连接, 然后重新设置定时器
+    void SweepSessions_();
+    /// @brief 断开发送队列长时间写不出去的推送连接(没有新的帧入队时 PushStream 自己发现不了)
+    void SweepPushStreams_();
 
     /// @brief 设置非阻塞方式
     /// @param fd 文件描述符
@@ -98,6 +164,17 @@ private:
 
 private:
     static const int MAX_FD = 65536;
+    static const size_t USER_BLOOM_EXPECTED = 1 << 20; // 布隆过滤器预计容纳的用户数
+    static const int REGISTER_BATCH_MAX = 64;          // 一次组提交最多合并的注册数
+    static const int REGISTER_BATCH_WINDOW_US = 2000;  // 组提交的攒批时间窗口
+    static const int SESSION_SWEEP_MS = 10000;         // 过期会话的清理间隔
+    static const char* SESSION_TIMER_KEY;              // 会话清理定时器在时间轮中的 key
+    static const size_t RESOURCE_CACHE_MAX_FILE = 1 << 20; // 超过该大小的资源文件不读入内存
+    static const size_t MAX_BODY_BYTES = 1 << 20;          // 保存在内存中的请求体(表单等)上限
+    static const size_t MAX_UPLOAD_BYTES = 1UL << 30;      // 上传文件的大小上限
+    static const size_t MAX_UPLOAD_DIR_BYTES = 8UL << 30;  // 上传目录中所有文件的总大小上限
+    static const size_t MAX_UPLOAD_FILES = 10000;          // 上传目录中的文件数上限
+    static const size_t CHAT_MAX_MESSAGE = 16 << 10;       // 聊天室一条消息的大小上限
     
     int port_;
     bool openLinger_;
@@ -112,7 +189,9 @@ private:
     std::unique_ptr<TimeWheel> timeWheel_;   // 线程安全
     std::unique_ptr<ThreadPool> threadpool_; // 线程安全
     std::unique_ptr<Epoller> epoller_;       // 注意并发安全
+    std::unique_ptr<ThreadPool> sqlExecutor_; // 专门执行数据库请求的线程, 先于 epoller_ 析构
     std::unordered_map<int, connPtr> users_; // fd-connPtr map(注意并发安全)
+    std::unordered_map<int, connPtr> upstreams_; // 转发中的上游 fd-客户端(users_lock_ 保护)
 
     std::mutex users_lock_;
 };
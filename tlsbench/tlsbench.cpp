@@ -0,0 +1,264 @@
+/*
+    TLS 压力测试: 握手速率和大文件吞吐
+
+    ./tlsbench -m handshake [-r] -c 并发数 -t 秒数 [-H 地址] [-p 端口]
+        每个连接只做握手就关闭, 统计每秒握手数; -r 用会话票据恢复(先取一次票据, 之后每个连接都带上)
+    ./tlsbench -m bulk [-n] -c 并发数 -t 秒数 -f /big.bin [-H 地址] [-p 端口]
+        每个线程一个 keep-alive 连接, 反复下载同一个文件, 统计吞吐; -n 用明文连接作对比
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8888;
+    std::string mode = "handshake";
+    std::string path = "/index.html";
+    int concurrency = 8;
+    int seconds = 10;
+    bool resume = false;
+    bool plain = false;
+};
+
+Options opt;
+SSL_CTX* ctx = nullptr;
+SSL_SESSION* ticket = nullptr;
+std::atomic<bool> stop(false);
+std::atomic<uint64_t> handshakes(0);
+std::atomic<uint64_t> resumed(0);
+std::atomic<uint64_t> failures(0);
+std::atomic<uint64_t> bytes(0);
+std::atomic<uint64_t> responses(0);
+
+int Connect() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 阻塞的连接: 明文时 ssl 为 nullptr
+struct Conn {
+    int fd = -1;
+    SSL* ssl = nullptr;
+
+    bool Open(SSL_SESSION* session) {
+        fd = Connect();
+        if (fd < 0) {
+            return false;
+        }
+        if (opt.plain) {
+            return true;
+        }
+        ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, fd);
+        SSL_set_tlsext_host_name(ssl, "localhost");
+        if (session) {
+            // 每个连接用一份副本: 连接出错时 OpenSSL 会把用过的会话标记为不能恢复
+            SSL_SESSION* copy = SSL_SESSION_dup(session);
+            SSL_set_session(ssl, copy);
+            SSL_SESSION_free(copy);
+        }
+        return SSL_connect(ssl) == 1;
+    }
+
+    void Close() {
+        if (ssl) {
+            // 没有 SSL_shutdown 就释放的会话会被标记为不能恢复
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+            ssl = nullptr;
+        }
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    bool Write(const std::string& data) {
+        if (ssl) {
+            return SSL_write(ssl, data.data(), static_cast<int>(data.size())) == static_cast<int>(data.size());
+        }
+        return write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    }
+
+    int Read(char* buf, int len) {
+        return ssl ? SSL_read(ssl, buf, len) : static_cast<int>(read(fd, buf, len));
+    }
+};
+
+// 读一个响应(只支持 Content-Length), 返回内容长度, 出错返回 -1
+long ReadResponse(Conn& conn, std::vector<char>& buf) {
+    std::string head;
+    size_t pos;
+    char tmp[16384];
+    while ((pos = head.find("\r\n\r\n")) == std::string::npos) {
+        int n = conn.Read(tmp, sizeof(tmp));
+        if (n <= 0) {
+            return -1;
+        }
+        head.append(tmp, n);
+    }
+    const char* cl = strcasestr(head.c_str(), "Content-Length:");
+    if (!cl) {
+        return -1;
+    }
+    long len = atol(cl + 15);
+    long left = len - static_cast<long>(head.size() - pos - 4);
+    while (left > 0) {
+        int n = conn.Read(buf.data(), static_cast<int>(std::min<long>(left, buf.size())));
+        if (n <= 0) {
+            return -1;
+        }
+        left -= n;
+    }
+    return len;
+}
+
+void HandshakeWorker() {
+    while (!stop) {
+        Conn conn;
+        if (conn.Open(opt.resume ? ticket : nullptr)) {
+            handshakes++;
+            if (SSL_session_reused(conn.ssl)) {
+                resumed++;
+            }
+        }
+        else {
+            failures++;
+        }
+        conn.Close();
+    }
+}
+
+void BulkWorker() {
+    std::string req = "GET " + opt.path + " HTTP/1.1\r\nHost: " + opt.host + "\r\nConnection: keep-alive\r\n\r\n";
+    std::vector<char> buf(256 * 1024);
+    while (!stop) {
+        Conn conn;
+        if (!conn.Open(nullptr)) {
+            failures++;
+            conn.Close();
+            continue;
+        }
+        while (!stop) {
+            long len;
+            if (!conn.Write(req) || (len = ReadResponse(conn, buf)) < 0) {
+                failures++;
+                break;
+            }
+            bytes += len;
+            responses++;
+        }
+        conn.Close();
+    }
+}
+
+// 取一个可以恢复的会话: TLS 1.3 的票据在握手之后才到, 要先完成一次请求
+bool FetchTicket() {
+    Conn conn;
+    std::vector<char> buf(64 * 1024);
+    std::string req = "GET " + opt.path + " HTTP/1.1\r\nHost: " + opt.host + "\r\nConnection: close\r\n\r\n";
+    bool ok = conn.Open(nullptr) && conn.Write(req) && ReadResponse(conn, buf) >= 0;
+    if (ok) {
+        ticket = SSL_get1_session(conn.ssl);
+    }
+    conn.Close();
+    return ok && ticket && SSL_SESSION_is_resumable(ticket);
+}
+
+void Usage(const char* name) {
+    fprintf(stderr, "usage: %s [-m handshake|bulk] [-r] [-n] [-c concurrency] [-t seconds] "
+                    "[-f path] [-H host] [-p port]\n", name);
+    exit(1);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int ch;
+    while ((ch = getopt(argc, argv, "m:rnc:t:f:H:p:")) != -1) {
+        switch (ch) {
+            case 'm': opt.mode = optarg; break;
+            case 'r': opt.resume = true; break;
+            case 'n': opt.plain = true; break;
+            case 'c': opt.concurrency = atoi(optarg); break;
+            case 't': opt.seconds = atoi(optarg); break;
+            case 'f': opt.path = optarg; break;
+            case 'H': opt.host = optarg; break;
+            case 'p': opt.port = atoi(optarg); break;
+            default: Usage(argv[0]);
+        }
+    }
+    bool bulk = (opt.mode == "bulk");
+    if ((!bulk && opt.mode != "handshake") || opt.concurrency <= 0 || opt.seconds <= 0 || (opt.plain && !bulk)) {
+        Usage(argv[0]);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+    if (opt.resume && !FetchTicket()) {
+        fprintf(stderr, "cannot get a resumable session from %s:%d\n", opt.host.c_str(), opt.port);
+        return 1;
+    }
+
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < opt.concurrency; ++i) {
+        threads.emplace_back(bulk ? BulkWorker : HandshakeWorker);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    stop = true;
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (bulk) {
+        printf("%s bulk %s: %d connections, %.1fs, %lu responses, %.1f MB/s, %lu failures\n",
+               opt.plain ? "plain" : "TLS", opt.path.c_str(), opt.concurrency, sec,
+               responses.load(), bytes.load() / sec / (1 << 20), failures.load());
+    }
+    else {
+        printf("TLS handshakes%s: %d connections, %.1fs, %lu handshakes (%lu resumed), %.0f/s, %lu failures\n",
+               opt.resume ? " (resume)" : "", opt.concurrency, sec, handshakes.load(), resumed.load(),
+               handshakes.load() / sec, failures.load());
+    }
+    if (ticket) {
+        SSL_SESSION_free(ticket);
+    }
+    SSL_CTX_free(ctx);
+    return 0;
+}